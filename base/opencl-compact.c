@@ -0,0 +1,161 @@
+/*
+ * opencl-compact.c
+ *
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <limits.h>
+
+#include "opencl-compact.h"
+#include "opencl-host.h"
+
+static const char * s_flags_names[] = {
+	[opencl_scan_type_float] = "compact_flags_float",
+	[opencl_scan_type_int] = "compact_flags_int",
+};
+static const char * s_scatter_names[] = {
+	[opencl_scan_type_float] = "compact_scatter_float",
+	[opencl_scan_type_int] = "compact_scatter_int",
+};
+
+static int compact_launch(struct opencl_compact * compact, struct opencl_function * function, size_t n)
+{
+	size_t local_size = compact->local_size;
+	size_t global_size = local_size?opencl_function_get_grid_size(function, n, local_size):n;
+	function->set_dims(function, 1, NULL, &global_size, local_size?&local_size:NULL);
+	return function->execute(function, 0, NULL, NULL);
+}
+
+/*
+ * __kernel void compact_flags_<type>(__const int n, __global const type * in, __global int * flags, 
+ *     __const int op, __const type value);
+ * __kernel void compact_scatter_<type>(__const int n, __global const type * in, __global const int * flags, 
+ *     __global const int * positions, __global type * out, __global int * count);
+*/
+static int compact_execute(struct opencl_compact * compact, struct opencl_buffer * in, struct opencl_buffer * out, struct opencl_buffer * count, 
+	size_t n, enum opencl_compact_op op, const void * value)
+{
+	assert(compact && in && out && count && value);
+	size_t size = n * sizeof(cl_int);	// float and int items
+	if(n > INT_MAX || size > in->size || size > out->size || count->size < sizeof(cl_int)) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): invalid length %lu\n",
+			__FILE__, __LINE__, __FUNCTION__,
+			(unsigned long)n);
+		return -1;
+	}
+	// an empty input only runs the scatter, which sets count to 0
+	size_t cb_temp = n?size:sizeof(cl_int);
+	if(opencl_buffer_reserve(compact->flags, compact->ctx, CL_MEM_READ_WRITE, cb_temp)
+		|| opencl_buffer_reserve(compact->positions, compact->ctx, CL_MEM_READ_WRITE, cb_temp)) return -1;
+	
+	cl_int length = (cl_int)n;
+	cl_int predicate = op;
+	if(n > 0) {
+		struct opencl_function * flags = compact->flags_func;
+		opencl_function_set_args(flags, 5, 
+			sizeof(length), &length, 
+			sizeof(cl_mem), NULL, 
+			sizeof(cl_mem), NULL, 
+			sizeof(predicate), &predicate, 
+			sizeof(cl_int), value);
+		opencl_function_bind_buffer(flags, 1, in, opencl_buffer_access_read);
+		opencl_function_bind_buffer(flags, 2, compact->flags, opencl_buffer_access_write);
+		int rc = compact_launch(compact, flags, n);
+		if(rc) return rc;
+		
+		rc = compact->scan->execute(compact->scan, compact->flags, compact->positions, n, 0);
+		if(rc) return rc;
+	}
+	
+	struct opencl_function * scatter = compact->scatter;
+	opencl_function_set_args(scatter, 6, 
+		sizeof(length), &length, 
+		sizeof(cl_mem), NULL, 
+		sizeof(cl_mem), NULL, 
+		sizeof(cl_mem), NULL, 
+		sizeof(cl_mem), NULL, 
+		sizeof(cl_mem), NULL);
+	opencl_function_bind_buffer(scatter, 1, in, opencl_buffer_access_read);
+	opencl_function_bind_buffer(scatter, 2, compact->flags, opencl_buffer_access_read);
+	opencl_function_bind_buffer(scatter, 3, compact->positions, opencl_buffer_access_read);
+	opencl_function_bind_buffer(scatter, 4, out, opencl_buffer_access_write);
+	opencl_function_bind_buffer(scatter, 5, count, opencl_buffer_access_write);
+	return compact_launch(compact, scatter, n?n:1);
+}
+
+struct opencl_compact * opencl_compact_init(struct opencl_compact * compact, cl_program program, cl_command_queue queue, enum opencl_scan_type type, size_t local_size)
+{
+	assert(type == opencl_scan_type_float || type == opencl_scan_type_int);
+	if(NULL == compact) compact = calloc(1, sizeof(*compact));
+	else memset(compact, 0, sizeof(*compact));
+	assert(compact);
+	
+	compact->type = type;
+	compact->local_size = local_size;
+	compact->execute = compact_execute;
+	
+	if(NULL == program) {
+		compact->backend = opencl_backend_type_host;
+		if(NULL == opencl_host_function_init(compact->flags_func, s_flags_names[type])
+			|| NULL == opencl_host_function_init(compact->scatter, s_scatter_names[type])
+			|| NULL == opencl_scan_init(compact->scan, NULL, NULL, opencl_scan_type_int, 0)) {
+			opencl_compact_cleanup(compact);
+			return NULL;
+		}
+		return compact;
+	}
+	
+	assert(queue);
+	compact->backend = opencl_backend_type_opencl;
+	compact->queue = queue;
+	cl_int ret = clGetCommandQueueInfo(queue, CL_QUEUE_CONTEXT, sizeof(compact->ctx), &compact->ctx, NULL);
+	assert(ret == CL_SUCCESS);
+	
+	opencl_function_init(compact->flags_func, program, s_flags_names[type]);
+	opencl_function_init(compact->scatter, program, s_scatter_names[type]);
+	compact->flags_func->queue = queue;
+	compact->scatter->queue = queue;
+	if(NULL == opencl_scan_init(compact->scan, program, queue, opencl_scan_type_int, 0)) {
+		opencl_compact_cleanup(compact);
+		return NULL;
+	}
+	return compact;
+}
+
+void opencl_compact_cleanup(struct opencl_compact * compact)
+{
+	if(NULL == compact) return;
+	opencl_function_cleanup(compact->flags_func);
+	opencl_function_cleanup(compact->scatter);
+	opencl_scan_cleanup(compact->scan);
+	if(compact->flags->size) opencl_buffer_cleanup(compact->flags);
+	if(compact->positions->size) opencl_buffer_cleanup(compact->positions);
+	return;
+}
@@ -34,6 +34,10 @@
 
 #define cl_check_error(ret)  assert(CL_SUCCESS == (ret))
 
+#ifndef CL_PLATFORM_NOT_FOUND_KHR
+#define CL_PLATFORM_NOT_FOUND_KHR (-1001)	// cl_khr_icd: returned by the icd loader if no platform was installed
+#endif
+
 
 /********************************************************
  * opencl platform
@@ -435,6 +439,13 @@ opencl_context_t * opencl_context_init(opencl_context_t * cl, void * user_data)
 	cl_uint num_platforms = 0;
 	
 	cl_int ret = clGetPlatformIDs(0, NULL, &num_available);
+	if(ret == CL_PLATFORM_NOT_FOUND_KHR || (ret == CL_SUCCESS && 0 == num_available)) {
+		// no ICD installed, the callers may fall back to the host backend
+		fprintf(stderr, "[WARNING]: no opencl platform found\n");
+		cl->num_platforms = 0;
+		cl->platforms = NULL;
+		return cl;
+	}
 	cl_check_error(ret);
 	
 	printf("avaliable platforms: %d\r\n", num_available);
@@ -0,0 +1,191 @@
+/*
+ * opencl-gemm.c
+ *
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "opencl-gemm.h"
+#include "opencl-context.h"
+#include "opencl-host.h"
+
+#define GEMV_LOCAL_SIZE (64)
+
+static int check_size(struct opencl_buffer * buf, size_t length, const char * name)
+{
+	if(buf->size >= length * sizeof(float)) return 0;
+	fprintf(stderr, "[ERROR]::%s(%d)::%s(): %s: %lu bytes < %lu items\n",
+		__FILE__, __LINE__, __FUNCTION__,
+		name, (unsigned long)buf->size, (unsigned long)length);
+	return -1;
+}
+
+/*
+ * __kernel void sgemm(__const int M, __const int N, __const int K, __const float alpha, 
+ *     __global const float * A, __global const float * B, __const float beta, __global float * C);
+*/
+static int gemm_sgemm(struct opencl_gemm * gemm, int M, int N, int K, float alpha, 
+	struct opencl_buffer * A, struct opencl_buffer * B, float beta, struct opencl_buffer * C)
+{
+	assert(gemm && A && B && C);
+	if(M <= 0 || N <= 0 || K <= 0) return -1;
+	if(check_size(A, (size_t)M * K, "A") || check_size(B, (size_t)K * N, "B") || check_size(C, (size_t)M * N, "C")) return -1;
+	
+	struct opencl_function * function = gemm->sgemm_func;
+	opencl_function_set_args(function, 8, 
+		sizeof(M), &M, 
+		sizeof(N), &N, 
+		sizeof(K), &K, 
+		sizeof(alpha), &alpha, 
+		sizeof(cl_mem), NULL, 
+		sizeof(cl_mem), NULL, 
+		sizeof(beta), &beta, 
+		sizeof(cl_mem), NULL);
+	opencl_function_bind_buffer(function, 4, A, opencl_buffer_access_read);
+	opencl_function_bind_buffer(function, 5, B, opencl_buffer_access_read);
+	opencl_function_bind_buffer(function, 7, C, (beta == 0)?opencl_buffer_access_write:opencl_buffer_access_read_write);
+	
+	// each work-group computes a (TILE_SIZE x TILE_SIZE) tile of C
+	const struct dim_3d * block = &gemm->sgemm_block;
+	size_t tile_size = block->x;
+	struct dim_3d grid = {
+		(N + tile_size - 1) / tile_size * block->x,
+		(M + tile_size - 1) / tile_size * block->y,
+		1
+	};
+	function->set_dims(function, 2, NULL, (size_t *)&grid, (size_t *)block);
+	return function->execute(function, 0, NULL, NULL);
+}
+
+/*
+ * __kernel void gemv_batched(__const int m, __const int n, __const int batch_count, __const float alpha, 
+ *     __global const float * A, __global const float * x, __const float beta, __global float * y);
+*/
+static int gemm_gemv_batched(struct opencl_gemm * gemm, int m, int n, int batch_count, float alpha, 
+	struct opencl_buffer * A, struct opencl_buffer * x, float beta, struct opencl_buffer * y)
+{
+	assert(gemm && A && x && y);
+	if(m <= 0 || n <= 0 || batch_count <= 0) return -1;
+	if(check_size(A, (size_t)m * n * batch_count, "A") 
+		|| check_size(x, (size_t)n * batch_count, "x") 
+		|| check_size(y, (size_t)m * batch_count, "y")) return -1;
+	
+	struct opencl_function * function = gemm->gemv_func;
+	opencl_function_set_args(function, 8, 
+		sizeof(m), &m, 
+		sizeof(n), &n, 
+		sizeof(batch_count), &batch_count, 
+		sizeof(alpha), &alpha, 
+		sizeof(cl_mem), NULL, 
+		sizeof(cl_mem), NULL, 
+		sizeof(beta), &beta, 
+		sizeof(cl_mem), NULL);
+	opencl_function_bind_buffer(function, 4, A, opencl_buffer_access_read);
+	opencl_function_bind_buffer(function, 5, x, opencl_buffer_access_read);
+	opencl_function_bind_buffer(function, 7, y, (beta == 0)?opencl_buffer_access_write:opencl_buffer_access_read_write);
+	
+	// rows along x, matrices along y
+	const struct dim_3d * block = &gemm->gemv_block;
+	struct dim_3d grid = { (m + block->x - 1) / block->x * block->x, batch_count, 1 };
+	function->set_dims(function, 2, NULL, (size_t *)&grid, (size_t *)block);
+	return function->execute(function, 0, NULL, NULL);
+}
+
+/*
+ * the tile sizes the kernel was built with: __attribute__((reqd_work_group_size(TILE_SIZE, TILE_SIZE / WORK_PER_ITEM, 1)))
+*/
+static int get_compile_work_group_size(struct opencl_function * function, struct dim_3d * block)
+{
+	cl_device_id device = NULL;
+	size_t sizes[3] = { 0 };
+	cl_int ret = clGetCommandQueueInfo(function->queue, CL_QUEUE_DEVICE, sizeof(device), &device, NULL);
+	if(ret == CL_SUCCESS) ret = clGetKernelWorkGroupInfo(function->kernel->_kernel, device, CL_KERNEL_COMPILE_WORK_GROUP_SIZE, sizeof(sizes), sizes, NULL);
+	if(ret != CL_SUCCESS || 0 == sizes[0]) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): %s: no required work-group size: %s\n",
+			__FILE__, __LINE__, __FUNCTION__,
+			function->kernel->name, opencl_error_to_string(ret));
+		return -1;
+	}
+	*block = (struct dim_3d){ sizes[0], sizes[1], sizes[2] };
+	return 0;
+}
+
+struct opencl_gemm * opencl_gemm_init(struct opencl_gemm * gemm, cl_program program, cl_command_queue queue)
+{
+	if(NULL == gemm) gemm = calloc(1, sizeof(*gemm));
+	else memset(gemm, 0, sizeof(*gemm));
+	assert(gemm);
+	
+	gemm->sgemm = gemm_sgemm;
+	gemm->gemv_batched = gemm_gemv_batched;
+	
+	if(NULL == program) {
+		// the host kernels don't depend on the grid
+		gemm->backend = opencl_backend_type_host;
+		gemm->sgemm_block = (struct dim_3d){ 32, 4, 1 };
+		gemm->gemv_block = (struct dim_3d){ GEMV_LOCAL_SIZE, 1, 1 };
+		if(NULL == opencl_host_function_init(gemm->sgemm_func, "sgemm")
+			|| NULL == opencl_host_function_init(gemm->gemv_func, "gemv_batched")) {
+			opencl_gemm_cleanup(gemm);
+			return NULL;
+		}
+		return gemm;
+	}
+	
+	assert(queue);
+	gemm->backend = opencl_backend_type_opencl;
+	gemm->queue = queue;
+	opencl_function_init(gemm->sgemm_func, program, "sgemm");
+	opencl_function_init(gemm->gemv_func, program, "gemv_batched");
+	gemm->sgemm_func->queue = queue;
+	gemm->gemv_func->queue = queue;
+	
+	if(get_compile_work_group_size(gemm->sgemm_func, &gemm->sgemm_block)) {
+		opencl_gemm_cleanup(gemm);
+		return NULL;
+	}
+	
+	size_t local_size = opencl_function_get_max_work_group_size(gemm->gemv_func);
+	if(local_size > GEMV_LOCAL_SIZE) local_size = GEMV_LOCAL_SIZE;
+	if(0 == local_size) {
+		opencl_gemm_cleanup(gemm);
+		return NULL;
+	}
+	gemm->gemv_block = (struct dim_3d){ local_size, 1, 1 };
+	return gemm;
+}
+
+void opencl_gemm_cleanup(struct opencl_gemm * gemm)
+{
+	if(NULL == gemm) return;
+	opencl_function_cleanup(gemm->sgemm_func);
+	opencl_function_cleanup(gemm->gemv_func);
+	return;
+}
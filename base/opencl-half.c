@@ -0,0 +1,267 @@
+/*
+ * opencl-half.c
+ *
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+#include "opencl-half.h"
+
+static inline uint32_t float_bits(float x)
+{
+	uint32_t u;
+	memcpy(&u, &x, sizeof(u));
+	return u;
+}
+
+static inline float bits_float(uint32_t u)
+{
+	float x;
+	memcpy(&x, &u, sizeof(x));
+	return x;
+}
+
+size_t opencl_storage_type_size(enum opencl_storage_type type)
+{
+	return (type == opencl_storage_type_float)?sizeof(float):sizeof(cl_ushort);
+}
+
+const char * opencl_storage_type_to_string(enum opencl_storage_type type)
+{
+	switch(type) {
+	case opencl_storage_type_float: return "float";
+	case opencl_storage_type_half: return "half";
+	case opencl_storage_type_bf16: return "bf16";
+	}
+	return "unknown";
+}
+
+/*
+ * half: sign(1) | exponent(5, bias 15) | mantissa(10)
+*/
+cl_half opencl_float_to_half(float x)
+{
+	uint32_t u = float_bits(x);
+	uint32_t sign = (u >> 16) & 0x8000;
+	uint32_t abs = u & 0x7fffffff;
+	
+	if(abs >= 0x7f800000) return sign | 0x7c00 | ((abs > 0x7f800000)?0x200:0);	// inf, NaN
+	if(abs >= 0x477ff000) return sign | 0x7c00;	// >= 65520: rounded to inf
+	
+	if(abs < 0x38800000) {	// < 2^-14: subnormal half
+		if(abs <= 0x33000000) return sign;	// <= 2^-25: rounded to 0
+		uint32_t mantissa = (abs & 0x7fffff) | 0x800000;
+		uint32_t shift = 126 - (abs >> 23);
+		uint32_t h = mantissa >> shift;
+		uint32_t rem = mantissa & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		if(rem > halfway || (rem == halfway && (h & 1))) ++h;
+		return sign | h;
+	}
+	
+	// rebias the exponent, a carry out of the mantissa increments the exponent
+	uint32_t h = (abs - 0x38000000) >> 13;
+	uint32_t rem = abs & 0x1fff;
+	if(rem > 0x1000 || (rem == 0x1000 && (h & 1))) ++h;
+	return sign | h;
+}
+
+float opencl_half_to_float(cl_half x)
+{
+	uint32_t sign = (uint32_t)(x & 0x8000) << 16;
+	uint32_t exponent = (x >> 10) & 0x1f;
+	uint32_t mantissa = x & 0x3ff;
+	
+	if(exponent == 0x1f) return bits_float(sign | 0x7f800000 | (mantissa << 13));
+	if(exponent) return bits_float(sign | ((exponent + 112) << 23) | (mantissa << 13));
+	if(0 == mantissa) return bits_float(sign);
+	
+	// subnormal: normalize
+	exponent = 113;
+	while(!(mantissa & 0x400)) {
+		mantissa <<= 1;
+		--exponent;
+	}
+	return bits_float(sign | (exponent << 23) | ((mantissa & 0x3ff) << 13));
+}
+
+cl_ushort opencl_float_to_bf16(float x)
+{
+	uint32_t u = float_bits(x);
+	if((u & 0x7fffffff) > 0x7f800000) return (cl_ushort)((u >> 16) | 0x40);	// keep it a (quiet) NaN
+	u += 0x7fff + ((u >> 16) & 1);
+	return (cl_ushort)(u >> 16);
+}
+
+float opencl_bf16_to_float(cl_ushort x)
+{
+	return bits_float((uint32_t)x << 16);
+}
+
+/*
+ * the arrays: a branch-free pass converts the normal values (vectorized by the compiler, or by F16C),
+ * the few others (zero, subnormal, inf, NaN, out of the half range) are converted again one by one.
+*/
+#define CONVERT_BLOCK_SIZE (256)
+
+static inline int half_is_normal(uint32_t h)
+{
+	return ((h & 0x7c00) - 0x400) < 0x7800;	// exponent neither 0 nor 0x1f
+}
+
+static inline int float_is_half_normal(uint32_t u)
+{
+	return ((u & 0x7fffffff) - 0x38800000) < (0x477ff000 - 0x38800000);	// [2^-14, 65520)
+}
+
+static inline float half_to_float_normal(uint32_t h)
+{
+	return bits_float(((h & 0x8000) << 16) | (((h & 0x7fff) << 13) + (112 << 23)));
+}
+
+static inline cl_half float_to_half_normal(uint32_t u)
+{
+	uint32_t abs = u & 0x7fffffff;
+	// rebias the exponent and round to nearest even (the bias doesn't change the low 14 bits)
+	return (cl_half)(((u >> 16) & 0x8000) | ((abs - 0x38000000 + 0xfff + ((abs >> 13) & 1)) >> 13));
+}
+
+/*
+ * the conversions of one block, n is CONVERT_BLOCK_SIZE but for the last one:
+ * the full blocks are inlined with a constant trip count, which -O2 vectorizes.
+*/
+static inline void half_to_float_block(float * dst, const cl_half * src, size_t n)
+{
+	int num_specials = 0;
+	for(size_t i = 0; i < n; ++i) {
+		dst[i] = half_to_float_normal(src[i]);
+		num_specials += !half_is_normal(src[i]);
+	}
+	if(0 == num_specials) return;
+	for(size_t i = 0; i < n; ++i) if(!half_is_normal(src[i])) dst[i] = opencl_half_to_float(src[i]);
+}
+
+static inline void float_to_half_block(cl_half * dst, const float * src, size_t n)
+{
+	int num_specials = 0;
+	for(size_t i = 0; i < n; ++i) {
+		uint32_t u = float_bits(src[i]);
+		dst[i] = float_to_half_normal(u);
+		num_specials += !float_is_half_normal(u);
+	}
+	if(0 == num_specials) return;
+	for(size_t i = 0; i < n; ++i) if(!float_is_half_normal(float_bits(src[i]))) dst[i] = opencl_float_to_half(src[i]);
+}
+
+static inline void float_to_bf16_block(cl_ushort * dst, const float * src, size_t n)
+{
+	for(size_t i = 0; i < n; ++i) {
+		uint32_t u = float_bits(src[i]);
+		uint32_t rounded = (u + 0x7fff + ((u >> 16) & 1)) >> 16;
+		uint32_t nan = (u >> 16) | 0x40;	// keep it a (quiet) NaN
+		dst[i] = (cl_ushort)(((u & 0x7fffffff) > 0x7f800000)?nan:rounded);	// a select, not a branch
+	}
+}
+
+static inline void bf16_to_float_block(float * dst, const cl_ushort * src, size_t n)
+{
+	for(size_t i = 0; i < n; ++i) dst[i] = bits_float((uint32_t)src[i] << 16);
+}
+
+#define CONVERT_ARRAY(convert_block, dst, src, n) do { \
+		size_t i = 0; \
+		for(; i + CONVERT_BLOCK_SIZE <= n; i += CONVERT_BLOCK_SIZE) convert_block(&dst[i], &src[i], CONVERT_BLOCK_SIZE); \
+		if(i < n) convert_block(&dst[i], &src[i], n - i); \
+	} while(0)
+
+void opencl_float_to_half_array(cl_half * dst, const float * src, size_t n)
+{
+#ifdef __F16C__
+	size_t length = n & ~(size_t)7;
+	for(size_t i = 0; i < length; i += 8) {
+		__m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(&src[i]), _MM_FROUND_TO_NEAREST_INT);
+		_mm_storeu_si128((__m128i *)&dst[i], h);
+	}
+	dst += length;
+	src += length;
+	n -= length;
+#endif
+	CONVERT_ARRAY(float_to_half_block, dst, src, n);
+}
+
+void opencl_half_to_float_array(float * dst, const cl_half * src, size_t n)
+{
+#ifdef __F16C__
+	size_t length = n & ~(size_t)7;
+	for(size_t i = 0; i < length; i += 8) {
+		__m256 x = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)&src[i]));
+		_mm256_storeu_ps(&dst[i], x);
+	}
+	dst += length;
+	src += length;
+	n -= length;
+#endif
+	CONVERT_ARRAY(half_to_float_block, dst, src, n);
+}
+
+void opencl_float_to_bf16_array(cl_ushort * dst, const float * src, size_t n)
+{
+	CONVERT_ARRAY(float_to_bf16_block, dst, src, n);
+}
+
+void opencl_bf16_to_float_array(float * dst, const cl_ushort * src, size_t n)
+{
+	CONVERT_ARRAY(bf16_to_float_block, dst, src, n);
+}
+
+void opencl_storage_from_float(enum opencl_storage_type type, void * dst, const float * src, size_t n)
+{
+	switch(type) {
+	case opencl_storage_type_float: memmove(dst, src, n * sizeof(float)); break;
+	case opencl_storage_type_half: opencl_float_to_half_array(dst, src, n); break;
+	case opencl_storage_type_bf16: opencl_float_to_bf16_array(dst, src, n); break;
+	default: assert(0);
+	}
+}
+
+void opencl_storage_to_float(enum opencl_storage_type type, float * dst, const void * src, size_t n)
+{
+	switch(type) {
+	case opencl_storage_type_float: memmove(dst, src, n * sizeof(float)); break;
+	case opencl_storage_type_half: opencl_half_to_float_array(dst, src, n); break;
+	case opencl_storage_type_bf16: opencl_bf16_to_float_array(dst, src, n); break;
+	default: assert(0);
+	}
+}
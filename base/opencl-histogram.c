@@ -0,0 +1,196 @@
+/*
+ * opencl-histogram.c
+ *
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <limits.h>
+
+#include "opencl-histogram.h"
+#include "opencl-host.h"
+
+#define HISTOGRAM_LOCAL_SIZE (256)
+#define HISTOGRAM_GROUPS_PER_CU (8)
+#define HISTOGRAM_HOST_LOCAL_SIZE (4096)
+
+/*
+ * __kernel void histogram_float(__const int n, __global const float * in, __global uint * partials);
+ * __kernel void histogram_merge(__global const uint * partials, __global uint * histogram);
+ * both on the same grid
+*/
+static int histogram_execute(struct opencl_histogram * hist, struct opencl_buffer * in, size_t n, struct opencl_buffer * histogram)
+{
+	assert(hist && in && histogram);
+	if(0 == n || n > INT_MAX || n * sizeof(float) > in->size || histogram->size < hist->num_bins * sizeof(cl_uint)) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): invalid length %lu\n",
+			__FILE__, __LINE__, __FUNCTION__,
+			(unsigned long)n);
+		return -1;
+	}
+	
+	size_t local_size = hist->local_size;
+	size_t num_groups = (n + local_size - 1) / local_size;
+	if(num_groups > hist->max_groups) num_groups = hist->max_groups;
+	size_t global_size = num_groups * local_size;
+	if(opencl_buffer_reserve(hist->partials, hist->ctx, CL_MEM_READ_WRITE, num_groups * hist->num_bins * sizeof(cl_uint))) return -1;
+	
+	cl_int length = (cl_int)n;
+	struct opencl_function * count = hist->count;
+	opencl_function_set_args(count, 3, 
+		sizeof(length), &length, 
+		sizeof(cl_mem), NULL, 
+		sizeof(cl_mem), NULL);
+	opencl_function_bind_buffer(count, 1, in, opencl_buffer_access_read);
+	opencl_function_bind_buffer(count, 2, hist->partials, opencl_buffer_access_write);
+	count->set_dims(count, 1, NULL, &global_size, &local_size);
+	int rc = count->execute(count, 0, NULL, NULL);
+	if(rc) return rc;
+	
+	struct opencl_function * merge = hist->merge;
+	opencl_function_set_args(merge, 2, 
+		sizeof(cl_mem), NULL, 
+		sizeof(cl_mem), NULL);
+	opencl_function_bind_buffer(merge, 0, hist->partials, opencl_buffer_access_read);
+	opencl_function_bind_buffer(merge, 1, histogram, opencl_buffer_access_write);
+	merge->set_dims(merge, 1, NULL, &global_size, &local_size);
+	return merge->execute(merge, 0, NULL, NULL);
+}
+
+/*
+ * __kernel void histogram_info(__global float * info);
+ * the HISTOGRAM_NUM_BINS, HISTOGRAM_MIN and HISTOGRAM_MAX the program (or the host functions) was built with
+*/
+static int histogram_get_info(struct opencl_histogram * hist, cl_program program, float info[3])
+{
+	struct opencl_function function[1];
+	if(NULL == program) {
+		if(NULL == opencl_host_function_init(function, "histogram_info")) return -1;
+	}else {
+		opencl_function_init(function, program, "histogram_info");
+		function->queue = hist->queue;
+	}
+	
+	struct opencl_buffer buf[1];
+	size_t size = 3 * sizeof(cl_float);
+	size_t global_size = 1;
+	opencl_buffer_init(buf, hist->ctx, CL_MEM_WRITE_ONLY, size, NULL);
+	opencl_function_set_args(function, 1, sizeof(cl_mem), NULL);
+	opencl_function_bind_buffer(function, 0, buf, opencl_buffer_access_write);
+	function->set_dims(function, 1, NULL, &global_size, NULL);
+	int rc = function->execute(function, 0, NULL, NULL);
+	if(0 == rc && NULL == opencl_buffer_enqueue_read(buf, hist->queue, CL_TRUE, 0, size, info)) rc = -1;
+	
+	opencl_function_cleanup(function);
+	opencl_buffer_cleanup(buf);
+	return rc;
+}
+
+/*
+ * the partials and the histogram are sized by num_bins, the kernels write HISTOGRAM_NUM_BINS items
+*/
+static struct opencl_histogram * histogram_check_bins(struct opencl_histogram * hist, cl_program program, size_t num_bins)
+{
+	float info[3] = { 0 };
+	if(histogram_get_info(hist, program, info) || !(info[0] >= 1.0f)) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): can't query the bins of the histogram kernels\n",
+			__FILE__, __LINE__, __FUNCTION__);
+		opencl_histogram_cleanup(hist);
+		return NULL;
+	}
+	
+	size_t program_bins = (size_t)info[0];
+	if(num_bins && num_bins != program_bins) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): num_bins %lu != HISTOGRAM_NUM_BINS %lu of the program\n",
+			__FILE__, __LINE__, __FUNCTION__,
+			(unsigned long)num_bins, (unsigned long)program_bins);
+		opencl_histogram_cleanup(hist);
+		return NULL;
+	}
+	hist->num_bins = program_bins;
+	hist->min = info[1];
+	hist->max = info[2];
+	return hist;
+}
+
+struct opencl_histogram * opencl_histogram_init(struct opencl_histogram * hist, cl_program program, cl_command_queue queue, size_t num_bins)
+{
+	if(NULL == hist) hist = calloc(1, sizeof(*hist));
+	else memset(hist, 0, sizeof(*hist));
+	assert(hist);
+	
+	hist->execute = histogram_execute;
+	
+	if(NULL == program) {
+		hist->backend = opencl_backend_type_host;
+		hist->local_size = HISTOGRAM_HOST_LOCAL_SIZE;
+		hist->max_groups = opencl_host_get_num_threads() * 4;
+		if(NULL == opencl_host_function_init(hist->count, "histogram_float")
+			|| NULL == opencl_host_function_init(hist->merge, "histogram_merge")) {
+			opencl_histogram_cleanup(hist);
+			return NULL;
+		}
+		return histogram_check_bins(hist, program, num_bins);
+	}
+	
+	assert(queue);
+	hist->backend = opencl_backend_type_opencl;
+	hist->queue = queue;
+	cl_device_id device = NULL;
+	cl_uint num_compute_units = 0;
+	cl_int ret = clGetCommandQueueInfo(queue, CL_QUEUE_CONTEXT, sizeof(hist->ctx), &hist->ctx, NULL);
+	if(ret == CL_SUCCESS) ret = clGetCommandQueueInfo(queue, CL_QUEUE_DEVICE, sizeof(device), &device, NULL);
+	if(ret == CL_SUCCESS) ret = clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(num_compute_units), &num_compute_units, NULL);
+	assert(ret == CL_SUCCESS);
+	
+	opencl_function_init(hist->count, program, "histogram_float");
+	opencl_function_init(hist->merge, program, "histogram_merge");
+	hist->count->queue = queue;
+	hist->merge->queue = queue;
+	
+	// enough groups to fill the device, few enough to keep the merge pass short
+	size_t local_size = opencl_function_get_max_work_group_size(hist->count);
+	if(local_size > HISTOGRAM_LOCAL_SIZE) local_size = HISTOGRAM_LOCAL_SIZE;
+	if(0 == local_size) {
+		opencl_histogram_cleanup(hist);
+		return NULL;
+	}
+	hist->local_size = local_size;
+	hist->max_groups = (num_compute_units?num_compute_units:1) * HISTOGRAM_GROUPS_PER_CU;
+	return histogram_check_bins(hist, program, num_bins);
+}
+
+void opencl_histogram_cleanup(struct opencl_histogram * hist)
+{
+	if(NULL == hist) return;
+	opencl_function_cleanup(hist->count);
+	opencl_function_cleanup(hist->merge);
+	if(hist->partials->size) opencl_buffer_cleanup(hist->partials);
+	return;
+}
@@ -0,0 +1,1391 @@
+/*
+ * opencl-host.c
+ *
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <ctype.h>
+
+#include <pthread.h>
+#include <unistd.h>
+#include "opencl-host.h"
+#include "opencl-half.h"
+
+/*
+ * 8 x float (256 bits), lowered by gcc to AVX / SSE pairs / NEON depending on the target
+*/
+typedef float host_float8 __attribute__((vector_size(32)));
+#define HOST_FLOAT8_LENGTH (sizeof(host_float8) / sizeof(float))
+
+#define HOST_MIN_CHUNK_SIZE (4096)
+
+/* *
+host thread pool
+* */
+static struct host_thread_pool
+{
+	pthread_once_t once;
+	int initialized;	// the workers have been created, num_threads is fixed
+	int num_threads;	// including the caller thread
+
+	pthread_mutex_t submit_mutex;	// serialize the jobs submitted from different tasks
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	pthread_cond_t done_cond;
+
+	unsigned long generation;
+	int num_running;
+
+	opencl_host_job_func job;
+	void * user_data;
+	size_t n;
+	size_t chunk_size;
+	size_t next;		// atomic
+}s_pool[1] = {{
+	.once = PTHREAD_ONCE_INIT,
+	.submit_mutex = PTHREAD_MUTEX_INITIALIZER,
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.done_cond = PTHREAD_COND_INITIALIZER,
+}};
+
+static void pool_run_chunks(struct host_thread_pool * pool)
+{
+	const size_t n = pool->n;
+	const size_t chunk_size = pool->chunk_size;
+	while(1) {
+		size_t begin = __atomic_fetch_add(&pool->next, chunk_size, __ATOMIC_RELAXED);
+		if(begin >= n) break;
+		size_t end = begin + chunk_size;
+		if(end > n) end = n;
+		pool->job(pool->user_data, begin, end);
+	}
+}
+
+static void * pool_worker(void * user_data)
+{
+	struct host_thread_pool * pool = user_data;
+	unsigned long generation = 0;
+
+	pthread_mutex_lock(&pool->mutex);
+	while(1) {
+		while(generation == pool->generation) pthread_cond_wait(&pool->cond, &pool->mutex);
+		generation = pool->generation;
+		pthread_mutex_unlock(&pool->mutex);
+
+		pool_run_chunks(pool);
+
+		pthread_mutex_lock(&pool->mutex);
+		if(--pool->num_running == 0) pthread_cond_signal(&pool->done_cond);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	return NULL;
+}
+
+static void pool_init(void)
+{
+	struct host_thread_pool * pool = s_pool;
+	pthread_mutex_lock(&pool->mutex);
+	if(pool->num_threads <= 0) {
+		const char * env = getenv("OPENCL_HOST_THREADS");
+		if(env) pool->num_threads = atoi(env);
+	}
+	if(pool->num_threads <= 0) pool->num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if(pool->num_threads <= 0) pool->num_threads = 1;
+
+	for(int i = 1; i < pool->num_threads; ++i) {
+		pthread_t th;
+		int rc = pthread_create(&th, NULL, pool_worker, pool);
+		if(rc) {
+			fprintf(stderr, "[WARNING]::%s(%d)::%s(): only %d host threads were created\n",
+				__FILE__, __LINE__, __FUNCTION__, i);
+			pool->num_threads = i;
+			break;
+		}
+		pthread_detach(th);
+	}
+	pool->initialized = 1;
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+int opencl_host_set_num_threads(int num_threads)
+{
+	struct host_thread_pool * pool = s_pool;
+	if(num_threads <= 0) return -1;
+	
+	pthread_mutex_lock(&pool->mutex);
+	int initialized = pool->initialized;
+	if(!initialized) pool->num_threads = num_threads;
+	pthread_mutex_unlock(&pool->mutex);
+	return initialized?-1:0;	// the workers have already been created
+}
+
+int opencl_host_get_num_threads(void)
+{
+	pthread_once(&s_pool->once, pool_init);
+	return s_pool->num_threads;
+}
+
+void opencl_host_parallel_for(size_t n, size_t chunk_size, opencl_host_job_func job, void * user_data)
+{
+	assert(job);
+	if(0 == n) return;
+
+	struct host_thread_pool * pool = s_pool;
+	pthread_once(&pool->once, pool_init);
+
+	if(0 == chunk_size) {
+		chunk_size = n / (pool->num_threads * 4);
+		if(chunk_size < HOST_MIN_CHUNK_SIZE) chunk_size = HOST_MIN_CHUNK_SIZE;
+		chunk_size = (chunk_size + HOST_FLOAT8_LENGTH - 1) & ~(HOST_FLOAT8_LENGTH - 1);
+	}
+
+	if(pool->num_threads <= 1 || n <= chunk_size) {
+		job(user_data, 0, n);
+		return;
+	}
+
+	pthread_mutex_lock(&pool->submit_mutex);
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->job = job;
+	pool->user_data = user_data;
+	pool->n = n;
+	pool->chunk_size = chunk_size;
+	pool->next = 0;
+	pool->num_running = pool->num_threads - 1;
+	++pool->generation;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	pool_run_chunks(pool);	// the caller thread takes part in the job
+
+	pthread_mutex_lock(&pool->mutex);
+	while(pool->num_running > 0) pthread_cond_wait(&pool->done_cond, &pool->mutex);
+	pthread_mutex_unlock(&pool->mutex);
+
+	pthread_mutex_unlock(&pool->submit_mutex);
+	return;
+}
+
+/* *
+build options
+* */
+/*
+ * the defines of the build options (-D NAME[=VALUE]), the host kernels are specialized by the same macros as the device kernels.
+ * each host function keeps the defines it was initialized with (like a program built with its options),
+ * s_build_options: the ones captured by the functions initialized from now on.
+*/
+#define HOST_MAX_DEFINES (32)
+struct host_define
+{
+	char name[64];
+	double value;
+};
+struct host_defines
+{
+	int num_defines;
+	struct host_define defines[HOST_MAX_DEFINES];
+};
+static struct host_defines s_build_options[1];
+static pthread_mutex_t s_build_options_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void add_define(struct host_defines * defines, const char * define, size_t length)
+{
+	const char * value = memchr(define, '=', length);
+	size_t name_length = value?(size_t)(value - define):length;
+	if(0 == name_length || name_length >= sizeof(defines->defines[0].name) || defines->num_defines >= HOST_MAX_DEFINES) {
+		fprintf(stderr, "[WARNING]::%s(%d)::%s(): define '%.*s' ignored\n",
+			__FILE__, __LINE__, __FUNCTION__,
+			(int)length, define);
+		return;
+	}
+	
+	struct host_define * def = &defines->defines[defines->num_defines++];
+	memcpy(def->name, define, name_length);
+	def->name[name_length] = '\0';
+	def->value = 1;
+	if(value) {
+		++value;
+		while(*value == '(') ++value;	// e.g. (1.0f)
+		def->value = strtod(value, NULL);
+	}
+}
+
+static void parse_build_options(struct host_defines * defines, const char * options)
+{
+	defines->num_defines = 0;
+	if(NULL == options) return;
+	
+	const char * p = options;
+	int is_define = 0;	// "-D" followed by a separate token
+	while(*p) {
+		while(*p && isspace((unsigned char)*p)) ++p;
+		if(!*p) break;
+		const char * token = p;
+		while(*p && !isspace((unsigned char)*p)) ++p;
+		size_t length = p - token;
+		
+		if(is_define) add_define(defines, token, length);
+		else if(length > 2 && strncmp(token, "-D", 2) == 0) add_define(defines, token + 2, length - 2);
+		is_define = (length == 2 && strncmp(token, "-D", 2) == 0);
+	}
+}
+
+int opencl_host_set_build_options(const char * options)
+{
+	pthread_mutex_lock(&s_build_options_mutex);
+	parse_build_options(s_build_options, options);
+	pthread_mutex_unlock(&s_build_options_mutex);
+	return 0;
+}
+
+/*
+ * function->priv of the host functions
+*/
+struct host_function
+{
+	const struct host_kernel * kernel;
+	struct host_defines defines[1];
+};
+
+int opencl_host_function_set_build_options(struct opencl_function * function, const char * options)
+{
+	assert(function && function->backend == opencl_backend_type_host && function->priv);
+	struct host_function * host_function = function->priv;
+	parse_build_options(host_function->defines, options);
+	return 0;
+}
+
+double opencl_host_function_get_define(const struct opencl_function * function, const char * name, double default_value)
+{
+	assert(function && function->backend == opencl_backend_type_host && function->priv);
+	assert(name);
+	const struct host_defines * defines = ((const struct host_function *)function->priv)->defines;
+	for(int i = defines->num_defines - 1; i >= 0; --i) {	// the last one wins
+		if(strcmp(defines->defines[i].name, name) == 0) return defines->defines[i].value;
+	}
+	return default_value;
+}
+
+/* *
+host kernels
+* */
+static int host_get_arg(const struct opencl_kernel * kernel, size_t index, size_t size, void * value)
+{
+	if(index >= kernel->num_args || kernel->sizes[index] != size || NULL == kernel->args[index]) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): %s: invalid arg[%d]\n",
+			__FILE__, __LINE__, __FUNCTION__,
+			kernel->name, (int)index);
+		return -1;
+	}
+	memcpy(value, kernel->args[index], size);
+	return 0;
+}
+
+struct host_map_args
+{
+	float * Y;
+	const float * X;
+	float a;
+};
+
+static void vec_mul_scalar_job(void * user_data, size_t begin, size_t end)
+{
+	const struct host_map_args * args = user_data;
+	float * restrict Y = args->Y;
+	const float * restrict X = args->X;
+	const float a = args->a;
+
+	size_t i = begin;
+	for(; i + HOST_FLOAT8_LENGTH <= end; i += HOST_FLOAT8_LENGTH) {
+		host_float8 x;
+		memcpy(&x, &X[i], sizeof(x));
+		x = x * a;
+		memcpy(&Y[i], &x, sizeof(x));
+	}
+	for(; i < end; ++i) Y[i] = X[i] * a;
+}
+
+static void vec_add_scalar_job(void * user_data, size_t begin, size_t end)
+{
+	const struct host_map_args * args = user_data;
+	float * restrict Y = args->Y;
+	const float * restrict X = args->X;
+	const float a = args->a;
+
+	size_t i = begin;
+	for(; i + HOST_FLOAT8_LENGTH <= end; i += HOST_FLOAT8_LENGTH) {
+		host_float8 x;
+		memcpy(&x, &X[i], sizeof(x));
+		x = x + a;
+		memcpy(&Y[i], &x, sizeof(x));
+	}
+	for(; i < end; ++i) Y[i] = X[i] + a;
+}
+
+/*
+ * the element-wise kernels process [global_offset, n), whatever the grid size
+*/
+static size_t host_get_range(const struct opencl_function * function, cl_int n, size_t * offset)
+{
+	*offset = function->global_offsets?function->global_offsets[0]:0;
+	return (n > 0 && (size_t)n > *offset)?(n - *offset):0;
+}
+
+/*
+ * __kernel void vec_mul_scalar(__const int n, __global float * Y, __global const float * X, __const float a);
+*/
+static int host_vec_mul_scalar(struct opencl_function * function)
+{
+	struct opencl_kernel * kernel = function->kernel;
+	cl_int n = 0;
+	float * Y = NULL;
+	float * X = NULL;
+	struct host_map_args args = { NULL };
+
+	if(host_get_arg(kernel, 0, sizeof(n), &n)
+		|| host_get_arg(kernel, 1, sizeof(Y), &Y)
+		|| host_get_arg(kernel, 2, sizeof(X), &X)
+		|| host_get_arg(kernel, 3, sizeof(args.a), &args.a)) return -1;
+
+	size_t offset = 0;
+	size_t length = host_get_range(function, n, &offset);
+	args.Y = Y + offset;
+	args.X = X + offset;
+	opencl_host_parallel_for(length, 0, vec_mul_scalar_job, &args);
+	return 0;
+}
+
+/*
+ * __kernel void vec_add_scalar(__const int n, __global float * Y, __global const float * X, __const float a);
+*/
+static int host_vec_add_scalar(struct opencl_function * function)
+{
+	struct opencl_kernel * kernel = function->kernel;
+	cl_int n = 0;
+	float * Y = NULL;
+	float * X = NULL;
+	struct host_map_args args = { NULL };
+
+	if(host_get_arg(kernel, 0, sizeof(n), &n)
+		|| host_get_arg(kernel, 1, sizeof(Y), &Y)
+		|| host_get_arg(kernel, 2, sizeof(X), &X)
+		|| host_get_arg(kernel, 3, sizeof(args.a), &args.a)) return -1;
+
+	size_t offset = 0;
+	size_t length = host_get_range(function, n, &offset);
+	args.Y = Y + offset;
+	args.X = X + offset;
+	opencl_host_parallel_for(length, 0, vec_add_scalar_job, &args);
+	return 0;
+}
+
+/*
+ * the reductions (kernels/vec_sum.cl) stride over A like the device work-groups:
+ *   group g sums the blocks [global_offset + g * group_size + k * global_size, + group_size) of [0, n)
+*/
+struct host_strided_sum_args
+{
+	size_t n;
+	const void * A;
+	size_t offset;
+	size_t group_size;
+	size_t global_size;
+	void * result;
+};
+
+static float host_sum(const float * restrict A, size_t length)
+{
+	host_float8 acc[2];
+	memset(acc, 0, sizeof(acc));
+
+	size_t i = 0;
+	for(; i + 2 * HOST_FLOAT8_LENGTH <= length; i += 2 * HOST_FLOAT8_LENGTH) {
+		host_float8 x[2];
+		memcpy(x, &A[i], sizeof(x));
+		acc[0] += x[0];
+		acc[1] += x[1];
+	}
+	acc[0] += acc[1];
+
+	float sum = 0;
+	for(size_t k = 0; k < HOST_FLOAT8_LENGTH; ++k) sum += acc[0][k];
+	for(; i < length; ++i) sum += A[i];
+	return sum;
+}
+
+static void vec_sum_job(void * user_data, size_t begin, size_t end)
+{
+	const struct host_strided_sum_args * args = user_data;
+	const float * A = args->A;
+	float * result = args->result;
+	for(size_t group_id = begin; group_id < end; ++group_id) {
+		float sum = 0;
+		for(size_t first = args->offset + group_id * args->group_size; first < args->n; first += args->global_size) {
+			size_t last = first + args->group_size;
+			if(last > args->n) last = args->n;
+			sum += host_sum(&A[first], last - first);
+		}
+		result[group_id] = sum;
+	}
+}
+
+// Kahan summation, 8 lanes, the sum is (*sum - *c)
+static void host_kahan_sum(const float * restrict A, size_t length, float * sum, float * c)
+{
+	host_float8 s8 = { 0 }, c8 = { 0 };
+	size_t i = 0;
+	for(; i + HOST_FLOAT8_LENGTH <= length; i += HOST_FLOAT8_LENGTH) {
+		host_float8 x;
+		memcpy(&x, &A[i], sizeof(x));
+		host_float8 y = x - c8;
+		host_float8 t = s8 + y;
+		c8 = (t - s8) - y;
+		s8 = t;
+	}
+	
+	#define KAHAN_ADD(s, c, x) do { float y = (x) - c; float t = s + y; c = (t - s) - y; s = t; } while(0)
+	float s1 = *sum, c1 = *c;
+	for(size_t k = 0; k < HOST_FLOAT8_LENGTH; ++k) {
+		KAHAN_ADD(s1, c1, s8[k]);
+		KAHAN_ADD(s1, c1, -c8[k]);
+	}
+	for(; i < length; ++i) KAHAN_ADD(s1, c1, A[i]);
+	#undef KAHAN_ADD
+	*sum = s1;
+	*c = c1;
+}
+
+static void vec_sum_compensated_job(void * user_data, size_t begin, size_t end)
+{
+	const struct host_strided_sum_args * args = user_data;
+	const float * A = args->A;
+	float * result = args->result;
+	for(size_t group_id = begin; group_id < end; ++group_id) {
+		float sum = 0, c = 0;
+		for(size_t first = args->offset + group_id * args->group_size; first < args->n; first += args->global_size) {
+			size_t last = first + args->group_size;
+			if(last > args->n) last = args->n;
+			host_kahan_sum(&A[first], last - first, &sum, &c);
+		}
+		result[group_id] = sum - c;
+	}
+}
+
+static void vec_sum_double_job(void * user_data, size_t begin, size_t end)
+{
+	const struct host_strided_sum_args * args = user_data;
+	const float * A = args->A;
+	double * result = args->result;
+	for(size_t group_id = begin; group_id < end; ++group_id) {
+		double sum = 0;
+		for(size_t first = args->offset + group_id * args->group_size; first < args->n; first += args->global_size) {
+			size_t last = first + args->group_size;
+			if(last > args->n) last = args->n;
+			for(size_t i = first; i < last; ++i) sum += A[i];
+		}
+		result[group_id] = sum;
+	}
+}
+
+static int host_strided_sum(struct opencl_function * function, size_t result_index, opencl_host_job_func job)
+{
+	struct opencl_kernel * kernel = function->kernel;
+	cl_int n = 0;
+	struct host_strided_sum_args args = { 0 };
+	
+	if(host_get_arg(kernel, 0, sizeof(n), &n)
+		|| host_get_arg(kernel, 1, sizeof(args.A), &args.A)
+		|| host_get_arg(kernel, result_index, sizeof(args.result), &args.result)) return -1;
+	
+	args.n = (n > 0)?n:0;
+	args.offset = function->global_offsets?function->global_offsets[0]:0;
+	args.global_size = function->global_sizes[0];
+	args.group_size = function->local_sizes?function->local_sizes[0]:args.global_size;
+	assert(args.group_size > 0);
+	
+	size_t num_groups = (args.global_size + args.group_size - 1) / args.group_size;
+	args.global_size = num_groups * args.group_size;
+	size_t groups_per_chunk = (HOST_MIN_CHUNK_SIZE + args.group_size - 1) / args.group_size;
+	opencl_host_parallel_for(num_groups, groups_per_chunk, job, &args);
+	return 0;
+}
+
+/*
+ * __kernel void vec_sum(__const int n, __global const float * A, __local float * partials, __global float * result);
+*/
+static int host_vec_sum(struct opencl_function * function)
+{
+	return host_strided_sum(function, 3, vec_sum_job);
+}
+
+/*
+ * __kernel void vec_sum_compensated(__const int n, __global const float * A, 
+ *     __local float * partials, __local float * compensations, __global float * result);
+*/
+static int host_vec_sum_compensated(struct opencl_function * function)
+{
+	return host_strided_sum(function, 4, vec_sum_compensated_job);
+}
+
+/*
+ * __kernel void vec_sum_double(__const int n, __global const float * A, __local double * partials, __global double * result);
+*/
+static int host_vec_sum_double(struct opencl_function * function)
+{
+	return host_strided_sum(function, 3, vec_sum_double_job);
+}
+
+/*
+ * the 16-bit storage variants (kernels/vec_half.cl), converted by blocks and computed in float
+*/
+#define HOST_CONVERT_BLOCK_SIZE (256)
+struct host_storage_map_args
+{
+	void * Y;
+	const void * X;
+	float a;
+	int is_add;
+};
+
+#define DEFINE_HOST_STORAGE(suffix, type) \
+static void vec_map_##suffix##_job(void * user_data, size_t begin, size_t end) \
+{ \
+	const struct host_storage_map_args * args = user_data; \
+	type * Y = args->Y; \
+	const type * X = args->X; \
+	float block[HOST_CONVERT_BLOCK_SIZE]; \
+	for(size_t first = begin; first < end; first += HOST_CONVERT_BLOCK_SIZE) { \
+		size_t length = end - first; \
+		if(length > HOST_CONVERT_BLOCK_SIZE) length = HOST_CONVERT_BLOCK_SIZE; \
+		opencl_##suffix##_to_float_array(block, &X[first], length); \
+		if(args->is_add) for(size_t i = 0; i < length; ++i) block[i] += args->a; \
+		else for(size_t i = 0; i < length; ++i) block[i] *= args->a; \
+		opencl_float_to_##suffix##_array(&Y[first], block, length); \
+	} \
+} \
+\
+static int host_vec_mul_scalar_##suffix(struct opencl_function * function) \
+{ \
+	struct opencl_kernel * kernel = function->kernel; \
+	cl_int n = 0; \
+	type * Y = NULL; \
+	type * X = NULL; \
+	struct host_storage_map_args args = { NULL }; \
+	\
+	if(host_get_arg(kernel, 0, sizeof(n), &n) \
+		|| host_get_arg(kernel, 1, sizeof(Y), &Y) \
+		|| host_get_arg(kernel, 2, sizeof(X), &X) \
+		|| host_get_arg(kernel, 3, sizeof(args.a), &args.a)) return -1; \
+	\
+	size_t offset = 0; \
+	size_t length = host_get_range(function, n, &offset); \
+	args.Y = Y + offset; \
+	args.X = X + offset; \
+	opencl_host_parallel_for(length, 0, vec_map_##suffix##_job, &args); \
+	return 0; \
+} \
+\
+static int host_vec_add_scalar_##suffix(struct opencl_function * function) \
+{ \
+	struct opencl_kernel * kernel = function->kernel; \
+	cl_int n = 0; \
+	type * Y = NULL; \
+	type * X = NULL; \
+	struct host_storage_map_args args = { .is_add = 1 }; \
+	\
+	if(host_get_arg(kernel, 0, sizeof(n), &n) \
+		|| host_get_arg(kernel, 1, sizeof(Y), &Y) \
+		|| host_get_arg(kernel, 2, sizeof(X), &X) \
+		|| host_get_arg(kernel, 3, sizeof(args.a), &args.a)) return -1; \
+	\
+	size_t offset = 0; \
+	size_t length = host_get_range(function, n, &offset); \
+	args.Y = Y + offset; \
+	args.X = X + offset; \
+	opencl_host_parallel_for(length, 0, vec_map_##suffix##_job, &args); \
+	return 0; \
+} \
+\
+static void vec_sum_##suffix##_job(void * user_data, size_t begin, size_t end) \
+{ \
+	const struct host_strided_sum_args * args = user_data; \
+	const type * A = args->A; \
+	float * result = args->result; \
+	float block[HOST_CONVERT_BLOCK_SIZE]; \
+	for(size_t group_id = begin; group_id < end; ++group_id) { \
+		float sum = 0; \
+		for(size_t first = args->offset + group_id * args->group_size; first < args->n; first += args->global_size) { \
+			size_t last = first + args->group_size; \
+			if(last > args->n) last = args->n; \
+			for(size_t i = first; i < last; i += HOST_CONVERT_BLOCK_SIZE) { \
+				size_t length = last - i; \
+				if(length > HOST_CONVERT_BLOCK_SIZE) length = HOST_CONVERT_BLOCK_SIZE; \
+				opencl_##suffix##_to_float_array(block, &A[i], length); \
+				sum += host_sum(block, length); \
+			} \
+		} \
+		result[group_id] = sum; \
+	} \
+} \
+\
+static int host_vec_sum_##suffix(struct opencl_function * function) \
+{ \
+	return host_strided_sum(function, 3, vec_sum_##suffix##_job); \
+}
+
+DEFINE_HOST_STORAGE(half, cl_half)
+DEFINE_HOST_STORAGE(bf16, cl_ushort)
+
+/*
+ * prefix sums, the same blocks as the device kernels (kernels/scan.cl):
+ *   each work-group scans (2 * local_size) items and writes its total to block_sums[group_id]
+*/
+struct host_scan_args
+{
+	size_t n;
+	size_t block_size;	// 2 * local_size
+	const void * in;
+	void * out;
+	void * sums;		// block_sums / offsets
+	int inclusive;
+};
+
+#define DEFINE_HOST_SCAN(type) \
+static void scan_blocks_##type##_job(void * user_data, size_t begin, size_t end) \
+{ \
+	const struct host_scan_args * args = user_data; \
+	const type * in = args->in; \
+	type * out = args->out; \
+	type * block_sums = args->sums; \
+	for(size_t group_id = begin; group_id < end; ++group_id) { \
+		size_t first = group_id * args->block_size; \
+		size_t last = first + args->block_size; \
+		if(last > args->n) last = args->n; \
+		\
+		type sum = 0; \
+		if(args->inclusive) { \
+			for(size_t i = first; i < last; ++i) out[i] = (sum += in[i]); \
+		}else { \
+			for(size_t i = first; i < last; ++i) { \
+				type x = in[i]; \
+				out[i] = sum; \
+				sum += x; \
+			} \
+		} \
+		block_sums[group_id] = sum; \
+	} \
+} \
+\
+static void scan_add_offsets_##type##_job(void * user_data, size_t begin, size_t end) \
+{ \
+	const struct host_scan_args * args = user_data; \
+	type * out = args->out; \
+	const type * offsets = args->sums; \
+	for(size_t group_id = begin; group_id < end; ++group_id) { \
+		size_t first = group_id * args->block_size; \
+		size_t last = first + args->block_size; \
+		if(last > args->n) last = args->n; \
+		\
+		const type offset = offsets[group_id]; \
+		for(size_t i = first; i < last; ++i) out[i] += offset; \
+	} \
+} \
+\
+static int host_scan_blocks_##type(struct opencl_function * function) \
+{ \
+	struct opencl_kernel * kernel = function->kernel; \
+	cl_int n = 0; \
+	cl_int inclusive = 0; \
+	struct host_scan_args args = { 0 }; \
+	\
+	if(host_get_arg(kernel, 0, sizeof(n), &n) \
+		|| host_get_arg(kernel, 1, sizeof(args.in), &args.in) \
+		|| host_get_arg(kernel, 2, sizeof(args.out), &args.out) \
+		|| host_get_arg(kernel, 4, sizeof(args.sums), &args.sums) \
+		|| host_get_arg(kernel, 5, sizeof(inclusive), &inclusive)) return -1; \
+	if(NULL == function->local_sizes) return -1; \
+	\
+	args.n = (n > 0)?n:0; \
+	args.block_size = function->local_sizes[0] * 2; \
+	args.inclusive = inclusive; \
+	size_t num_groups = function->global_sizes[0] / function->local_sizes[0]; \
+	size_t groups_per_chunk = (HOST_MIN_CHUNK_SIZE + args.block_size - 1) / args.block_size; \
+	opencl_host_parallel_for(num_groups, groups_per_chunk, scan_blocks_##type##_job, &args); \
+	return 0; \
+} \
+\
+static int host_scan_add_offsets_##type(struct opencl_function * function) \
+{ \
+	struct opencl_kernel * kernel = function->kernel; \
+	cl_int n = 0; \
+	struct host_scan_args args = { 0 }; \
+	\
+	if(host_get_arg(kernel, 0, sizeof(n), &n) \
+		|| host_get_arg(kernel, 1, sizeof(args.out), &args.out) \
+		|| host_get_arg(kernel, 2, sizeof(args.sums), &args.sums)) return -1; \
+	if(NULL == function->local_sizes) return -1; \
+	\
+	args.n = (n > 0)?n:0; \
+	args.block_size = function->local_sizes[0] * 2; \
+	size_t num_groups = function->global_sizes[0] / function->local_sizes[0]; \
+	size_t groups_per_chunk = (HOST_MIN_CHUNK_SIZE + args.block_size - 1) / args.block_size; \
+	opencl_host_parallel_for(num_groups, groups_per_chunk, scan_add_offsets_##type##_job, &args); \
+	return 0; \
+}
+
+/*
+ * __kernel void scan_blocks_<type>(__const int n, __global const type * in, __global type * out, 
+ *     __local type * partials, __global type * block_sums, __const int inclusive);
+ * __kernel void scan_add_offsets_<type>(__const int n, __global type * out, __global const type * offsets);
+*/
+DEFINE_HOST_SCAN(float)
+DEFINE_HOST_SCAN(cl_int)
+
+/*
+ * radix sort passes, the same tiles of (2 * local_size) items as the device kernels (kernels/radix_sort.cl)
+*/
+#define HOST_RADIX_BITS (4)
+#define HOST_RADIX_NUM_DIGITS (1 << HOST_RADIX_BITS)
+struct host_radix_args
+{
+	size_t n;
+	size_t tile_size;
+	size_t num_groups;
+	int shift;
+	const cl_uint * keys_in;
+	const cl_uint * values_in;
+	cl_uint * keys_out;
+	cl_uint * values_out;
+	cl_int * histograms;	// offsets (scatter)
+};
+
+static void radix_count_job(void * user_data, size_t begin, size_t end)
+{
+	const struct host_radix_args * args = user_data;
+	for(size_t group_id = begin; group_id < end; ++group_id) {
+		size_t first = group_id * args->tile_size;
+		size_t last = first + args->tile_size;
+		if(last > args->n) last = args->n;
+		
+		cl_int counts[HOST_RADIX_NUM_DIGITS] = { 0 };
+		for(size_t i = first; i < last; ++i) ++counts[(args->keys_in[i] >> args->shift) & (HOST_RADIX_NUM_DIGITS - 1)];
+		for(int d = 0; d < HOST_RADIX_NUM_DIGITS; ++d) args->histograms[d * args->num_groups + group_id] = counts[d];
+	}
+}
+
+static void radix_scatter_job(void * user_data, size_t begin, size_t end)
+{
+	const struct host_radix_args * args = user_data;
+	for(size_t group_id = begin; group_id < end; ++group_id) {
+		size_t first = group_id * args->tile_size;
+		size_t last = first + args->tile_size;
+		if(last > args->n) last = args->n;
+		
+		cl_int next[HOST_RADIX_NUM_DIGITS];
+		for(int d = 0; d < HOST_RADIX_NUM_DIGITS; ++d) next[d] = args->histograms[d * args->num_groups + group_id];
+		for(size_t i = first; i < last; ++i) {
+			cl_uint key = args->keys_in[i];
+			cl_int dst = next[(key >> args->shift) & (HOST_RADIX_NUM_DIGITS - 1)]++;
+			args->keys_out[dst] = key;
+			if(args->values_out) args->values_out[dst] = args->values_in[i];
+		}
+	}
+}
+
+/*
+ * __kernel void radix_count(__const int n, __global const uint * keys, __const int shift, 
+ *     __local uint * counts, __global int * histograms);
+*/
+static int host_radix_count(struct opencl_function * function)
+{
+	struct opencl_kernel * kernel = function->kernel;
+	cl_int n = 0;
+	struct host_radix_args args = { 0 };
+	
+	if(host_get_arg(kernel, 0, sizeof(n), &n)
+		|| host_get_arg(kernel, 1, sizeof(args.keys_in), &args.keys_in)
+		|| host_get_arg(kernel, 2, sizeof(args.shift), &args.shift)
+		|| host_get_arg(kernel, 4, sizeof(args.histograms), &args.histograms)) return -1;
+	if(NULL == function->local_sizes) return -1;
+	
+	args.n = (n > 0)?n:0;
+	args.tile_size = function->local_sizes[0] * 2;
+	args.num_groups = function->global_sizes[0] / function->local_sizes[0];
+	opencl_host_parallel_for(args.num_groups, (HOST_MIN_CHUNK_SIZE + args.tile_size - 1) / args.tile_size, radix_count_job, &args);
+	return 0;
+}
+
+/*
+ * __kernel void radix_scatter(__const int n, __global const uint * keys_in, __global const uint * values_in, 
+ *     __global uint * keys_out, __global uint * values_out, __const int shift, __global const int * offsets, 
+ *     __local uint * local_keys, __local int * local_indices, __local int * partials, __const int has_values);
+*/
+static int host_radix_scatter(struct opencl_function * function)
+{
+	struct opencl_kernel * kernel = function->kernel;
+	cl_int n = 0;
+	cl_int has_values = 0;
+	struct host_radix_args args = { 0 };
+	
+	if(host_get_arg(kernel, 0, sizeof(n), &n)
+		|| host_get_arg(kernel, 1, sizeof(args.keys_in), &args.keys_in)
+		|| host_get_arg(kernel, 2, sizeof(args.values_in), &args.values_in)
+		|| host_get_arg(kernel, 3, sizeof(args.keys_out), &args.keys_out)
+		|| host_get_arg(kernel, 4, sizeof(args.values_out), &args.values_out)
+		|| host_get_arg(kernel, 5, sizeof(args.shift), &args.shift)
+		|| host_get_arg(kernel, 6, sizeof(args.histograms), &args.histograms)
+		|| host_get_arg(kernel, 10, sizeof(has_values), &has_values)) return -1;
+	if(NULL == function->local_sizes) return -1;
+	
+	if(!has_values) args.values_out = NULL;
+	args.n = (n > 0)?n:0;
+	args.tile_size = function->local_sizes[0] * 2;
+	args.num_groups = function->global_sizes[0] / function->local_sizes[0];
+	opencl_host_parallel_for(args.num_groups, (HOST_MIN_CHUNK_SIZE + args.tile_size - 1) / args.tile_size, radix_scatter_job, &args);
+	return 0;
+}
+
+/*
+ * stream compaction (kernels/compact.cl)
+*/
+enum host_compact_op
+{
+	host_compact_op_greater,
+	host_compact_op_less,
+	host_compact_op_equal,
+	host_compact_op_not_equal,
+};
+struct host_compact_args
+{
+	const void * in;
+	cl_int * flags;
+	const cl_int * positions;
+	void * out;
+	cl_int * count;
+	size_t n;
+	int op;
+	union {
+		float f32;
+		cl_int i32;
+	}value;
+};
+
+#define DEFINE_HOST_COMPACT(type, field) \
+static void compact_flags_##type##_job(void * user_data, size_t begin, size_t end) \
+{ \
+	const struct host_compact_args * args = user_data; \
+	const type * in = args->in; \
+	const type value = args->value.field; \
+	switch(args->op) { \
+	case host_compact_op_greater: for(size_t i = begin; i < end; ++i) args->flags[i] = (in[i] > value); break; \
+	case host_compact_op_less: for(size_t i = begin; i < end; ++i) args->flags[i] = (in[i] < value); break; \
+	case host_compact_op_equal: for(size_t i = begin; i < end; ++i) args->flags[i] = (in[i] == value); break; \
+	case host_compact_op_not_equal: for(size_t i = begin; i < end; ++i) args->flags[i] = (in[i] != value); break; \
+	default: memset(&args->flags[begin], 0, (end - begin) * sizeof(cl_int)); break; \
+	} \
+} \
+\
+static void compact_scatter_##type##_job(void * user_data, size_t begin, size_t end) \
+{ \
+	const struct host_compact_args * args = user_data; \
+	const type * in = args->in; \
+	type * out = args->out; \
+	for(size_t i = begin; i < end; ++i) { \
+		if(args->flags[i]) out[args->positions[i]] = in[i]; \
+	} \
+	if(end == args->n) args->count[0] = args->positions[end - 1] + args->flags[end - 1]; \
+} \
+\
+static int host_compact_flags_##type(struct opencl_function * function) \
+{ \
+	struct opencl_kernel * kernel = function->kernel; \
+	cl_int n = 0; \
+	struct host_compact_args args = { NULL }; \
+	\
+	if(host_get_arg(kernel, 0, sizeof(n), &n) \
+		|| host_get_arg(kernel, 1, sizeof(args.in), &args.in) \
+		|| host_get_arg(kernel, 2, sizeof(args.flags), &args.flags) \
+		|| host_get_arg(kernel, 3, sizeof(args.op), &args.op) \
+		|| host_get_arg(kernel, 4, sizeof(args.value.field), &args.value.field)) return -1; \
+	\
+	args.n = (n > 0)?n:0; \
+	opencl_host_parallel_for(args.n, 0, compact_flags_##type##_job, &args); \
+	return 0; \
+} \
+\
+static int host_compact_scatter_##type(struct opencl_function * function) \
+{ \
+	struct opencl_kernel * kernel = function->kernel; \
+	cl_int n = 0; \
+	struct host_compact_args args = { NULL }; \
+	\
+	if(host_get_arg(kernel, 0, sizeof(n), &n) \
+		|| host_get_arg(kernel, 1, sizeof(args.in), &args.in) \
+		|| host_get_arg(kernel, 2, sizeof(args.flags), &args.flags) \
+		|| host_get_arg(kernel, 3, sizeof(args.positions), &args.positions) \
+		|| host_get_arg(kernel, 4, sizeof(args.out), &args.out) \
+		|| host_get_arg(kernel, 5, sizeof(args.count), &args.count)) return -1; \
+	\
+	args.n = (n > 0)?n:0; \
+	if(0 == args.n) { /* empty input */ \
+		args.count[0] = 0; \
+		return 0; \
+	} \
+	opencl_host_parallel_for(args.n, 0, compact_scatter_##type##_job, &args); \
+	return 0; \
+}
+
+/*
+ * __kernel void compact_flags_<type>(__const int n, __global const type * in, __global int * flags, 
+ *     __const int op, __const type value);
+ * __kernel void compact_scatter_<type>(__const int n, __global const type * in, __global const int * flags, 
+ *     __global const int * positions, __global type * out, __global int * count);
+*/
+DEFINE_HOST_COMPACT(float, f32)
+DEFINE_HOST_COMPACT(cl_int, i32)
+
+/*
+ * sgemm / gemv_batched (kernels/gemm.cl), row-major
+*/
+#define HOST_GEMM_BLOCK_ROWS (4)	// the rows of C sharing each row of B
+struct host_gemm_args
+{
+	cl_int M, N, K;		// gemv: m, n, batch_count
+	float alpha;
+	float beta;
+	const float * A;
+	const float * B;	// gemv: x
+	float * C;			// gemv: y
+};
+
+static void sgemm_job(void * user_data, size_t begin, size_t end)
+{
+	const struct host_gemm_args * args = user_data;
+	const size_t N = args->N;
+	const size_t K = args->K;
+	float * acc = NULL;
+	int rc = posix_memalign((void **)&acc, 64, sizeof(*acc) * N * HOST_GEMM_BLOCK_ROWS);
+	assert(0 == rc && acc);
+	
+	for(size_t first = begin; first < end; first += HOST_GEMM_BLOCK_ROWS) {
+		size_t num_rows = end - first;
+		if(num_rows > HOST_GEMM_BLOCK_ROWS) num_rows = HOST_GEMM_BLOCK_ROWS;
+		memset(acc, 0, sizeof(*acc) * N * num_rows);
+		
+		for(size_t k = 0; k < K; ++k) {
+			const float * restrict b = &args->B[k * N];
+			for(size_t r = 0; r < num_rows; ++r) {
+				float * restrict c = &acc[r * N];
+				const float a = args->A[(first + r) * K + k];
+				size_t j = 0;
+				for(; j + HOST_FLOAT8_LENGTH <= N; j += HOST_FLOAT8_LENGTH) {
+					host_float8 x, y;
+					memcpy(&x, &b[j], sizeof(x));
+					memcpy(&y, &c[j], sizeof(y));
+					y += x * a;
+					memcpy(&c[j], &y, sizeof(y));
+				}
+				for(; j < N; ++j) c[j] += a * b[j];
+			}
+		}
+		
+		for(size_t r = 0; r < num_rows; ++r) {
+			float * c = &args->C[(first + r) * N];
+			const float * c_acc = &acc[r * N];
+			if(args->beta == 0) for(size_t j = 0; j < N; ++j) c[j] = args->alpha * c_acc[j];
+			else for(size_t j = 0; j < N; ++j) c[j] = args->alpha * c_acc[j] + args->beta * c[j];
+		}
+	}
+	free(acc);
+}
+
+/*
+ * __kernel void sgemm(__const int M, __const int N, __const int K, __const float alpha, 
+ *     __global const float * A, __global const float * B, __const float beta, __global float * C);
+*/
+static int host_sgemm(struct opencl_function * function)
+{
+	struct opencl_kernel * kernel = function->kernel;
+	struct host_gemm_args args = { 0 };
+	
+	if(host_get_arg(kernel, 0, sizeof(args.M), &args.M)
+		|| host_get_arg(kernel, 1, sizeof(args.N), &args.N)
+		|| host_get_arg(kernel, 2, sizeof(args.K), &args.K)
+		|| host_get_arg(kernel, 3, sizeof(args.alpha), &args.alpha)
+		|| host_get_arg(kernel, 4, sizeof(args.A), &args.A)
+		|| host_get_arg(kernel, 5, sizeof(args.B), &args.B)
+		|| host_get_arg(kernel, 6, sizeof(args.beta), &args.beta)
+		|| host_get_arg(kernel, 7, sizeof(args.C), &args.C)) return -1;
+	if(args.M <= 0 || args.N <= 0 || args.K < 0) return -1;
+	
+	size_t flops_per_row = (size_t)args.N * (args.K + 1);
+	size_t rows_per_chunk = (HOST_MIN_CHUNK_SIZE * 16 + flops_per_row - 1) / flops_per_row;
+	rows_per_chunk = (rows_per_chunk + HOST_GEMM_BLOCK_ROWS - 1) / HOST_GEMM_BLOCK_ROWS * HOST_GEMM_BLOCK_ROWS;
+	opencl_host_parallel_for(args.M, rows_per_chunk, sgemm_job, &args);
+	return 0;
+}
+
+static float host_dot(const float * restrict a, const float * restrict b, size_t length)
+{
+	host_float8 acc = { 0 };
+	size_t i = 0;
+	for(; i + HOST_FLOAT8_LENGTH <= length; i += HOST_FLOAT8_LENGTH) {
+		host_float8 x, y;
+		memcpy(&x, &a[i], sizeof(x));
+		memcpy(&y, &b[i], sizeof(y));
+		acc += x * y;
+	}
+	
+	float sum = 0;
+	for(size_t k = 0; k < HOST_FLOAT8_LENGTH; ++k) sum += acc[k];
+	for(; i < length; ++i) sum += a[i] * b[i];
+	return sum;
+}
+
+static void gemv_batched_job(void * user_data, size_t begin, size_t end)
+{
+	const struct host_gemm_args * args = user_data;
+	const size_t m = args->M;
+	const size_t n = args->N;
+	for(size_t b = begin; b < end; ++b) {
+		const float * A = &args->A[b * m * n];
+		const float * x = &args->B[b * n];
+		float * y = &args->C[b * m];
+		for(size_t row = 0; row < m; ++row) {
+			float dot = host_dot(&A[row * n], x, n);
+			y[row] = (args->beta == 0)?(args->alpha * dot):(args->alpha * dot + args->beta * y[row]);
+		}
+	}
+}
+
+/*
+ * __kernel void gemv_batched(__const int m, __const int n, __const int batch_count, __const float alpha, 
+ *     __global const float * A, __global const float * x, __const float beta, __global float * y);
+*/
+static int host_gemv_batched(struct opencl_function * function)
+{
+	struct opencl_kernel * kernel = function->kernel;
+	struct host_gemm_args args = { 0 };
+	
+	if(host_get_arg(kernel, 0, sizeof(args.M), &args.M)
+		|| host_get_arg(kernel, 1, sizeof(args.N), &args.N)
+		|| host_get_arg(kernel, 2, sizeof(args.K), &args.K)
+		|| host_get_arg(kernel, 3, sizeof(args.alpha), &args.alpha)
+		|| host_get_arg(kernel, 4, sizeof(args.A), &args.A)
+		|| host_get_arg(kernel, 5, sizeof(args.B), &args.B)
+		|| host_get_arg(kernel, 6, sizeof(args.beta), &args.beta)
+		|| host_get_arg(kernel, 7, sizeof(args.C), &args.C)) return -1;
+	if(args.M <= 0 || args.N < 0 || args.K < 0) return -1;
+	
+	size_t matrix_size = (size_t)args.M * args.N + 1;
+	opencl_host_parallel_for(args.K, (HOST_MIN_CHUNK_SIZE * 4 + matrix_size - 1) / matrix_size, gemv_batched_job, &args);
+	return 0;
+}
+
+/*
+ * histogram (kernels/histogram.cl), each host work-group counts the same items as a device work-group:
+ *   the groups stride over the input by global_size, in blocks of local_size items.
+*/
+struct host_histogram_args
+{
+	size_t n;
+	const float * in;
+	unsigned int * partials;
+	size_t global_size;
+	size_t group_size;
+	size_t num_bins;
+	float min;
+	float scale;
+};
+
+static void host_histogram_init(struct host_histogram_args * args, const struct opencl_function * function)
+{
+	args->num_bins = opencl_host_function_get_define(function, "HISTOGRAM_NUM_BINS", 256);
+	args->min = opencl_host_function_get_define(function, "HISTOGRAM_MIN", 0.0);
+	float max = opencl_host_function_get_define(function, "HISTOGRAM_MAX", 1.0);
+	args->scale = (float)args->num_bins / (max - args->min);
+}
+
+static void histogram_float_job(void * user_data, size_t begin, size_t end)
+{
+	const struct host_histogram_args * args = user_data;
+	const float last_bin = (float)(args->num_bins - 1);
+	for(size_t group_id = begin; group_id < end; ++group_id) {
+		unsigned int * bins = &args->partials[group_id * args->num_bins];
+		memset(bins, 0, args->num_bins * sizeof(*bins));
+		
+		for(size_t first = group_id * args->group_size; first < args->n; first += args->global_size) {
+			size_t last = first + args->group_size;
+			if(last > args->n) last = args->n;
+			for(size_t i = first; i < last; ++i) {
+				float t = (args->in[i] - args->min) * args->scale;
+				size_t bin = 0;
+				if(t >= 0.0f) bin = (size_t)((t < last_bin)?t:last_bin);
+				++bins[bin];
+			}
+		}
+	}
+}
+
+/*
+ * __kernel void histogram_float(__const int n, __global const float * in, __global uint * partials);
+*/
+static int host_histogram_float(struct opencl_function * function)
+{
+	struct opencl_kernel * kernel = function->kernel;
+	cl_int n = 0;
+	struct host_histogram_args args = { 0 };
+	
+	if(host_get_arg(kernel, 0, sizeof(n), &n)
+		|| host_get_arg(kernel, 1, sizeof(args.in), &args.in)
+		|| host_get_arg(kernel, 2, sizeof(args.partials), &args.partials)) return -1;
+	
+	host_histogram_init(&args, function);
+	args.n = (n > 0)?n:0;
+	args.global_size = function->global_sizes[0];
+	args.group_size = function->local_sizes?function->local_sizes[0]:args.global_size;
+	assert(args.group_size > 0);
+	
+	size_t num_groups = (args.global_size + args.group_size - 1) / args.group_size;
+	args.global_size = num_groups * args.group_size;
+	opencl_host_parallel_for(num_groups, 1, histogram_float_job, &args);
+	return 0;
+}
+
+/*
+ * __kernel void histogram_merge(__global const uint * partials, __global uint * histogram);
+*/
+static int host_histogram_merge(struct opencl_function * function)
+{
+	struct opencl_kernel * kernel = function->kernel;
+	const unsigned int * partials = NULL;
+	unsigned int * histogram = NULL;
+	
+	if(host_get_arg(kernel, 0, sizeof(partials), &partials)
+		|| host_get_arg(kernel, 1, sizeof(histogram), &histogram)) return -1;
+	
+	struct host_histogram_args args = { 0 };
+	host_histogram_init(&args, function);
+	size_t global_size = function->global_sizes[0];
+	size_t group_size = function->local_sizes?function->local_sizes[0]:global_size;
+	assert(group_size > 0);
+	size_t num_groups = (global_size + group_size - 1) / group_size;
+	
+	memcpy(histogram, partials, args.num_bins * sizeof(*histogram));
+	for(size_t group_id = 1; group_id < num_groups; ++group_id) {
+		const unsigned int * bins = &partials[group_id * args.num_bins];
+		for(size_t bin = 0; bin < args.num_bins; ++bin) histogram[bin] += bins[bin];
+	}
+	return 0;
+}
+
+/*
+ * __kernel void histogram_info(__global float * info);
+*/
+static int host_histogram_info(struct opencl_function * function)
+{
+	float * info = NULL;
+	if(host_get_arg(function->kernel, 0, sizeof(info), &info)) return -1;
+	
+	info[0] = opencl_host_function_get_define(function, "HISTOGRAM_NUM_BINS", 256);
+	info[1] = opencl_host_function_get_define(function, "HISTOGRAM_MIN", 0.0);
+	info[2] = opencl_host_function_get_define(function, "HISTOGRAM_MAX", 1.0);
+	return 0;
+}
+
+/*
+ * persistent_batch(): the descriptors of kernels/persistent.cl (struct opencl_work_desc)
+*/
+#define HOST_WORK_OP_MUL_SCALAR (1)
+#define HOST_WORK_OP_ADD_SCALAR (2)
+#define HOST_WORK_DESCS_PER_CHUNK (64)
+struct host_work_desc
+{
+	cl_int op;
+	cl_int offset;
+	cl_int length;
+	cl_float a;
+};
+
+struct host_persistent_batch_args
+{
+	const struct host_work_desc * descs;
+	cl_uint first;
+	cl_uint capacity;
+	float * Y;
+	const float * X;
+};
+
+static void persistent_batch_job(void * user_data, size_t begin, size_t end)
+{
+	const struct host_persistent_batch_args * args = user_data;
+	for(size_t group_id = begin; group_id < end; ++group_id) {
+		const struct host_work_desc * desc = &args->descs[(args->first + group_id) % args->capacity];
+		float * y = args->Y + desc->offset;
+		const float * x = args->X + desc->offset;
+		switch(desc->op) {
+		case HOST_WORK_OP_MUL_SCALAR: for(cl_int i = 0; i < desc->length; ++i) y[i] = x[i] * desc->a; break;
+		case HOST_WORK_OP_ADD_SCALAR: for(cl_int i = 0; i < desc->length; ++i) y[i] = x[i] + desc->a; break;
+		default: break;
+		}
+	}
+}
+
+/*
+ * __kernel void persistent_batch(__global const struct work_desc * descs, __const uint first, __const uint capacity, 
+ *     __global float * Y, __global const float * X);
+ * one work-group per descriptor
+*/
+static int host_persistent_batch(struct opencl_function * function)
+{
+	struct opencl_kernel * kernel = function->kernel;
+	struct host_persistent_batch_args args = { NULL };
+	
+	if(host_get_arg(kernel, 0, sizeof(args.descs), &args.descs)
+		|| host_get_arg(kernel, 1, sizeof(args.first), &args.first)
+		|| host_get_arg(kernel, 2, sizeof(args.capacity), &args.capacity)
+		|| host_get_arg(kernel, 3, sizeof(args.Y), &args.Y)
+		|| host_get_arg(kernel, 4, sizeof(args.X), &args.X)) return -1;
+	if(0 == args.capacity) return -1;
+	
+	size_t global_size = function->global_sizes[0];
+	size_t group_size = function->local_sizes?function->local_sizes[0]:1;
+	assert(group_size > 0);
+	size_t num_groups = (global_size + group_size - 1) / group_size;
+	opencl_host_parallel_for(num_groups, HOST_WORK_DESCS_PER_CHUNK, persistent_batch_job, &args);
+	return 0;
+}
+
+static const struct host_kernel
+{
+	const char * name;
+	size_t num_args;
+	int (* execute)(struct opencl_function * function);
+}s_host_kernels[] = {
+	{ "vec_mul_scalar", 4, host_vec_mul_scalar },
+	{ "vec_add_scalar", 4, host_vec_add_scalar },
+	{ "vec_sum", 4, host_vec_sum },
+	{ "vec_sum_compensated", 5, host_vec_sum_compensated },
+	{ "vec_sum_double", 4, host_vec_sum_double },
+	{ "vec_mul_scalar_half", 4, host_vec_mul_scalar_half },
+	{ "vec_add_scalar_half", 4, host_vec_add_scalar_half },
+	{ "vec_sum_half", 4, host_vec_sum_half },
+	{ "vec_mul_scalar_bf16", 4, host_vec_mul_scalar_bf16 },
+	{ "vec_add_scalar_bf16", 4, host_vec_add_scalar_bf16 },
+	{ "vec_sum_bf16", 4, host_vec_sum_bf16 },
+	{ "scan_blocks_float", 6, host_scan_blocks_float },
+	{ "scan_blocks_int", 6, host_scan_blocks_cl_int },
+	{ "scan_add_offsets_float", 3, host_scan_add_offsets_float },
+	{ "scan_add_offsets_int", 3, host_scan_add_offsets_cl_int },
+	{ "radix_count", 5, host_radix_count },
+	{ "radix_scatter", 11, host_radix_scatter },
+	{ "compact_flags_float", 5, host_compact_flags_float },
+	{ "compact_flags_int", 5, host_compact_flags_cl_int },
+	{ "compact_scatter_float", 6, host_compact_scatter_float },
+	{ "compact_scatter_int", 6, host_compact_scatter_cl_int },
+	{ "sgemm", 8, host_sgemm },
+	{ "gemv_batched", 8, host_gemv_batched },
+	{ "histogram_float", 3, host_histogram_float },
+	{ "histogram_merge", 2, host_histogram_merge },
+	{ "histogram_info", 1, host_histogram_info },
+	{ "persistent_batch", 5, host_persistent_batch },
+};
+#define NUM_HOST_KERNELS (sizeof(s_host_kernels) / sizeof(s_host_kernels[0]))
+
+static const struct host_kernel * find_host_kernel(const char * kernel_name)
+{
+	if(NULL == kernel_name) return NULL;
+	for(size_t i = 0; i < NUM_HOST_KERNELS; ++i) {
+		if(strcmp(s_host_kernels[i].name, kernel_name) == 0) return &s_host_kernels[i];
+	}
+	return NULL;
+}
+
+int opencl_host_has_kernel(const char * kernel_name)
+{
+	return (NULL != find_host_kernel(kernel_name));
+}
+
+/* *
+struct opencl_function (host backend)
+* */
+static int host_function_execute(struct opencl_function * function, size_t num_waiting_events, const cl_event * waiting_events, cl_event * event)
+{
+	assert(function && function->priv);
+	assert(function->work_dim > 0 && function->global_sizes);
+
+	const struct host_kernel * host_kernel = ((const struct host_function *)function->priv)->kernel;
+	struct opencl_kernel * kernel = function->kernel;
+	if(kernel->num_args != host_kernel->num_args) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): %s: num_args mismatch (%d != %d)\n",
+			__FILE__, __LINE__, __FUNCTION__,
+			kernel->name, (int)kernel->num_args, (int)host_kernel->num_args);
+		return -1;
+	}
+
+	// the host backend executes synchronously,
+	// opencl events are only waited when the host and device functions are mixed.
+	if(num_waiting_events > 0 && waiting_events) {
+		cl_int ret = clWaitForEvents(num_waiting_events, waiting_events);
+		if(ret != CL_SUCCESS) return -1;
+	}
+	if(event) *event = NULL;
+
+	return host_kernel->execute(function);
+}
+
+struct opencl_function * opencl_host_function_init(struct opencl_function * function, const char * kernel_name)
+{
+	const struct host_kernel * host_kernel = find_host_kernel(kernel_name);
+	if(NULL == host_kernel) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): kernel '%s' has no host implementation\n",
+			__FILE__, __LINE__, __FUNCTION__,
+			kernel_name);
+		return NULL;
+	}
+
+	function = opencl_function_init(function, NULL, NULL);
+	assert(function);
+
+	struct host_function * host_function = calloc(1, sizeof(*host_function));
+	assert(host_function);
+	host_function->kernel = host_kernel;
+	pthread_mutex_lock(&s_build_options_mutex);
+	*host_function->defines = *s_build_options;
+	pthread_mutex_unlock(&s_build_options_mutex);
+
+	function->backend = opencl_backend_type_host;
+	function->priv = host_function;
+	function->on_free_priv = free;
+	function->execute = host_function_execute;
+	strncpy(function->kernel->name, kernel_name, sizeof(function->kernel->name) - 1);
+	return function;
+}
@@ -32,6 +32,9 @@
 #include <assert.h>
 
 #include <stdarg.h>
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
 #include "opencl-kernel.h"
 
 
@@ -146,82 +149,233 @@ static int program_load_builtin_kernels(struct opencl_program * program, const c
 	return 0;
 }
 
-static int program_compile(struct opencl_program * program, const char * options, size_t num_headers, const cl_program * headers, const char ** header_names)
+/*
+ * the logs of the devices having one: "device[i]:\n<log>"
+*/
+static char * program_capture_build_log(struct opencl_program * program)
+{
+	char * build_log = NULL;
+	size_t length = 0;
+	for(size_t i = 0; i < program->num_devices; ++i) {
+		ssize_t cb_log = opencl_program_get_build_log(program, program->device_ids[i], NULL, 0);
+		if(cb_log <= 1) continue;	// empty, or only the terminating null
+		
+		char header[64] = "";
+		int cb_header = snprintf(header, sizeof(header), "device[%d]:\n", (int)i);
+		char * p_log = realloc(build_log, length + cb_header + cb_log + 1);
+		assert(p_log);
+		build_log = p_log;
+		memcpy(build_log + length, header, cb_header);
+		length += cb_header;
+		
+		cb_log = opencl_program_get_build_log(program, program->device_ids[i], build_log + length, cb_log);
+		if(cb_log < 0) cb_log = 1;
+		length += cb_log - 1;
+		build_log[length++] = '\n';
+		build_log[length] = '\0';
+	}
+	return build_log;
+}
+
+/*
+ * a build has completed: check every device, capture the logs and notify the waiters.
+ * only the first call of a build completes it (the callback may race with the caller's error path)
+*/
+static void program_complete_build(struct opencl_program * program, cl_int err_code)
+{
+	pthread_mutex_lock(&program->mutex);
+	int is_completed = program->is_completed;
+	program->is_completed = 1;
+	pthread_mutex_unlock(&program->mutex);
+	if(is_completed) return;
+	
+	if(NULL == program->prog && CL_SUCCESS == err_code) err_code = CL_LINK_PROGRAM_FAILURE;
+	for(size_t i = 0; CL_SUCCESS == err_code && i < program->num_devices; ++i) {
+		cl_build_status status = CL_BUILD_NONE;
+		err_code = clGetProgramBuildInfo(program->prog, program->device_ids[i], CL_PROGRAM_BUILD_STATUS, sizeof(status), &status, NULL);
+		if(CL_SUCCESS == err_code && status != CL_BUILD_SUCCESS) err_code = CL_BUILD_PROGRAM_FAILURE;
+	}
+	char * build_log = program->prog?program_capture_build_log(program):NULL;
+	if(err_code != CL_SUCCESS) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): %s\n%s", 
+			__FILE__, __LINE__, __FUNCTION__, 
+			opencl_error_to_string(err_code), build_log?build_log:"");
+	}
+	
+	pthread_mutex_lock(&program->mutex);
+	free(program->build_log);
+	program->build_log = build_log;
+	program->err_code = err_code;
+	program->build_status = (CL_SUCCESS == err_code)?CL_BUILD_SUCCESS:CL_BUILD_ERROR;
+	opencl_program_built_func on_built = program->on_built;
+	void * user_data = program->user_data;
+	pthread_cond_broadcast(&program->cond);
+	pthread_mutex_unlock(&program->mutex);
+	
+	if(on_built) on_built(program, user_data);
+	
+	// the program can be cleaned up from now on
+	pthread_mutex_lock(&program->mutex);
+	program->is_pending = 0;
+	pthread_cond_broadcast(&program->cond);
+	pthread_mutex_unlock(&program->mutex);
+}
+
+static void program_wait_pending(struct opencl_program * program)
+{
+	pthread_mutex_lock(&program->mutex);
+	while(program->is_pending) pthread_cond_wait(&program->cond, &program->mutex);
+	pthread_mutex_unlock(&program->mutex);
+}
+
+static int program_start_build(struct opencl_program * program, opencl_program_built_func on_built, void * user_data)
 {
 	assert(program && program->ctx);
 	assert(program->num_devices > 0 && program->device_ids);
-	cl_int ret = 0;
-	cl_program prog = program->prog;
+	program_wait_pending(program);
 	
+	pthread_mutex_lock(&program->mutex);
 	program->build_status = CL_BUILD_IN_PROGRESS;
-	ret = clCompileProgram(prog, program->num_devices, program->device_ids,
-		options,
-		num_headers, headers, header_names,
-		NULL, NULL);
+	program->is_pending = 1;
+	program->is_completed = 0;
+	program->on_built = on_built;
+	program->user_data = user_data;
+	pthread_mutex_unlock(&program->mutex);
+	return 0;
+}
+
+static int program_build(struct opencl_program * program, const char * options)
+{
+	assert(program->prog);
+	int rc = program_start_build(program, NULL, NULL);
+	if(rc) return rc;
+	
+	cl_int ret = clBuildProgram(program->prog, program->num_devices, program->device_ids, options, NULL, NULL);
+	program_complete_build(program, ret);
+	return (program->build_status == CL_BUILD_SUCCESS)?0:-1;
+}
+
+static void CL_CALLBACK on_program_built(cl_program prog, void * user_data)
+{
+	struct opencl_program * program = user_data;
+	assert(program && program->prog == prog);
+	program_complete_build(program, CL_SUCCESS);
+}
+
+static int program_build_async(struct opencl_program * program, const char * options, opencl_program_built_func on_built, void * user_data)
+{
+	assert(program->prog);
+	int rc = program_start_build(program, on_built, user_data);
+	if(rc) return rc;
+	
+	cl_int ret = clBuildProgram(program->prog, program->num_devices, program->device_ids, options, on_program_built, program);
 	if(ret != CL_SUCCESS) {
-		fprintf(stderr, "[ERROR]::%s(%d)::%s(): %s\n", 
-			__FILE__, __LINE__, __FUNCTION__, 
-			opencl_error_to_string(ret));
-			
+		// the build could not be started (or failed synchronously), the callback may have been called already
+		program_complete_build(program, ret);
+		return -1;
+	}
+	return 0;
+}
+
+static int program_compile(struct opencl_program * program, const char * options, size_t num_headers, const cl_program * headers, const char ** header_names, 
+	opencl_program_built_func on_compiled, void * user_data)
+{
+	assert(program);
+	if(NULL == program->prog) {	// load_sources() must be called first
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): no sources loaded\n", 
+			__FILE__, __LINE__, __FUNCTION__);
 		program->build_status = CL_BUILD_ERROR;
 		return -1;
 	}
+	int rc = program_start_build(program, on_compiled, user_data);
+	if(rc) return rc;
 	
-	program->build_status = CL_BUILD_IN_PROGRESS;
-	return 0;
+	cl_int ret = clCompileProgram(program->prog, program->num_devices, program->device_ids,
+		options,
+		num_headers, headers, header_names,
+		on_compiled?on_program_built:NULL, on_compiled?program:NULL);
+	if(NULL == on_compiled || ret != CL_SUCCESS) program_complete_build(program, ret);
+	return (ret == CL_SUCCESS)?0:-1;
+}
+
+static void CL_CALLBACK on_program_linked(cl_program prog, void * user_data)
+{
+	struct opencl_program * program = user_data;
+	assert(program);
+	
+	// may be called before clLinkProgram() returns the program
+	pthread_mutex_lock(&program->mutex);
+	if(NULL == program->prog) program->prog = prog;
+	pthread_mutex_unlock(&program->mutex);
+	program_complete_build(program, CL_SUCCESS);
 }
 
-static int program_link(struct opencl_program * program, const char * options, size_t num_input_programs, const cl_program * input_programs)
+static int program_link(struct opencl_program * program, const char * options, size_t num_input_programs, const cl_program * input_programs, 
+	opencl_program_built_func on_linked, void * user_data)
 {
 	assert(program && program->ctx);
 	assert(program->num_devices > 0 && program->device_ids);
-	cl_int ret = 0;
-	cl_context ctx = program->ctx;
+	program_wait_pending(program);
 	
 	if(program->prog) {
 		clReleaseProgram(program->prog);
 		program->prog = NULL;
 	}
+	int rc = program_start_build(program, on_linked, user_data);
+	if(rc) return rc;
 	
-	program->build_status = CL_BUILD_IN_PROGRESS;
-	program->prog = clLinkProgram(ctx, program->num_devices, program->device_ids, 
+	cl_int ret = 0;
+	cl_program prog = clLinkProgram(program->ctx, program->num_devices, program->device_ids, 
 		options,
 		num_input_programs, input_programs, 
-		NULL, NULL, 
+		on_linked?on_program_linked:NULL, on_linked?program:NULL, 
 		&ret);
-	if(ret != CL_SUCCESS) {
-		fprintf(stderr, "[ERROR]::%s(%d)::%s(): %s\n", 
-			__FILE__, __LINE__, __FUNCTION__, 
-			opencl_error_to_string(ret));
-			
-		program->build_status = CL_BUILD_ERROR;
-		return -1;
-	}
 	
-	program->build_status = CL_BUILD_SUCCESS;
-	return 0;
+	pthread_mutex_lock(&program->mutex);
+	if(NULL == program->prog) program->prog = prog;
+	pthread_mutex_unlock(&program->mutex);
+	
+	if(NULL == on_linked || ret != CL_SUCCESS) program_complete_build(program, ret);
+	return (ret == CL_SUCCESS)?0:-1;
 }
 
-static int program_build(struct opencl_program * program, const char * options)
+static int program_wait(struct opencl_program * program, int timeout_ms)
 {
-	assert(program && program->ctx);
-	assert(program->num_devices > 0 && program->device_ids);
-	cl_int ret = 0;
-	cl_program prog = program->prog;
-	
-	program->build_status = CL_BUILD_IN_PROGRESS;
+	assert(program);
+	struct timespec deadline;
+	if(timeout_ms >= 0) {
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += timeout_ms / 1000;
+		deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+		if(deadline.tv_nsec >= 1000000000) {
+			++deadline.tv_sec;
+			deadline.tv_nsec -= 1000000000;
+		}
+	}
 	
-	ret = clBuildProgram(prog, program->num_devices, program->device_ids, options, NULL, NULL);
-	if(ret != CL_SUCCESS) {
-		fprintf(stderr, "[ERROR]::%s(%d)::%s(): %s\n", 
-			__FILE__, __LINE__, __FUNCTION__, 
-			opencl_error_to_string(ret));
-			
-		program->build_status = CL_BUILD_ERROR;
+	pthread_mutex_lock(&program->mutex);
+	while(program->build_status == CL_BUILD_IN_PROGRESS) {
+		int rc = 0;
+		if(timeout_ms < 0) rc = pthread_cond_wait(&program->cond, &program->mutex);
+		else rc = pthread_cond_timedwait(&program->cond, &program->mutex, &deadline);
+		if(rc == ETIMEDOUT) break;
+	}
+	int build_status = program->build_status;
+	pthread_mutex_unlock(&program->mutex);
+	return build_status;
+}
+
+int opencl_program_build_all(size_t num_programs, struct opencl_program ** programs, const char ** options)
+{
+	for(size_t i = 0; i < num_programs; ++i) {
+		programs[i]->build_async(programs[i], options?options[i]:NULL, NULL, NULL);
 	}
 	
-	program->build_status = CL_BUILD_SUCCESS;
-	return 0;
+	int rc = 0;
+	for(size_t i = 0; i < num_programs; ++i) {
+		if(programs[i]->wait(programs[i], -1) != CL_BUILD_SUCCESS) rc = -1;
+	}
+	return rc;
 }
 
 ssize_t opencl_program_get_build_log(struct opencl_program * program, cl_device_id device_id, char * build_log, size_t build_log_size)
@@ -257,10 +411,17 @@ struct opencl_program * opencl_program_init(struct opencl_program * program, cl_
 	program->compile = program_compile;
 	program->link = program_link;
 	program->build = program_build;
+	program->build_async = program_build_async;
+	program->wait = program_wait;
 	
 	program->ctx = ctx;
 	program->build_status = CL_BUILD_NONE;
 	
+	int rc = pthread_mutex_init(&program->mutex, NULL);
+	assert(0 == rc);
+	rc = pthread_cond_init(&program->cond, NULL);
+	assert(0 == rc);
+	
 	if(ctx) {
 		cl_int ret = clRetainContext(ctx); // add_ref
 		if(ret != CL_SUCCESS) {
@@ -288,6 +449,13 @@ struct opencl_program * opencl_program_init(struct opencl_program * program, cl_
 void opencl_program_cleanup(struct opencl_program * program)
 {
 	if(NULL == program) return;
+	program_wait_pending(program);	// the runtime may still call back into the program
+	
+	free(program->build_log);
+	program->build_log = NULL;
+	pthread_cond_destroy(&program->cond);
+	pthread_mutex_destroy(&program->mutex);
+	
 	cl_program prog = program->prog;
 	program->prog = NULL;
 	if(prog) clReleaseProgram(prog);
@@ -365,15 +533,264 @@ int opencl_kernel_set_args(struct opencl_kernel * kernel, size_t num_args, ... /
 	return 0;
 }
 
+int opencl_kernel_set_arg(struct opencl_kernel * kernel, size_t arg_index, size_t size, const void * arg)
+{
+	assert(kernel);
+	if(arg_index >= kernel->num_args) {
+		size_t num_args = arg_index + 1;
+		kernel->sizes = realloc(kernel->sizes, sizeof(*kernel->sizes) * num_args);
+		kernel->args = realloc(kernel->args, sizeof(*kernel->args) * num_args);
+		assert(kernel->sizes && kernel->args);
+		
+		for(size_t i = kernel->num_args; i < num_args; ++i) {
+			kernel->sizes[i] = 0;
+			kernel->args[i] = NULL;
+		}
+		kernel->num_args = num_args;
+	}
+	
+	kernel->sizes[arg_index] = size;
+	kernel->args[arg_index] = (void *)arg;
+	return 0;
+}
+
+/* *
+struct opencl_event_list
+* */
+static int event_list_reserve(struct opencl_event_list * list, size_t size)
+{
+	if(size <= list->size) return 0;
+	
+	size_t new_size = list->size * 2;
+	if(new_size < size) new_size = size;
+	
+	cl_event * events = NULL;
+	if(list->events == list->inline_events) {
+		events = malloc(sizeof(*events) * new_size);
+		if(events) memcpy(events, list->inline_events, sizeof(*events) * list->length);
+	}else {
+		events = realloc(list->events, sizeof(*events) * new_size);
+	}
+	if(NULL == events) return -1;
+	
+	list->events = events;
+	list->size = new_size;
+	return 0;
+}
+
+static int event_list_add(struct opencl_event_list * list, cl_event event)
+{
+	assert(list && list->events);
+	if(NULL == event) return 0;
+	for(size_t i = 0; i < list->length; ++i) {
+		if(list->events[i] == event) return 0;
+	}
+	
+	if(event_list_reserve(list, list->length + 1)) return -1;
+	clRetainEvent(event);
+	list->events[list->length++] = event;
+	return 0;
+}
+
+static cl_event event_list_remove(struct opencl_event_list * list, int index)
+{
+	assert(list);
+	if(index < 0 || index >= list->length) return NULL;
+	
+	cl_event event = list->events[index];
+	--list->length;
+	memmove(&list->events[index], &list->events[index + 1], sizeof(*list->events) * (list->length - index));
+	return event;
+}
+
+struct opencl_event_list * opencl_event_list_init(struct opencl_event_list * list, size_t size)
+{
+	if(NULL == list) list = calloc(1, sizeof(*list));
+	else memset(list, 0, sizeof(*list));
+	assert(list);
+	
+	list->add = event_list_add;
+	list->remove = event_list_remove;
+	list->events = list->inline_events;
+	list->size = OPENCL_EVENT_LIST_INLINE_SIZE;
+	
+	int rc = event_list_reserve(list, size);
+	assert(0 == rc);
+	return list;
+}
+
+void opencl_event_list_clear(struct opencl_event_list * list)
+{
+	if(NULL == list) return;
+	for(size_t i = 0; i < list->length; ++i) {
+		if(list->events[i]) clReleaseEvent(list->events[i]);
+		list->events[i] = NULL;
+	}
+	list->length = 0;
+}
+
+void opencl_event_list_cleanup(struct opencl_event_list * list)
+{
+	if(NULL == list) return;
+	opencl_event_list_clear(list);
+	if(list->events && list->events != list->inline_events) free(list->events);
+	list->events = list->inline_events;
+	list->size = OPENCL_EVENT_LIST_INLINE_SIZE;
+}
+
+int opencl_event_list_merge(struct opencl_event_list * list, const struct opencl_event_list * src)
+{
+	assert(list && src);
+	if(event_list_reserve(list, list->length + src->length)) return -1;
+	for(size_t i = 0; i < src->length; ++i) {
+		int rc = event_list_add(list, src->events[i]);
+		if(rc) return rc;
+	}
+	return 0;
+}
+
+int opencl_event_list_wait(struct opencl_event_list * list, int clear)
+{
+	assert(list);
+	cl_int ret = CL_SUCCESS;
+	if(list->length > 0) ret = clWaitForEvents(list->length, list->events);
+	if(clear) opencl_event_list_clear(list);
+	
+	if(ret != CL_SUCCESS) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): %s\n", 
+			__FILE__, __LINE__, __FUNCTION__, 
+			opencl_error_to_string(ret));
+		return -1;
+	}
+	return 0;
+}
+
+ssize_t opencl_event_list_prune(struct opencl_event_list * list)
+{
+	assert(list);
+	size_t length = 0;
+	for(size_t i = 0; i < list->length; ++i) {
+		cl_event event = list->events[i];
+		cl_int status = CL_QUEUED;
+		cl_int ret = clGetEventInfo(event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, NULL);
+		if(ret == CL_SUCCESS && status <= CL_COMPLETE) { // completed or terminated abnormally (< 0)
+			if(status < 0) {
+				fprintf(stderr, "[WARNING]::%s(%d)::%s(): event %p terminated with %s\n", 
+					__FILE__, __LINE__, __FUNCTION__, 
+					event, opencl_error_to_string(status));
+			}
+			clReleaseEvent(event);
+			continue;
+		}
+		list->events[length++] = event;
+	}
+	for(size_t i = length; i < list->length; ++i) list->events[i] = NULL;
+	list->length = length;
+	return length;
+}
+
 /* *
 struct opencl_function
 * */
+static size_t * dims_copy(size_t * dst, size_t work_dim, const size_t * src)
+{
+	if(NULL == src) {
+		if(dst) free(dst);
+		return NULL;
+	}
+	dst = realloc(dst, sizeof(*dst) * work_dim);
+	assert(dst);
+	memcpy(dst, src, sizeof(*dst) * work_dim);
+	return dst;
+}
+
 static int function_set_dims(struct opencl_function * function, size_t work_dim, const size_t * global_offsets, const size_t * global_sizes, const size_t * local_sizes)
 {
+	assert(function);
+	assert(work_dim >= 1 && work_dim <= 3);
+	assert(global_sizes);
+	
+	function->work_dim = work_dim;
+	function->global_offsets = dims_copy(function->global_offsets, work_dim, global_offsets);
+	function->global_sizes = dims_copy(function->global_sizes, work_dim, global_sizes);
+	function->local_sizes = dims_copy(function->local_sizes, work_dim, local_sizes);
 	return 0;
 }
+/*
+ * process-wide: guards the hazards of every buffer (and view), not only the ones shared by the caller's tasks.
+ * function_execute() holds it across clEnqueueNDRangeKernel(): the access is recorded with the kernel's event,
+ * so the launches of all the functions with bindings are serialized through it (the enqueue itself doesn't block).
+*/
+static pthread_mutex_t s_hazards_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 static int function_execute(struct opencl_function * function, size_t num_waiting_events, const cl_event * waiting_events, cl_event * event)
 {
+	assert(function && function->kernel->_kernel);
+	assert(function->work_dim > 0 && function->global_sizes);
+	
+	cl_int ret = 0;
+	struct opencl_kernel * kernel = function->kernel;
+	if(NULL == function->queue) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): no command queue\n", 
+			__FILE__, __LINE__, __FUNCTION__);
+		return -1;
+	}
+	
+	for(size_t i = 0; i < kernel->num_args; ++i) {
+		ret = clSetKernelArg(kernel->_kernel, i, kernel->sizes[i], kernel->args[i]);
+		if(ret != CL_SUCCESS) {
+			fprintf(stderr, "[ERROR]::%s(%d)::%s(): %s: set arg[%d] failed: %s\n", 
+				__FILE__, __LINE__, __FUNCTION__, 
+				kernel->name, (int)i, opencl_error_to_string(ret));
+			return -1;
+		}
+	}
+	
+	if(0 == function->num_bindings) {
+		ret = clEnqueueNDRangeKernel(function->queue, kernel->_kernel, function->work_dim,
+			function->global_offsets, function->global_sizes, function->local_sizes,
+			num_waiting_events, waiting_events, event);
+		if(ret != CL_SUCCESS) {
+			fprintf(stderr, "[ERROR]::%s(%d)::%s(): %s: %s\n", 
+				__FILE__, __LINE__, __FUNCTION__, 
+				kernel->name, opencl_error_to_string(ret));
+			return -1;
+		}
+		return 0;
+	}
+	
+	struct opencl_event_list * waiting_list = function->waiting_list;
+	pthread_mutex_lock(&s_hazards_mutex);
+	for(size_t i = 0; i < num_waiting_events; ++i) {
+		waiting_list->add(waiting_list, waiting_events[i]);
+	}
+	for(size_t i = 0; i < function->num_bindings; ++i) {
+		struct opencl_buffer_binding * binding = &function->bindings[i];
+		opencl_buffer_get_hazards(binding->buf, binding->access, waiting_list);
+	}
+	
+	cl_event ev = NULL;
+	ret = clEnqueueNDRangeKernel(function->queue, kernel->_kernel, function->work_dim,
+		function->global_offsets, function->global_sizes, function->local_sizes,
+		waiting_list->length, waiting_list->length?waiting_list->events:NULL, &ev);
+	if(ret == CL_SUCCESS) {
+		for(size_t i = 0; i < function->num_bindings; ++i) {
+			struct opencl_buffer_binding * binding = &function->bindings[i];
+			opencl_buffer_add_access(binding->buf, binding->access, ev);
+		}
+	}
+	pthread_mutex_unlock(&s_hazards_mutex);
+	opencl_event_list_clear(waiting_list);
+	
+	if(ret != CL_SUCCESS) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): %s: %s\n", 
+			__FILE__, __LINE__, __FUNCTION__, 
+			kernel->name, opencl_error_to_string(ret));
+		return -1;
+	}
+	
+	if(event) *event = ev;
+	else clReleaseEvent(ev);
 	return 0;
 }
 
@@ -388,6 +805,7 @@ struct opencl_function * opencl_function_init(struct opencl_function * function,
 	
 	function->set_dims = function_set_dims;
 	function->execute = function_execute;
+	opencl_event_list_init(function->waiting_list, 0);
 	
 	if(program && kernel_name) {
 		struct opencl_kernel * kernel = opencl_kernel_init((struct opencl_kernel *)function, program, kernel_name);
@@ -397,9 +815,18 @@ struct opencl_function * opencl_function_init(struct opencl_function * function,
 	return function;
 }
 
+static int is_user_event(cl_event event)
+{
+	cl_command_type type = 0;
+	cl_int ret = clGetEventInfo(event, CL_EVENT_COMMAND_TYPE, sizeof(type), &type, NULL);
+	return (CL_SUCCESS == ret && CL_COMMAND_USER == type);
+}
+
 void opencl_function_cleanup(struct opencl_function * function)
 {
 	opencl_kernel_cleanup(function->kernel);
+	if(function->priv && function->on_free_priv) function->on_free_priv(function->priv);
+	function->priv = NULL;
 	
 	if(function->global_offsets) free(function->global_offsets);
 	if(function->global_sizes) free(function->global_sizes);
@@ -409,30 +836,176 @@ void opencl_function_cleanup(struct opencl_function * function)
 	function->global_sizes = NULL;
 	function->local_sizes = NULL;
 	
+	if(function->bindings) free(function->bindings);
+	function->bindings = NULL;
+	function->num_bindings = 0;
+	opencl_event_list_cleanup(function->waiting_list);
+	
 	if(function->event) {
-		clSetUserEventStatus(function->event, CL_COMPLETE);
+		// only user events can be completed by the host, others must be drained (clFinish) before cleanup
+		if(is_user_event(function->event)) clSetUserEventStatus(function->event, CL_COMPLETE);
 		clReleaseEvent(function->event);
 		function->event = NULL;
 	}
 	return;
 }
 
-/* *
-struct opencl_buffer
+int opencl_function_bind_buffer(struct opencl_function * function, size_t arg_index, struct opencl_buffer * buf, enum opencl_buffer_access access)
 {
-	cl_mem gpu_data;
-	size_t size;
-	cl_mem_flags flags;
+	assert(function && buf);
+	assert(access & opencl_buffer_access_read_write);
+	
+	struct opencl_kernel * kernel = function->kernel;
+	if(arg_index >= kernel->num_args) {	// opencl_function_set_args() must be called first
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): %s: invalid arg_index %d\n", 
+			__FILE__, __LINE__, __FUNCTION__, 
+			kernel->name, (int)arg_index);
+		return -1;
+	}
 	
-	void * cpu_data;
-	void (* on_cpu_data_free)(void *);
+	if(function->backend == opencl_backend_type_host) {
+		kernel->sizes[arg_index] = sizeof(buf->cpu_data);
+		kernel->args[arg_index] = &buf->cpu_data;
+	}else {
+		kernel->sizes[arg_index] = sizeof(buf->gpu_data);
+		kernel->args[arg_index] = &buf->gpu_data;
+	}
 	
-	const opencl_event_list * waiting_list;
-	cl_event event;
-	cl_int err_code;
-};
-* */
+	struct opencl_buffer_binding * binding = NULL;
+	for(size_t i = 0; i < function->num_bindings; ++i) {
+		if(function->bindings[i].arg_index == arg_index) {
+			binding = &function->bindings[i];
+			break;
+		}
+	}
+	if(NULL == binding) {
+		binding = realloc(function->bindings, sizeof(*binding) * (function->num_bindings + 1));
+		assert(binding);
+		function->bindings = binding;
+		binding += function->num_bindings++;
+	}
+	binding->arg_index = arg_index;
+	binding->buf = buf;
+	binding->access = access;
+	return 0;
+}
 
+size_t opencl_function_get_max_work_group_size(const struct opencl_function * function)
+{
+	assert(function);
+	if(NULL == function->kernel->_kernel || NULL == function->queue) return 0;
+	
+	cl_device_id device = NULL;
+	size_t max_size = 0;
+	cl_int ret = clGetCommandQueueInfo(function->queue, CL_QUEUE_DEVICE, sizeof(device), &device, NULL);
+	if(ret == CL_SUCCESS) ret = clGetKernelWorkGroupInfo(function->kernel->_kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(max_size), &max_size, NULL);
+	if(ret != CL_SUCCESS) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): %s: %s\n", 
+			__FILE__, __LINE__, __FUNCTION__, 
+			function->kernel->name, opencl_error_to_string(ret));
+		return 0;
+	}
+	return max_size;
+}
+
+int opencl_function_set_svm_buffers(struct opencl_function * function, size_t num_buffers, struct opencl_buffer ** buffers)
+{
+	assert(function && (0 == num_buffers || buffers));
+	if(function->backend == opencl_backend_type_host) return 0;	// host pointers
+	
+#if defined(CL_TARGET_OPENCL_VERSION) && (CL_TARGET_OPENCL_VERSION >= 200)
+	void ** svm_ptrs = calloc(num_buffers + 1, sizeof(*svm_ptrs));
+	assert(svm_ptrs);
+	for(size_t i = 0; i < num_buffers; ++i) {
+		if(NULL == buffers[i]->svm_data) {
+			fprintf(stderr, "[ERROR]::%s(%d)::%s(): %s: buffers[%d] is not a SVM buffer\n", 
+				__FILE__, __LINE__, __FUNCTION__, 
+				function->kernel->name, (int)i);
+			free(svm_ptrs);
+			return -1;
+		}
+		svm_ptrs[i] = buffers[i]->svm_data;
+	}
+	cl_int ret = clSetKernelExecInfo(function->kernel->_kernel, CL_KERNEL_EXEC_INFO_SVM_PTRS, num_buffers * sizeof(*svm_ptrs), svm_ptrs);
+	free(svm_ptrs);
+	if(ret != CL_SUCCESS) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): %s: %s\n", 
+			__FILE__, __LINE__, __FUNCTION__, 
+			function->kernel->name, opencl_error_to_string(ret));
+		return -1;
+	}
+	return 0;
+#else
+	fprintf(stderr, "[ERROR]::%s(%d)::%s(): %s: SVM requires CL_TARGET_OPENCL_VERSION >= 200\n", 
+		__FILE__, __LINE__, __FUNCTION__, 
+		function->kernel->name);
+	return -1;
+#endif
+}
+
+#define OPENCL_GRID_ITEMS_PER_CU (2048)	// resident work-items per compute unit (GPUs)
+size_t opencl_get_grid_size(cl_kernel kernel, cl_device_id device, size_t n, size_t local_size)
+{
+	assert(kernel && device && local_size > 0);
+	size_t global_size = (n + local_size - 1) / local_size * local_size;
+	
+	cl_device_type type = 0;
+	cl_uint num_compute_units = 0;
+	cl_ulong device_local_mem_size = 0;
+	cl_ulong kernel_local_mem_size = 0;
+	cl_int ret = clGetDeviceInfo(device, CL_DEVICE_TYPE, sizeof(type), &type, NULL);
+	if(ret == CL_SUCCESS) ret = clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(num_compute_units), &num_compute_units, NULL);
+	if(ret == CL_SUCCESS) ret = clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(device_local_mem_size), &device_local_mem_size, NULL);
+	if(ret == CL_SUCCESS) ret = clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_LOCAL_MEM_SIZE, sizeof(kernel_local_mem_size), &kernel_local_mem_size, NULL);
+	if(ret != CL_SUCCESS || 0 == num_compute_units) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): %s\n", 
+			__FILE__, __LINE__, __FUNCTION__, 
+			opencl_error_to_string(ret));
+		return global_size;	// unbounded
+	}
+	
+	// occupancy: the work-groups resident on a compute unit
+	size_t groups_per_cu = 1;
+	if(!(type & CL_DEVICE_TYPE_CPU)) {
+		groups_per_cu = OPENCL_GRID_ITEMS_PER_CU / local_size;
+		if(kernel_local_mem_size > 0 && groups_per_cu > device_local_mem_size / kernel_local_mem_size) {
+			groups_per_cu = device_local_mem_size / kernel_local_mem_size;
+		}
+		if(groups_per_cu < 1) groups_per_cu = 1;
+	}
+	
+	size_t max_global_size = (size_t)num_compute_units * groups_per_cu * local_size;
+	return (global_size < max_global_size)?global_size:max_global_size;
+}
+
+size_t opencl_function_get_grid_size(const struct opencl_function * function, size_t n, size_t local_size)
+{
+	assert(function && local_size > 0);
+	if(function->backend == opencl_backend_type_host || NULL == function->queue) {
+		return (n + local_size - 1) / local_size * local_size;
+	}
+	
+	cl_device_id device = NULL;
+	cl_int ret = clGetCommandQueueInfo(function->queue, CL_QUEUE_DEVICE, sizeof(device), &device, NULL);
+	if(ret != CL_SUCCESS) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): %s: %s\n", 
+			__FILE__, __LINE__, __FUNCTION__, 
+			function->kernel->name, opencl_error_to_string(ret));
+		return (n + local_size - 1) / local_size * local_size;
+	}
+	
+	// the __local args count against the kernel's local memory once they are set
+	const struct opencl_kernel * kernel = function->kernel;
+	for(size_t i = 0; i < kernel->num_args; ++i) {
+		clSetKernelArg(kernel->_kernel, i, kernel->sizes[i], kernel->args[i]);
+	}
+	return opencl_get_grid_size(kernel->_kernel, device, n, local_size);
+}
+
+/* *
+struct opencl_buffer
+* */
+#define OPENCL_HOST_BUFFER_ALIGNMENT (64)
 struct opencl_buffer * opencl_buffer_init(struct opencl_buffer * buf, cl_context ctx, cl_mem_flags flags, size_t size, const void * cpu_data)
 {
 	if(NULL == buf) buf = calloc(1, sizeof(*buf));
@@ -440,20 +1013,61 @@ struct opencl_buffer * opencl_buffer_init(struct opencl_buffer * buf, cl_context
 	assert(buf);
 	
 	assert(size > 0);
+	buf->size = size;
+	buf->flags = flags;
+	opencl_event_list_init(buf->reads, 0);
+	
+	if(NULL == ctx) { // host buffer
+		void * data = NULL;
+		int rc = posix_memalign(&data, OPENCL_HOST_BUFFER_ALIGNMENT, size);
+		assert(0 == rc && data);
+		if(cpu_data) memcpy(data, cpu_data, size);
+		else memset(data, 0, size);
+		
+		buf->cpu_data = data;
+		buf->on_free_cpu_data = free;
+		return buf;
+	}
+	
 	buf->gpu_data = clCreateBuffer(ctx, flags, size, (void *)cpu_data, &buf->err_code);
 	check_error(buf->err_code);
 	
+	if(flags & CL_MEM_USE_HOST_PTR) buf->cpu_data = (void *)cpu_data;
 	return buf;
 }
+
+void opencl_buffer_reset_hazards(struct opencl_buffer * buf)
+{
+	assert(buf);
+	if(buf->event) {
+		clReleaseEvent(buf->event);
+		buf->event = NULL;
+	}
+	opencl_event_list_clear(buf->reads);
+	return;
+}
+
 void opencl_buffer_cleanup(struct opencl_buffer * buf)
 {
 	if(NULL == buf) return;
 	
-	buf->waiting_list = NULL;
-	if(buf->event) {
-		clSetUserEventStatus(buf->event, CL_COMPLETE);
-		buf->event = NULL;
+	pthread_mutex_lock(&s_hazards_mutex);
+	struct opencl_buffer * parent = buf->parent;
+	for(size_t i = 0; parent && i < parent->num_views; ++i) {
+		if(parent->views[i] != buf) continue;
+		parent->views[i] = parent->views[--parent->num_views];
+		break;
 	}
+	for(size_t i = 0; i < buf->num_views; ++i) buf->views[i]->parent = NULL;	// the views should have been cleaned up first
+	free(buf->views);
+	buf->views = NULL;
+	buf->num_views = 0;
+	buf->parent = NULL;
+	buf->origin = 0;
+	pthread_mutex_unlock(&s_hazards_mutex);
+	
+	opencl_buffer_reset_hazards(buf);
+	opencl_event_list_cleanup(buf->reads);
 	
 	if(buf->cpu_data && buf->on_free_cpu_data) {
 		buf->on_free_cpu_data(buf->cpu_data);
@@ -465,22 +1079,521 @@ void opencl_buffer_cleanup(struct opencl_buffer * buf)
 		buf->gpu_data = NULL;
 	}
 	
+#if defined(CL_TARGET_OPENCL_VERSION) && (CL_TARGET_OPENCL_VERSION >= 200)
+	// after the cl_mem wrapping it
+	if(buf->svm_data) clSVMFree(buf->svm_ctx, buf->svm_data);
+#endif
+	buf->svm_data = NULL;
+	buf->svm_ctx = NULL;
+	buf->type = opencl_buffer_type_mem;
+	buf->mapped_data = NULL;
+	
 	buf->size = 0;
 	buf->flags = 0;
 	return;
 }
 
-void * opencl_buffer_enqueue_read(struct opencl_buffer * buf, cl_command_queue queue, cl_bool blocking, size_t offset, size_t length, const void * cpu_data)
+int opencl_buffer_reserve(struct opencl_buffer * buf, cl_context ctx, cl_mem_flags flags, size_t size)
+{
+	assert(buf && size > 0);
+	if(buf->size >= size) return 0;
+	
+	if(buf->size) opencl_buffer_cleanup(buf);
+	opencl_buffer_init(buf, ctx, flags, size, NULL);
+	if(buf->err_code != CL_SUCCESS) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): failed to allocate %lu bytes: %s\n", 
+			__FILE__, __LINE__, __FUNCTION__, 
+			(unsigned long)size, opencl_error_to_string(buf->err_code));
+		opencl_buffer_cleanup(buf);
+		return -1;
+	}
+	return 0;
+}
+
+static int buffer_get_own_hazards(const struct opencl_buffer * buf, enum opencl_buffer_access access, struct opencl_event_list * waiting_list)
+{
+	// RAW and WAW: wait for the last writer
+	int rc = waiting_list->add(waiting_list, buf->event);
+	
+	// WAR: a writer waits for all readers since the last write
+	if(0 == rc && (access & opencl_buffer_access_write)) {
+		rc = opencl_event_list_merge(waiting_list, buf->reads);
+	}
+	return rc;
+}
+
+static int is_overlapped(const struct opencl_buffer * a, const struct opencl_buffer * b)
+{
+	return (a->origin < b->origin + b->size) && (b->origin < a->origin + a->size);
+}
+
+int opencl_buffer_get_hazards(const struct opencl_buffer * buf, enum opencl_buffer_access access, struct opencl_event_list * waiting_list)
+{
+	assert(buf && waiting_list);
+	int rc = buffer_get_own_hazards(buf, access, waiting_list);
+	
+	// views: the accesses of the whole parent and of the overlapping views,
+	// parent: the accesses of all its views
+	const struct opencl_buffer * parent = buf->parent?buf->parent:buf;
+	if(0 == rc && parent != buf) rc = buffer_get_own_hazards(parent, access, waiting_list);
+	for(size_t i = 0; 0 == rc && i < parent->num_views; ++i) {
+		const struct opencl_buffer * view = parent->views[i];
+		if(view == buf || (parent != buf && !is_overlapped(view, buf))) continue;
+		rc = buffer_get_own_hazards(view, access, waiting_list);
+	}
+	return rc;
+}
+
+void opencl_buffer_add_access(struct opencl_buffer * buf, enum opencl_buffer_access access, cl_event event)
+{
+	assert(buf);
+	if(NULL == event) return;
+	
+	if(access & opencl_buffer_access_write) {
+		// the new writer has waited for all previous accesses (of the views too)
+		opencl_buffer_reset_hazards(buf);
+		for(size_t i = 0; i < buf->num_views; ++i) opencl_buffer_reset_hazards(buf->views[i]);
+		clRetainEvent(event);
+		buf->event = event;
+		return;
+	}
+	
+	struct opencl_event_list * reads = buf->reads;
+	if(reads->length >= reads->size) opencl_event_list_prune(reads);	// drop the finished readers before growing
+	int rc = reads->add(reads, event);
+	assert(0 == rc);
+	return;
+}
+
+/*
+ * a command without data transfer, ordered as an access of the buffer:
+ *   marker (fine-grained SVM, the host sees the data in place), map or unmap
+*/
+enum buffer_command
+{
+	buffer_command_marker,
+	buffer_command_map,
+	buffer_command_unmap,
+};
+static int buffer_enqueue_command(struct opencl_buffer * buf, cl_command_queue queue, cl_bool blocking, 
+	enum opencl_buffer_access access, enum buffer_command command)
+{
+	cl_int ret = 0;
+	struct opencl_event_list waiting_list[1];
+	opencl_event_list_init(waiting_list, 0);
+	
+	pthread_mutex_lock(&s_hazards_mutex);
+	opencl_buffer_get_hazards(buf, access, waiting_list);
+	cl_event * events = waiting_list->length?waiting_list->events:NULL;
+	cl_event ev = NULL;
+	switch(command) {
+	case buffer_command_map:
+		buf->mapped_data = clEnqueueMapBuffer(queue, buf->gpu_data, CL_FALSE, 
+			(access & opencl_buffer_access_write)?(CL_MAP_READ | CL_MAP_WRITE):CL_MAP_READ, 
+			0, buf->size, waiting_list->length, events, &ev, &ret);
+		break;
+	case buffer_command_unmap:
+		ret = clEnqueueUnmapMemObject(queue, buf->gpu_data, buf->mapped_data, waiting_list->length, events, &ev);
+		break;
+	default:
+		ret = clEnqueueMarkerWithWaitList(queue, waiting_list->length, events, &ev);
+		break;
+	}
+	if(ret == CL_SUCCESS) opencl_buffer_add_access(buf, access, ev);
+	pthread_mutex_unlock(&s_hazards_mutex);
+	opencl_event_list_cleanup(waiting_list);
+	
+	buf->err_code = ret;
+	if(ret != CL_SUCCESS) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): %s\n", 
+			__FILE__, __LINE__, __FUNCTION__, 
+			opencl_error_to_string(ret));
+		return -1;
+	}
+	
+	if(blocking) ret = clWaitForEvents(1, &ev);
+	clReleaseEvent(ev);
+	return (ret == CL_SUCCESS)?0:-1;
+}
+
+static int buffer_enqueue_transfer(struct opencl_buffer * buf, cl_command_queue queue, cl_bool blocking, 
+	enum opencl_buffer_access access, size_t offset, size_t length, void * cpu_data)
+{
+	cl_int ret = 0;
+	struct opencl_event_list waiting_list[1];
+	opencl_event_list_init(waiting_list, 0);
+	
+	pthread_mutex_lock(&s_hazards_mutex);
+	// reading from the device is a read access of the buffer, writing to the device is a write access
+	opencl_buffer_get_hazards(buf, access, waiting_list);
+	cl_event * events = waiting_list->length?waiting_list->events:NULL;
+	cl_event ev = NULL;
+	if(access & opencl_buffer_access_write) {
+		ret = clEnqueueWriteBuffer(queue, buf->gpu_data, CL_FALSE, offset, length, cpu_data,
+			waiting_list->length, events, &ev);
+	}else {
+		ret = clEnqueueReadBuffer(queue, buf->gpu_data, CL_FALSE, offset, length, cpu_data,
+			waiting_list->length, events, &ev);
+	}
+	if(ret == CL_SUCCESS) opencl_buffer_add_access(buf, access, ev);
+	pthread_mutex_unlock(&s_hazards_mutex);
+	opencl_event_list_cleanup(waiting_list);
+	
+	buf->err_code = ret;
+	if(ret != CL_SUCCESS) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): %s\n", 
+			__FILE__, __LINE__, __FUNCTION__, 
+			opencl_error_to_string(ret));
+		return -1;
+	}
+	
+	// wait outside the lock, other tasks can keep enqueuing commands
+	if(blocking) ret = clWaitForEvents(1, &ev);
+	clReleaseEvent(ev);
+	return (ret == CL_SUCCESS)?0:-1;
+}
+
+/*
+ * read [offset, offset + length) from the device to cpu_data (default: buf->cpu_data + offset)
+ * return the host pointer
+*/
+void * opencl_buffer_enqueue_read(struct opencl_buffer * buf, cl_command_queue queue, cl_bool blocking, size_t offset, size_t length, void * cpu_data)
 {
 	assert(buf);
 	assert(length > 0);
+	assert(offset + length <= buf->size);
+	
+	void * dst = cpu_data;
+	if(NULL == dst) {
+		if(NULL == buf->cpu_data) return NULL;
+		dst = (char *)buf->cpu_data + offset;
+	}
+	
+	if(NULL == buf->gpu_data) { // host buffer
+		if(dst != (char *)buf->cpu_data + offset) memcpy(dst, (char *)buf->cpu_data + offset, length);
+		return dst;
+	}
 	
+	// fine-grained SVM: the data is already in place once the writers are done
+	if(buf->type == opencl_buffer_type_svm_fine && dst == (char *)buf->cpu_data + offset) {
+		int rc = buffer_enqueue_command(buf, queue, blocking, opencl_buffer_access_read, buffer_command_marker);
+		return (0 == rc)?dst:NULL;
+	}
 	
-	// todo:
-	return NULL;
+	int rc = buffer_enqueue_transfer(buf, queue, blocking, opencl_buffer_access_read, offset, length, dst);
+	return (0 == rc)?dst:NULL;
 }
+
+/*
+ * write [offset, offset + length) from buf->cpu_data to the device
+*/
 int opencl_buffer_enqueue_write(struct opencl_buffer * buf, cl_command_queue queue, cl_bool blocking, size_t offset, size_t length)
 {
-	// todo:
-	return -1;
+	assert(buf);
+	assert(length > 0);
+	assert(offset + length <= buf->size);
+	
+	if(NULL == buf->cpu_data) return -1;
+	if(NULL == buf->gpu_data) return 0; // host buffer
+	
+	// fine-grained SVM: the host has written the shared memory, the marker is the write the next readers wait for
+	if(buf->type == opencl_buffer_type_svm_fine) {
+		return buffer_enqueue_command(buf, queue, blocking, opencl_buffer_access_write, buffer_command_marker);
+	}
+	
+	return buffer_enqueue_transfer(buf, queue, blocking, opencl_buffer_access_write, offset, length, (char *)buf->cpu_data + offset);
+}
+
+const char * opencl_buffer_type_to_string(enum opencl_buffer_type type)
+{
+	switch(type) {
+	case opencl_buffer_type_mem: return "cl_mem";
+	case opencl_buffer_type_svm_coarse: return "svm_coarse";
+	case opencl_buffer_type_svm_fine: return "svm_fine";
+	default: break;
+	}
+	return "unknown";
+}
+
+#if defined(CL_TARGET_OPENCL_VERSION) && (CL_TARGET_OPENCL_VERSION >= 200)
+// the preferred type if the device supports it, or the next one down
+static enum opencl_buffer_type svm_get_supported_type(cl_device_id device, cl_mem_flags flags, enum opencl_buffer_type type)
+{
+	char version[100] = "";
+	int major = 0;
+	cl_device_svm_capabilities caps = 0;
+	cl_int ret = clGetDeviceInfo(device, CL_DEVICE_VERSION, sizeof(version) - 1, version, NULL);
+	if(ret != CL_SUCCESS || sscanf(version, "OpenCL %d", &major) != 1 || major < 2) return opencl_buffer_type_mem;
+	ret = clGetDeviceInfo(device, CL_DEVICE_SVM_CAPABILITIES, sizeof(caps), &caps, NULL);
+	if(ret != CL_SUCCESS) return opencl_buffer_type_mem;
+	
+	cl_device_svm_capabilities fine_caps = CL_DEVICE_SVM_FINE_GRAIN_BUFFER;
+	if(flags & CL_MEM_SVM_ATOMICS) fine_caps |= CL_DEVICE_SVM_ATOMICS;
+	if(type == opencl_buffer_type_svm_fine && (caps & fine_caps) == fine_caps) return opencl_buffer_type_svm_fine;
+	if(caps & CL_DEVICE_SVM_COARSE_GRAIN_BUFFER) return opencl_buffer_type_svm_coarse;
+	return opencl_buffer_type_mem;
+}
+#endif
+
+struct opencl_buffer * opencl_buffer_init_svm(struct opencl_buffer * buf, cl_context ctx, cl_device_id device, 
+	cl_mem_flags flags, size_t size, const void * cpu_data, enum opencl_buffer_type type)
+{
+	assert(ctx && device);
+	assert(size > 0);
+	
+#if defined(CL_TARGET_OPENCL_VERSION) && (CL_TARGET_OPENCL_VERSION >= 200)
+	if(type != opencl_buffer_type_mem) type = svm_get_supported_type(device, flags, type);
+	
+	cl_mem_flags access = flags & (CL_MEM_READ_WRITE | CL_MEM_READ_ONLY | CL_MEM_WRITE_ONLY);
+	if(0 == access) access = CL_MEM_READ_WRITE;
+	void * svm_data = NULL;
+	if(type != opencl_buffer_type_mem) {
+		cl_svm_mem_flags svm_flags = access;
+		if(type == opencl_buffer_type_svm_fine) svm_flags |= CL_MEM_SVM_FINE_GRAIN_BUFFER | (flags & CL_MEM_SVM_ATOMICS);
+		svm_data = clSVMAlloc(ctx, svm_flags, size, 0);
+		if(NULL == svm_data) {
+			fprintf(stderr, "[ERROR]::%s(%d)::%s(): failed to allocate %lu bytes of %s, fallback to cl_mem\n", 
+				__FILE__, __LINE__, __FUNCTION__, 
+				(unsigned long)size, opencl_buffer_type_to_string(type));
+			type = opencl_buffer_type_mem;
+		}
+	}
+	
+	if(type != opencl_buffer_type_mem) {
+		buf = opencl_buffer_init(buf, ctx, access | CL_MEM_USE_HOST_PTR, size, svm_data);
+		buf->type = type;
+		buf->svm_data = svm_data;
+		buf->svm_ctx = ctx;
+		if(buf->err_code != CL_SUCCESS) return buf;
+		
+		if(type == opencl_buffer_type_svm_fine) {
+			if(cpu_data) memcpy(svm_data, cpu_data, size);
+			return buf;
+		}
+		
+		// coarse-grained: the host accesses it by map / unmap only, the initial data is copied by a temporary queue
+		buf->cpu_data = NULL;
+		if(cpu_data) {
+			cl_command_queue queue = clCreateCommandQueueWithProperties(ctx, device, NULL, &buf->err_code);
+			if(buf->err_code == CL_SUCCESS) {
+				buf->err_code = clEnqueueSVMMemcpy(queue, CL_TRUE, svm_data, cpu_data, size, 0, NULL, NULL);
+				clReleaseCommandQueue(queue);
+			}
+			check_error(buf->err_code);
+		}
+		return buf;
+	}
+#else
+	(void)device;
+#endif
+	
+	// cl_mem (OpenCL 1.x)
+#ifdef CL_MEM_SVM_ATOMICS
+	flags &= ~(cl_mem_flags)CL_MEM_SVM_ATOMICS;
+#endif
+	buf = opencl_buffer_init(buf, ctx, flags, size, cpu_data);
+	buf->type = opencl_buffer_type_mem;
+	return buf;
+}
+
+void * opencl_buffer_map(struct opencl_buffer * buf, cl_command_queue queue, enum opencl_buffer_access access)
+{
+	assert(buf);
+	assert(access & opencl_buffer_access_read_write);
+	if(NULL == buf->gpu_data) return buf->cpu_data;	// host buffer
+	if(buf->mapped_data) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): already mapped\n", 
+			__FILE__, __LINE__, __FUNCTION__);
+		return NULL;
+	}
+	
+	// fine-grained SVM: wait for the commands, the host accesses it in place
+	if(buf->type == opencl_buffer_type_svm_fine) {
+		if(buffer_enqueue_command(buf, queue, CL_TRUE, access, buffer_command_marker)) return NULL;
+		buf->map_access = access;
+		buf->mapped_data = buf->cpu_data;
+		return buf->mapped_data;
+	}
+	
+	if(buffer_enqueue_command(buf, queue, CL_TRUE, access, buffer_command_map)) return NULL;
+	buf->map_access = access;
+	return buf->mapped_data;
+}
+
+int opencl_buffer_unmap(struct opencl_buffer * buf, cl_command_queue queue)
+{
+	assert(buf);
+	if(NULL == buf->gpu_data) return 0;	// host buffer
+	if(NULL == buf->mapped_data) return -1;
+	
+	int rc = 0;
+	if(buf->type != opencl_buffer_type_svm_fine) {
+		// the commands enqueued after it wait for the host's writes
+		rc = buffer_enqueue_command(buf, queue, CL_FALSE, buf->map_access, buffer_command_unmap);
+	}
+	buf->mapped_data = NULL;
+	return rc;
+}
+
+size_t opencl_buffer_get_alignment(cl_context ctx)
+{
+	if(NULL == ctx) return OPENCL_HOST_BUFFER_ALIGNMENT;
+	
+	cl_uint num_devices = 0;
+	cl_device_id devices[64];
+	cl_int ret = clGetContextInfo(ctx, CL_CONTEXT_NUM_DEVICES, sizeof(num_devices), &num_devices, NULL);
+	if(ret == CL_SUCCESS && num_devices > 64) num_devices = 64;
+	if(ret == CL_SUCCESS) ret = clGetContextInfo(ctx, CL_CONTEXT_DEVICES, sizeof(*devices) * num_devices, devices, NULL);
+	
+	size_t alignment = OPENCL_HOST_BUFFER_ALIGNMENT;
+	for(cl_uint i = 0; ret == CL_SUCCESS && i < num_devices; ++i) {
+		cl_uint align_bits = 0;
+		ret = clGetDeviceInfo(devices[i], CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(align_bits), &align_bits, NULL);
+		if(ret == CL_SUCCESS && align_bits / 8 > alignment) alignment = align_bits / 8;
+	}
+	if(ret != CL_SUCCESS) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): %s\n", 
+			__FILE__, __LINE__, __FUNCTION__, 
+			opencl_error_to_string(ret));
+		return 0;
+	}
+	return alignment;
+}
+
+static const cl_mem_flags s_access_flags = CL_MEM_READ_WRITE | CL_MEM_READ_ONLY | CL_MEM_WRITE_ONLY;
+static int view_create_mem(struct opencl_buffer * view)
+{
+	cl_buffer_region region = { .origin = view->origin, .size = view->size };
+	view->gpu_data = clCreateSubBuffer(view->parent->gpu_data, view->flags & s_access_flags, CL_BUFFER_CREATE_TYPE_REGION, &region, &view->err_code);
+	if(view->err_code != CL_SUCCESS) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): [%lu, %lu): %s\n", 
+			__FILE__, __LINE__, __FUNCTION__, 
+			(unsigned long)view->origin, (unsigned long)(view->origin + view->size), opencl_error_to_string(view->err_code));
+		view->gpu_data = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+struct opencl_buffer * opencl_buffer_init_view(struct opencl_buffer * view, struct opencl_buffer * parent, cl_mem_flags flags, size_t origin, size_t size)
+{
+	assert(parent && size > 0);
+	if(parent->parent) {
+		origin += parent->origin;
+		parent = parent->parent;
+	}
+	assert(origin + size <= parent->size);
+	
+	int is_allocated = (NULL == view);
+	if(is_allocated) view = calloc(1, sizeof(*view));
+	else memset(view, 0, sizeof(*view));
+	assert(view);
+	
+	view->size = size;
+	view->flags = flags?flags:(parent->flags & s_access_flags);
+	view->type = parent->type;
+	view->parent = parent;
+	view->origin = origin;
+	opencl_event_list_init(view->reads, 0);
+	if(parent->cpu_data) view->cpu_data = (char *)parent->cpu_data + origin;
+	
+	if(parent->gpu_data && view_create_mem(view)) {
+		opencl_event_list_cleanup(view->reads);
+		view->parent = NULL;
+		view->cpu_data = NULL;
+		if(is_allocated) free(view);
+		return NULL;
+	}
+	
+	pthread_mutex_lock(&s_hazards_mutex);
+	struct opencl_buffer ** views = realloc(parent->views, sizeof(*views) * (parent->num_views + 1));
+	assert(views);
+	views[parent->num_views++] = view;
+	parent->views = views;
+	pthread_mutex_unlock(&s_hazards_mutex);
+	return view;
+}
+
+struct opencl_buffer * opencl_buffer_init_parts(struct opencl_buffer * parent, cl_context ctx, cl_mem_flags flags, 
+	size_t num_parts, const size_t * sizes, struct opencl_buffer * views)
+{
+	assert(parent && num_parts > 0 && sizes && views);
+	size_t alignment = opencl_buffer_get_alignment(ctx);
+	if(0 == alignment) return NULL;
+	
+	size_t size = 0;
+	for(size_t i = 0; i < num_parts; ++i) {
+		assert(sizes[i] > 0);
+		size = (size + alignment - 1) / alignment * alignment + sizes[i];
+	}
+	
+	opencl_buffer_init(parent, ctx, flags, size, NULL);
+	size_t origin = 0;
+	for(size_t i = 0; i < num_parts; ++i) {
+		origin = (origin + alignment - 1) / alignment * alignment;
+		if(NULL == opencl_buffer_init_view(&views[i], parent, 0, origin, sizes[i])) {
+			while(i > 0) opencl_buffer_cleanup(&views[--i]);
+			opencl_buffer_cleanup(parent);
+			return NULL;
+		}
+		origin += sizes[i];
+	}
+	return parent;
+}
+
+// (called with s_hazards_mutex locked)
+static void buffer_release_views(struct opencl_buffer * parent)
+{
+	for(size_t i = 0; i < parent->num_views; ++i) {
+		struct opencl_buffer * view = parent->views[i];
+		if(view->gpu_data) clReleaseMemObject(view->gpu_data);
+		view->gpu_data = NULL;
+		opencl_buffer_reset_hazards(view);
+	}
+	return;
+}
+
+static int buffer_restore_views(struct opencl_buffer * parent)
+{
+	int rc = 0;
+	for(size_t i = 0; i < parent->num_views; ++i) {
+		struct opencl_buffer * view = parent->views[i];
+		if(NULL == view->gpu_data && view_create_mem(view)) rc = -1;
+	}
+	return rc;
+}
+
+void opencl_buffer_release_views(struct opencl_buffer * parent)
+{
+	assert(parent);
+	pthread_mutex_lock(&s_hazards_mutex);
+	buffer_release_views(parent);
+	pthread_mutex_unlock(&s_hazards_mutex);
+	return;
+}
+
+int opencl_buffer_restore_views(struct opencl_buffer * parent)
+{
+	assert(parent && parent->gpu_data);
+	pthread_mutex_lock(&s_hazards_mutex);
+	int rc = buffer_restore_views(parent);
+	pthread_mutex_unlock(&s_hazards_mutex);
+	return rc;
+}
+
+int opencl_buffer_replace_mem(struct opencl_buffer * buf, cl_mem mem, cl_event event)
+{
+	assert(buf && NULL == buf->parent && buf->type == opencl_buffer_type_mem);
+	int rc = 0;
+	pthread_mutex_lock(&s_hazards_mutex);
+	buffer_release_views(buf);	// they hold the old allocation
+	if(buf->gpu_data) clReleaseMemObject(buf->gpu_data);
+	buf->gpu_data = mem;
+	opencl_buffer_reset_hazards(buf);	// the new cl_mem doesn't depend on the commands using the old one
+	if(mem) {
+		if(event) opencl_buffer_add_access(buf, opencl_buffer_access_write, event);
+		rc = buffer_restore_views(buf);
+	}
+	pthread_mutex_unlock(&s_hazards_mutex);
+	return rc;
 }
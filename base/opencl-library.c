@@ -0,0 +1,468 @@
+/*
+ * opencl-library.c
+ *
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <stdint.h>
+#include <limits.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <sys/stat.h>
+#include "opencl-library.h"
+#include "utils.h"
+
+struct opencl_library_header
+{
+	char path[PATH_MAX];
+	char name[NAME_MAX + 1];	// the include name
+	uint64_t hash;			// of the source
+	cl_program prog;		// created from the source, not compiled
+};
+
+struct opencl_library_module
+{
+	char path[PATH_MAX];
+	uint64_t hash;			// of the source compiled
+	struct opencl_program program[1];	// the compiled object, reused while build_status is CL_BUILD_SUCCESS
+};
+
+static uint64_t fnv1a_hash(const void * data, size_t length)
+{
+	const unsigned char * p = data;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for(size_t i = 0; i < length; ++i) {
+		hash ^= p[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static int has_suffix(const char * name, const char * suffix)
+{
+	size_t cb_name = strlen(name);
+	size_t cb_suffix = strlen(suffix);
+	return cb_name > cb_suffix && 0 == strcmp(name + cb_name - cb_suffix, suffix);
+}
+
+static int library_add_header(struct opencl_library * library, const char * path)
+{
+	assert(library && path);
+	if(strlen(path) >= PATH_MAX) return -1;
+	
+	char name[PATH_MAX] = "";
+	strcpy(name, path);
+	const char * base_name = basename(name);
+	if(strlen(base_name) > NAME_MAX) return -1;
+	for(int i = 0; i < library->num_headers; ++i) {
+		if(0 == strcmp(library->headers[i].name, base_name)) {
+			fprintf(stderr, "[ERROR]::%s(%d)::%s(): duplicate header name '%s' (%s)\n", 
+				__FILE__, __LINE__, __FUNCTION__, 
+				base_name, path);
+			return -1;
+		}
+	}
+	
+	struct opencl_library_header * headers = realloc(library->headers, sizeof(*headers) * (library->num_headers + 1));
+	assert(headers);
+	library->headers = headers;
+	
+	struct opencl_library_header * header = &headers[library->num_headers++];
+	memset(header, 0, sizeof(*header));
+	strcpy(header->path, path);
+	strcpy(header->name, base_name);
+	return 0;
+}
+
+static int library_add_module(struct opencl_library * library, const char * path)
+{
+	assert(library && path);
+	if(strlen(path) >= PATH_MAX) return -1;
+	
+	pthread_mutex_lock(&library->mutex);
+	int is_building = library->is_building;
+	pthread_mutex_unlock(&library->mutex);
+	if(is_building) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): can't add a module while building\n", 
+			__FILE__, __LINE__, __FUNCTION__);
+		return -1;
+	}
+	
+	struct opencl_library_module ** modules = realloc(library->modules, sizeof(*modules) * (library->num_modules + 1));
+	assert(modules);
+	library->modules = modules;
+	
+	struct opencl_library_module * module = calloc(1, sizeof(*module));
+	assert(module);
+	strcpy(module->path, path);
+	opencl_program_init(module->program, library->ctx, library->num_devices, library->device_ids);
+	modules[library->num_modules++] = module;
+	return 0;
+}
+
+static void library_complete(struct opencl_library * library, struct opencl_program * program)
+{
+	pthread_mutex_lock(&library->mutex);
+	opencl_library_built_func on_built = library->on_built;
+	void * user_data = library->user_data;
+	if(NULL == on_built) library->program = program;
+	pthread_mutex_unlock(&library->mutex);
+	
+	if(on_built) on_built(library, program, user_data);
+	
+	pthread_mutex_lock(&library->mutex);
+	library->is_building = 0;
+	pthread_cond_broadcast(&library->cond);
+	pthread_mutex_unlock(&library->mutex);
+}
+
+static void on_library_linked(struct opencl_program * program, void * user_data)
+{
+	library_complete(user_data, program);
+}
+
+/*
+ * the last module compiled links the library
+*/
+static void library_link(struct opencl_library * library)
+{
+	pthread_mutex_lock(&library->mutex);
+	int num_compiling = --library->num_compiling;
+	pthread_mutex_unlock(&library->mutex);
+	if(num_compiling > 0) return;
+	
+	struct opencl_program * program = opencl_program_init(NULL, library->ctx, library->num_devices, library->device_ids);
+	assert(program);
+	
+	int num_modules = library->num_modules;
+	cl_program objects[num_modules];	// c99
+	char * build_log = NULL;
+	size_t cb_log = 0;
+	for(int i = 0; i < num_modules; ++i) {
+		struct opencl_library_module * module = library->modules[i];
+		objects[i] = module->program->prog;
+		if(module->program->build_status == CL_BUILD_SUCCESS) continue;
+		
+		const char * module_log = module->program->build_log?module->program->build_log:"(no build log)\n";
+		size_t length = strlen(module->path) + strlen(module_log) + 2;
+		build_log = realloc(build_log, cb_log + length + 1);
+		assert(build_log);
+		cb_log += sprintf(build_log + cb_log, "%s:\n%s", module->path, module_log);
+	}
+	if(build_log) {
+		program->err_code = CL_COMPILE_PROGRAM_FAILURE;
+		program->build_status = CL_BUILD_ERROR;
+		program->build_log = build_log;
+		library_complete(library, program);
+		return;
+	}
+	program->link(program, NULL, num_modules, objects, on_library_linked, library);	// failures are notified too
+}
+
+static void on_module_compiled(struct opencl_program * program, void * user_data)
+{
+	library_link(user_data);
+}
+
+static int library_build_async(struct opencl_library * library, opencl_library_built_func on_built, void * user_data)
+{
+	assert(library && library->ctx);
+	if(library->num_modules <= 0) return -1;
+	
+	struct opencl_program * prev_program = library->wait(library);	// the result of the previous build has not been taken
+	if(prev_program) {
+		opencl_program_cleanup(prev_program);
+		free(prev_program);
+	}
+	
+	// reload the sources
+	int headers_changed = 0;
+	for(int i = 0; i < library->num_headers; ++i) {
+		struct opencl_library_header * header = &library->headers[i];
+		char * source = NULL;
+		ssize_t cb_source = load_file(header->path, &source);
+		if(cb_source < 0) {
+			fprintf(stderr, "[ERROR]::%s(%d)::%s(): failed to load %s\n", 
+				__FILE__, __LINE__, __FUNCTION__, 
+				header->path);
+			return -1;
+		}
+		uint64_t hash = fnv1a_hash(source, cb_source);
+		if(header->prog && hash == header->hash) {
+			free(source);
+			continue;
+		}
+		
+		cl_int ret = 0;
+		size_t length = cb_source;
+		cl_program prog = clCreateProgramWithSource(library->ctx, 1, (const char **)&source, &length, &ret);
+		free(source);
+		if(NULL == prog) {
+			fprintf(stderr, "[ERROR]::%s(%d)::%s(): %s: %s\n", 
+				__FILE__, __LINE__, __FUNCTION__, 
+				header->path, opencl_error_to_string(ret));
+			return -1;
+		}
+		if(header->prog) clReleaseProgram(header->prog);
+		header->prog = prog;
+		header->hash = hash;
+		headers_changed = 1;
+	}
+	
+	if(library->options_changed) headers_changed = 1;	// recompile all the modules
+	library->options_changed = 0;
+	
+	int num_modules = library->num_modules;
+	char * sources[num_modules];	// c99, NULL: unchanged
+	size_t lengths[num_modules];
+	memset(sources, 0, sizeof(sources));
+	int rc = 0;
+	for(int i = 0; i < num_modules; ++i) {
+		struct opencl_library_module * module = library->modules[i];
+		ssize_t cb_source = load_file(module->path, &sources[i]);
+		if(cb_source < 0) {
+			fprintf(stderr, "[ERROR]::%s(%d)::%s(): failed to load %s\n", 
+				__FILE__, __LINE__, __FUNCTION__, 
+				module->path);
+			rc = -1;
+			break;
+		}
+		lengths[i] = cb_source;
+		uint64_t hash = fnv1a_hash(sources[i], cb_source);
+		if(!headers_changed && module->program->build_status == CL_BUILD_SUCCESS && hash == module->hash) {
+			free(sources[i]);
+			sources[i] = NULL;
+			continue;
+		}
+		module->hash = hash;
+	}
+	if(rc) {
+		for(int i = 0; i < num_modules; ++i) free(sources[i]);
+		return rc;
+	}
+	
+	int num_headers = library->num_headers;
+	cl_program header_progs[num_headers + 1];
+	const char * header_names[num_headers + 1];
+	for(int i = 0; i < num_headers; ++i) {
+		header_progs[i] = library->headers[i].prog;
+		header_names[i] = library->headers[i].name;
+	}
+	
+	pthread_mutex_lock(&library->mutex);
+	library->is_building = 1;
+	library->num_compiling = 1;	// released once all the compiles have been started
+	library->on_built = on_built;
+	library->user_data = user_data;
+	pthread_mutex_unlock(&library->mutex);
+	
+	for(int i = 0; i < num_modules; ++i) {
+		if(NULL == sources[i]) continue;
+		struct opencl_program * program = library->modules[i]->program;
+		rc = program->load_sources(program, 1, (const char **)&sources[i], &lengths[i]);
+		free(sources[i]);
+		sources[i] = NULL;
+		if(rc) continue;	// build_status: CL_BUILD_ERROR
+		
+		pthread_mutex_lock(&library->mutex);
+		++library->num_compiling;
+		pthread_mutex_unlock(&library->mutex);
+		program->compile(program, library->options, num_headers, header_progs, header_names, on_module_compiled, library);	// failures are notified too
+	}
+	library_link(library);
+	return 0;
+}
+
+static struct opencl_program * library_wait(struct opencl_library * library)
+{
+	assert(library);
+	pthread_mutex_lock(&library->mutex);
+	while(library->is_building) pthread_cond_wait(&library->cond, &library->mutex);
+	struct opencl_program * program = library->program;
+	library->program = NULL;
+	pthread_mutex_unlock(&library->mutex);
+	return program;
+}
+
+struct opencl_library * opencl_library_init(struct opencl_library * library, cl_context ctx, size_t num_devices, const cl_device_id * device_ids)
+{
+	assert(ctx && num_devices > 0 && device_ids);
+	if(NULL == library) library = calloc(1, sizeof(*library));
+	else memset(library, 0, sizeof(*library));
+	assert(library);
+	
+	library->add_header = library_add_header;
+	library->add_module = library_add_module;
+	library->build_async = library_build_async;
+	library->wait = library_wait;
+	
+	int rc = pthread_mutex_init(&library->mutex, NULL);
+	assert(0 == rc);
+	rc = pthread_cond_init(&library->cond, NULL);
+	assert(0 == rc);
+	
+	cl_int ret = clRetainContext(ctx);
+	assert(CL_SUCCESS == ret);
+	library->ctx = ctx;
+	
+	library->device_ids = calloc(num_devices, sizeof(*library->device_ids));
+	assert(library->device_ids);
+	memcpy(library->device_ids, device_ids, sizeof(*device_ids) * num_devices);
+	library->num_devices = num_devices;
+	return library;
+}
+
+void opencl_library_cleanup(struct opencl_library * library)
+{
+	if(NULL == library) return;
+	struct opencl_program * program = library->wait(library);
+	if(program) {
+		opencl_program_cleanup(program);
+		free(program);
+	}
+	
+	for(int i = 0; i < library->num_modules; ++i) {
+		opencl_program_cleanup(library->modules[i]->program);
+		free(library->modules[i]);
+	}
+	free(library->modules);
+	library->modules = NULL;
+	library->num_modules = 0;
+	
+	for(int i = 0; i < library->num_headers; ++i) {
+		if(library->headers[i].prog) clReleaseProgram(library->headers[i].prog);
+	}
+	free(library->headers);
+	library->headers = NULL;
+	library->num_headers = 0;
+	
+	free(library->options);
+	library->options = NULL;
+	
+	free(library->device_ids);
+	library->device_ids = NULL;
+	library->num_devices = 0;
+	if(library->ctx) clReleaseContext(library->ctx);
+	library->ctx = NULL;
+	
+	pthread_cond_destroy(&library->cond);
+	pthread_mutex_destroy(&library->mutex);
+	return;
+}
+
+int opencl_library_set_options(struct opencl_library * library, const char * options)
+{
+	assert(library);
+	if(options && !options[0]) options = NULL;
+	
+	pthread_mutex_lock(&library->mutex);
+	int is_building = library->is_building;
+	pthread_mutex_unlock(&library->mutex);
+	if(is_building) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): can't change the options while building\n", 
+			__FILE__, __LINE__, __FUNCTION__);
+		return -1;
+	}
+	
+	if(NULL == options && NULL == library->options) return 0;
+	if(options && library->options && 0 == strcmp(options, library->options)) return 0;
+	
+	free(library->options);
+	library->options = options?strdup(options):NULL;
+	library->options_changed = 1;
+	return 0;
+}
+
+static int name_compare(const struct dirent ** a, const struct dirent ** b)
+{
+	return strcmp((*a)->d_name, (*b)->d_name);
+}
+
+/*
+ * add the files of the directory with the suffix (in the order of their names)
+*/
+static int add_dir_files(struct opencl_library * library, const char * dir, const char * suffix, int (* add)(struct opencl_library *, const char *))
+{
+	struct dirent ** entries = NULL;
+	int num_entries = scandir(dir, &entries, NULL, name_compare);
+	if(num_entries < 0) {
+		perror(dir);
+		return -1;
+	}
+	
+	int rc = 0;
+	for(int i = 0; i < num_entries; ++i) {
+		const char * name = entries[i]->d_name;
+		if(0 == rc && name[0] != '.' && has_suffix(name, suffix)) {
+			char path[PATH_MAX] = "";
+			if(snprintf(path, sizeof(path), "%s/%s", dir, name) >= (int)sizeof(path)) rc = -1;
+			else rc = add(library, path);
+		}
+		free(entries[i]);
+	}
+	free(entries);
+	return rc;
+}
+
+int opencl_library_add_path(struct opencl_library * library, const char * path)
+{
+	assert(library && path);
+	struct stat st;
+	if(stat(path, &st)) {
+		perror(path);
+		return -1;
+	}
+	
+	if(S_ISDIR(st.st_mode)) {
+		int rc = add_dir_files(library, path, ".h", library_add_header);
+		if(0 == rc) rc = add_dir_files(library, path, ".cl", library_add_module);
+		return rc;
+	}
+	
+	if(strlen(path) >= PATH_MAX) return -1;
+	char dir[PATH_MAX] = "";
+	strcpy(dir, path);
+	int rc = add_dir_files(library, dirname(dir), ".h", library_add_header);
+	if(0 == rc) rc = library_add_module(library, path);
+	return rc;
+}
+
+int opencl_library_get_files(const struct opencl_library * library, const char ** paths, int max_paths)
+{
+	int num_paths = 0;
+	for(int i = 0; i < library->num_headers; ++i, ++num_paths) {
+		if(num_paths < max_paths) paths[num_paths] = library->headers[i].path;
+	}
+	for(int i = 0; i < library->num_modules; ++i, ++num_paths) {
+		if(num_paths < max_paths) paths[num_paths] = library->modules[i]->path;
+	}
+	return num_paths;
+}
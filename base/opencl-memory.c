@@ -0,0 +1,445 @@
+/*
+ * opencl-memory.c
+ *
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "opencl-memory.h"
+
+struct opencl_memory_entry
+{
+	struct opencl_buffer * buf;
+	cl_mem_flags flags;		// the flags to recreate the cl_mem with
+	int is_evictable;		// a cl_mem allocated by the runtime (not CL_MEM_USE_HOST_PTR, not SVM)
+	int is_resident;
+	int is_evicting;		// being read back with the mutex dropped, neither a victim nor acquired until it's done
+	int pins;				// acquired, not released yet
+	uint64_t last_use;
+	
+	// the pinned host copy, kept once the buffer has been evicted
+	cl_mem host_mem;
+	void * host_data;
+};
+
+static int memory_find(const struct opencl_memory_manager * mm, const struct opencl_buffer * buf)
+{
+	for(int i = 0; i < mm->num_entries; ++i) if(mm->entries[i].buf == buf) return i;
+	return -1;
+}
+
+static int is_in_set(const struct opencl_buffer * buf, size_t num_buffers, struct opencl_buffer ** buffers)
+{
+	for(size_t i = 0; i < num_buffers; ++i) if(buffers[i] == buf) return 1;
+	return 0;
+}
+
+// the bytes to restore (each buffer is counted once)
+static cl_ulong memory_get_missing_size(const struct opencl_memory_manager * mm, size_t num_buffers, struct opencl_buffer ** buffers)
+{
+	cl_ulong size = 0;
+	for(size_t i = 0; i < num_buffers; ++i) {
+		if(is_in_set(buffers[i], i, buffers)) continue;
+		int index = memory_find(mm, buffers[i]);
+		if(index >= 0 && !mm->entries[index].is_resident) size += buffers[i]->size;
+	}
+	return size;
+}
+
+// the least recently used buffer which can be evicted, (-1: none)
+static int memory_find_victim(const struct opencl_memory_manager * mm, size_t num_buffers, struct opencl_buffer ** buffers)
+{
+	int victim = -1;
+	for(int i = 0; i < mm->num_entries; ++i) {
+		const struct opencl_memory_entry * entry = &mm->entries[i];
+		if(!entry->is_resident || entry->is_evicting || !entry->is_evictable || entry->pins > 0) continue;
+		if(is_in_set(entry->buf, num_buffers, buffers)) continue;
+		if(victim < 0 || entry->last_use < mm->entries[victim].last_use) victim = i;
+	}
+	return victim;
+}
+
+static int memory_has_pins(const struct opencl_memory_manager * mm)
+{
+	for(int i = 0; i < mm->num_entries; ++i) if(mm->entries[i].pins > 0) return 1;
+	return 0;
+}
+
+static int memory_is_evicting(const struct opencl_memory_manager * mm, size_t num_buffers, struct opencl_buffer ** buffers)
+{
+	for(size_t i = 0; i < num_buffers; ++i) {
+		int index = memory_find(mm, buffers[i]);
+		if(index >= 0 && mm->entries[index].is_evicting) return 1;
+	}
+	return 0;
+}
+
+static int memory_alloc_host_copy(struct opencl_memory_manager * mm, size_t size, cl_mem * p_host_mem, void ** p_host_data)
+{
+	cl_int ret = CL_SUCCESS;
+	cl_mem host_mem = clCreateBuffer(mm->ctx, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, size, NULL, &ret);
+	void * host_data = NULL;
+	if(ret == CL_SUCCESS) {
+		host_data = clEnqueueMapBuffer(mm->queue, host_mem, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 
+			0, size, 0, NULL, NULL, &ret);
+	}
+	if(ret != CL_SUCCESS) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): failed to allocate %lu bytes of pinned memory: %s\n", 
+			__FILE__, __LINE__, __FUNCTION__, 
+			(unsigned long)size, opencl_error_to_string(ret));
+		if(host_mem) clReleaseMemObject(host_mem);
+		return -1;
+	}
+	*p_host_mem = host_mem;
+	*p_host_data = host_data;
+	return 0;
+}
+
+/*
+ * read the buffer back to the pinned host copy and release its cl_mem, (called with the mutex locked)
+ * the mutex is dropped while the read is in flight, the entry is marked as evicting meanwhile.
+ * the read has waited for the writers, the commands still reading the old cl_mem keep it alive.
+*/
+static int memory_evict(struct opencl_memory_manager * mm, int index, struct opencl_memory_stats * usage)
+{
+	struct opencl_memory_entry * entry = &mm->entries[index];
+	struct opencl_buffer * buf = entry->buf;
+	assert(entry->is_resident && !entry->is_evicting && buf->gpu_data);
+	
+	entry->is_evicting = 1;
+	mm->evicting += buf->size;
+	cl_mem host_mem = entry->host_mem;
+	void * host_data = entry->host_data;
+	pthread_mutex_unlock(&mm->mutex);
+	
+	int rc = 0;
+	if(NULL == host_mem) rc = memory_alloc_host_copy(mm, buf->size, &host_mem, &host_data);
+	// enqueued after the writers, the wait is outside both locks
+	if(0 == rc && NULL == opencl_buffer_enqueue_read(buf, mm->queue, CL_TRUE, 0, buf->size, host_data)) rc = -1;
+	if(0 == rc) opencl_buffer_replace_mem(buf, NULL, NULL);	// releases the views' and the buffer's cl_mems
+	
+	pthread_mutex_lock(&mm->mutex);
+	entry = &mm->entries[memory_find(mm, buf)];	// the entries may have moved meanwhile
+	entry->host_mem = host_mem;
+	entry->host_data = host_data;
+	entry->is_evicting = 0;
+	mm->evicting -= buf->size;
+	pthread_cond_broadcast(&mm->cond);
+	if(rc) return -1;
+	
+	entry->is_resident = 0;
+	mm->stats.used -= buf->size;
+	++mm->stats.num_evictions;
+	mm->stats.bytes_evicted += buf->size;
+	if(usage) {
+		++usage->num_evictions;
+		usage->bytes_evicted += buf->size;
+	}
+	return 0;
+}
+
+// recreate the cl_mem, the write from the host copy is the buffer's last writer
+static int memory_restore(struct opencl_memory_manager * mm, int index, struct opencl_memory_stats * usage)
+{
+	struct opencl_memory_entry * entry = &mm->entries[index];
+	struct opencl_buffer * buf = entry->buf;
+	assert(!entry->is_resident && entry->host_data);
+	
+	cl_int ret = CL_SUCCESS;
+	cl_event ev = NULL;
+	cl_mem mem = clCreateBuffer(mm->ctx, entry->flags, buf->size, NULL, &ret);
+	if(ret == CL_SUCCESS) ret = clEnqueueWriteBuffer(mm->queue, mem, CL_FALSE, 0, buf->size, entry->host_data, 0, NULL, &ev);
+	if(ret != CL_SUCCESS) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): failed to restore %lu bytes: %s\n", 
+			__FILE__, __LINE__, __FUNCTION__, 
+			(unsigned long)buf->size, opencl_error_to_string(ret));
+		if(mem) clReleaseMemObject(mem);
+		return -1;
+	}
+	int rc = opencl_buffer_replace_mem(buf, mem, ev);
+	clReleaseEvent(ev);
+	entry->is_resident = 1;
+	
+	mm->stats.used += buf->size;
+	if(mm->stats.used > mm->stats.peak) mm->stats.peak = mm->stats.used;
+	++mm->stats.num_restores;
+	mm->stats.bytes_restored += buf->size;
+	if(usage) {
+		++usage->num_restores;
+		usage->bytes_restored += buf->size;
+	}
+	return rc;
+}
+
+/*
+ * evict the least recently used buffers (not in the set) until (size) more bytes
+ * and the evicted buffers of the set fit in the budget, (called with the mutex locked)
+*/
+static int memory_make_room(struct opencl_memory_manager * mm, cl_ulong size, 
+	size_t num_buffers, struct opencl_buffer ** buffers, struct opencl_memory_stats * usage)
+{
+	if(0 == mm->budget) return 0;
+	while(1) {
+		cl_ulong needed = size + memory_get_missing_size(mm, num_buffers, buffers);
+		if(needed > mm->budget) {
+			fprintf(stderr, "[ERROR]::%s(%d)::%s(): %lu bytes exceed the budget (%lu bytes)\n", 
+				__FILE__, __LINE__, __FUNCTION__, 
+				(unsigned long)needed, (unsigned long)mm->budget);
+			return -1;
+		}
+		if(mm->stats.used + needed <= mm->budget) return 0;
+		
+		// the evictions in flight (the other threads) will make enough room
+		if(mm->stats.used - mm->evicting + needed <= mm->budget) {
+			pthread_cond_wait(&mm->cond, &mm->mutex);
+			continue;
+		}
+		
+		int victim = memory_find_victim(mm, num_buffers, buffers);
+		if(victim >= 0) {
+			if(memory_evict(mm, victim, usage)) return -1;
+			continue;
+		}
+		
+		// the rest is held by the launches of the other threads
+		if(!memory_has_pins(mm) && 0 == mm->evicting) {
+			fprintf(stderr, "[ERROR]::%s(%d)::%s(): %lu bytes in use can't be evicted\n", 
+				__FILE__, __LINE__, __FUNCTION__, 
+				(unsigned long)mm->stats.used);
+			return -1;
+		}
+		pthread_cond_wait(&mm->cond, &mm->mutex);
+	}
+	return 0;
+}
+
+static struct opencl_buffer * memory_alloc(struct opencl_memory_manager * mm, struct opencl_buffer * buf, cl_mem_flags flags, size_t size, const void * cpu_data)
+{
+	assert(mm && size > 0);
+	if(mm->max_alloc_size && size > mm->max_alloc_size) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): %lu bytes exceed CL_DEVICE_MAX_MEM_ALLOC_SIZE (%lu bytes)\n", 
+			__FILE__, __LINE__, __FUNCTION__, 
+			(unsigned long)size, (unsigned long)mm->max_alloc_size);
+		return NULL;
+	}
+	
+	pthread_mutex_lock(&mm->mutex);
+	if(memory_make_room(mm, size, 0, NULL, NULL)) {
+		pthread_mutex_unlock(&mm->mutex);
+		return NULL;
+	}
+	
+	if(mm->num_entries >= mm->max_entries) {
+		int max_entries = mm->max_entries?(mm->max_entries * 2):16;
+		struct opencl_memory_entry * entries = realloc(mm->entries, sizeof(*entries) * max_entries);
+		assert(entries);
+		mm->entries = entries;
+		mm->max_entries = max_entries;
+	}
+	
+	buf = opencl_buffer_init(buf, mm->ctx, flags, size, cpu_data);
+	assert(buf);
+	
+	struct opencl_memory_entry * entry = &mm->entries[mm->num_entries++];
+	memset(entry, 0, sizeof(*entry));
+	entry->buf = buf;
+	entry->flags = flags & ~(cl_mem_flags)CL_MEM_COPY_HOST_PTR;
+	entry->is_evictable = mm->ctx && !(flags & CL_MEM_USE_HOST_PTR) && buf->type == opencl_buffer_type_mem;
+	entry->is_resident = 1;
+	entry->last_use = mm->clock;
+	
+	mm->stats.used += size;
+	if(mm->stats.used > mm->stats.peak) mm->stats.peak = mm->stats.used;
+	pthread_mutex_unlock(&mm->mutex);
+	return buf;
+}
+
+static void memory_free(struct opencl_memory_manager * mm, struct opencl_buffer * buf)
+{
+	assert(mm && buf);
+	pthread_mutex_lock(&mm->mutex);
+	int index = memory_find(mm, buf);
+	while(index >= 0 && mm->entries[index].is_evicting) {
+		pthread_cond_wait(&mm->cond, &mm->mutex);
+		index = memory_find(mm, buf);
+	}
+	if(index >= 0) {
+		struct opencl_memory_entry * entry = &mm->entries[index];
+		assert(0 == entry->pins);
+		if(entry->host_mem) {
+			clEnqueueUnmapMemObject(mm->queue, entry->host_mem, entry->host_data, 0, NULL, NULL);
+			clReleaseMemObject(entry->host_mem);
+		}
+		if(entry->is_resident) mm->stats.used -= buf->size;
+		mm->entries[index] = mm->entries[--mm->num_entries];
+		pthread_cond_broadcast(&mm->cond);
+	}
+	pthread_mutex_unlock(&mm->mutex);
+	
+	opencl_buffer_cleanup(buf);
+	return;
+}
+
+static int memory_acquire(struct opencl_memory_manager * mm, size_t num_buffers, struct opencl_buffer ** buffers, struct opencl_memory_stats * usage)
+{
+	assert(mm);
+	if(0 == num_buffers) return 0;
+	assert(buffers);
+	
+	pthread_mutex_lock(&mm->mutex);
+	int rc = 0;
+	while(1) {
+		rc = memory_make_room(mm, 0, num_buffers, buffers, usage);
+		if(rc || !memory_is_evicting(mm, num_buffers, buffers)) break;
+		pthread_cond_wait(&mm->cond, &mm->mutex);	// one of them is being evicted by another thread
+	}
+	uint64_t clock = ++mm->clock;
+	int num_restores = 0;
+	size_t num_pinned = 0;
+	for(; num_pinned < num_buffers && 0 == rc; ++num_pinned) {
+		int index = memory_find(mm, buffers[num_pinned]);
+		if(index < 0) continue;	// not allocated by the manager
+		
+		struct opencl_memory_entry * entry = &mm->entries[index];
+		if(!entry->is_resident) {
+			rc = memory_restore(mm, index, usage);
+			if(rc) break;
+			++num_restores;
+		}
+		++entry->pins;
+		entry->last_use = clock;
+	}
+	if(rc) {	// undo the pins taken so far
+		for(size_t i = 0; i < num_pinned; ++i) {
+			int index = memory_find(mm, buffers[i]);
+			if(index >= 0) --mm->entries[index].pins;
+		}
+		pthread_cond_broadcast(&mm->cond);
+	}
+	pthread_mutex_unlock(&mm->mutex);
+	
+	if(num_restores) clFlush(mm->queue);	// the launches on the other queues wait for the restores
+	return rc;
+}
+
+static void memory_release(struct opencl_memory_manager * mm, size_t num_buffers, struct opencl_buffer ** buffers)
+{
+	assert(mm);
+	pthread_mutex_lock(&mm->mutex);
+	for(size_t i = 0; i < num_buffers; ++i) {
+		int index = memory_find(mm, buffers[i]);
+		if(index < 0) continue;
+		assert(mm->entries[index].pins > 0);
+		--mm->entries[index].pins;
+	}
+	pthread_cond_broadcast(&mm->cond);
+	pthread_mutex_unlock(&mm->mutex);
+	return;
+}
+
+struct opencl_memory_manager * opencl_memory_manager_init(struct opencl_memory_manager * mm, cl_context ctx,
+	size_t num_devices, const cl_device_id * device_ids, cl_ulong budget)
+{
+	if(NULL == mm) mm = calloc(1, sizeof(*mm));
+	else memset(mm, 0, sizeof(*mm));
+	assert(mm);
+	
+	mm->alloc = memory_alloc;
+	mm->free = memory_free;
+	mm->acquire = memory_acquire;
+	mm->release = memory_release;
+	
+	int rc = pthread_mutex_init(&mm->mutex, NULL);
+	assert(0 == rc);
+	rc = pthread_cond_init(&mm->cond, NULL);
+	assert(0 == rc);
+	
+	if(NULL == ctx) return mm;	// host backend, accounting only
+	
+	assert(num_devices > 0 && device_ids);
+	cl_ulong global_mem_size = 0;
+	cl_ulong max_alloc_size = 0;
+	for(size_t i = 0; i < num_devices; ++i) {
+		cl_ulong mem_size = 0, alloc_size = 0;
+		cl_int ret = clGetDeviceInfo(device_ids[i], CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(mem_size), &mem_size, NULL);
+		if(ret == CL_SUCCESS) ret = clGetDeviceInfo(device_ids[i], CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(alloc_size), &alloc_size, NULL);
+		if(ret != CL_SUCCESS) {
+			fprintf(stderr, "[ERROR]::%s(%d)::%s(): clGetDeviceInfo() failed: %s\n", 
+				__FILE__, __LINE__, __FUNCTION__, 
+				opencl_error_to_string(ret));
+			opencl_memory_manager_cleanup(mm);
+			return NULL;
+		}
+		if(0 == global_mem_size || mem_size < global_mem_size) global_mem_size = mem_size;
+		if(0 == max_alloc_size || alloc_size < max_alloc_size) max_alloc_size = alloc_size;
+	}
+	if(budget > global_mem_size) {
+		fprintf(stderr, "[WARNING]: memory budget %lu bytes exceeds CL_DEVICE_GLOBAL_MEM_SIZE (%lu bytes)\n", 
+			(unsigned long)budget, (unsigned long)global_mem_size);
+	}
+	if(0 == budget || budget > global_mem_size) budget = global_mem_size;
+	mm->budget = budget;
+	mm->max_alloc_size = max_alloc_size;
+	
+	cl_int ret = CL_SUCCESS;
+	mm->ctx = ctx;
+#if defined(CL_TARGET_OPENCL_VERSION) && (CL_TARGET_OPENCL_VERSION >= 200)
+	mm->queue = clCreateCommandQueueWithProperties(ctx, device_ids[0], NULL, &ret);
+#else
+	mm->queue = clCreateCommandQueue(ctx, device_ids[0], 0, &ret);
+#endif
+	if(ret != CL_SUCCESS) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): failed to create the command queue: %s\n", 
+			__FILE__, __LINE__, __FUNCTION__, 
+			opencl_error_to_string(ret));
+		opencl_memory_manager_cleanup(mm);
+		return NULL;
+	}
+	return mm;
+}
+
+void opencl_memory_manager_cleanup(struct opencl_memory_manager * mm)
+{
+	if(NULL == mm) return;
+	while(mm->num_entries > 0) memory_free(mm, mm->entries[mm->num_entries - 1].buf);
+	free(mm->entries);
+	mm->entries = NULL;
+	mm->max_entries = 0;
+	
+	if(mm->queue) {
+		clFinish(mm->queue);
+		clReleaseCommandQueue(mm->queue);
+		mm->queue = NULL;
+	}
+	mm->ctx = NULL;
+	pthread_cond_destroy(&mm->cond);
+	pthread_mutex_destroy(&mm->mutex);
+	return;
+}
@@ -0,0 +1,348 @@
+/*
+ * opencl-notifier.c
+ *
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "opencl-context.h"
+#include "opencl-notifier.h"
+
+struct notify_node
+{
+	struct notify_node * next;
+	struct opencl_notifier * notifier;
+
+	opencl_notify_func on_completed;
+	void * user_data;
+	cl_event event;
+	cl_int status;
+};
+
+struct fd_watch
+{
+	struct fd_watch * next;
+	int fd;
+	opencl_notify_fd_func on_readable;
+	void * user_data;
+};
+
+struct notifier_private
+{
+	struct opencl_notifier * notifier;
+	pthread_mutex_t mutex;
+
+	// fds watched by the host loop (epoll data.ptr), only accessed from the host loop's thread
+	struct fd_watch * fd_watches;
+
+	// completed notifications (FIFO)
+	struct notify_node * head;
+	struct notify_node * tail;
+
+	// recycled nodes, no allocation in steady state
+	struct notify_node * free_list;
+};
+
+static struct notify_node * node_alloc(struct notifier_private * priv)
+{
+	pthread_mutex_lock(&priv->mutex);
+	struct notify_node * node = priv->free_list;
+	if(node) priv->free_list = node->next;
+	pthread_mutex_unlock(&priv->mutex);
+
+	if(NULL == node) node = malloc(sizeof(*node));
+	assert(node);
+	memset(node, 0, sizeof(*node));
+	node->notifier = priv->notifier;
+	return node;
+}
+
+static void node_free(struct notifier_private * priv, struct notify_node * node)
+{
+	pthread_mutex_lock(&priv->mutex);
+	node->next = priv->free_list;
+	priv->free_list = node;
+	pthread_mutex_unlock(&priv->mutex);
+}
+
+static void notifier_wakeup(struct opencl_notifier * notifier)
+{
+	uint64_t value = 1;
+	ssize_t cb = write(notifier->event_fd, &value, sizeof(value));
+	(void)cb; // EAGAIN: the counter is already non-zero, the loop will wake up anyway
+}
+
+static void notifier_push(struct opencl_notifier * notifier, struct notify_node * node)
+{
+	struct notifier_private * priv = notifier->priv;
+	node->next = NULL;
+
+	pthread_mutex_lock(&priv->mutex);
+	if(priv->tail) priv->tail->next = node;
+	else priv->head = node;
+	priv->tail = node;
+	pthread_mutex_unlock(&priv->mutex);
+
+	notifier_wakeup(notifier);
+}
+
+/*
+ * called from the opencl runtime's thread, only queue the notification
+*/
+static void CL_CALLBACK on_event_completed(cl_event event, cl_int status, void * user_data)
+{
+	struct notify_node * node = user_data;
+	assert(node && node->event == event);
+
+	node->status = status;
+	notifier_push(node->notifier, node);
+}
+
+static int notifier_watch(struct opencl_notifier * notifier, cl_event event, opencl_notify_func on_completed, void * user_data)
+{
+	assert(notifier && notifier->priv);
+	assert(event && on_completed);
+
+	struct notifier_private * priv = notifier->priv;
+	struct notify_node * node = node_alloc(priv);
+	node->on_completed = on_completed;
+	node->user_data = user_data;
+	node->event = event;
+	clRetainEvent(event);
+
+	cl_int ret = clSetEventCallback(event, CL_COMPLETE, on_event_completed, node);
+	if(ret != CL_SUCCESS) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): %s\n",
+			__FILE__, __LINE__, __FUNCTION__,
+			opencl_error_to_string(ret));
+		clReleaseEvent(event);
+		node_free(priv, node);
+		return -1;
+	}
+	return 0;
+}
+
+static int notifier_post(struct opencl_notifier * notifier, opencl_notify_func on_completed, void * user_data)
+{
+	assert(notifier && notifier->priv);
+	assert(on_completed);
+
+	struct notify_node * node = node_alloc(notifier->priv);
+	node->on_completed = on_completed;
+	node->user_data = user_data;
+	node->status = CL_COMPLETE;
+	notifier_push(notifier, node);
+	return 0;
+}
+
+static int notifier_dispatch(struct opencl_notifier * notifier)
+{
+	struct notifier_private * priv = notifier->priv;
+
+	pthread_mutex_lock(&priv->mutex);
+	struct notify_node * node = priv->head;
+	priv->head = NULL;
+	priv->tail = NULL;
+	pthread_mutex_unlock(&priv->mutex);
+
+	int num_dispatched = 0;
+	while(node) {
+		struct notify_node * next = node->next;
+		node->on_completed(node->user_data, node->event, node->status);
+		if(node->event) clReleaseEvent(node->event);
+		node_free(priv, node);
+
+		++num_dispatched;
+		node = next;
+	}
+	return num_dispatched;
+}
+
+static int notifier_add_fd(struct opencl_notifier * notifier, int fd, opencl_notify_fd_func on_readable, void * user_data)
+{
+	assert(notifier && notifier->priv);
+	assert(fd >= 0 && on_readable);
+
+	struct notifier_private * priv = notifier->priv;
+	struct fd_watch * watch = calloc(1, sizeof(*watch));
+	assert(watch);
+	watch->fd = fd;
+	watch->on_readable = on_readable;
+	watch->user_data = user_data;
+
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = watch };
+	int rc = epoll_ctl(notifier->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+	if(rc) {
+		perror("epoll_ctl");
+		free(watch);
+		return -1;
+	}
+	watch->next = priv->fd_watches;
+	priv->fd_watches = watch;
+	return 0;
+}
+
+static int notifier_remove_fd(struct opencl_notifier * notifier, int fd)
+{
+	assert(notifier && notifier->priv);
+	struct notifier_private * priv = notifier->priv;
+
+	struct fd_watch ** p_watch = &priv->fd_watches;
+	while(*p_watch && (*p_watch)->fd != fd) p_watch = &(*p_watch)->next;
+	if(NULL == *p_watch) return -1;
+
+	struct fd_watch * watch = *p_watch;
+	*p_watch = watch->next;
+	epoll_ctl(notifier->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+	free(watch);
+	return 0;
+}
+
+#define NOTIFIER_MAX_EPOLL_EVENTS (16)
+static int notifier_run_once(struct opencl_notifier * notifier, int timeout_ms)
+{
+	assert(notifier && notifier->priv);
+
+	struct epoll_event events[NOTIFIER_MAX_EPOLL_EVENTS];
+	int n = epoll_wait(notifier->epoll_fd, events, NOTIFIER_MAX_EPOLL_EVENTS, timeout_ms);
+	if(n < 0) {
+		if(errno == EINTR) return 0;	// interrupted by a signal, let the caller check its quit flag
+		perror("epoll_wait");
+		return -1;
+	}
+
+	int num_dispatched = 0;
+	for(int i = 0; i < n; ++i) {
+		if(events[i].data.ptr == NULL) { // eventfd
+			uint64_t value = 0;
+			ssize_t cb = read(notifier->event_fd, &value, sizeof(value));
+			(void)cb;
+			continue;
+		}
+		struct fd_watch * watch = events[i].data.ptr;
+		watch->on_readable(watch->user_data, watch->fd);	// must not remove the other watched fds
+		++num_dispatched;
+	}
+	return num_dispatched + notifier_dispatch(notifier);
+}
+
+static int notifier_run(struct opencl_notifier * notifier)
+{
+	assert(notifier);
+	while(!notifier->quit) {
+		int rc = notifier_run_once(notifier, -1);
+		if(rc < 0) return rc;
+	}
+	return 0;
+}
+
+static void notifier_stop(struct opencl_notifier * notifier)
+{
+	notifier->quit = 1;
+	notifier_wakeup(notifier);
+}
+
+struct opencl_notifier * opencl_notifier_init(struct opencl_notifier * notifier, void * user_data)
+{
+	if(NULL == notifier) notifier = calloc(1, sizeof(*notifier));
+	else memset(notifier, 0, sizeof(*notifier));
+	assert(notifier);
+
+	notifier->user_data = user_data;
+	notifier->watch = notifier_watch;
+	notifier->post = notifier_post;
+	notifier->add_fd = notifier_add_fd;
+	notifier->remove_fd = notifier_remove_fd;
+	notifier->run_once = notifier_run_once;
+	notifier->run = notifier_run;
+	notifier->stop = notifier_stop;
+
+	struct notifier_private * priv = calloc(1, sizeof(*priv));
+	assert(priv);
+	priv->notifier = notifier;
+	pthread_mutex_init(&priv->mutex, NULL);
+	notifier->priv = priv;
+
+	notifier->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	notifier->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if(notifier->event_fd < 0 || notifier->epoll_fd < 0) {
+		perror("eventfd / epoll_create1");
+		opencl_notifier_cleanup(notifier);
+		return NULL;
+	}
+
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+	int rc = epoll_ctl(notifier->epoll_fd, EPOLL_CTL_ADD, notifier->event_fd, &ev);
+	assert(0 == rc);
+	return notifier;
+}
+
+/*
+ * all watched events must have been completed (e.g. clFinish() the queues) before cleanup
+*/
+void opencl_notifier_cleanup(struct opencl_notifier * notifier)
+{
+	if(NULL == notifier) return;
+	struct notifier_private * priv = notifier->priv;
+	notifier->priv = NULL;
+
+	if(notifier->epoll_fd >= 0) close(notifier->epoll_fd);
+	if(notifier->event_fd >= 0) close(notifier->event_fd);
+	notifier->epoll_fd = -1;
+	notifier->event_fd = -1;
+
+	if(NULL == priv) return;
+	struct fd_watch * watch = priv->fd_watches;
+	while(watch) {
+		struct fd_watch * next = watch->next;
+		free(watch);
+		watch = next;
+	}
+
+	struct notify_node * lists[2] = { priv->head, priv->free_list };
+	for(int i = 0; i < 2; ++i) {
+		struct notify_node * node = lists[i];
+		while(node) {
+			struct notify_node * next = node->next;
+			if(i == 0 && node->event) clReleaseEvent(node->event);
+			free(node);
+			node = next;
+		}
+	}
+	pthread_mutex_destroy(&priv->mutex);
+	free(priv);
+	return;
+}
@@ -0,0 +1,215 @@
+/*
+ * opencl-radix-sort.c
+ *
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <limits.h>
+
+#include "opencl-radix-sort.h"
+#include "opencl-host.h"
+
+#define RADIX_BITS (4)	// same as kernels/radix_sort.cl
+#define RADIX_NUM_DIGITS (1 << RADIX_BITS)
+#define RADIX_SORT_MAX_LOCAL_SIZE (256)
+#define RADIX_SORT_HOST_LOCAL_SIZE (1024)
+
+static int sort_launch(struct opencl_radix_sort * sort, struct opencl_function * function, size_t num_groups)
+{
+	size_t global_size = num_groups * sort->local_size;
+	function->set_dims(function, 1, NULL, &global_size, &sort->local_size);
+	return function->execute(function, 0, NULL, NULL);
+}
+
+/*
+ * __kernel void radix_count(__const int n, __global const uint * keys, __const int shift, 
+ *     __local uint * counts, __global int * histograms);
+ * __kernel void radix_scatter(__const int n, __global const uint * keys_in, __global const uint * values_in, 
+ *     __global uint * keys_out, __global uint * values_out, __const int shift, __global const int * offsets, 
+ *     __local uint * local_keys, __local int * local_indices, __local int * partials, __const int has_values);
+*/
+static int sort_pass(struct opencl_radix_sort * sort, size_t n, size_t num_groups, int shift,
+	struct opencl_buffer * keys_in, struct opencl_buffer * values_in, 
+	struct opencl_buffer * keys_out, struct opencl_buffer * values_out)
+{
+	cl_int length = (cl_int)n;
+	cl_int has_values = (NULL != values_in);
+	size_t cb_local = sort->local_size * 2 * sizeof(cl_int);
+	
+	// without values, the keys are bound in their place and are not accessed
+	if(!has_values) {
+		values_in = keys_in;
+		values_out = keys_out;
+	}
+	
+	struct opencl_function * count = sort->count;
+	opencl_function_set_args(count, 5, 
+		sizeof(length), &length, 
+		sizeof(cl_mem), NULL, 
+		sizeof(shift), &shift, 
+		RADIX_NUM_DIGITS * sizeof(cl_uint), NULL, 
+		sizeof(cl_mem), NULL);
+	opencl_function_bind_buffer(count, 1, keys_in, opencl_buffer_access_read);
+	opencl_function_bind_buffer(count, 4, sort->histograms, opencl_buffer_access_write);
+	int rc = sort_launch(sort, count, num_groups);
+	if(rc) return rc;
+	
+	rc = sort->scan->execute(sort->scan, sort->histograms, sort->histograms, RADIX_NUM_DIGITS * num_groups, 0);
+	if(rc) return rc;
+	
+	struct opencl_function * scatter = sort->scatter;
+	opencl_function_set_args(scatter, 11, 
+		sizeof(length), &length, 
+		sizeof(cl_mem), NULL, 
+		sizeof(cl_mem), NULL, 
+		sizeof(cl_mem), NULL, 
+		sizeof(cl_mem), NULL, 
+		sizeof(shift), &shift, 
+		sizeof(cl_mem), NULL, 
+		cb_local, NULL, 
+		cb_local, NULL, 
+		cb_local, NULL, 
+		sizeof(has_values), &has_values);
+	opencl_function_bind_buffer(scatter, 1, keys_in, opencl_buffer_access_read);
+	opencl_function_bind_buffer(scatter, 2, values_in, opencl_buffer_access_read);
+	opencl_function_bind_buffer(scatter, 3, keys_out, opencl_buffer_access_write);
+	opencl_function_bind_buffer(scatter, 4, values_out, opencl_buffer_access_write);
+	opencl_function_bind_buffer(scatter, 6, sort->histograms, opencl_buffer_access_read);
+	return sort_launch(sort, scatter, num_groups);
+}
+
+static int sort_execute(struct opencl_radix_sort * sort, struct opencl_buffer * keys, struct opencl_buffer * values, size_t n)
+{
+	assert(sort && keys);
+	if(n <= 1) return 0;
+	
+	size_t size = n * sizeof(cl_uint);
+	if(n > INT_MAX || size > keys->size || (values && size > values->size)) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): invalid length %lu\n",
+			__FILE__, __LINE__, __FUNCTION__,
+			(unsigned long)n);
+		return -1;
+	}
+	
+	size_t tile_size = sort->local_size * 2;
+	size_t num_groups = (n + tile_size - 1) / tile_size;
+	if(opencl_buffer_reserve(sort->histograms, sort->ctx, CL_MEM_READ_WRITE, RADIX_NUM_DIGITS * num_groups * sizeof(cl_int))
+		|| opencl_buffer_reserve(sort->keys, sort->ctx, CL_MEM_READ_WRITE, size)
+		|| (values && opencl_buffer_reserve(sort->values, sort->ctx, CL_MEM_READ_WRITE, size))) return -1;
+	
+	// an even number of passes: the result ends up in the caller's buffers
+	struct opencl_buffer * src_keys = keys;
+	struct opencl_buffer * src_values = values;
+	struct opencl_buffer * dst_keys = sort->keys;
+	struct opencl_buffer * dst_values = values?sort->values:NULL;
+	for(int shift = 0; shift < 32; shift += RADIX_BITS) {
+		int rc = sort_pass(sort, n, num_groups, shift, src_keys, src_values, dst_keys, dst_values);
+		if(rc) return rc;
+		
+		struct opencl_buffer * tmp = src_keys;
+		src_keys = dst_keys;
+		dst_keys = tmp;
+		tmp = src_values;
+		src_values = dst_values;
+		dst_values = tmp;
+	}
+	assert(src_keys == keys);
+	return 0;
+}
+
+struct opencl_radix_sort * opencl_radix_sort_init(struct opencl_radix_sort * sort, cl_program program, cl_command_queue queue, size_t local_size)
+{
+	if(local_size & (local_size - 1)) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): local_size (%lu) must be a power of 2\n",
+			__FILE__, __LINE__, __FUNCTION__,
+			(unsigned long)local_size);
+		return NULL;
+	}
+	
+	if(NULL == sort) sort = calloc(1, sizeof(*sort));
+	else memset(sort, 0, sizeof(*sort));
+	assert(sort);
+	sort->execute = sort_execute;
+	
+	if(NULL == program) {
+		sort->backend = opencl_backend_type_host;
+		sort->local_size = local_size?local_size:RADIX_SORT_HOST_LOCAL_SIZE;
+		if(NULL == opencl_host_function_init(sort->count, "radix_count")
+			|| NULL == opencl_host_function_init(sort->scatter, "radix_scatter")
+			|| NULL == opencl_scan_init(sort->scan, NULL, NULL, opencl_scan_type_int, 0)) {
+			opencl_radix_sort_cleanup(sort);
+			return NULL;
+		}
+		return sort;
+	}
+	
+	assert(queue);
+	sort->backend = opencl_backend_type_opencl;
+	sort->queue = queue;
+	cl_int ret = clGetCommandQueueInfo(queue, CL_QUEUE_CONTEXT, sizeof(sort->ctx), &sort->ctx, NULL);
+	assert(ret == CL_SUCCESS);
+	
+	opencl_function_init(sort->count, program, "radix_count");
+	opencl_function_init(sort->scatter, program, "radix_scatter");
+	sort->count->queue = queue;
+	sort->scatter->queue = queue;
+	
+	// the tiles are sorted in local memory: the scatter kernel decides the local size
+	if(0 == local_size) {
+		size_t max_size = opencl_function_get_max_work_group_size(sort->scatter);
+		if(max_size > RADIX_SORT_MAX_LOCAL_SIZE) max_size = RADIX_SORT_MAX_LOCAL_SIZE;
+		for(local_size = 1; local_size * 2 <= max_size; local_size *= 2);
+	}
+	if(local_size * 2 < RADIX_NUM_DIGITS) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): local_size (%lu) is too small\n",
+			__FILE__, __LINE__, __FUNCTION__,
+			(unsigned long)local_size);
+		opencl_radix_sort_cleanup(sort);
+		return NULL;
+	}
+	if(NULL == opencl_scan_init(sort->scan, program, queue, opencl_scan_type_int, 0)) {
+		opencl_radix_sort_cleanup(sort);
+		return NULL;
+	}
+	sort->local_size = local_size;
+	return sort;
+}
+
+void opencl_radix_sort_cleanup(struct opencl_radix_sort * sort)
+{
+	if(NULL == sort) return;
+	opencl_function_cleanup(sort->count);
+	opencl_function_cleanup(sort->scatter);
+	opencl_scan_cleanup(sort->scan);
+	if(sort->histograms->size) opencl_buffer_cleanup(sort->histograms);
+	if(sort->keys->size) opencl_buffer_cleanup(sort->keys);
+	if(sort->values->size) opencl_buffer_cleanup(sort->values);
+	return;
+}
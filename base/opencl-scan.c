@@ -0,0 +1,207 @@
+/*
+ * opencl-scan.c
+ *
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <limits.h>
+
+#include "opencl-scan.h"
+#include "opencl-host.h"
+
+#define OPENCL_SCAN_MAX_LOCAL_SIZE (256)
+#define OPENCL_SCAN_HOST_LOCAL_SIZE (1024)
+
+static const char * s_scan_blocks_names[] = {
+	[opencl_scan_type_float] = "scan_blocks_float",
+	[opencl_scan_type_int] = "scan_blocks_int",
+};
+static const char * s_add_offsets_names[] = {
+	[opencl_scan_type_float] = "scan_add_offsets_float",
+	[opencl_scan_type_int] = "scan_add_offsets_int",
+};
+
+#define SCAN_ITEM_SIZE (4)	// sizeof(cl_float) == sizeof(cl_int)
+
+static int scan_launch(struct opencl_scan * scan, struct opencl_function * function, size_t n)
+{
+	size_t block_size = scan->local_size * 2;
+	size_t global_size = (n + block_size - 1) / block_size * scan->local_size;
+	function->set_dims(function, 1, NULL, &global_size, &scan->local_size);
+	return function->execute(function, 0, NULL, NULL);
+}
+
+/*
+ * __kernel void scan_blocks_<type>(__const int n, __global const type * in, __global type * out, 
+ *     __local type * partials, __global type * block_sums, __const int inclusive);
+*/
+static int scan_blocks(struct opencl_scan * scan, struct opencl_buffer * in, struct opencl_buffer * out, size_t n, 
+	struct opencl_buffer * block_sums, int inclusive)
+{
+	struct opencl_function * function = scan->scan_blocks;
+	cl_int length = (cl_int)n;
+	cl_int is_inclusive = inclusive;
+	
+	// the args are passed by address, they are only read during execute(),
+	// the buffer args are set by opencl_function_bind_buffer()
+	opencl_function_set_args(function, 6, 
+		sizeof(length), &length, 
+		sizeof(cl_mem), NULL, 
+		sizeof(cl_mem), NULL, 
+		scan->local_size * 2 * SCAN_ITEM_SIZE, NULL, 
+		sizeof(cl_mem), NULL, 
+		sizeof(is_inclusive), &is_inclusive);
+	opencl_function_bind_buffer(function, 1, in, opencl_buffer_access_read);
+	opencl_function_bind_buffer(function, 2, out, opencl_buffer_access_write);
+	opencl_function_bind_buffer(function, 4, block_sums, opencl_buffer_access_write);
+	return scan_launch(scan, function, n);
+}
+
+/*
+ * __kernel void scan_add_offsets_<type>(__const int n, __global type * out, __global const type * offsets);
+*/
+static int scan_add_offsets(struct opencl_scan * scan, struct opencl_buffer * out, size_t n, struct opencl_buffer * offsets)
+{
+	struct opencl_function * function = scan->add_offsets;
+	cl_int length = (cl_int)n;
+	
+	opencl_function_set_args(function, 3, sizeof(length), &length, sizeof(cl_mem), NULL, sizeof(cl_mem), NULL);
+	opencl_function_bind_buffer(function, 1, out, opencl_buffer_access_read_write);
+	opencl_function_bind_buffer(function, 2, offsets, opencl_buffer_access_read);
+	return scan_launch(scan, function, n);
+}
+
+static int scan_execute(struct opencl_scan * scan, struct opencl_buffer * in, struct opencl_buffer * out, size_t n, int inclusive)
+{
+	assert(scan && in && out);
+	if(0 == n) return 0;
+	if(n > INT_MAX || n * SCAN_ITEM_SIZE > in->size || n * SCAN_ITEM_SIZE > out->size) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): invalid length %lu\n",
+			__FILE__, __LINE__, __FUNCTION__,
+			(unsigned long)n);
+		return -1;
+	}
+	
+	// lengths[level]: the number of items scanned by the level
+	const size_t block_size = scan->local_size * 2;
+	size_t lengths[OPENCL_SCAN_MAX_LEVELS + 1] = { n };
+	int num_levels = 0;
+	do {
+		if(num_levels == OPENCL_SCAN_MAX_LEVELS) return -1;
+		lengths[num_levels + 1] = (lengths[num_levels] + block_size - 1) / block_size;
+		if(opencl_buffer_reserve(&scan->sums[num_levels], scan->ctx, CL_MEM_READ_WRITE, lengths[num_levels + 1] * SCAN_ITEM_SIZE)) return -1;
+		++num_levels;
+	}while(lengths[num_levels] > 1);
+	
+	int rc = 0;
+	for(int level = 0; level < num_levels; ++level) {
+		struct opencl_buffer * src = level?&scan->sums[level - 1]:in;
+		struct opencl_buffer * dst = level?&scan->sums[level - 1]:out;
+		rc = scan_blocks(scan, src, dst, lengths[level], &scan->sums[level], level?0:inclusive);
+		if(rc) return rc;
+	}
+	
+	// sums[level] holds the (exclusive) offsets of the blocks of the level
+	for(int level = num_levels - 2; level >= 0; --level) {
+		struct opencl_buffer * dst = level?&scan->sums[level - 1]:out;
+		rc = scan_add_offsets(scan, dst, lengths[level], &scan->sums[level]);
+		if(rc) return rc;
+	}
+	return 0;
+}
+
+static size_t get_max_local_size(const struct opencl_function * function)
+{
+	size_t max_size = opencl_function_get_max_work_group_size(function);
+	if(0 == max_size) return 0;
+	
+	size_t local_size = 1;
+	while(local_size * 2 <= max_size && local_size * 2 <= OPENCL_SCAN_MAX_LOCAL_SIZE) local_size *= 2;
+	return local_size;
+}
+
+struct opencl_scan * opencl_scan_init(struct opencl_scan * scan, cl_program program, cl_command_queue queue, enum opencl_scan_type type, size_t local_size)
+{
+	assert(type == opencl_scan_type_float || type == opencl_scan_type_int);
+	if(local_size & (local_size - 1)) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): local_size (%lu) must be a power of 2\n",
+			__FILE__, __LINE__, __FUNCTION__,
+			(unsigned long)local_size);
+		return NULL;
+	}
+	
+	if(NULL == scan) scan = calloc(1, sizeof(*scan));
+	else memset(scan, 0, sizeof(*scan));
+	assert(scan);
+	
+	scan->type = type;
+	scan->execute = scan_execute;
+	
+	if(NULL == program) {
+		scan->backend = opencl_backend_type_host;
+		if(NULL == opencl_host_function_init(scan->scan_blocks, s_scan_blocks_names[type])
+			|| NULL == opencl_host_function_init(scan->add_offsets, s_add_offsets_names[type])) {
+			opencl_scan_cleanup(scan);
+			return NULL;
+		}
+		scan->local_size = local_size?local_size:OPENCL_SCAN_HOST_LOCAL_SIZE;
+		return scan;
+	}
+	
+	assert(queue);
+	scan->backend = opencl_backend_type_opencl;
+	scan->queue = queue;
+	cl_int ret = clGetCommandQueueInfo(queue, CL_QUEUE_CONTEXT, sizeof(scan->ctx), &scan->ctx, NULL);
+	assert(ret == CL_SUCCESS);
+	
+	opencl_function_init(scan->scan_blocks, program, s_scan_blocks_names[type]);
+	opencl_function_init(scan->add_offsets, program, s_add_offsets_names[type]);
+	scan->scan_blocks->queue = queue;
+	scan->add_offsets->queue = queue;
+	
+	if(0 == local_size) local_size = get_max_local_size(scan->scan_blocks);
+	if(0 == local_size) {
+		opencl_scan_cleanup(scan);
+		return NULL;
+	}
+	scan->local_size = local_size;
+	return scan;
+}
+
+void opencl_scan_cleanup(struct opencl_scan * scan)
+{
+	if(NULL == scan) return;
+	opencl_function_cleanup(scan->scan_blocks);
+	opencl_function_cleanup(scan->add_offsets);
+	for(int i = 0; i < OPENCL_SCAN_MAX_LEVELS; ++i) {
+		if(scan->sums[i].size) opencl_buffer_cleanup(&scan->sums[i]);
+	}
+	return;
+}
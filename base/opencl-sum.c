@@ -0,0 +1,211 @@
+/*
+ * opencl-sum.c
+ *
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <limits.h>
+
+#include "opencl-sum.h"
+#include "opencl-host.h"
+
+#define SUM_LOCAL_SIZE (256)
+#define SUM_GROUPS_PER_CU (8)
+#define SUM_HOST_LOCAL_SIZE (4096)
+
+static const char * s_kernel_names[] = {
+	[opencl_sum_mode_plain] = "vec_sum",
+	[opencl_sum_mode_compensated] = "vec_sum_compensated",
+	[opencl_sum_mode_double] = "vec_sum_double",
+};
+
+const char * opencl_sum_mode_to_string(enum opencl_sum_mode mode)
+{
+	switch(mode) {
+	case opencl_sum_mode_plain: return "plain";
+	case opencl_sum_mode_compensated: return "compensated";
+	case opencl_sum_mode_double: return "double";
+	}
+	return "unknown";
+}
+
+static float pairwise_sum(const float * partials, size_t n)
+{
+	if(n <= 8) {
+		float sum = 0;
+		for(size_t i = 0; i < n; ++i) sum += partials[i];
+		return sum;
+	}
+	size_t half_n = n / 2;
+	return pairwise_sum(partials, half_n) + pairwise_sum(partials + half_n, n - half_n);
+}
+
+/*
+ * __kernel void vec_sum(__const int n, __global const float * A, __local float * partials, __global float * result);
+ * __kernel void vec_sum_compensated(__const int n, __global const float * A, 
+ *     __local float * partials, __local float * compensations, __global float * result);
+ * __kernel void vec_sum_double(__const int n, __global const float * A, __local double * partials, __global double * result);
+*/
+static int sum_execute(struct opencl_sum * sum, struct opencl_buffer * in, size_t n, double * result)
+{
+	assert(sum && in && result);
+	if(0 == n || n > INT_MAX || n * sizeof(float) > in->size) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): invalid length %lu\n",
+			__FILE__, __LINE__, __FUNCTION__,
+			(unsigned long)n);
+		return -1;
+	}
+	
+	size_t local_size = sum->local_size;
+	size_t num_groups = (n + local_size - 1) / local_size;
+	if(num_groups > sum->max_groups) num_groups = sum->max_groups;
+	size_t global_size = num_groups * local_size;
+	
+	size_t item_size = (sum->mode == opencl_sum_mode_double)?sizeof(double):sizeof(float);
+	size_t partials_size = num_groups * item_size;
+	if(opencl_buffer_reserve(sum->partials, sum->ctx, CL_MEM_READ_WRITE, partials_size)) return -1;
+	if(partials_size > sum->host_partials_size) {
+		sum->host_partials = realloc(sum->host_partials, partials_size);
+		assert(sum->host_partials);
+		sum->host_partials_size = partials_size;
+	}
+	
+	cl_int length = (cl_int)n;
+	struct opencl_function * function = sum->func;
+	if(sum->mode == opencl_sum_mode_compensated) {
+		opencl_function_set_args(function, 5, 
+			sizeof(length), &length, 
+			sizeof(cl_mem), NULL, 
+			local_size * sizeof(float), NULL, 
+			local_size * sizeof(float), NULL, 
+			sizeof(cl_mem), NULL);
+	}else {
+		opencl_function_set_args(function, 4, 
+			sizeof(length), &length, 
+			sizeof(cl_mem), NULL, 
+			local_size * item_size, NULL, 
+			sizeof(cl_mem), NULL);
+	}
+	opencl_function_bind_buffer(function, 1, in, opencl_buffer_access_read);
+	opencl_function_bind_buffer(function, function->kernel->num_args - 1, sum->partials, opencl_buffer_access_write);
+	function->set_dims(function, 1, NULL, &global_size, &local_size);
+	int rc = function->execute(function, 0, NULL, NULL);
+	if(rc) return rc;
+	
+	void * partials = opencl_buffer_enqueue_read(sum->partials, sum->queue, CL_TRUE, 0, partials_size, sum->host_partials);
+	if(NULL == partials) return -1;
+	
+	switch(sum->mode) {
+	case opencl_sum_mode_plain: {
+			float total = 0;
+			const float * sums = partials;
+			for(size_t i = 0; i < num_groups; ++i) total += sums[i];
+			*result = total;
+		}
+		break;
+	case opencl_sum_mode_compensated:
+		*result = pairwise_sum(partials, num_groups);
+		break;
+	case opencl_sum_mode_double: {
+			double total = 0;
+			const double * sums = partials;
+			for(size_t i = 0; i < num_groups; ++i) total += sums[i];
+			*result = total;
+		}
+		break;
+	}
+	return 0;
+}
+
+struct opencl_sum * opencl_sum_init(struct opencl_sum * sum, cl_program program, cl_command_queue queue, enum opencl_sum_mode mode)
+{
+	assert(mode >= opencl_sum_mode_plain && mode <= opencl_sum_mode_double);
+	if(NULL == sum) sum = calloc(1, sizeof(*sum));
+	else memset(sum, 0, sizeof(*sum));
+	assert(sum);
+	
+	sum->mode = mode;
+	sum->execute = sum_execute;
+	
+	if(NULL == program) {
+		sum->backend = opencl_backend_type_host;
+		sum->local_size = (mode == opencl_sum_mode_plain)?SUM_LOCAL_SIZE:SUM_HOST_LOCAL_SIZE;
+		sum->max_groups = opencl_host_get_num_threads() * 4;
+		if(NULL == opencl_host_function_init(sum->func, s_kernel_names[mode])) {
+			opencl_sum_cleanup(sum);
+			return NULL;
+		}
+		return sum;
+	}
+	
+	assert(queue);
+	sum->backend = opencl_backend_type_opencl;
+	sum->queue = queue;
+	cl_device_id device = NULL;
+	cl_uint num_compute_units = 0;
+	cl_device_fp_config fp64_config = 0;
+	cl_int ret = clGetCommandQueueInfo(queue, CL_QUEUE_CONTEXT, sizeof(sum->ctx), &sum->ctx, NULL);
+	if(ret == CL_SUCCESS) ret = clGetCommandQueueInfo(queue, CL_QUEUE_DEVICE, sizeof(device), &device, NULL);
+	if(ret == CL_SUCCESS) ret = clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(num_compute_units), &num_compute_units, NULL);
+	assert(ret == CL_SUCCESS);
+	
+	// vec_sum_double is only built if the device supports fp64
+	if(mode == opencl_sum_mode_double) {
+		ret = clGetDeviceInfo(device, CL_DEVICE_DOUBLE_FP_CONFIG, sizeof(fp64_config), &fp64_config, NULL);
+		if(ret != CL_SUCCESS || 0 == fp64_config) {
+			opencl_sum_cleanup(sum);
+			return NULL;
+		}
+	}
+	
+	opencl_function_init(sum->func, program, s_kernel_names[mode]);
+	sum->func->queue = queue;
+	
+	size_t local_size = opencl_function_get_max_work_group_size(sum->func);
+	if(local_size > SUM_LOCAL_SIZE) local_size = SUM_LOCAL_SIZE;
+	if(0 == local_size) {
+		opencl_sum_cleanup(sum);
+		return NULL;
+	}
+	sum->local_size = local_size;
+	sum->max_groups = (num_compute_units?num_compute_units:1) * SUM_GROUPS_PER_CU;
+	return sum;
+}
+
+void opencl_sum_cleanup(struct opencl_sum * sum)
+{
+	if(NULL == sum) return;
+	opencl_function_cleanup(sum->func);
+	if(sum->partials->size) opencl_buffer_cleanup(sum->partials);
+	free(sum->host_partials);
+	sum->host_partials = NULL;
+	sum->host_partials_size = 0;
+	return;
+}
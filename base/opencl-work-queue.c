@@ -0,0 +1,485 @@
+/*
+ * opencl-work-queue.c
+ *
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <limits.h>
+#include <sched.h>
+
+#include "opencl-work-queue.h"
+#include "opencl-host.h"
+
+#define WORK_QUEUE_DEFAULT_CAPACITY (1024)
+#define WORK_QUEUE_LOCAL_SIZE (64)		// the descriptors are small jobs
+
+// the layout of struct work_ring (kernels/persistent.cl), atomic_uint counters
+struct opencl_work_ring
+{
+	uint32_t head;
+	uint32_t claimed;
+	uint32_t completed;
+	uint32_t quit;
+};
+
+const char * opencl_work_queue_mode_to_string(enum opencl_work_queue_mode mode)
+{
+	switch(mode) {
+	case opencl_work_queue_mode_batched: return "batched";
+	case opencl_work_queue_mode_persistent: return "persistent";
+	default: break;
+	}
+	return "unknown";
+}
+
+/* *
+ * batched
+ * */
+/*
+ * __kernel void persistent_batch(__global const struct work_desc * descs, __const uint first, __const uint capacity, 
+ *     __global float * Y, __global const float * X);
+*/
+static int batched_flush(struct opencl_work_queue * wq)
+{
+	uint32_t count = wq->head - wq->flushed;
+	if(0 == count) return 0;
+	
+	size_t desc_size = sizeof(struct opencl_work_desc);
+	uint32_t first = wq->flushed & (wq->capacity - 1);
+	uint32_t length = count;
+	if(first + length > wq->capacity) length = wq->capacity - first;
+	
+	// the ring's wrapped part is written separately
+	int rc = opencl_buffer_enqueue_write(wq->descs, wq->queue, CL_FALSE, first * desc_size, length * desc_size);
+	if(0 == rc && length < count) rc = opencl_buffer_enqueue_write(wq->descs, wq->queue, CL_FALSE, 0, (count - length) * desc_size);
+	if(rc) return rc;
+	
+	struct opencl_function * worker = wq->worker;
+	size_t local_size = wq->local_size;
+	size_t global_size = (size_t)count * local_size;
+	wq->arg_first = first;
+	worker->set_dims(worker, 1, NULL, &global_size, &local_size);
+	
+	cl_event event = NULL;
+	rc = worker->execute(worker, 0, NULL, (wq->backend == opencl_backend_type_host)?NULL:&event);
+	if(rc) return rc;
+	if(wq->event) clReleaseEvent(wq->event);
+	wq->event = event;
+	wq->flushed = wq->head;
+	if(wq->backend == opencl_backend_type_host) wq->completed = wq->head;
+	return 0;
+}
+
+static int batched_wait(struct opencl_work_queue * wq)
+{
+	int rc = batched_flush(wq);
+	if(rc) return rc;
+	
+	if(wq->event) {
+		cl_int ret = clWaitForEvents(1, &wq->event);
+		clReleaseEvent(wq->event);
+		wq->event = NULL;
+		if(ret != CL_SUCCESS) {
+			fprintf(stderr, "[ERROR]::%s(%d)::%s(): %s\n", 
+				__FILE__, __LINE__, __FUNCTION__, 
+				opencl_error_to_string(ret));
+			return -1;
+		}
+	}
+	wq->completed = wq->head;
+	return 0;
+}
+
+static int batched_start(struct opencl_work_queue * wq)
+{
+	struct opencl_function * worker = wq->worker;
+	opencl_function_set_args(worker, 5, 
+		sizeof(cl_mem), NULL, 
+		sizeof(wq->arg_first), &wq->arg_first, 
+		sizeof(wq->arg_capacity), &wq->arg_capacity, 
+		sizeof(cl_mem), NULL, 
+		sizeof(cl_mem), NULL);
+	opencl_function_bind_buffer(worker, 0, wq->descs, opencl_buffer_access_read);
+	opencl_function_bind_buffer(worker, 3, wq->Y, opencl_buffer_access_write);
+	opencl_function_bind_buffer(worker, 4, wq->X, opencl_buffer_access_read);
+	return 0;
+}
+
+/* *
+ * persistent (OpenCL 2.0 fine-grained SVM with atomics)
+ * */
+#if defined(CL_TARGET_OPENCL_VERSION) && (CL_TARGET_OPENCL_VERSION >= 200)
+static int program_has_kernel(cl_program program, const char * kernel_name)
+{
+	size_t cb_names = 0;
+	cl_int ret = clGetProgramInfo(program, CL_PROGRAM_KERNEL_NAMES, 0, NULL, &cb_names);
+	if(ret != CL_SUCCESS || 0 == cb_names) return 0;
+	
+	char * names = calloc(cb_names + 1, 1);
+	assert(names);
+	ret = clGetProgramInfo(program, CL_PROGRAM_KERNEL_NAMES, cb_names, names, NULL);
+	
+	int found = 0;
+	char * saveptr = NULL;
+	for(char * name = strtok_r(names, ";", &saveptr); ret == CL_SUCCESS && name; name = strtok_r(NULL, ";", &saveptr)) {
+		if(0 == strcmp(name, kernel_name)) {
+			found = 1;
+			break;
+		}
+	}
+	free(names);
+	return found;
+}
+
+static int persistent_check_worker(struct opencl_work_queue * wq)
+{
+	cl_int status = CL_COMPLETE;
+	cl_int ret = clGetEventInfo(wq->event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, NULL);
+	if(ret != CL_SUCCESS || status < 0) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): the worker has failed: %s\n", 
+			__FILE__, __LINE__, __FUNCTION__, 
+			opencl_error_to_string((ret != CL_SUCCESS)?ret:status));
+		return -1;
+	}
+	return 0;
+}
+
+// wait until the device has completed all the pushed descriptors
+static int persistent_wait(struct opencl_work_queue * wq)
+{
+	struct opencl_work_ring * ring = wq->ring;
+	for(unsigned int i = 1; ; ++i) {
+		wq->completed = __atomic_load_n(&ring->completed, __ATOMIC_ACQUIRE);
+		if(wq->completed == wq->head) break;
+		if(0 == (i % 1024) && persistent_check_worker(wq)) return -1;
+		sched_yield();
+	}
+	return 0;
+}
+
+// wait until the worker has copied the slot's previous descriptor
+static int persistent_wait_slot(struct opencl_work_queue * wq, struct opencl_work_desc * slot)
+{
+	for(unsigned int i = 1; __atomic_load_n(&slot->op, __ATOMIC_ACQUIRE) != opencl_work_op_none; ++i) {
+		if(0 == (i % 1024) && persistent_check_worker(wq)) return -1;
+		sched_yield();
+	}
+	return 0;
+}
+
+static int persistent_start(struct opencl_work_queue * wq)
+{
+	struct opencl_work_ring * ring = wq->ring;
+	memset(ring, 0, sizeof(*ring));
+	memset(wq->descs->cpu_data, 0, wq->descs->size);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	
+	struct opencl_function * worker = wq->worker;
+	opencl_function_set_args(worker, 5, 
+		sizeof(cl_mem), NULL, 
+		sizeof(cl_mem), NULL, 
+		sizeof(wq->arg_capacity), &wq->arg_capacity, 
+		sizeof(cl_mem), NULL, 
+		sizeof(cl_mem), NULL);
+	opencl_function_bind_buffer(worker, 0, wq->ring_buf, opencl_buffer_access_read_write);
+	opencl_function_bind_buffer(worker, 1, wq->descs, opencl_buffer_access_read_write);
+	opencl_function_bind_buffer(worker, 3, wq->Y, opencl_buffer_access_write);
+	opencl_function_bind_buffer(worker, 4, wq->X, opencl_buffer_access_read);
+	
+	size_t local_size = wq->local_size;
+	size_t global_size = wq->num_groups * local_size;
+	worker->set_dims(worker, 1, NULL, &global_size, &local_size);
+	int rc = worker->execute(worker, 0, NULL, &wq->event);
+	if(rc) return rc;
+	
+	// the worker must be running before the host polls its counters
+	cl_int ret = clFlush(wq->queue);
+	if(ret != CL_SUCCESS) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): %s\n", 
+			__FILE__, __LINE__, __FUNCTION__, 
+			opencl_error_to_string(ret));
+		return -1;
+	}
+	return 0;
+}
+
+static int persistent_stop(struct opencl_work_queue * wq)
+{
+	// the groups drain the ring, then exit
+	__atomic_store_n(&wq->ring->quit, 1, __ATOMIC_RELEASE);
+	cl_int ret = clWaitForEvents(1, &wq->event);
+	clReleaseEvent(wq->event);
+	wq->event = NULL;
+	if(ret != CL_SUCCESS) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): %s\n", 
+			__FILE__, __LINE__, __FUNCTION__, 
+			opencl_error_to_string(ret));
+		return -1;
+	}
+	wq->completed = __atomic_load_n(&wq->ring->completed, __ATOMIC_ACQUIRE);
+	return 0;
+}
+
+static void persistent_free_svm(struct opencl_work_queue * wq)
+{
+	if(wq->descs->size) opencl_buffer_cleanup(wq->descs);
+	if(wq->ring_buf->size) opencl_buffer_cleanup(wq->ring_buf);
+	wq->ring = NULL;
+}
+
+/*
+ * the ring and the descriptors are fine-grained SVM buffers with atomics (opencl_buffer_init_svm())
+*/
+static int persistent_init(struct opencl_work_queue * wq, cl_program program, cl_device_id device)
+{
+	if(!program_has_kernel(program, "persistent_worker")) return -1;	// not built with -cl-std=CL2.0
+	
+	const cl_mem_flags flags = CL_MEM_READ_WRITE | CL_MEM_SVM_ATOMICS;
+	opencl_buffer_init_svm(wq->ring_buf, wq->ctx, device, flags, sizeof(*wq->ring), NULL, opencl_buffer_type_svm_fine);
+	opencl_buffer_init_svm(wq->descs, wq->ctx, device, flags, wq->capacity * sizeof(struct opencl_work_desc), NULL, opencl_buffer_type_svm_fine);
+	if(wq->ring_buf->err_code != CL_SUCCESS || wq->descs->err_code != CL_SUCCESS
+		|| wq->ring_buf->type != opencl_buffer_type_svm_fine || wq->descs->type != opencl_buffer_type_svm_fine) {
+		persistent_free_svm(wq);
+		return -1;
+	}
+	wq->ring = wq->ring_buf->svm_data;
+	
+	opencl_function_init(wq->worker, program, "persistent_worker");
+	wq->worker->queue = wq->queue;
+	
+	size_t local_size = opencl_function_get_max_work_group_size(wq->worker);
+	if(local_size > WORK_QUEUE_LOCAL_SIZE) local_size = WORK_QUEUE_LOCAL_SIZE;
+	if(0 == local_size) {
+		opencl_function_cleanup(wq->worker);
+		persistent_free_svm(wq);
+		return -1;
+	}
+	
+	// the resident groups only: the others would not start before the first ones exit
+	wq->local_size = local_size;
+	wq->num_groups = opencl_function_get_grid_size(wq->worker, wq->capacity * local_size, local_size) / local_size;
+	return 0;
+}
+#endif
+
+/* *
+ * opencl_work_queue
+ * */
+static int work_queue_start(struct opencl_work_queue * wq, struct opencl_buffer * Y, struct opencl_buffer * X)
+{
+	assert(wq && Y && X);
+	if(wq->is_running) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): already started\n", 
+			__FILE__, __LINE__, __FUNCTION__);
+		return -1;
+	}
+	
+	wq->Y = Y;
+	wq->X = X;
+	wq->head = 0;
+	wq->flushed = 0;
+	wq->completed = 0;
+	
+	int rc = 0;
+#if defined(CL_TARGET_OPENCL_VERSION) && (CL_TARGET_OPENCL_VERSION >= 200)
+	if(wq->mode == opencl_work_queue_mode_persistent) rc = persistent_start(wq);
+	else
+#endif
+	rc = batched_start(wq);
+	if(0 == rc) wq->is_running = 1;
+	return rc;
+}
+
+static int work_queue_push(struct opencl_work_queue * wq, const struct opencl_work_desc * desc)
+{
+	assert(wq && desc);
+	assert(wq->is_running);
+	if(desc->op <= opencl_work_op_none || desc->op > opencl_work_op_add_scalar) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): invalid op %d\n", 
+			__FILE__, __LINE__, __FUNCTION__, 
+			(int)desc->op);
+		return -1;
+	}
+	if(desc->offset < 0 || desc->length < 0 
+		|| ((size_t)desc->offset + desc->length) * sizeof(float) > wq->Y->size
+		|| ((size_t)desc->offset + desc->length) * sizeof(float) > wq->X->size) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): invalid range [%d, +%d)\n", 
+			__FILE__, __LINE__, __FUNCTION__, 
+			(int)desc->offset, (int)desc->length);
+		return -1;
+	}
+	
+	struct opencl_work_desc * descs = wq->descs->cpu_data;
+	struct opencl_work_desc * slot = &descs[wq->head & (wq->capacity - 1)];
+#if defined(CL_TARGET_OPENCL_VERSION) && (CL_TARGET_OPENCL_VERSION >= 200)
+	if(wq->mode == opencl_work_queue_mode_persistent) {
+		if(persistent_wait_slot(wq, slot)) return -1;
+		*slot = *desc;
+		++wq->head;
+		
+		// publish the descriptor to the worker
+		__atomic_store_n(&wq->ring->head, wq->head, __ATOMIC_RELEASE);
+		return 0;
+	}
+#endif
+	
+	// batched: the slot is reused once the batch which has written it is done
+	if((uint32_t)(wq->head - wq->completed) >= wq->capacity) {
+		int rc = batched_wait(wq);
+		if(rc) return rc;
+	}
+	*slot = *desc;
+	++wq->head;
+	return 0;
+}
+
+static int work_queue_flush(struct opencl_work_queue * wq)
+{
+	assert(wq && wq->is_running);
+	if(wq->mode == opencl_work_queue_mode_persistent) return 0;
+	return batched_flush(wq);
+}
+
+static int work_queue_wait(struct opencl_work_queue * wq)
+{
+	assert(wq && wq->is_running);
+#if defined(CL_TARGET_OPENCL_VERSION) && (CL_TARGET_OPENCL_VERSION >= 200)
+	if(wq->mode == opencl_work_queue_mode_persistent) return persistent_wait(wq);
+#endif
+	return batched_wait(wq);
+}
+
+static int work_queue_stop(struct opencl_work_queue * wq)
+{
+	assert(wq);
+	if(!wq->is_running) return 0;
+	
+	int rc = 0;
+#if defined(CL_TARGET_OPENCL_VERSION) && (CL_TARGET_OPENCL_VERSION >= 200)
+	if(wq->mode == opencl_work_queue_mode_persistent) rc = persistent_stop(wq);
+	else
+#endif
+	rc = batched_wait(wq);
+	
+	wq->is_running = 0;
+	wq->Y = NULL;
+	wq->X = NULL;
+	return rc;
+}
+
+struct opencl_work_queue * opencl_work_queue_init(struct opencl_work_queue * wq, cl_program program, cl_command_queue queue, 
+	size_t capacity, enum opencl_work_queue_mode mode)
+{
+	if(NULL == wq) wq = calloc(1, sizeof(*wq));
+	else memset(wq, 0, sizeof(*wq));
+	assert(wq);
+	
+	if(0 == capacity) capacity = WORK_QUEUE_DEFAULT_CAPACITY;
+	assert(capacity <= ((size_t)1 << 30));
+	size_t size = 1;
+	while(size < capacity) size <<= 1;
+	wq->capacity = size;
+	wq->arg_capacity = (cl_uint)size;
+	
+	wq->start = work_queue_start;
+	wq->push = work_queue_push;
+	wq->flush = work_queue_flush;
+	wq->wait = work_queue_wait;
+	wq->stop = work_queue_stop;
+	
+	size_t cb_descs = wq->capacity * sizeof(struct opencl_work_desc);
+	wq->mode = opencl_work_queue_mode_batched;
+	if(NULL == program) {
+		wq->backend = opencl_backend_type_host;
+		wq->local_size = WORK_QUEUE_LOCAL_SIZE;
+		opencl_buffer_init(wq->descs, NULL, 0, cb_descs, NULL);
+		if(NULL == opencl_host_function_init(wq->worker, "persistent_batch")) {
+			opencl_work_queue_cleanup(wq);
+			return NULL;
+		}
+		return wq;
+	}
+	
+	assert(queue);
+	wq->backend = opencl_backend_type_opencl;
+	wq->queue = queue;
+	cl_device_id device = NULL;
+	cl_int ret = clGetCommandQueueInfo(queue, CL_QUEUE_CONTEXT, sizeof(wq->ctx), &wq->ctx, NULL);
+	if(ret == CL_SUCCESS) ret = clGetCommandQueueInfo(queue, CL_QUEUE_DEVICE, sizeof(device), &device, NULL);
+	assert(ret == CL_SUCCESS);
+	
+#if defined(CL_TARGET_OPENCL_VERSION) && (CL_TARGET_OPENCL_VERSION >= 200)
+	if(mode == opencl_work_queue_mode_persistent && 0 == persistent_init(wq, program, device)) {
+		wq->mode = opencl_work_queue_mode_persistent;
+		return wq;
+	}
+#else
+	(void)device;
+#endif
+	
+	// batched: the descriptors are staged on the host and written to the device on flush
+	opencl_buffer_init(wq->descs, wq->ctx, CL_MEM_READ_ONLY, cb_descs, NULL);
+	if(wq->descs->err_code != CL_SUCCESS) {
+		opencl_work_queue_cleanup(wq);
+		return NULL;
+	}
+	wq->descs->cpu_data = calloc(wq->capacity, sizeof(struct opencl_work_desc));
+	assert(wq->descs->cpu_data);
+	wq->descs->on_free_cpu_data = free;
+	
+	opencl_function_init(wq->worker, program, "persistent_batch");
+	wq->worker->queue = queue;
+	size_t local_size = opencl_function_get_max_work_group_size(wq->worker);
+	if(local_size > WORK_QUEUE_LOCAL_SIZE) local_size = WORK_QUEUE_LOCAL_SIZE;
+	if(0 == local_size) {
+		opencl_work_queue_cleanup(wq);
+		return NULL;
+	}
+	wq->local_size = local_size;
+	return wq;
+}
+
+void opencl_work_queue_cleanup(struct opencl_work_queue * wq)
+{
+	if(NULL == wq) return;
+	work_queue_stop(wq);
+	opencl_function_cleanup(wq->worker);
+	if(wq->event) {
+		clReleaseEvent(wq->event);
+		wq->event = NULL;
+	}
+#if defined(CL_TARGET_OPENCL_VERSION) && (CL_TARGET_OPENCL_VERSION >= 200)
+	if(wq->mode == opencl_work_queue_mode_persistent) {
+		persistent_free_svm(wq);
+		return;
+	}
+#endif
+	if(wq->descs->size) opencl_buffer_cleanup(wq->descs);
+	return;
+}
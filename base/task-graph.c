@@ -0,0 +1,819 @@
+/*
+ * task-graph.c
+ *
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <strings.h>
+
+#include "task-graph.h"
+
+static int graph_error(struct task_graph * graph, const char * path, const char * fmt, ...)
+{
+	int cb = snprintf(graph->err_msg, sizeof(graph->err_msg), "%s: ", path);
+	if(cb < 0 || cb >= (int)sizeof(graph->err_msg)) return -1;
+
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(graph->err_msg + cb, sizeof(graph->err_msg) - cb, fmt, ap);
+	va_end(ap);
+	return -1;
+}
+
+/*
+ * typos in the keys are reported instead of being silently ignored
+*/
+static int check_keys(struct task_graph * graph, json_object * jobject, const char * path, const char ** known_keys)
+{
+	struct json_object_iterator iter = json_object_iter_begin(jobject);
+	struct json_object_iterator end = json_object_iter_end(jobject);
+	for(; !json_object_iter_equal(&iter, &end); json_object_iter_next(&iter)) {
+		const char * key = json_object_iter_peek_name(&iter);
+		int found = 0;
+		for(const char ** known = known_keys; *known; ++known) {
+			if(strcmp(key, *known) == 0) { found = 1; break; }
+		}
+		if(!found) return graph_error(graph, path, "unknown key '%s'", key);
+	}
+	return 0;
+}
+
+static int get_integer(struct task_graph * graph, json_object * jvalue, const char * path, int64_t min_value, int64_t max_value, int64_t * p_value)
+{
+	if(!json_object_is_type(jvalue, json_type_int)) return graph_error(graph, path, "expected an integer");
+	int64_t value = json_object_get_int64(jvalue);
+	if(value < min_value || value > max_value) {
+		return graph_error(graph, path, "%ld is out of range [%ld, %ld]", (long)value, (long)min_value, (long)max_value);
+	}
+	*p_value = value;
+	return 0;
+}
+
+static int get_string(struct task_graph * graph, json_object * jvalue, const char * path, char * dst, size_t size)
+{
+	if(!json_object_is_type(jvalue, json_type_string)) return graph_error(graph, path, "expected a string");
+	const char * value = json_object_get_string(jvalue);
+	size_t length = strlen(value);
+	if(0 == length) return graph_error(graph, path, "empty string");
+	if(length >= size) return graph_error(graph, path, "'%s' is too long (max: %d)", value, (int)size - 1);
+	memcpy(dst, value, length + 1);
+	return 0;
+}
+
+// "[x, y, z]": exactly work_dim items
+static int get_sizes(struct task_graph * graph, json_object * jarray, const char * path, int work_dim, int64_t min_value, uint64_t sizes[3])
+{
+	if(!json_object_is_type(jarray, json_type_array)) return graph_error(graph, path, "expected an array of %d integers", work_dim);
+	int length = json_object_array_length(jarray);
+	if(length != work_dim) return graph_error(graph, path, "expected %d items (dims), got %d", work_dim, length);
+
+	char item_path[200] = "";
+	for(int i = 0; i < length; ++i) {
+		int64_t value = 0;
+		snprintf(item_path, sizeof(item_path), "%s[%d]", path, i);
+		if(get_integer(graph, json_object_array_get_idx(jarray, i), item_path, min_value, INT64_MAX, &value)) return -1;
+		sizes[i] = value;
+	}
+	return 0;
+}
+
+static int get_number(struct task_graph * graph, json_object * jvalue, const char * path, double * p_value)
+{
+	if(!json_object_is_type(jvalue, json_type_double) && !json_object_is_type(jvalue, json_type_int)) {
+		return graph_error(graph, path, "expected a number");
+	}
+	*p_value = json_object_get_double(jvalue);
+	return 0;
+}
+
+static int get_enum(struct task_graph * graph, json_object * jvalue, const char * path, const char ** names, int * p_value)
+{
+	if(!json_object_is_type(jvalue, json_type_string)) return graph_error(graph, path, "expected a string");
+	const char * value = json_object_get_string(jvalue);
+	for(int i = 0; names[i]; ++i) {
+		if(names[i][0] && strcmp(value, names[i]) == 0) {
+			*p_value = i;
+			return 0;
+		}
+	}
+	return graph_error(graph, path, "unknown value '%s'", value);
+}
+
+static const char * s_data_types[] = { "float", "int", "uint", NULL };
+static const char * s_buffer_access[] = { "", "read_only", "write_only", "read_write", NULL };	// enum task_graph_access
+static const char * s_arg_access[] = { "", "read", "write", "read_write", NULL };
+static const char * s_residencies[] = { "device", "host", NULL };
+
+static const char * s_buffer_keys[] = {
+	"name", "type", "length", "access", "residency", "init",
+	NULL
+};
+
+static int parse_buffer(struct task_graph * graph, int index, json_object * jbuffer)
+{
+	struct task_graph_buffer * buffer = &graph->buffers[index];
+	memset(buffer, 0, sizeof(*buffer));
+	buffer->type = task_graph_data_type_float;
+	buffer->access = task_graph_access_read_write;
+	buffer->residency = task_graph_residency_device;
+
+	char path[100] = "";
+	char sub_path[200] = "";
+	snprintf(path, sizeof(path), "buffers[%d]", index);
+	if(!json_object_is_type(jbuffer, json_type_object)) return graph_error(graph, path, "expected an object");
+	if(check_keys(graph, jbuffer, path, s_buffer_keys)) return -1;
+
+	json_object * jvalue = NULL;
+	int64_t value = 0;
+
+	snprintf(sub_path, sizeof(sub_path), "%s.name", path);
+	if(!json_object_object_get_ex(jbuffer, "name", &jvalue)) return graph_error(graph, sub_path, "missing");
+	if(get_string(graph, jvalue, sub_path, buffer->name, sizeof(buffer->name))) return -1;
+	for(int i = 0; i < index; ++i) {
+		if(strcmp(graph->buffers[i].name, buffer->name) == 0) {
+			return graph_error(graph, sub_path, "duplicated name '%s' (buffers[%d])", buffer->name, i);
+		}
+	}
+
+	snprintf(sub_path, sizeof(sub_path), "%s.length", path);
+	if(!json_object_object_get_ex(jbuffer, "length", &jvalue)) return graph_error(graph, sub_path, "missing");
+	if(get_integer(graph, jvalue, sub_path, 1, INT32_MAX, &value)) return -1;
+	buffer->length = value;
+
+	if(json_object_object_get_ex(jbuffer, "type", &jvalue)) {
+		snprintf(sub_path, sizeof(sub_path), "%s.type", path);
+		if(get_enum(graph, jvalue, sub_path, s_data_types, &buffer->type)) return -1;
+	}
+	if(json_object_object_get_ex(jbuffer, "access", &jvalue)) {
+		snprintf(sub_path, sizeof(sub_path), "%s.access", path);
+		if(get_enum(graph, jvalue, sub_path, s_buffer_access, &buffer->access)) return -1;
+	}
+	if(json_object_object_get_ex(jbuffer, "residency", &jvalue)) {
+		snprintf(sub_path, sizeof(sub_path), "%s.residency", path);
+		if(get_enum(graph, jvalue, sub_path, s_residencies, &buffer->residency)) return -1;
+	}
+	if(json_object_object_get_ex(jbuffer, "init", &jvalue) && !json_object_is_type(jvalue, json_type_null)) {
+		snprintf(sub_path, sizeof(sub_path), "%s.init", path);
+		if(!json_object_is_type(jvalue, json_type_array) || json_object_array_length(jvalue) != 2) {
+			return graph_error(graph, sub_path, "expected [start, step]");
+		}
+		for(int i = 0; i < 2; ++i) {
+			snprintf(sub_path, sizeof(sub_path), "%s.init[%d]", path, i);
+			if(get_number(graph, json_object_array_get_idx(jvalue, i), sub_path, &buffer->init[i])) return -1;
+		}
+		buffer->has_init = 1;
+	}
+	return 0;
+}
+
+static const char * s_arg_keys[] = {
+	"buffer", "access", "offset", "length", 
+	"float", "int", "uint", "local", "local_per_item",
+	NULL
+};
+
+static int parse_arg(struct task_graph * graph, struct task_graph_arg * arg, json_object * jarg, const char * path)
+{
+	memset(arg, 0, sizeof(*arg));
+	arg->buffer_index = -1;
+
+	char sub_path[300] = "";
+	if(!json_object_is_type(jarg, json_type_object)) return graph_error(graph, path, "expected an object");
+	if(check_keys(graph, jarg, path, s_arg_keys)) return -1;
+
+	// exactly one of the value keys
+	static const char * value_keys[] = { "buffer", "float", "int", "uint", "local", "local_per_item", NULL };
+	const char * key = NULL;
+	json_object * jvalue = NULL;
+	for(int i = 0; value_keys[i]; ++i) {
+		json_object * jitem = NULL;
+		if(!json_object_object_get_ex(jarg, value_keys[i], &jitem)) continue;
+		if(key) return graph_error(graph, path, "both '%s' and '%s' are set", key, value_keys[i]);
+		key = value_keys[i];
+		jvalue = jitem;
+	}
+	if(NULL == key) return graph_error(graph, path, "expected one of 'buffer', 'float', 'int', 'uint', 'local', 'local_per_item'");
+
+	int is_buffer = (strcmp(key, "buffer") == 0);
+	if(!is_buffer) {
+		json_object * jitem = NULL;
+		if(json_object_object_get_ex(jarg, "access", &jitem)
+			|| json_object_object_get_ex(jarg, "offset", &jitem)
+			|| json_object_object_get_ex(jarg, "length", &jitem))
+		{
+			return graph_error(graph, path, "'access', 'offset' and 'length' only apply to buffers");
+		}
+	}
+
+	snprintf(sub_path, sizeof(sub_path), "%s.%s", path, key);
+	int64_t value = 0;
+	double number = 0;
+	if(is_buffer) {
+		char name[TASK_GRAPH_MAX_NAME] = "";
+		if(get_string(graph, jvalue, sub_path, name, sizeof(name))) return -1;
+		for(int i = 0; i < graph->num_buffers; ++i) {
+			if(strcmp(graph->buffers[i].name, name) == 0) { arg->buffer_index = i; break; }
+		}
+		if(arg->buffer_index < 0) return graph_error(graph, sub_path, "undefined buffer '%s'", name);
+		const struct task_graph_buffer * buffer = &graph->buffers[arg->buffer_index];
+
+		arg->type = task_graph_arg_type_buffer;
+		arg->access = buffer->access;
+		if(json_object_object_get_ex(jarg, "access", &jvalue)) {
+			snprintf(sub_path, sizeof(sub_path), "%s.access", path);
+			if(get_enum(graph, jvalue, sub_path, s_arg_access, &arg->access)) return -1;
+			if((arg->access & buffer->access) != arg->access) {
+				return graph_error(graph, sub_path, "'%s' is %s", buffer->name, s_buffer_access[buffer->access]);
+			}
+		}
+
+		arg->length = buffer->length;
+		if(json_object_object_get_ex(jarg, "offset", &jvalue)) {
+			snprintf(sub_path, sizeof(sub_path), "%s.offset", path);
+			if(get_integer(graph, jvalue, sub_path, 0, buffer->length - 1, &value)) return -1;
+			arg->offset = value;
+			arg->length = buffer->length - arg->offset;
+		}
+		if(json_object_object_get_ex(jarg, "length", &jvalue)) {
+			snprintf(sub_path, sizeof(sub_path), "%s.length", path);
+			if(get_integer(graph, jvalue, sub_path, 1, buffer->length - arg->offset, &value)) return -1;
+			arg->length = value;
+		}
+	}else if(strcmp(key, "float") == 0) {
+		if(get_number(graph, jvalue, sub_path, &number)) return -1;
+		arg->type = task_graph_arg_type_float;
+		arg->value.f32 = (float)number;
+	}else if(strcmp(key, "int") == 0) {
+		if(get_integer(graph, jvalue, sub_path, INT32_MIN, INT32_MAX, &value)) return -1;
+		arg->type = task_graph_arg_type_int;
+		arg->value.i32 = value;
+	}else if(strcmp(key, "uint") == 0) {
+		if(get_integer(graph, jvalue, sub_path, 0, UINT32_MAX, &value)) return -1;
+		arg->type = task_graph_arg_type_uint;
+		arg->value.u32 = value;
+	}else {
+		if(get_integer(graph, jvalue, sub_path, 1, INT32_MAX, &value)) return -1;
+		arg->type = task_graph_arg_type_local;
+		arg->local_per_item = (strcmp(key, "local_per_item") == 0);
+		arg->value.cb_local = value;
+	}
+	return 0;
+}
+
+static const char * s_function_keys[] = { "kernel", "args", NULL };
+
+static int parse_function(struct task_graph * graph, struct task_graph_function * function, json_object * jfunction, const char * path)
+{
+	memset(function, 0, sizeof(*function));
+	if(json_object_is_type(jfunction, json_type_string)) {
+		return get_string(graph, jfunction, path, function->kernel_name, sizeof(function->kernel_name));
+	}
+	if(!json_object_is_type(jfunction, json_type_object)) return graph_error(graph, path, "expected a kernel name or an object");
+	if(check_keys(graph, jfunction, path, s_function_keys)) return -1;
+
+	char sub_path[300] = "";
+	json_object * jvalue = NULL;
+	snprintf(sub_path, sizeof(sub_path), "%s.kernel", path);
+	if(!json_object_object_get_ex(jfunction, "kernel", &jvalue)) return graph_error(graph, sub_path, "missing");
+	if(get_string(graph, jvalue, sub_path, function->kernel_name, sizeof(function->kernel_name))) return -1;
+
+	if(!json_object_object_get_ex(jfunction, "args", &jvalue) || json_object_is_type(jvalue, json_type_null)) return 0;
+	snprintf(sub_path, sizeof(sub_path), "%s.args", path);
+	if(!json_object_is_type(jvalue, json_type_array)) return graph_error(graph, sub_path, "expected an array");
+	int num_args = json_object_array_length(jvalue);
+	if(num_args > TASK_GRAPH_MAX_ARGS) return graph_error(graph, sub_path, "too many args (max: %d)", TASK_GRAPH_MAX_ARGS);
+	for(int i = 0; i < num_args; ++i) {
+		snprintf(sub_path, sizeof(sub_path), "%s.args[%d]", path, i);
+		if(parse_arg(graph, &function->args[i], json_object_array_get_idx(jvalue, i), sub_path)) return -1;
+	}
+	function->num_args = num_args;
+	return 0;
+}
+
+static const char * s_task_keys[] = {
+	"functions", "dims", "n", "global_sizes", "local_sizes", "offsets", "dependencies", "device",
+	NULL
+};
+
+static int parse_task(struct task_graph * graph, int index, json_object * jtask)
+{
+	struct task_graph_task * task = &graph->tasks[index];
+	memset(task, 0, sizeof(*task));
+	task->index = index;
+	task->work_dim = 1;
+	task->device_index = -1;
+	for(int i = 0; i < 3; ++i) task->global_sizes[i] = 1;
+
+	char path[100] = "";
+	char sub_path[200] = "";
+	snprintf(path, sizeof(path), "tasks[%d]", index);
+	if(!json_object_is_type(jtask, json_type_object)) return graph_error(graph, path, "expected an object");
+	if(check_keys(graph, jtask, path, s_task_keys)) return -1;
+
+	int64_t value = 0;
+	json_object * jvalue = NULL;
+
+	// functions
+	snprintf(sub_path, sizeof(sub_path), "%s.functions", path);
+	if(!json_object_object_get_ex(jtask, "functions", &jvalue)) return graph_error(graph, sub_path, "missing");
+	if(!json_object_is_type(jvalue, json_type_array)) return graph_error(graph, sub_path, "expected an array of kernel names");
+	int num_functions = json_object_array_length(jvalue);
+	if(num_functions <= 0 || num_functions > TASK_GRAPH_MAX_FUNCTIONS) {
+		return graph_error(graph, sub_path, "expected 1 ~ %d kernel names, got %d", TASK_GRAPH_MAX_FUNCTIONS, num_functions);
+	}
+	for(int i = 0; i < num_functions; ++i) {
+		snprintf(sub_path, sizeof(sub_path), "%s.functions[%d]", path, i);
+		if(parse_function(graph, &task->functions[i], json_object_array_get_idx(jvalue, i), sub_path)) return -1;
+	}
+	task->num_functions = num_functions;
+
+	// dims
+	if(json_object_object_get_ex(jtask, "dims", &jvalue)) {
+		snprintf(sub_path, sizeof(sub_path), "%s.dims", path);
+		if(get_integer(graph, jvalue, sub_path, 1, 3, &value)) return -1;
+		task->work_dim = value;
+	}
+
+	// global sizes
+	json_object * jn = NULL;
+	json_object * jglobal_sizes = NULL;
+	json_object_object_get_ex(jtask, "n", &jn);
+	json_object_object_get_ex(jtask, "global_sizes", &jglobal_sizes);
+	if(jn && jglobal_sizes) return graph_error(graph, path, "both 'n' and 'global_sizes' are set");
+	if(jn) {
+		snprintf(sub_path, sizeof(sub_path), "%s.n", path);
+		if(get_integer(graph, jn, sub_path, 1, INT32_MAX, &value)) return -1;
+		task->global_sizes[0] = value;
+		task->grid_stride = 1;
+	}else if(jglobal_sizes) {
+		snprintf(sub_path, sizeof(sub_path), "%s.global_sizes", path);
+		if(get_sizes(graph, jglobal_sizes, sub_path, task->work_dim, 1, task->global_sizes)) return -1;
+	}else {
+		return graph_error(graph, path, "missing 'n' or 'global_sizes'");
+	}
+
+	if(json_object_object_get_ex(jtask, "local_sizes", &jvalue) && !json_object_is_type(jvalue, json_type_null)) {
+		snprintf(sub_path, sizeof(sub_path), "%s.local_sizes", path);
+		if(get_sizes(graph, jvalue, sub_path, task->work_dim, 1, task->local_sizes)) return -1;
+		for(int i = task->grid_stride?1:0; i < task->work_dim; ++i) {
+			if(task->global_sizes[i] % task->local_sizes[i]) {
+				return graph_error(graph, sub_path, "global size %lu is not a multiple of the local size %lu (dim %d)",
+					(unsigned long)task->global_sizes[i], (unsigned long)task->local_sizes[i], i);
+			}
+		}
+	}
+
+	if(json_object_object_get_ex(jtask, "offsets", &jvalue) && !json_object_is_type(jvalue, json_type_null)) {
+		snprintf(sub_path, sizeof(sub_path), "%s.offsets", path);
+		if(get_sizes(graph, jvalue, sub_path, task->work_dim, 0, task->offsets)) return -1;
+	}
+
+	// dependencies
+	if(json_object_object_get_ex(jtask, "dependencies", &jvalue) && !json_object_is_type(jvalue, json_type_null)) {
+		snprintf(sub_path, sizeof(sub_path), "%s.dependencies", path);
+		if(!json_object_is_type(jvalue, json_type_array)) return graph_error(graph, sub_path, "expected an array of task indices");
+		int num_dependencies = json_object_array_length(jvalue);
+		for(int i = 0; i < num_dependencies; ++i) {
+			snprintf(sub_path, sizeof(sub_path), "%s.dependencies[%d]", path, i);
+			if(get_integer(graph, json_object_array_get_idx(jvalue, i), sub_path, 0, graph->num_tasks - 1, &value)) return -1;
+			if(value == index) return graph_error(graph, sub_path, "a task can't depend on itself");
+			for(int j = 0; j < task->num_dependencies; ++j) {
+				if(task->dependencies[j] == value) return graph_error(graph, sub_path, "duplicated dependency %d", (int)value);
+			}
+			task->dependencies[task->num_dependencies++] = value;
+		}
+	}
+
+	// device placement
+	if(json_object_object_get_ex(jtask, "device", &jvalue) && !json_object_is_type(jvalue, json_type_null)) {
+		snprintf(sub_path, sizeof(sub_path), "%s.device", path);
+		if(get_integer(graph, jvalue, sub_path, 0, INT32_MAX, &value)) return -1;
+		task->device_index = value;
+	}
+	return 0;
+}
+
+/*
+ * Kahn's algorithm, the tasks left over are on a dependency cycle
+*/
+static int build_order(struct task_graph * graph)
+{
+	int num_tasks = graph->num_tasks;
+	int num_waiting[TASK_GRAPH_MAX_TASKS] = { 0 };
+	int done[TASK_GRAPH_MAX_TASKS] = { 0 };
+
+	for(int i = 0; i < num_tasks; ++i) num_waiting[i] = graph->tasks[i].num_dependencies;
+
+	int num_ordered = 0;
+	while(num_ordered < num_tasks) {
+		int next = -1;
+		for(int i = 0; i < num_tasks; ++i) {
+			if(!done[i] && 0 == num_waiting[i]) { next = i; break; }
+		}
+		if(next < 0) break;
+
+		done[next] = 1;
+		graph->order[num_ordered++] = next;
+		for(int i = 0; i < num_tasks; ++i) {
+			const struct task_graph_task * task = &graph->tasks[i];
+			for(int j = 0; j < task->num_dependencies; ++j) {
+				if(task->dependencies[j] == next) --num_waiting[i];
+			}
+		}
+	}
+
+	if(num_ordered < num_tasks) {
+		for(int i = 0; i < num_tasks; ++i) {
+			if(done[i]) continue;
+			char path[100] = "";
+			snprintf(path, sizeof(path), "tasks[%d].dependencies", i);
+			return graph_error(graph, path, "dependency cycle");
+		}
+	}
+	return 0;
+}
+
+/*
+ * a task reading a buffer written by another task must depend on it,
+ * otherwise nothing orders the accesses (or copies the data to the reader's worker process).
+*/
+static int check_data_flow(struct task_graph * graph)
+{
+	for(int consumer = 0; consumer < graph->num_tasks; ++consumer) {
+		const struct task_graph_task * task = &graph->tasks[consumer];
+		for(int i = 0; i < task->num_functions; ++i) {
+			const struct task_graph_function * function = &task->functions[i];
+			for(int j = 0; j < function->num_args; ++j) {
+				const struct task_graph_arg * arg = &function->args[j];
+				if(arg->type != task_graph_arg_type_buffer || !(arg->access & task_graph_access_read)) continue;
+				
+				for(int producer = 0; producer < graph->num_tasks; ++producer) {
+					if(producer == consumer) continue;
+					struct task_graph_range range;
+					int is_dependency = 0;
+					for(int k = 0; k < task->num_dependencies; ++k) is_dependency |= (task->dependencies[k] == producer);
+					if(is_dependency || 0 == task_graph_get_edge_ranges(graph, producer, consumer, &range, 1)) continue;
+					
+					char path[200] = "";
+					snprintf(path, sizeof(path), "tasks[%d].functions[%d].args[%d]", consumer, i, j);
+					return graph_error(graph, path, "reads '%s' written by tasks[%d], but doesn't depend on it", 
+						graph->buffers[arg->buffer_index].name, producer);
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+int task_graph_get_edge_ranges(const struct task_graph * graph, int producer, int consumer, struct task_graph_range * ranges, int max_ranges)
+{
+	assert(graph && producer >= 0 && producer < graph->num_tasks && consumer >= 0 && consumer < graph->num_tasks);
+	const struct task_graph_task * writer = &graph->tasks[producer];
+	const struct task_graph_task * reader = &graph->tasks[consumer];
+	
+	int num_ranges = 0;
+	for(int i = 0; i < writer->num_functions; ++i) {
+		const struct task_graph_function * function = &writer->functions[i];
+		for(int j = 0; j < function->num_args; ++j) {
+			const struct task_graph_arg * arg = &function->args[j];
+			if(arg->type != task_graph_arg_type_buffer || !(arg->access & task_graph_access_write)) continue;
+			
+			// read by the consumer
+			int is_read = 0;
+			for(int k = 0; !is_read && k < reader->num_functions; ++k) {
+				const struct task_graph_function * reader_function = &reader->functions[k];
+				for(int l = 0; l < reader_function->num_args; ++l) {
+					const struct task_graph_arg * reader_arg = &reader_function->args[l];
+					if(reader_arg->type == task_graph_arg_type_buffer 
+						&& reader_arg->buffer_index == arg->buffer_index 
+						&& (reader_arg->access & task_graph_access_read)
+						&& reader_arg->offset < (arg->offset + arg->length)
+						&& arg->offset < (reader_arg->offset + reader_arg->length)) 
+					{
+						is_read = 1;
+						break;
+					}
+				}
+			}
+			if(!is_read) continue;
+			
+			int is_duplicated = 0;
+			for(int k = 0; k < num_ranges && k < max_ranges; ++k) {
+				is_duplicated |= (ranges[k].buffer_index == arg->buffer_index 
+					&& ranges[k].offset == arg->offset && ranges[k].length == arg->length);
+			}
+			if(is_duplicated) continue;
+			if(num_ranges < max_ranges) {
+				ranges[num_ranges] = (struct task_graph_range){ arg->buffer_index, arg->offset, arg->length };
+			}
+			++num_ranges;
+		}
+	}
+	return num_ranges;
+}
+
+static const char * s_config_keys[] = {
+	"backend", "platform", "pipeline_depth", "shutdown_timeout_ms", "multi_processes", "kernels", "watch", "build_options", 
+	"memory_budget_mb", "numa", "buffers", "tasks",
+	NULL
+};
+
+static int parse_settings(struct task_graph * graph, json_object * jconfig)
+{
+	struct task_graph_settings * settings = &graph->settings;
+	json_object * jvalue = NULL;
+	int64_t value = 0;
+
+	if(json_object_object_get_ex(jconfig, "backend", &jvalue)) {
+		if(get_string(graph, jvalue, "backend", settings->backend, sizeof(settings->backend))) return -1;
+		if(strcasecmp(settings->backend, "opencl") && strcasecmp(settings->backend, "host")) {
+			return graph_error(graph, "backend", "unknown backend '%s' (opencl | host)", settings->backend);
+		}
+	}
+	if(json_object_object_get_ex(jconfig, "platform", &jvalue)) {
+		if(get_string(graph, jvalue, "platform", settings->platform, sizeof(settings->platform))) return -1;
+	}
+	if(json_object_object_get_ex(jconfig, "pipeline_depth", &jvalue)) {
+		if(get_integer(graph, jvalue, "pipeline_depth", 1, INT32_MAX, &value)) return -1;
+		settings->pipeline_depth = value;
+	}
+	if(json_object_object_get_ex(jconfig, "shutdown_timeout_ms", &jvalue)) {
+		if(get_integer(graph, jvalue, "shutdown_timeout_ms", -1, INT64_MAX, &value)) return -1;
+		settings->shutdown_timeout_ms = value;
+		settings->has_shutdown_timeout = 1;
+	}
+	if(json_object_object_get_ex(jconfig, "multi_processes", &jvalue)) {
+		if(!json_object_is_type(jvalue, json_type_boolean)) return graph_error(graph, "multi_processes", "expected true or false");
+		settings->multi_processes = json_object_get_boolean(jvalue);
+	}
+	if(json_object_object_get_ex(jconfig, "kernels", &jvalue)) {
+		if(get_string(graph, jvalue, "kernels", settings->kernel_file, sizeof(settings->kernel_file))) return -1;
+	}
+	if(json_object_object_get_ex(jconfig, "watch", &jvalue)) {
+		if(!json_object_is_type(jvalue, json_type_boolean)) return graph_error(graph, "watch", "expected true or false");
+		settings->watch = json_object_get_boolean(jvalue);
+	}
+	if(json_object_object_get_ex(jconfig, "build_options", &jvalue)) {
+		if(get_string(graph, jvalue, "build_options", settings->build_options, sizeof(settings->build_options))) return -1;
+	}
+	if(json_object_object_get_ex(jconfig, "memory_budget_mb", &jvalue)) {
+		if(get_integer(graph, jvalue, "memory_budget_mb", 1, INT64_MAX / (1 << 20), &value)) return -1;
+		settings->memory_budget_mb = value;
+	}
+	if(json_object_object_get_ex(jconfig, "numa", &jvalue)) {
+		if(!json_object_is_type(jvalue, json_type_boolean)) return graph_error(graph, "numa", "expected true or false");
+		settings->numa = json_object_get_boolean(jvalue);
+	}
+	return 0;
+}
+
+int task_graph_load_json(struct task_graph * graph, json_object * jconfig)
+{
+	assert(graph);
+	task_graph_cleanup(graph);
+	graph->settings.multi_processes = -1;
+	graph->settings.watch = -1;
+	graph->settings.numa = -1;
+
+	if(!json_object_is_type(jconfig, json_type_object)) return graph_error(graph, "(config)", "expected an object");
+	if(check_keys(graph, jconfig, "(config)", s_config_keys)) return -1;
+	if(parse_settings(graph, jconfig)) return -1;
+
+	json_object * jbuffers = NULL;
+	if(json_object_object_get_ex(jconfig, "buffers", &jbuffers) && !json_object_is_type(jbuffers, json_type_null)) {
+		if(!json_object_is_type(jbuffers, json_type_array)) return graph_error(graph, "buffers", "expected an array");
+		int num_buffers = json_object_array_length(jbuffers);
+		if(num_buffers > TASK_GRAPH_MAX_BUFFERS) {
+			return graph_error(graph, "buffers", "too many buffers (max: %d)", TASK_GRAPH_MAX_BUFFERS);
+		}
+		if(num_buffers > 0) {
+			graph->buffers = calloc(num_buffers, sizeof(*graph->buffers));
+			assert(graph->buffers);
+			graph->num_buffers = num_buffers;
+		}
+		for(int i = 0; i < num_buffers; ++i) {
+			if(parse_buffer(graph, i, json_object_array_get_idx(jbuffers, i))) return -1;
+		}
+	}
+
+	json_object * jtasks = NULL;
+	if(!json_object_object_get_ex(jconfig, "tasks", &jtasks)) return graph_error(graph, "tasks", "missing");
+	if(!json_object_is_type(jtasks, json_type_array)) return graph_error(graph, "tasks", "expected an array");
+	int num_tasks = json_object_array_length(jtasks);
+	if(num_tasks <= 0 || num_tasks > TASK_GRAPH_MAX_TASKS) {
+		return graph_error(graph, "tasks", "expected 1 ~ %d tasks, got %d", TASK_GRAPH_MAX_TASKS, num_tasks);
+	}
+
+	graph->tasks = calloc(num_tasks, sizeof(*graph->tasks));
+	graph->order = calloc(num_tasks, sizeof(*graph->order));
+	assert(graph->tasks && graph->order);
+	graph->num_tasks = num_tasks;
+
+	for(int i = 0; i < num_tasks; ++i) {
+		if(parse_task(graph, i, json_object_array_get_idx(jtasks, i))) return -1;
+	}
+	if(check_data_flow(graph)) return -1;
+	return build_order(graph);
+}
+
+int task_graph_load_file(struct task_graph * graph, const char * conf_file, const char * cache_file)
+{
+	assert(graph && conf_file);
+	if(cache_file && 0 == task_graph_load_binary(graph, cache_file, conf_file)) return 0;
+
+	json_object * jconfig = json_object_from_file(conf_file);
+	if(NULL == jconfig) {
+		task_graph_cleanup(graph);
+		const char * reason = json_util_get_last_err();
+		if(NULL == reason) reason = "failed to parse the json file";
+		int cb = strcspn(reason, "\n");	// json-c appends a '\n'
+		return graph_error(graph, "(config)", "%.*s", cb, reason);
+	}
+
+	int rc = task_graph_load_json(graph, jconfig);
+	json_object_put(jconfig);
+	if(rc) return rc;
+
+	if(cache_file && task_graph_save_binary(graph, cache_file, conf_file)) {
+		fprintf(stderr, "[WARNING]::%s(%d)::%s(): failed to write the cache '%s'\n",
+			__FILE__, __LINE__, __FUNCTION__, cache_file);
+	}
+	return 0;
+}
+
+void task_graph_cleanup(struct task_graph * graph)
+{
+	if(NULL == graph) return;
+	free(graph->buffers);
+	free(graph->tasks);
+	free(graph->order);
+	memset(graph, 0, sizeof(*graph));
+	return;
+}
+
+/*********************************************
+ * binary cache:
+ *   header | settings | buffers[num_buffers] | tasks[num_tasks]
+ *   only valid for the config file of the same size and mtime, and for the same build
+*********************************************/
+#define TASK_GRAPH_MAGIC	"TGRAPH\0\0"
+#define TASK_GRAPH_VERSION	(7)
+
+struct task_graph_file_header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t cb_settings;
+	uint32_t cb_buffer;
+	uint32_t cb_task;
+	uint32_t num_buffers;
+	uint32_t num_tasks;
+	uint64_t source_size;
+	int64_t source_mtime_sec;
+	int64_t source_mtime_nsec;
+	uint32_t checksum;	// fnv-1a of the payload
+	uint32_t reserved;
+};
+
+static uint32_t fnv1a(uint32_t hash, const void * data, size_t length)
+{
+	const unsigned char * p = data;
+	for(size_t i = 0; i < length; ++i) {
+		hash ^= p[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static uint32_t graph_checksum(const struct task_graph * graph)
+{
+	uint32_t hash = 2166136261u;
+	hash = fnv1a(hash, &graph->settings, sizeof(graph->settings));
+	if(graph->num_buffers > 0) hash = fnv1a(hash, graph->buffers, sizeof(*graph->buffers) * graph->num_buffers);
+	hash = fnv1a(hash, graph->tasks, sizeof(*graph->tasks) * graph->num_tasks);
+	return hash;
+}
+
+static int init_file_header(struct task_graph_file_header * hdr, const char * conf_file)
+{
+	struct stat st[1];
+	if(stat(conf_file, st)) return -1;
+
+	memset(hdr, 0, sizeof(*hdr));
+	memcpy(hdr->magic, TASK_GRAPH_MAGIC, sizeof(hdr->magic));
+	hdr->version = TASK_GRAPH_VERSION;
+	hdr->cb_settings = sizeof(struct task_graph_settings);
+	hdr->cb_buffer = sizeof(struct task_graph_buffer);
+	hdr->cb_task = sizeof(struct task_graph_task);
+	hdr->source_size = st->st_size;
+	hdr->source_mtime_sec = st->st_mtim.tv_sec;
+	hdr->source_mtime_nsec = st->st_mtim.tv_nsec;
+	return 0;
+}
+
+int task_graph_save_binary(const struct task_graph * graph, const char * cache_file, const char * conf_file)
+{
+	assert(graph && graph->num_tasks > 0 && cache_file && conf_file);
+	struct task_graph_file_header hdr[1];
+	if(init_file_header(hdr, conf_file)) return -1;
+	hdr->num_buffers = graph->num_buffers;
+	hdr->num_tasks = graph->num_tasks;
+	hdr->checksum = graph_checksum(graph);
+
+	// write to a temp file then rename, the readers never see a partial cache
+	char tmp_file[4096] = "";
+	snprintf(tmp_file, sizeof(tmp_file), "%s.%ld.tmp", cache_file, (long)getpid());
+	FILE * fp = fopen(tmp_file, "wb");
+	if(NULL == fp) return -1;
+
+	int ok = (fwrite(hdr, sizeof(*hdr), 1, fp) == 1)
+		&& (fwrite(&graph->settings, sizeof(graph->settings), 1, fp) == 1)
+		&& (fwrite(graph->buffers, sizeof(*graph->buffers), graph->num_buffers, fp) == (size_t)graph->num_buffers)
+		&& (fwrite(graph->tasks, sizeof(*graph->tasks), graph->num_tasks, fp) == (size_t)graph->num_tasks);
+	ok = (0 == fclose(fp)) && ok;
+	if(ok) ok = (0 == rename(tmp_file, cache_file));
+	if(!ok) {
+		unlink(tmp_file);
+		return -1;
+	}
+	return 0;
+}
+
+int task_graph_load_binary(struct task_graph * graph, const char * cache_file, const char * conf_file)
+{
+	assert(graph && cache_file && conf_file);
+	struct task_graph_file_header expected[1];
+	struct task_graph_file_header hdr[1];
+	if(init_file_header(expected, conf_file)) return -1;
+
+	FILE * fp = fopen(cache_file, "rb");
+	if(NULL == fp) return -1;
+
+	int rc = -1;
+	task_graph_cleanup(graph);
+	if(fread(hdr, sizeof(*hdr), 1, fp) != 1) goto label_exit;
+	if(memcmp(hdr->magic, expected->magic, sizeof(hdr->magic))
+		|| hdr->version != expected->version
+		|| hdr->cb_settings != expected->cb_settings
+		|| hdr->cb_buffer != expected->cb_buffer
+		|| hdr->cb_task != expected->cb_task
+		|| hdr->source_size != expected->source_size
+		|| hdr->source_mtime_sec != expected->source_mtime_sec
+		|| hdr->source_mtime_nsec != expected->source_mtime_nsec
+		|| hdr->num_buffers > TASK_GRAPH_MAX_BUFFERS
+		|| hdr->num_tasks == 0 || hdr->num_tasks > TASK_GRAPH_MAX_TASKS) goto label_exit;	// stale
+
+	graph->num_buffers = hdr->num_buffers;
+	if(graph->num_buffers > 0) {
+		graph->buffers = calloc(graph->num_buffers, sizeof(*graph->buffers));
+		assert(graph->buffers);
+	}
+
+	graph->num_tasks = hdr->num_tasks;
+	graph->tasks = calloc(graph->num_tasks, sizeof(*graph->tasks));
+	graph->order = calloc(graph->num_tasks, sizeof(*graph->order));
+	assert(graph->tasks && graph->order);
+
+	if(fread(&graph->settings, sizeof(graph->settings), 1, fp) != 1) goto label_exit;
+	if(fread(graph->buffers, sizeof(*graph->buffers), graph->num_buffers, fp) != (size_t)graph->num_buffers) goto label_exit;
+	if(fread(graph->tasks, sizeof(*graph->tasks), graph->num_tasks, fp) != (size_t)graph->num_tasks) goto label_exit;
+	if(graph_checksum(graph) != hdr->checksum) goto label_exit;
+
+	rc = build_order(graph);
+
+label_exit:
+	fclose(fp);
+	if(rc) task_graph_cleanup(graph);
+	return rc;
+}
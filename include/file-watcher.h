@@ -0,0 +1,35 @@
+#ifndef OPENCL_TEST_FILE_WATCHER_H_
+#define OPENCL_TEST_FILE_WATCHER_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * file_watcher:
+ *   inotify based, the directories are watched instead of the files: 
+ *   editors saving through a temp file + rename() replace the watched inode.
+ *   the fd is non-blocking, add it to a poll loop (see opencl_notifier::add_fd) and call dispatch() when readable.
+*/
+typedef void (* file_changed_func)(void * user_data, const char * path);
+
+struct file_watch;
+struct file_watcher
+{
+	int fd;		// inotify fd
+	int num_files;
+	struct file_watch * files;
+	
+	int (* add)(struct file_watcher * watcher, const char * path, file_changed_func on_changed, void * user_data);
+	
+	// read the pending events and call on_changed() for each changed file, return the number of changed files
+	int (* dispatch)(struct file_watcher * watcher);
+};
+struct file_watcher * file_watcher_init(struct file_watcher * watcher);
+void file_watcher_cleanup(struct file_watcher * watcher);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,53 @@
+#ifndef OPENCL_TEST_NUMA_TOPOLOGY_H_
+#define OPENCL_TEST_NUMA_TOPOLOGY_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <sys/types.h>
+
+/**
+ * numa_topology:
+ *   the NUMA nodes of the host and their cpus (/sys/devices/system/node),
+ *   a single node with all the online cpus if the kernel doesn't expose them.
+ *   the nodes are addressed by their index in nodes[], the memory policies are set
+ *   through the mbind / move_pages syscalls (no libnuma).
+*/
+struct numa_node
+{
+	int id;			// the kernel's node id
+	int num_cpus;
+	int * cpus;
+};
+
+struct numa_topology
+{
+	int num_nodes;
+	struct numa_node * nodes;
+};
+struct numa_topology * numa_topology_init(struct numa_topology * topo);
+void numa_topology_cleanup(struct numa_topology * topo);
+
+int numa_topology_get_cpu_node(const struct numa_topology * topo, int cpu);	// (-1: unknown)
+
+// pin the calling thread to the cpus of nodes[node]
+int numa_topology_bind_thread(const struct numa_topology * topo, int node);
+
+/*
+ * prefer nodes[node] for the whole pages of [addr, addr + size), the pages already touched are migrated.
+ * return -1 if it's not supported (the pages are left where they are)
+*/
+int numa_topology_bind_memory(const struct numa_topology * topo, void * addr, size_t size, int node);
+
+/*
+ * count the resident pages of [addr, addr + size) per node (counts[num_nodes]),
+ * return the number of pages counted, -1 if it's not supported
+*/
+ssize_t numa_topology_count_pages(const struct numa_topology * topo, const void * addr, size_t size, size_t * counts);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,60 @@
+#ifndef OPENCL_COMPACT_H_
+#define OPENCL_COMPACT_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "opencl-kernel.h"
+#include "opencl-scan.h"
+
+/**
+ * opencl_compact:
+ *   stream compaction, keep the items for which (item <op> value) is true, in order (kernels/compact.cl).
+ *   the flags are scanned into the output positions (opencl_scan),
+ *   the number of items kept is written to a device buffer, it is only read back if needed.
+*/
+enum opencl_compact_op	// same values as COMPACT_OP_* in kernels/compact.cl
+{
+	opencl_compact_op_greater,
+	opencl_compact_op_less,
+	opencl_compact_op_equal,
+	opencl_compact_op_not_equal,
+};
+
+struct opencl_compact
+{
+	enum opencl_backend_type backend;
+	enum opencl_scan_type type;	// float or int items
+	cl_context ctx;				// NULL: host backend
+	cl_command_queue queue;
+	size_t local_size;
+
+	struct opencl_function flags_func[1];
+	struct opencl_function scatter[1];
+	struct opencl_scan scan[1];
+
+	// temporary buffers (size 0: not allocated)
+	struct opencl_buffer flags[1];
+	struct opencl_buffer positions[1];
+
+	/*
+	 * out[0, count) = the items of in[0, n) where (item <op> value),
+	 * value: a float or a cl_int (the type of the items), count: a buffer of one cl_int (0 if n == 0)
+	*/
+	int (* execute)(struct opencl_compact * compact, struct opencl_buffer * in, struct opencl_buffer * out, struct opencl_buffer * count, 
+		size_t n, enum opencl_compact_op op, const void * value);
+};
+
+/*
+ * program: the linked kernels (NULL: host backend)
+ * local_size: 0: decided by the runtime
+*/
+struct opencl_compact * opencl_compact_init(struct opencl_compact * compact, cl_program program, cl_command_queue queue, enum opencl_scan_type type, size_t local_size);
+void opencl_compact_cleanup(struct opencl_compact * compact);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,43 @@
+#ifndef OPENCL_GEMM_H_
+#define OPENCL_GEMM_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "opencl-kernel.h"
+
+/**
+ * opencl_gemm:
+ *   tiled SGEMM and batched GEMV (kernels/gemm.cl), row-major float matrices.
+ *   the tile sizes are selected when the kernels are built (SGEMM_TILE_SIZE, SGEMM_WORK_PER_ITEM, GEMV_TILE_SIZE),
+ *   the sgemm grid is derived from the kernel's required work-group size.
+*/
+struct opencl_gemm
+{
+	enum opencl_backend_type backend;
+	cl_command_queue queue;
+
+	struct opencl_function sgemm_func[1];
+	struct opencl_function gemv_func[1];
+	struct dim_3d sgemm_block;	// { TILE_SIZE, TILE_SIZE / WORK_PER_ITEM, 1 }
+	struct dim_3d gemv_block;
+
+	// C = alpha * A * B + beta * C,  A: (M x K), B: (K x N), C: (M x N)
+	int (* sgemm)(struct opencl_gemm * gemm, int M, int N, int K, float alpha, 
+		struct opencl_buffer * A, struct opencl_buffer * B, float beta, struct opencl_buffer * C);
+
+	// y[b] = alpha * A[b] * x[b] + beta * y[b],  A[b]: (m x n), b: [0, batch_count), stored contiguously
+	int (* gemv_batched)(struct opencl_gemm * gemm, int m, int n, int batch_count, float alpha, 
+		struct opencl_buffer * A, struct opencl_buffer * x, float beta, struct opencl_buffer * y);
+};
+
+// program: the linked kernels (NULL: host backend)
+struct opencl_gemm * opencl_gemm_init(struct opencl_gemm * gemm, cl_program program, cl_command_queue queue);
+void opencl_gemm_cleanup(struct opencl_gemm * gemm);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,46 @@
+#ifndef OPENCL_HALF_H_
+#define OPENCL_HALF_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <CL/cl.h>
+
+/**
+ * 16-bit storage of floats (the _half / _bf16 variants of the kernels in kernels/vec_half.cl):
+ *   half:  IEEE 754 binary16 (cl_half), 11 significant bits, range +-65504
+ *   bf16:  bfloat16, the upper 16 bits of a float (cl_ushort), 8 significant bits, the range of a float
+ * the conversions from float round to nearest even, like vstore_half_rte() on the device.
+*/
+enum opencl_storage_type
+{
+	opencl_storage_type_float,
+	opencl_storage_type_half,
+	opencl_storage_type_bf16,
+};
+size_t opencl_storage_type_size(enum opencl_storage_type type);	// bytes per item
+const char * opencl_storage_type_to_string(enum opencl_storage_type type);
+
+cl_half opencl_float_to_half(float x);
+float opencl_half_to_float(cl_half x);
+cl_ushort opencl_float_to_bf16(float x);
+float opencl_bf16_to_float(cl_ushort x);
+
+// convert n items, dst and src must not overlap (vectorized for the normal values, F16C if the build enables it)
+void opencl_float_to_half_array(cl_half * dst, const float * src, size_t n);
+void opencl_half_to_float_array(float * dst, const cl_half * src, size_t n);
+void opencl_float_to_bf16_array(cl_ushort * dst, const float * src, size_t n);
+void opencl_bf16_to_float_array(float * dst, const cl_ushort * src, size_t n);
+
+/*
+ * dst (n items of type) = src (n floats), and back
+*/
+void opencl_storage_from_float(enum opencl_storage_type type, void * dst, const float * src, size_t n);
+void opencl_storage_to_float(enum opencl_storage_type type, float * dst, const void * src, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,48 @@
+#ifndef OPENCL_HISTOGRAM_H_
+#define OPENCL_HISTOGRAM_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "opencl-kernel.h"
+
+/**
+ * opencl_histogram:
+ *   histogram of floats (kernels/histogram.cl), the bins and the range are specialized at build time:
+ *     -D HISTOGRAM_NUM_BINS=<n> -D HISTOGRAM_MIN=<x> -D HISTOGRAM_MAX=<x>  (default: 256 bins of [0, 1))
+ *   the work-groups count their items in __local bins (local atomics),
+ *   then a merge pass adds up the partial histograms of the groups.
+ *   only the bins are read back instead of the data.
+*/
+struct opencl_histogram
+{
+	enum opencl_backend_type backend;
+	cl_context ctx;				// NULL: host backend
+	cl_command_queue queue;
+	size_t num_bins;			// HISTOGRAM_NUM_BINS
+	float min;					// HISTOGRAM_MIN
+	float max;					// HISTOGRAM_MAX
+	size_t local_size;
+	size_t max_groups;			// the groups stride over the input
+
+	struct opencl_function count[1];
+	struct opencl_function merge[1];
+	struct opencl_buffer partials[1];	// (num_groups * num_bins) uint
+
+	// histogram[bin] = the number of in[0, n) items in the bin (num_bins uint)
+	int (* execute)(struct opencl_histogram * hist, struct opencl_buffer * in, size_t n, struct opencl_buffer * histogram);
+};
+
+/*
+ * program: the linked kernels (NULL: host backend, see opencl_host_set_build_options())
+ * num_bins: the HISTOGRAM_NUM_BINS the program was built with (0: any), checked against the program (histogram_info)
+*/
+struct opencl_histogram * opencl_histogram_init(struct opencl_histogram * hist, cl_program program, cl_command_queue queue, size_t num_bins);
+void opencl_histogram_cleanup(struct opencl_histogram * hist);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,54 @@
+#ifndef OPENCL_HOST_H_
+#define OPENCL_HOST_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "opencl-kernel.h"
+
+/**
+ * host backend:
+ *   pure-C (SIMD + multithreaded) implementations of the kernels in the kernel modules (kernels/),
+ *   used when no OpenCL platform is available.
+ *
+ * The host functions share the opencl_function interface.
+ * The only difference is how the buffer args are passed:
+ *   opencl: opencl_function_set_args(func, n, sizeof(cl_mem), &mem, ...)
+ *   host:   opencl_function_set_args(func, n, sizeof(float *), &host_ptr, ...)
+ * __local args (size, NULL) are accepted and ignored.
+*/
+struct opencl_function * opencl_host_function_init(struct opencl_function * function, const char * kernel_name);
+int opencl_host_has_kernel(const char * kernel_name);
+
+/*
+ * number of worker threads (including the caller thread) used by the host kernels,
+ * default: OPENCL_HOST_THREADS env or the number of online cpus.
+ * must be called before the pool is started (the first host function, or opencl_host_get_num_threads()),
+ * returns -1 otherwise.
+*/
+int opencl_host_set_num_threads(int num_threads);
+int opencl_host_get_num_threads(void);
+
+/*
+ * run job(user_data, begin, end) over [0, n) on the host thread pool.
+ * chunk_size: the minimal number of items per job call (0: auto)
+*/
+typedef void (* opencl_host_job_func)(void * user_data, size_t begin, size_t end);
+void opencl_host_parallel_for(size_t n, size_t chunk_size, opencl_host_job_func job, void * user_data);
+
+/*
+ * the build options of the device kernels (e.g. "-D HISTOGRAM_NUM_BINS=64"), NULL: none.
+ * the host kernels read the same defines: each host function keeps the options set when it was initialized,
+ * opencl_host_function_set_build_options() replaces them.
+ * get_define() returns default_value if the name is not defined.
+*/
+int opencl_host_set_build_options(const char * options);
+int opencl_host_function_set_build_options(struct opencl_function * function, const char * options);
+double opencl_host_function_get_define(const struct opencl_function * function, const char * name, double default_value);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -6,34 +6,70 @@
 extern "C" {
 #endif
 #include <stdarg.h>
+#include <pthread.h>
 
 #include <CL/cl.h>
 #include "opencl-context.h"
 
+struct opencl_program;
+typedef void (* opencl_program_built_func)(struct opencl_program * program, void * user_data);
+
 struct opencl_program
 {
 	cl_program prog;
 	cl_context ctx;
 	
-	int build_status;
+	int build_status;	// CL_BUILD_NONE, CL_BUILD_IN_PROGRESS, CL_BUILD_SUCCESS or CL_BUILD_ERROR
+	cl_int err_code;	// of the last build
+	char * build_log;	// the devices' logs of the last build, (NULL: empty)
 	
 	size_t num_devices;
 	cl_device_id * device_ids;
+	
+	// async builds: build_status is guarded by the mutex
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int is_pending;		// the build has not been notified yet
+	int is_completed;	// the build has been completed once (by the callback or by the caller's error path)
+	opencl_program_built_func on_built;
+	void * user_data;
 
 	int (* load_sources)(struct opencl_program * program, size_t num_sources, const char ** sources, const size_t * lengths);
 	int (* load_binaries)(struct opencl_program * program, const size_t * lengths, const unsigned char ** binaries); 
 	int (* load_builtin_kernels)(struct opencl_program * program, const char * kernel_names); // kernel_names: A semi-colon separated list of built-in kernel names.
 	
-	int (* compile)(struct opencl_program * program, const char * options, size_t num_headers, const cl_program * headers, const char ** header_names);
-	int (* link)(struct opencl_program * program, const char * options, size_t num_input_programs, const cl_program * input_programs);
+	/*
+	 * compile the loaded sources into an object, link objects into an executable program.
+	 * on_compiled / on_linked: NULL to wait for the completion, or called when it completes (see build_async)
+	*/
+	int (* compile)(struct opencl_program * program, const char * options, size_t num_headers, const cl_program * headers, const char ** header_names, 
+		opencl_program_built_func on_compiled, void * user_data);
+	int (* link)(struct opencl_program * program, const char * options, size_t num_input_programs, const cl_program * input_programs, 
+		opencl_program_built_func on_linked, void * user_data);
 	
 	// compile and link
 	int (* build)(struct opencl_program * program, const char * options);
+	
+	/*
+	 * start the build and return (clBuildProgram with a pfn_notify callback),
+	 * on_built (optional) is called from a runtime's thread when the build completes, 
+	 * or before build_async() returns if the driver builds synchronously.
+	*/
+	int (* build_async)(struct opencl_program * program, const char * options, opencl_program_built_func on_built, void * user_data);
+	
+	// wait for the pending build (timeout_ms < 0: infinite), return the build_status (CL_BUILD_IN_PROGRESS on timeout)
+	int (* wait)(struct opencl_program * program, int timeout_ms);
 };
 struct opencl_program * opencl_program_init(struct opencl_program * program, cl_context ctx, size_t num_devices, const cl_device_id * device_ids);
-void opencl_program_cleanup(struct opencl_program * program);
+void opencl_program_cleanup(struct opencl_program * program);	// waits for the pending build
 ssize_t opencl_program_get_build_log(struct opencl_program * program, cl_device_id device_id, char *p_build_log, size_t build_log_size);
 
+/*
+ * build the programs (e.g. the variants of a kernel built with different options) in parallel,
+ * options: per program (NULL: no options), return 0 if all of them have been built.
+*/
+int opencl_program_build_all(size_t num_programs, struct opencl_program ** programs, const char ** options);
+
 struct opencl_kernel
 {
 	cl_kernel _kernel;
@@ -45,11 +81,71 @@ struct opencl_kernel
 struct opencl_kernel * opencl_kernel_init(struct opencl_kernel * kernel, cl_program prog, const char * kernel_name);
 void opencl_kernel_cleanup(struct opencl_kernel * kernel);
 int opencl_kernel_set_args(struct opencl_kernel * kernel, size_t num_args, ... /* size_t size1, void * arg1, ...*/ );
+int opencl_kernel_set_arg(struct opencl_kernel * kernel, size_t arg_index, size_t size, const void * arg);	// grows the args if needed
+
+// the grid of a launch, passed to set_dims() as (size_t *)&dims
+typedef struct dim_3d
+{
+	size_t x;
+	size_t y;
+	size_t z;
+}opencl_dim_3d;
+
+enum opencl_backend_type
+{
+	opencl_backend_type_opencl,		// enqueue to an OpenCL device
+	opencl_backend_type_host,		// run the host (pure-C) implementation, see "opencl-host.h"
+};
+
+/**
+ * opencl_event_list:
+ *   the list holds a reference to each event (clRetainEvent on add, clReleaseEvent on remove / clear),
+ *   the first OPENCL_EVENT_LIST_INLINE_SIZE events are stored inline,
+ *   clear() keeps the capacity, so a reused list does not allocate in steady state.
+ * 
+ *   'events' may point into the list itself, do not memcpy an initialized list.
+*/
+#define OPENCL_EVENT_LIST_INLINE_SIZE (8)
+struct opencl_event_list
+{
+	size_t size;	// capacity
+	size_t length;
+	cl_event * events;
+	cl_event inline_events[OPENCL_EVENT_LIST_INLINE_SIZE];
+	
+	int (* add)(struct opencl_event_list * list, cl_event event);	// ignore NULL and duplicated events
+	cl_event (* remove)(struct opencl_event_list * list, int index);	// the reference is transferred to the caller
+};
+struct opencl_event_list * opencl_event_list_init(struct opencl_event_list * list, size_t size);
+void opencl_event_list_cleanup(struct opencl_event_list * list);
+void opencl_event_list_clear(struct opencl_event_list * list);
+int opencl_event_list_merge(struct opencl_event_list * list, const struct opencl_event_list * src);
+int opencl_event_list_wait(struct opencl_event_list * list, int clear);
+ssize_t opencl_event_list_prune(struct opencl_event_list * list);	// release the finished events, return the number of remaining events
+
+struct opencl_buffer;
+enum opencl_buffer_access
+{
+	opencl_buffer_access_read = 1,
+	opencl_buffer_access_write = 2,
+	opencl_buffer_access_read_write = 3,
+};
+struct opencl_buffer_binding
+{
+	size_t arg_index;
+	struct opencl_buffer * buf;
+	enum opencl_buffer_access access;
+};
 
 struct opencl_function
 {
 	struct opencl_kernel kernel[1]; // base object
 	#define opencl_function_set_args(func, num_args, ...) opencl_kernel_set_args((struct opencl_kernel *)func, num_args, __VA_ARGS__)
+	#define opencl_function_set_arg(func, arg_index, size, arg) opencl_kernel_set_arg((struct opencl_kernel *)func, arg_index, size, arg)
+
+	enum opencl_backend_type backend;
+	void * priv;	// backend private data
+	void (* on_free_priv)(void *);
 
 	size_t work_dim;
 	size_t * global_offsets;
@@ -59,43 +155,142 @@ struct opencl_function
 	cl_command_queue queue;
 	cl_event event;
 	
+	// buffer args, used to build the waiting list (RAW / WAR / WAW) automatically
+	size_t num_bindings;
+	struct opencl_buffer_binding * bindings;
+	struct opencl_event_list waiting_list[1];	// reused by each launch
+	
 	int (* set_dims)(struct opencl_function * function, size_t work_dim, const size_t * global_offsets, const size_t * global_sizes, const size_t * local_sizes);
 	int (* execute)(struct opencl_function * function, size_t num_waiting_events, const cl_event * waiting_events, cl_event * event);
 };
 struct opencl_function * opencl_function_init(struct opencl_function * function, const cl_program program, const char * kernel_name);
 void opencl_function_cleanup(struct opencl_function * function);
+int opencl_function_bind_buffer(struct opencl_function * function, size_t arg_index, struct opencl_buffer * buf, enum opencl_buffer_access access);
+size_t opencl_function_get_max_work_group_size(const struct opencl_function * function);	// on the device of function->queue (0: unknown)
 
-struct opencl_event_list
+// the SVM buffers the kernel reaches through pointers stored in its args (CL_KERNEL_EXEC_INFO_SVM_PTRS)
+int opencl_function_set_svm_buffers(struct opencl_function * function, size_t num_buffers, struct opencl_buffer ** buffers);
+
+/*
+ * the global size of a grid-stride launch over n items, a multiple of local_size:
+ *   round_up(n, local_size), bounded by the work-groups the device keeps resident
+ *   (compute units x work-groups per compute unit, limited by the kernel's __local memory, one per CU on CPU devices).
+ *   call it after the __local args are set (opencl_function_get_grid_size() applies the args of opencl_function_set_args()).
+ *   host backend: round_up(n, local_size), the host kernels split the work by themselves.
+*/
+size_t opencl_get_grid_size(cl_kernel kernel, cl_device_id device, size_t n, size_t local_size);
+size_t opencl_function_get_grid_size(const struct opencl_function * function, size_t n, size_t local_size);
+
+enum opencl_buffer_type
 {
-	size_t size;
-	size_t length;
-	const cl_event * events;
-	
-	int (* add)(struct opencl_event_list * list, const cl_event * event);
-	const cl_event *  (* remove)(struct opencl_event_list * list, int index);
+	opencl_buffer_type_mem,			// cl_mem
+	opencl_buffer_type_svm_coarse,	// coarse-grained SVM, the host accesses it between map and unmap
+	opencl_buffer_type_svm_fine,	// fine-grained SVM, the host accesses it once the commands using it are done
 };
-struct opencl_event_list * opencl_event_list_init(struct opencl_event_list * list, size_t size);
-void opencl_event_list_cleanup(struct opencl_event_list * list);
+const char * opencl_buffer_type_to_string(enum opencl_buffer_type type);
 
 struct opencl_buffer
 {
-	cl_mem gpu_data;
+	cl_mem gpu_data;	// NULL: host buffer (host backend)
 	size_t size;
 	cl_mem_flags flags;
 	
 	void * cpu_data;
 	void (* on_free_cpu_data)(void *);
 	
-	const struct opencl_event_list * waiting_list;
-	cl_event event;
+	// hazard tracking
+	cl_event event;		// the last command which writes the buffer
+	struct opencl_event_list reads[1];	// the commands which read the buffer since the last write
 	cl_int err_code;
+	
+	// SVM: gpu_data wraps the shared allocation (CL_MEM_USE_HOST_PTR)
+	enum opencl_buffer_type type;
+	void * svm_data;
+	cl_context svm_ctx;
+	
+	// opencl_buffer_map()
+	void * mapped_data;
+	enum opencl_buffer_access map_access;
+	
+	// sub-buffer views: a view's accesses conflict with the parent's and the overlapping views' ones
+	struct opencl_buffer * parent;	// NULL: not a view
+	size_t origin;					// bytes, in the parent
+	size_t num_views;
+	struct opencl_buffer ** views;	// the views of this buffer
 };
 
+// ctx == NULL: allocate a host buffer for the host backend
 struct opencl_buffer * opencl_buffer_init(struct opencl_buffer * buf, cl_context ctx, cl_mem_flags flags, size_t size, const void * cpu_data);
 void opencl_buffer_cleanup(struct opencl_buffer * buf);
-void * opencl_buffer_enqueue_read(struct opencl_buffer * buf, cl_command_queue queue, cl_bool blocking, size_t offset, size_t length, const void * cpu_data);
+
+/*
+ * SVM buffers (CL_TARGET_OPENCL_VERSION >= 200 and an OpenCL 2.0+ device):
+ *   the kernels and the host share the allocation (svm_data), pointers into it stay valid on both sides.
+ *   the kernels see it as a cl_mem wrapping the allocation, opencl_function_bind_buffer() and the hazard tracking are unchanged.
+ *   fine-grained: cpu_data == svm_data, opencl_buffer_enqueue_read() / write() into cpu_data only wait for the commands, no copies.
+ *   coarse-grained: cpu_data == NULL, the host accesses it through opencl_buffer_map() (no copy on shared-memory devices).
+ * type: the preferred type, fine-grained falls back to coarse-grained, coarse-grained to cl_mem.
+ *   flags: CL_MEM_READ_WRITE / READ_ONLY / WRITE_ONLY, CL_MEM_SVM_ATOMICS (fine-grained only),
+ *   the cl_mem fallback passes the flags to opencl_buffer_init().
+ * check buf->type for the buffer created.
+*/
+struct opencl_buffer * opencl_buffer_init_svm(struct opencl_buffer * buf, cl_context ctx, cl_device_id device, 
+	cl_mem_flags flags, size_t size, const void * cpu_data, enum opencl_buffer_type type);
+
+/*
+ * host access of the whole buffer once the commands using it are done, ordered by the hazard tracking:
+ *   read: after the last write, write: after all the previous accesses (the commands enqueued after unmap wait for it).
+ * cl_mem and coarse-grained SVM are mapped, fine-grained SVM and host buffers are returned as is.
+*/
+void * opencl_buffer_map(struct opencl_buffer * buf, cl_command_queue queue, enum opencl_buffer_access access);
+int opencl_buffer_unmap(struct opencl_buffer * buf, cl_command_queue queue);
+
+/*
+ * sub-buffer views (clCreateSubBuffer): [origin, origin + size) of the parent, sharing its allocation.
+ *   origin must be a multiple of opencl_buffer_get_alignment() (CL_DEVICE_MEM_BASE_ADDR_ALIGN of the context's devices).
+ *   cpu_data points into the parent's one (if any), a view of a view is a view of the same parent.
+ *   flags: 0 inherits the parent's access flags.
+ *   clean up the views before the parent.
+*/
+size_t opencl_buffer_get_alignment(cl_context ctx);	// bytes, (ctx == NULL: host buffers)
+struct opencl_buffer * opencl_buffer_init_view(struct opencl_buffer * view, struct opencl_buffer * parent, cl_mem_flags flags, size_t origin, size_t size);
+
+/*
+ * the parent's cl_mem is being replaced (e.g. evicted and restored by opencl_memory_manager):
+ * release the views' cl_mems, then create them again on the parent's new cl_mem.
+ * the views created while the parent has no cl_mem get theirs on restore.
+*/
+void opencl_buffer_release_views(struct opencl_buffer * parent);
+int opencl_buffer_restore_views(struct opencl_buffer * parent);
+
+/*
+ * swap the parent's cl_mem under the hazards lock (the old one is released, mem NULL: evicted),
+ * the hazards of the old cl_mem are dropped and the views are recreated on the new one.
+ * event (optional): the write which fills mem, it becomes the buffer's last writer.
+*/
+int opencl_buffer_replace_mem(struct opencl_buffer * buf, cl_mem mem, cl_event event);
+
+/*
+ * allocate one buffer holding num_parts views of sizes[i] bytes,
+ * each part starts at the next aligned origin (the parent is padded as needed).
+*/
+struct opencl_buffer * opencl_buffer_init_parts(struct opencl_buffer * parent, cl_context ctx, cl_mem_flags flags, 
+	size_t num_parts, const size_t * sizes, struct opencl_buffer * views);
+
+// (re)allocate a temporary buffer of at least size bytes, the content is not preserved (size 0: not allocated)
+int opencl_buffer_reserve(struct opencl_buffer * buf, cl_context ctx, cl_mem_flags flags, size_t size);
+void * opencl_buffer_enqueue_read(struct opencl_buffer * buf, cl_command_queue queue, cl_bool blocking, size_t offset, size_t length, void * cpu_data);
 int opencl_buffer_enqueue_write(struct opencl_buffer * buf, cl_command_queue queue, cl_bool blocking, size_t offset, size_t length);
 
+/*
+ * hazard tracking:
+ *   add the events the next command must wait for to the waiting_list,
+ *   then add the command's event to the buffer (retained).
+*/
+int opencl_buffer_get_hazards(const struct opencl_buffer * buf, enum opencl_buffer_access access, struct opencl_event_list * waiting_list);
+void opencl_buffer_add_access(struct opencl_buffer * buf, enum opencl_buffer_access access, cl_event event);
+void opencl_buffer_reset_hazards(struct opencl_buffer * buf);
+
 #ifdef __cplusplus
 }
 #endif
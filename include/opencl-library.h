@@ -0,0 +1,83 @@
+#ifndef OPENCL_LIBRARY_H_
+#define OPENCL_LIBRARY_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include <CL/cl.h>
+#include "opencl-kernel.h"
+
+/**
+ * opencl_library:
+ *   a kernel library split into headers and modules, built by a separate compile / link pipeline.
+ *   - the headers are created once as cl_programs and passed to clCompileProgram() by their file names,
+ *     the modules include them as: #include "<header_name>"
+ *   - the compiled modules are cached, a rebuild only recompiles the modules whose sources have changed
+ *     (all of them if a header has changed) and relinks.
+ *   - the modules are compiled in parallel (clCompileProgram callbacks).
+*/
+struct opencl_library_header;
+struct opencl_library_module;
+struct opencl_library;
+typedef void (* opencl_library_built_func)(struct opencl_library * library, struct opencl_program * program, void * user_data);
+
+struct opencl_library
+{
+	cl_context ctx;
+	size_t num_devices;
+	cl_device_id * device_ids;
+
+	int num_headers;
+	struct opencl_library_header * headers;
+	int num_modules;
+	struct opencl_library_module ** modules;
+	char * options;			// the compile options of the modules, (NULL: none)
+	int options_changed;
+
+	// the build in progress
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int is_building;
+	int num_compiling;
+	opencl_library_built_func on_built;
+	void * user_data;
+	struct opencl_program * program;	// the linked program, (if not passed to on_built)
+
+	int (* add_header)(struct opencl_library * library, const char * path);
+	int (* add_module)(struct opencl_library * library, const char * path);
+
+	/*
+	 * reload the sources, compile the changed modules and link them.
+	 * on_built (optional) is called from a runtime's thread with the linked program (owned by the callee),
+	 * check program->build_status and program->build_log.
+	*/
+	int (* build_async)(struct opencl_library * library, opencl_library_built_func on_built, void * user_data);
+
+	// wait for the build, return the linked program if no on_built callback was given (owned by the caller)
+	struct opencl_program * (* wait)(struct opencl_library * library);
+};
+struct opencl_library * opencl_library_init(struct opencl_library * library, cl_context ctx, size_t num_devices, const cl_device_id * device_ids);
+void opencl_library_cleanup(struct opencl_library * library);	// waits for the build
+
+/*
+ * path: a directory (the *.h headers and the *.cl modules in it),
+ *   or a module (the *.h headers in the same directory are added too)
+*/
+int opencl_library_add_path(struct opencl_library * library, const char * path);
+
+/*
+ * the compile options of all the modules (e.g. "-D SGEMM_TILE_SIZE=32"), NULL: none,
+ * the next build recompiles all the modules if they have changed.
+*/
+int opencl_library_set_options(struct opencl_library * library, const char * options);
+
+// the files to watch for changes
+int opencl_library_get_files(const struct opencl_library * library, const char ** paths, int max_paths);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
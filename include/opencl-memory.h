@@ -0,0 +1,81 @@
+#ifndef OPENCL_MEMORY_H_
+#define OPENCL_MEMORY_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <pthread.h>
+#include <CL/cl.h>
+#include "opencl-kernel.h"
+
+/**
+ * opencl_memory_manager:
+ *   keeps the buffers allocated through it within a budget of device memory.
+ *   a cl_mem of a context may be placed on any of its devices, the budget is checked against the smallest one.
+ *
+ *   when an allocation or a restore doesn't fit, the least recently used buffers are evicted:
+ *   the data is read back to pinned host memory (a mapped CL_MEM_ALLOC_HOST_PTR buffer) and the cl_mem released.
+ *   acquire() restores the evicted buffers a launch needs and keeps them resident until release().
+ *
+ *   the buffers bound by opencl_function_bind_buffer() pick up the new cl_mem at execute (the views' too),
+ *   but an evicted buffer (gpu_data == NULL) and its views must not be used until it has been acquired again.
+ *   host backend (ctx == NULL): the usage is accounted, nothing is evicted.
+*/
+struct opencl_memory_stats
+{
+	cl_ulong used;				// bytes resident
+	cl_ulong peak;
+	long num_evictions;
+	long num_restores;
+	cl_ulong bytes_evicted;
+	cl_ulong bytes_restored;
+};
+
+struct opencl_memory_entry;
+struct opencl_memory_manager
+{
+	cl_context ctx;				// NULL: host backend
+	cl_command_queue queue;		// evictions and restores
+	cl_ulong budget;			// bytes, (0: unlimited)
+	cl_ulong max_alloc_size;	// (0: unlimited)
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;		// the buffers acquired by the other threads have been released, or an eviction is done
+	int num_entries;
+	int max_entries;
+	struct opencl_memory_entry * entries;
+	uint64_t clock;				// LRU: the ticks of acquire()
+	struct opencl_memory_stats stats;
+	cl_ulong evicting;			// bytes being read back (the mutex is dropped meanwhile), still counted in stats.used
+
+	/*
+	 * allocate a buffer (see opencl_buffer_init()), evicting the others if needed,
+	 * return NULL if it exceeds max_alloc_size or the budget.
+	*/
+	struct opencl_buffer * (* alloc)(struct opencl_memory_manager * mm, struct opencl_buffer * buf, cl_mem_flags flags, size_t size, const void * cpu_data);
+	void (* free)(struct opencl_memory_manager * mm, struct opencl_buffer * buf);	// opencl_buffer_cleanup() and forget it
+
+	/*
+	 * make the buffers resident and keep them until release(), the restores are ordered by the buffers' hazard tracking.
+	 * waits while the memory is held by the buffers acquired by the other threads,
+	 * returns -1 if the buffers can't fit in the budget.
+	 * usage (optional): the evictions and restores caused by the call are added to it.
+	*/
+	int (* acquire)(struct opencl_memory_manager * mm, size_t num_buffers, struct opencl_buffer ** buffers, struct opencl_memory_stats * usage);
+	void (* release)(struct opencl_memory_manager * mm, size_t num_buffers, struct opencl_buffer ** buffers);
+};
+
+/*
+ * budget: bytes, (0: CL_DEVICE_GLOBAL_MEM_SIZE of the smallest device)
+*/
+struct opencl_memory_manager * opencl_memory_manager_init(struct opencl_memory_manager * mm, cl_context ctx,
+	size_t num_devices, const cl_device_id * device_ids, cl_ulong budget);
+void opencl_memory_manager_cleanup(struct opencl_memory_manager * mm);	// frees the buffers which are still allocated
+
+#ifdef __cplusplus
+}
+#endif
+#endif
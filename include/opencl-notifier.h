@@ -0,0 +1,54 @@
+#ifndef OPENCL_NOTIFIER_H_
+#define OPENCL_NOTIFIER_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <CL/cl.h>
+
+/**
+ * opencl_notifier:
+ *   host notifications of device completions.
+ *   clSetEventCallback() queues the completed events and wakes up the host loop through an eventfd,
+ *   the notification callbacks are dispatched from the thread calling run() / run_once().
+*/
+typedef void (* opencl_notify_func)(void * user_data, cl_event event, cl_int status);
+typedef void (* opencl_notify_fd_func)(void * user_data, int fd);
+
+struct opencl_notifier
+{
+	void * priv;
+	void * user_data;
+
+	int epoll_fd;
+	int event_fd;
+	volatile int quit;
+
+	// call on_completed(user_data, event, status) from the host loop when the event completes (or fails: status < 0)
+	int (* watch)(struct opencl_notifier * notifier, cl_event event, opencl_notify_func on_completed, void * user_data);
+
+	// queue a notification without an event (e.g. the host backend has already completed the work)
+	int (* post)(struct opencl_notifier * notifier, opencl_notify_func on_completed, void * user_data);
+
+	// call on_readable(user_data, fd) from the host loop when fd becomes readable (e.g. an inotify fd)
+	int (* add_fd)(struct opencl_notifier * notifier, int fd, opencl_notify_fd_func on_readable, void * user_data);
+	int (* remove_fd)(struct opencl_notifier * notifier, int fd);
+
+	// wait (timeout_ms < 0: infinite) and dispatch the notifications, return the number of dispatched notifications
+	int (* run_once)(struct opencl_notifier * notifier, int timeout_ms);
+
+	// dispatch until stop() is called
+	int (* run)(struct opencl_notifier * notifier);
+
+	// async-signal-safe
+	void (* stop)(struct opencl_notifier * notifier);
+};
+struct opencl_notifier * opencl_notifier_init(struct opencl_notifier * notifier, void * user_data);
+void opencl_notifier_cleanup(struct opencl_notifier * notifier);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
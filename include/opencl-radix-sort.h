@@ -0,0 +1,48 @@
+#ifndef OPENCL_RADIX_SORT_H_
+#define OPENCL_RADIX_SORT_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "opencl-kernel.h"
+#include "opencl-scan.h"
+
+/**
+ * opencl_radix_sort:
+ *   stable LSD radix sort of 32-bit (uint) keys, with optional 32-bit values, 4 bits per pass (kernels/radix_sort.cl).
+ *   each pass counts the digits of each tile (radix_count), scans the counts (opencl_scan)
+ *   and scatters the tiles (radix_scatter), ping-ponging with the temporary buffers.
+*/
+struct opencl_radix_sort
+{
+	enum opencl_backend_type backend;
+	cl_context ctx;				// NULL: host backend
+	cl_command_queue queue;
+	size_t local_size;			// work-items per group, each group handles (2 * local_size) items
+
+	struct opencl_function count[1];
+	struct opencl_function scatter[1];
+	struct opencl_scan scan[1];
+
+	// temporary buffers (size 0: not allocated)
+	struct opencl_buffer histograms[1];
+	struct opencl_buffer keys[1];
+	struct opencl_buffer values[1];
+
+	// sort keys[0, n) in place, values (optional) are moved along with the keys
+	int (* execute)(struct opencl_radix_sort * sort, struct opencl_buffer * keys, struct opencl_buffer * values, size_t n);
+};
+
+/*
+ * program: the linked kernels (NULL: host backend)
+ * local_size: 0: the largest power of 2 supported by the kernels (256 at most), host backend: 1024
+*/
+struct opencl_radix_sort * opencl_radix_sort_init(struct opencl_radix_sort * sort, cl_program program, cl_command_queue queue, size_t local_size);
+void opencl_radix_sort_cleanup(struct opencl_radix_sort * sort);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,57 @@
+#ifndef OPENCL_SCAN_H_
+#define OPENCL_SCAN_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "opencl-kernel.h"
+
+/**
+ * opencl_scan:
+ *   prefix sums of arbitrary length, built on the block scans of kernels/scan.cl.
+ *   level 0 scans the input in blocks of (2 * local_size) items and writes the block sums,
+ *   level k + 1 scans the block sums of level k (in place), until a single block is left,
+ *   then the scanned block sums are added back to the blocks of the level below.
+ *
+ *   the kernels are launched through opencl_function, the temporary buffers are kept between
+ *   the calls and the commands are ordered by the buffers' hazard tracking.
+*/
+enum opencl_scan_type
+{
+	opencl_scan_type_float,
+	opencl_scan_type_int,
+};
+
+#define OPENCL_SCAN_MAX_LEVELS (8)
+struct opencl_scan
+{
+	enum opencl_backend_type backend;
+	enum opencl_scan_type type;
+	cl_context ctx;				// NULL: host backend
+	cl_command_queue queue;
+	size_t local_size;			// work-items per group (power of 2)
+
+	struct opencl_function scan_blocks[1];
+	struct opencl_function add_offsets[1];
+	struct opencl_buffer sums[OPENCL_SCAN_MAX_LEVELS];	// the block sums of each level (size 0: not allocated)
+
+	/*
+	 * out[i] = sum(in[0, i)) or sum(in[0, i]) (inclusive), in and out may be the same buffer.
+	 * the commands are enqueued (opencl) or executed (host) before it returns.
+	*/
+	int (* execute)(struct opencl_scan * scan, struct opencl_buffer * in, struct opencl_buffer * out, size_t n, int inclusive);
+};
+
+/*
+ * program: the linked kernels (NULL: host backend)
+ * local_size: 0: the largest power of 2 supported by the kernels (256 at most), host backend: 1024
+*/
+struct opencl_scan * opencl_scan_init(struct opencl_scan * scan, cl_program program, cl_command_queue queue, enum opencl_scan_type type, size_t local_size);
+void opencl_scan_cleanup(struct opencl_scan * scan);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
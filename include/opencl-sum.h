@@ -0,0 +1,57 @@
+#ifndef OPENCL_SUM_H_
+#define OPENCL_SUM_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "opencl-kernel.h"
+
+/**
+ * opencl_sum:
+ *   the sum of a float array (kernels/vec_sum.cl), the work-groups write their partial sums,
+ *   which are read back and added on the host.
+ *   plain:        vec_sum(), a float per work-item, a float tree per group, the groups added in order (float)
+ *   compensated:  vec_sum_compensated(), Kahan summation per work-item, error-free pairwise sums per group,
+ *                 the groups added pairwise (float)
+ *   double:       vec_sum_double(), double accumulators (only if the device supports fp64)
+ *   the kernels stride over the input, the grid is bounded by the device size.
+*/
+enum opencl_sum_mode
+{
+	opencl_sum_mode_plain,
+	opencl_sum_mode_compensated,
+	opencl_sum_mode_double,
+};
+
+struct opencl_sum
+{
+	enum opencl_backend_type backend;
+	enum opencl_sum_mode mode;
+	cl_context ctx;				// NULL: host backend
+	cl_command_queue queue;
+	size_t local_size;
+	size_t max_groups;			// the grid bound
+
+	struct opencl_function func[1];
+	struct opencl_buffer partials[1];	// the sums of the work-groups
+	void * host_partials;
+	size_t host_partials_size;
+
+	// *result = sum(in[0, n)), waits for the kernel
+	int (* execute)(struct opencl_sum * sum, struct opencl_buffer * in, size_t n, double * result);
+};
+
+/*
+ * program: the linked kernels (NULL: host backend)
+ * return NULL if the mode is not supported by the device (double without fp64)
+*/
+struct opencl_sum * opencl_sum_init(struct opencl_sum * sum, cl_program program, cl_command_queue queue, enum opencl_sum_mode mode);
+void opencl_sum_cleanup(struct opencl_sum * sum);
+const char * opencl_sum_mode_to_string(enum opencl_sum_mode mode);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
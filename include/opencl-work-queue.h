@@ -0,0 +1,98 @@
+#ifndef OPENCL_WORK_QUEUE_H_
+#define OPENCL_WORK_QUEUE_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "opencl-kernel.h"
+
+/**
+ * opencl_work_queue:
+ *   high-rate tiny jobs without a clEnqueueNDRangeKernel() per job (kernels/persistent.cl).
+ *   the host pushes work descriptors into a ring, the jobs run on the Y / X buffers given to start().
+ *   persistent: persistent_worker() is launched once by start() and runs until stop(),
+ *               its work-groups poll the ring, which lives in fine-grained SVM with atomics:
+ *               push() writes the descriptor and bumps the head, nothing is enqueued.
+ *               a slot is reused once the worker has copied its descriptor (op reset to none).
+ *               requires an OpenCL 2.0 build (CL_TARGET_OPENCL_VERSION >= 200), a device with
+ *               CL_DEVICE_SVM_FINE_GRAIN_BUFFER | CL_DEVICE_SVM_ATOMICS and kernels built with -cl-std=CL2.0.
+ *   batched:    the fallback, the pushed descriptors are written to a device buffer and
+ *               flush() runs them with a single persistent_batch() launch (one work-group per descriptor).
+ *               host backend: the batches run on the host threads.
+ *
+ *   the descriptors run concurrently and in any order, wait() for the pushed ones before
+ *   pushing a job which depends on them. Y is written by the worker until stop() (hazard tracking).
+*/
+enum opencl_work_op
+{
+	opencl_work_op_none,
+	opencl_work_op_mul_scalar,	// Y[offset + i] = X[offset + i] * a
+	opencl_work_op_add_scalar,	// Y[offset + i] = X[offset + i] + a
+};
+
+struct opencl_work_desc
+{
+	cl_int op;			// enum opencl_work_op
+	cl_int offset;		// items
+	cl_int length;
+	cl_float a;
+};
+
+enum opencl_work_queue_mode
+{
+	opencl_work_queue_mode_batched,
+	opencl_work_queue_mode_persistent,
+};
+const char * opencl_work_queue_mode_to_string(enum opencl_work_queue_mode mode);
+
+struct opencl_work_ring;	// persistent: the counters shared with the device
+struct opencl_work_queue
+{
+	enum opencl_backend_type backend;
+	enum opencl_work_queue_mode mode;
+	cl_context ctx;				// NULL: host backend
+	cl_command_queue queue;		// persistent: occupied by the worker until stop()
+	size_t capacity;			// descriptors in the ring (power of 2)
+	size_t local_size;
+	size_t num_groups;			// persistent: the resident work-groups of the worker
+	
+	struct opencl_function worker[1];	// persistent_worker() or persistent_batch()
+	struct opencl_buffer descs[1];		// the ring of descriptors (cpu_data: the host side)
+	struct opencl_buffer ring_buf[1];	// persistent: wraps the SVM counters
+	struct opencl_work_ring * ring;
+	
+	// host counters, they wrap around
+	uint32_t head;			// pushed
+	uint32_t flushed;		// batched: launched
+	uint32_t completed;		// known to be done
+	cl_uint arg_first;		// the worker's args (set by pointer)
+	cl_uint arg_capacity;
+	cl_event event;			// the running worker, or the last batch
+	
+	struct opencl_buffer * Y;
+	struct opencl_buffer * X;
+	int is_running;
+	
+	int (* start)(struct opencl_work_queue * wq, struct opencl_buffer * Y, struct opencl_buffer * X);
+	int (* push)(struct opencl_work_queue * wq, const struct opencl_work_desc * desc);	// waits for a free slot
+	int (* flush)(struct opencl_work_queue * wq);	// batched: launch the pending descriptors, persistent: no-op
+	int (* wait)(struct opencl_work_queue * wq);	// all the pushed descriptors have been run
+	int (* stop)(struct opencl_work_queue * wq);	// run the pending descriptors and release the buffers
+};
+
+/*
+ * program: the linked kernels (NULL: host backend)
+ * capacity: the ring size, rounded up to a power of 2 (0: 1024)
+ * mode: persistent falls back to batched if the device, the build or the program doesn't support it
+*/
+struct opencl_work_queue * opencl_work_queue_init(struct opencl_work_queue * wq, cl_program program, cl_command_queue queue, 
+	size_t capacity, enum opencl_work_queue_mode mode);
+void opencl_work_queue_cleanup(struct opencl_work_queue * wq);	// stops the worker
+
+#ifdef __cplusplus
+}
+#endif
+#endif
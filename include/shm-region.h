@@ -0,0 +1,57 @@
+#ifndef OPENCL_TEST_SHM_REGION_H_
+#define OPENCL_TEST_SHM_REGION_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include <sys/types.h>
+
+/**
+ * shm_region:
+ *   a shared memory object (shm_open + mmap) inherited by the fork()ed worker processes.
+ *   the name is unlinked right after it has been mapped, nothing is left behind if the processes crash.
+*/
+struct shm_region
+{
+	int fd;
+	size_t size;
+	void * data;
+};
+struct shm_region * shm_region_init(struct shm_region * shm, size_t size);
+void shm_region_cleanup(struct shm_region * shm);
+
+/**
+ * shm_ring:
+ *   a ring buffer of variable length records placed in shared memory.
+ *   guarded by a process-shared robust mutex: a worker dying with the lock held won't block the others.
+*/
+struct shm_ring
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+
+	size_t size;	// capacity of data[] (bytes)
+	size_t head;	// read position (free running)
+	size_t tail;	// write position (free running)
+	unsigned char data[];
+};
+size_t shm_ring_calc_size(size_t capacity);	// bytes needed by a ring of capacity bytes (header included)
+struct shm_ring * shm_ring_init(void * mem, size_t capacity);
+void shm_ring_cleanup(struct shm_ring * ring);
+
+/*
+ * push a record of (header + payload), pop copies the whole record into record (max_size bytes).
+ * timeout_ms < 0: wait infinitely
+ * return: push: 0 on success; pop: the record length; -1 on timeout or error
+*/
+int shm_ring_push(struct shm_ring * ring, const void * header, size_t cb_header, const void * payload, size_t cb_payload, int timeout_ms);
+ssize_t shm_ring_pop(struct shm_ring * ring, void * record, size_t max_size, int timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
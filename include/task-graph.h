@@ -0,0 +1,211 @@
+#ifndef OPENCL_TEST_TASK_GRAPH_H_
+#define OPENCL_TEST_TASK_GRAPH_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <json-c/json.h>
+
+/**
+ * task_graph:
+ *   the json config compiled once into fixed-size, validated records.
+ *   the records hold no pointers, the graph can be cached as a binary file.
+ *
+ * {
+ *   "backend": "opencl" | "host",          // runner settings, all optional
+ *   "platform": "<platform_name_prefix>",
+ *   "pipeline_depth": <n>,
+ *   "shutdown_timeout_ms": <ms>,
+ *   "multi_processes": true | false,
+ *   "kernels": "<module.cl>" | "<directory>",  // (default: kernels)
+ *   "watch": true | false,                // hot-reload the kernels and the config
+ *   "build_options": "<options>",          // compile options of the kernels, e.g. "-D SGEMM_TILE_SIZE=32"
+ *   "memory_budget_mb": <MiB>,             // device memory of the buffers, the cold ones are evicted to host memory
+ *   "numa": true | false,                 // pin the tasks to NUMA nodes, with their host buffers (default: on multi-node hosts)
+ *   "buffers": [
+ *     { "name": "<buffer_name>",
+ *       "type": "float" | "int" | "uint",   // (default: float)
+ *       "length": <number of items>,
+ *       "access": "read_write" | "read_only" | "write_only",  // kernels' access, (default: read_write)
+ *       "residency": "device" | "host",    // host: pinned, read back after each write (default: device)
+ *       "init": [start, step]              // item[i] = start + i * step, (default: zeros)
+ *     },
+ *     ...
+ *   ],
+ *   "tasks": [
+ *     { "functions": [ 
+ *         "kernel_name",                   // a kernel without args
+ *         { "kernel": "kernel_name",
+ *           "args": [
+ *             { "buffer": "<buffer_name>", "access": "read" | "write" | "read_write",
+ *               "offset": <item>, "length": <items> },  // the range accessed, bound as a sub-buffer view (default: the whole buffer)
+ *                                                       // the offset must be aligned to the devices' CL_DEVICE_MEM_BASE_ADDR_ALIGN
+ *             { "float": <value> }, { "int": <value> }, { "uint": <value> },
+ *             { "local": <bytes> },        // __local memory
+ *             { "local_per_item": <bytes> },  // __local memory, (bytes * work-group size)
+ *             ...
+ *           ]
+ *         },
+ *         ... 
+ *       ],
+ *       "dims": 1 ~ 3,                    // (default: 1)
+ *       "n": <items>,                     // grid-stride kernels, the runner sizes the grid by the device's occupancy
+ *                                         // or "global_sizes": [x, y, z], the exact grid
+ *       "local_sizes": [x, y, z],         // (default: decided by the runner)
+ *       "offsets": [x, y, z],             // (default: null)
+ *       "dependencies": [ task_index, ... ],
+ *       "device": <device_index>          // (default: auto placement)
+ *     },
+ *     ...
+ *   ]
+ * }
+*/
+#define TASK_GRAPH_MAX_TASKS		(16)
+#define TASK_GRAPH_MAX_FUNCTIONS	(16)
+#define TASK_GRAPH_MAX_NAME			(64)
+#define TASK_GRAPH_MAX_BUFFERS		(32)
+#define TASK_GRAPH_MAX_ARGS			(16)
+
+// same values as enum opencl_buffer_access
+enum task_graph_access
+{
+	task_graph_access_read = 1,
+	task_graph_access_write = 2,
+	task_graph_access_read_write = 3,
+};
+
+enum task_graph_data_type
+{
+	task_graph_data_type_float,
+	task_graph_data_type_int,
+	task_graph_data_type_uint,
+};
+#define TASK_GRAPH_ITEM_SIZE (sizeof(float))	// bytes per item, the same for every data type
+
+enum task_graph_residency
+{
+	task_graph_residency_device,
+	task_graph_residency_host,
+};
+
+struct task_graph_buffer
+{
+	char name[TASK_GRAPH_MAX_NAME];
+	int32_t type;		// enum task_graph_data_type, TASK_GRAPH_ITEM_SIZE bytes per item
+	int32_t access;		// enum task_graph_access
+	int32_t residency;	// enum task_graph_residency
+	int32_t has_init;
+	uint64_t length;	// items
+	double init[2];		// start, step
+};
+
+enum task_graph_arg_type
+{
+	task_graph_arg_type_buffer = 1,
+	task_graph_arg_type_float,
+	task_graph_arg_type_int,
+	task_graph_arg_type_uint,
+	task_graph_arg_type_local,
+};
+
+struct task_graph_arg
+{
+	int32_t type;			// enum task_graph_arg_type
+	int32_t buffer_index;	// buffer: index of graph->buffers
+	int32_t access;			// buffer: enum task_graph_access
+	int32_t local_per_item;	// local: cb_local is multiplied by the work-group size
+	uint64_t offset;		// buffer: the range accessed (items)
+	uint64_t length;
+	union {
+		float f32;
+		int32_t i32;
+		uint32_t u32;
+		uint64_t cb_local;
+	}value;
+};
+
+struct task_graph_function
+{
+	char kernel_name[TASK_GRAPH_MAX_NAME];
+	int num_args;
+	struct task_graph_arg args[TASK_GRAPH_MAX_ARGS];
+};
+
+struct task_graph_task
+{
+	int index;
+	int work_dim;
+	uint64_t offsets[3];
+	uint64_t global_sizes[3];
+	uint64_t local_sizes[3];	// 0: unspecified
+	int32_t grid_stride;		// "n": global_sizes[0] is the number of items, the grid is sized by the runner
+	int device_index;			// -1: auto
+
+	int num_dependencies;
+	int dependencies[TASK_GRAPH_MAX_TASKS];
+
+	int num_functions;
+	struct task_graph_function functions[TASK_GRAPH_MAX_FUNCTIONS];
+};
+
+struct task_graph_settings
+{
+	char backend[16];			// "": unspecified
+	char platform[TASK_GRAPH_MAX_NAME];
+	int32_t pipeline_depth;		// 0: unspecified
+	int32_t multi_processes;	// -1: unspecified
+	int64_t shutdown_timeout_ms;
+	int32_t has_shutdown_timeout;
+	int32_t watch;				// -1: unspecified
+	char kernel_file[256];		// "": unspecified
+	char build_options[256];	// "": unspecified
+	int64_t memory_budget_mb;	// 0: unspecified
+	int32_t numa;				// -1: unspecified
+};
+
+struct task_graph
+{
+	struct task_graph_settings settings;
+	int num_buffers;
+	struct task_graph_buffer * buffers;
+	int num_tasks;
+	struct task_graph_task * tasks;
+	int * order;	// topological order of the tasks
+
+	char err_msg[256];	// "<path>: <reason>" of the last error
+};
+
+/*
+ * return 0 on success, -1 on error (graph->err_msg)
+*/
+int task_graph_load_json(struct task_graph * graph, json_object * jconfig);
+
+/*
+ * load a json config file, compiled graphs are cached in cache_file (NULL: no cache)
+ * and reused as long as the config file is unchanged.
+*/
+int task_graph_load_file(struct task_graph * graph, const char * conf_file, const char * cache_file);
+int task_graph_save_binary(const struct task_graph * graph, const char * cache_file, const char * conf_file);
+int task_graph_load_binary(struct task_graph * graph, const char * cache_file, const char * conf_file);
+
+void task_graph_cleanup(struct task_graph * graph);
+
+/*
+ * the ranges of the buffers written by the producer and read by the consumer (the data sent along the edge),
+ * return the number of ranges, only the first max_ranges ones are filled.
+*/
+struct task_graph_range
+{
+	int buffer_index;
+	uint64_t offset;	// items
+	uint64_t length;
+};
+int task_graph_get_edge_ranges(const struct task_graph * graph, int producer, int consumer, struct task_graph_range * ranges, int max_ranges);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,101 @@
+/*
+ * common.h
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+
+#ifndef KERNELS_COMMON_H_
+#define KERNELS_COMMON_H_
+
+/*
+ * shared by the kernel modules: #include "common.h"
+ * compiled once as a header program (see opencl_library).
+ */
+
+/*
+ * work_group_reduce_sum():  the sum of the work-group's values, valid in partials[0] on all work-items
+ * (the block size doesn't need to be a power of 2)
+ */
+static inline void work_group_reduce_sum(__local float * partials)
+{
+	const size_t local_index = get_local_id(0);
+	size_t block_size = get_local_size(0);
+	size_t half_block_size = block_size / 2;
+	
+	barrier(CLK_LOCAL_MEM_FENCE);
+	while(half_block_size > 0) {
+		if(local_index < half_block_size) {
+			partials[local_index] += partials[local_index + half_block_size];
+			if(block_size & 1) // odd number 
+			{
+				if(0 == local_index) partials[local_index] += partials[local_index + (block_size - 1)];
+			}
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+		block_size = half_block_size;
+		half_block_size /= 2;
+	}
+}
+
+/*
+ * work_group_exclusive_scan_<type>():  Blelloch (work-efficient) exclusive prefix sum of the
+ * (2 * local_size) values in partials, in place, return the sum of all of them on all work-items.
+ * (the block size must be a power of 2)
+ */
+#define DEFINE_WORK_GROUP_EXCLUSIVE_SCAN(type) \
+static inline type work_group_exclusive_scan_##type(__local type * partials) \
+{ \
+	const size_t local_index = get_local_id(0); \
+	const size_t block_size = get_local_size(0) * 2; \
+	size_t offset = 1; \
+	\
+	barrier(CLK_LOCAL_MEM_FENCE); \
+	for(size_t d = block_size / 2; d > 0; d /= 2) { /* up-sweep */ \
+		if(local_index < d) { \
+			size_t ai = offset * (2 * local_index + 1) - 1; \
+			partials[ai + offset] += partials[ai]; \
+		} \
+		offset *= 2; \
+		barrier(CLK_LOCAL_MEM_FENCE); \
+	} \
+	\
+	type total = partials[block_size - 1]; \
+	barrier(CLK_LOCAL_MEM_FENCE); \
+	if(0 == local_index) partials[block_size - 1] = 0; \
+	\
+	for(size_t d = 1; d < block_size; d *= 2) { /* down-sweep */ \
+		offset /= 2; \
+		barrier(CLK_LOCAL_MEM_FENCE); \
+		if(local_index < d) { \
+			size_t ai = offset * (2 * local_index + 1) - 1; \
+			type t = partials[ai]; \
+			partials[ai] = partials[ai + offset]; \
+			partials[ai + offset] += t; \
+		} \
+	} \
+	barrier(CLK_LOCAL_MEM_FENCE); \
+	return total; \
+}
+
+DEFINE_WORK_GROUP_EXCLUSIVE_SCAN(float)
+DEFINE_WORK_GROUP_EXCLUSIVE_SCAN(int)
+
+#endif
@@ -0,0 +1,69 @@
+/*
+ * compact.cl
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+
+#include "common.h"
+
+/*
+ * stream compaction (see opencl_compact):
+ *   flags[i] = predicate(in[i], value)
+ *   positions = exclusive_scan(flags)
+ *   out[positions[i]] = in[i] if flags[i], count[0] = the number of items kept
+ * the kernels stride over [0, n), any grid size covers all the items.
+ */
+#define COMPACT_OP_GREATER		(0)
+#define COMPACT_OP_LESS			(1)
+#define COMPACT_OP_EQUAL		(2)
+#define COMPACT_OP_NOT_EQUAL	(3)
+
+#define DEFINE_COMPACT(type) \
+__kernel void compact_flags_##type(__const int n, __global const type * in, __global int * flags, \
+	__const int op, __const type value) \
+{ \
+	const int global_size = get_global_size(0); \
+	for(int i = get_global_id(0); i < n; i += global_size) { \
+		const type x = in[i]; \
+		int flag = 0; \
+		switch(op) { \
+		case COMPACT_OP_GREATER: flag = (x > value); break; \
+		case COMPACT_OP_LESS: flag = (x < value); break; \
+		case COMPACT_OP_EQUAL: flag = (x == value); break; \
+		case COMPACT_OP_NOT_EQUAL: flag = (x != value); break; \
+		} \
+		flags[i] = flag; \
+	} \
+} \
+\
+__kernel void compact_scatter_##type(__const int n, __global const type * in, __global const int * flags, \
+	__global const int * positions, __global type * out, __global int * count) \
+{ \
+	const int global_size = get_global_size(0); \
+	if(0 == n && 0 == get_global_id(0)) count[0] = 0;	/* empty input */ \
+	for(int i = get_global_id(0); i < n; i += global_size) { \
+		if(flags[i]) out[positions[i]] = in[i]; \
+		if(i == n - 1) count[0] = positions[i] + flags[i]; \
+	} \
+}
+
+DEFINE_COMPACT(float)
+DEFINE_COMPACT(int)
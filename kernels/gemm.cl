@@ -0,0 +1,136 @@
+/*
+ * gemm.cl
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+
+#include "common.h"
+
+/*
+ * tile sizes, selected at build time (see opencl_library_set_options / --build-options):
+ *   -D SGEMM_TILE_SIZE=<n>      the (n x n) tiles of A and B staged in local memory
+ *   -D SGEMM_WORK_PER_ITEM=<n>  the outputs computed by each work-item (in registers), divides SGEMM_TILE_SIZE
+ *   -D GEMV_TILE_SIZE=<n>       the items of x staged in local memory
+ */
+#ifndef SGEMM_TILE_SIZE
+#define SGEMM_TILE_SIZE (32)
+#endif
+#ifndef SGEMM_WORK_PER_ITEM
+#define SGEMM_WORK_PER_ITEM (8)
+#endif
+#ifndef GEMV_TILE_SIZE
+#define GEMV_TILE_SIZE (256)
+#endif
+
+#define SGEMM_TS SGEMM_TILE_SIZE
+#define SGEMM_WPT SGEMM_WORK_PER_ITEM
+#define SGEMM_RTS (SGEMM_TILE_SIZE / SGEMM_WORK_PER_ITEM)	// work-items per tile column
+
+/*
+ * C = alpha * A * B + beta * C,  A: (M x K), B: (K x N), C: (M x N), row-major
+ * 
+ * 2d grid:  global = { ceil(N / TS) * TS, ceil(M / TS) * RTS },  local = { TS, RTS } (the required work-group size)
+ * each work-item computes WPT rows of a column of the (TS x TS) tile of C
+ */
+__kernel __attribute__((reqd_work_group_size(SGEMM_TS, SGEMM_RTS, 1)))
+void sgemm(__const int M, __const int N, __const int K, __const float alpha, 
+	__global const float * A, __global const float * B, __const float beta, __global float * C)
+{
+	__local float A_tile[SGEMM_TS][SGEMM_TS];
+	__local float B_tile[SGEMM_TS][SGEMM_TS];
+	
+	const int col = get_local_id(0);
+	const int row = get_local_id(1);
+	const int first_row = get_group_id(1) * SGEMM_TS;
+	const int global_col = get_group_id(0) * SGEMM_TS + col;
+	
+	float acc[SGEMM_WPT];
+	for(int w = 0; w < SGEMM_WPT; ++w) acc[w] = 0;
+	
+	for(int t = 0; t < K; t += SGEMM_TS) {
+		for(int w = 0; w < SGEMM_WPT; ++w) {
+			const int r = row + w * SGEMM_RTS;
+			const int a_row = first_row + r;
+			const int a_col = t + col;
+			const int b_row = t + r;
+			A_tile[r][col] = (a_row < M && a_col < K)?A[a_row * K + a_col]:0;
+			B_tile[r][col] = (b_row < K && global_col < N)?B[b_row * N + global_col]:0;
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+		
+		for(int k = 0; k < SGEMM_TS; ++k) {
+			const float b = B_tile[k][col];
+			for(int w = 0; w < SGEMM_WPT; ++w) acc[w] += A_tile[row + w * SGEMM_RTS][k] * b;
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+	
+	if(global_col >= N) return;
+	for(int w = 0; w < SGEMM_WPT; ++w) {
+		const int global_row = first_row + row + w * SGEMM_RTS;
+		if(global_row >= M) break;
+		
+		__global float * c = &C[global_row * N + global_col];
+		*c = (beta == 0)?(alpha * acc[w]):(alpha * acc[w] + beta * (*c));
+	}
+}
+
+/*
+ * batched GEMV, for many small matrices:
+ *   y[b] = alpha * A[b] * x[b] + beta * y[b],  A[b]: (m x n), row-major, x[b]: n items, y[b]: m items
+ *   the matrices and vectors of the batch are stored contiguously.
+ * 
+ * 2d grid:  global = { ceil(m / local_size) * local_size, batch_count },  local = { local_size, 1 }
+ * each work-item computes one row, the work-group stages x[b] in local memory by tiles.
+ */
+__kernel void gemv_batched(__const int m, __const int n, __const int batch_count, __const float alpha, 
+	__global const float * A, __global const float * x, __const float beta, __global float * y)
+{
+	__local float x_tile[GEMV_TILE_SIZE];
+	
+	const int row = get_global_id(0);
+	const int b = get_global_id(1);
+	const int is_valid = (row < m && b < batch_count);
+	const int local_index = get_local_id(0);
+	const int local_size = get_local_size(0);
+	
+	__global const float * a = A + ((size_t)b * m + row) * n;
+	__global const float * xb = x + (size_t)b * n;
+	
+	float acc = 0;
+	for(int t = 0; t < n; t += GEMV_TILE_SIZE) {
+		const int length = min(GEMV_TILE_SIZE, n - t);
+		if(b < batch_count) {
+			for(int i = local_index; i < length; i += local_size) x_tile[i] = xb[t + i];
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+		
+		if(is_valid) {
+			for(int k = 0; k < length; ++k) acc += a[t + k] * x_tile[k];
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+	
+	if(is_valid) {
+		__global float * yb = &y[(size_t)b * m + row];
+		*yb = (beta == 0)?(alpha * acc):(alpha * acc + beta * (*yb));
+	}
+}
@@ -0,0 +1,98 @@
+/*
+ * histogram.cl
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+
+
+#include "common.h"
+
+/*
+ * histogram of floats, specialized at compile time by the build options (see opencl_library_set_options):
+ *   -D HISTOGRAM_NUM_BINS=<n> -D HISTOGRAM_MIN=<x> -D HISTOGRAM_MAX=<x>
+ *   bin(x) = (x - MIN) * NUM_BINS / (MAX - MIN), the values out of [MIN, MAX) (and NaNs) are counted in the first / last bin.
+ *
+ * both kernels are launched on the same 1D grid (e.g. as the functions of one task):
+ *   histogram_float():  each work-group counts its items in __local bins, then writes them to partials[group_id]
+ *   histogram_merge():  histogram[bin] = sum(partials[*][bin])
+ *   partials: (num_groups * HISTOGRAM_NUM_BINS) items, histogram: HISTOGRAM_NUM_BINS items
+ * histogram_info(): the values the program was built with, checked by the host before sizing the buffers.
+ */
+#ifndef HISTOGRAM_NUM_BINS
+#define HISTOGRAM_NUM_BINS (256)
+#endif
+
+#ifndef HISTOGRAM_MIN
+#define HISTOGRAM_MIN (0.0f)
+#endif
+
+#ifndef HISTOGRAM_MAX
+#define HISTOGRAM_MAX (1.0f)
+#endif
+
+#define HISTOGRAM_SCALE ((float)HISTOGRAM_NUM_BINS / ((float)HISTOGRAM_MAX - (float)HISTOGRAM_MIN))
+
+static inline uint histogram_bin(const float x)
+{
+	float t = (x - (float)HISTOGRAM_MIN) * HISTOGRAM_SCALE;
+	if(!(t >= 0.0f)) return 0;
+	return (uint)min(t, (float)(HISTOGRAM_NUM_BINS - 1));
+}
+
+/*
+ * the work-groups stride over the input: work-item i counts in[i], in[i + global_size], ...
+ */
+__kernel void histogram_float(__const int n, __global const float * in, __global uint * partials)
+{
+	__local uint bins[HISTOGRAM_NUM_BINS];
+	const int local_index = get_local_id(0);
+	const int local_size = get_local_size(0);
+	const int global_size = get_global_size(0);
+	
+	for(int bin = local_index; bin < HISTOGRAM_NUM_BINS; bin += local_size) bins[bin] = 0;
+	barrier(CLK_LOCAL_MEM_FENCE);
+	
+	for(int i = get_global_id(0); i < n; i += global_size) {
+		atomic_inc(&bins[histogram_bin(in[i])]);
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+	
+	__global uint * group_bins = partials + get_group_id(0) * HISTOGRAM_NUM_BINS;
+	for(int bin = local_index; bin < HISTOGRAM_NUM_BINS; bin += local_size) group_bins[bin] = bins[bin];
+}
+
+__kernel void histogram_info(__global float * info)
+{
+	if(get_global_id(0) != 0) return;
+	info[0] = (float)HISTOGRAM_NUM_BINS;
+	info[1] = (float)HISTOGRAM_MIN;
+	info[2] = (float)HISTOGRAM_MAX;
+}
+
+__kernel void histogram_merge(__global const uint * partials, __global uint * histogram)
+{
+	const int num_groups = get_num_groups(0);
+	for(int bin = get_global_id(0); bin < HISTOGRAM_NUM_BINS; bin += get_global_size(0)) {
+		uint sum = 0;
+		for(int group_id = 0; group_id < num_groups; ++group_id) sum += partials[group_id * HISTOGRAM_NUM_BINS + bin];
+		histogram[bin] = sum;
+	}
+}
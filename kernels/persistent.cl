@@ -0,0 +1,138 @@
+/*
+ * persistent.cl
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+
+
+#include "common.h"
+
+/*
+ * work descriptors: small element-wise jobs on the Y / X buffers bound to the worker,
+ * (the same layout as struct opencl_work_desc, 16 bytes)
+ */
+#define WORK_OP_NONE		(0)
+#define WORK_OP_MUL_SCALAR	(1)		// Y[offset + i] = X[offset + i] * a
+#define WORK_OP_ADD_SCALAR	(2)		// Y[offset + i] = X[offset + i] + a
+
+struct work_desc
+{
+	int op;
+	int offset;		// items
+	int length;
+	float a;
+};
+
+/*
+ * run_work_desc():  a descriptor is run by a whole work-group, the items stride over the group
+ */
+static inline void run_work_desc(const struct work_desc * desc, __global float * Y, __global const float * X)
+{
+	const int local_size = get_local_size(0);
+	__global float * y = Y + desc->offset;
+	__global const float * x = X + desc->offset;
+	switch(desc->op) {
+	case WORK_OP_MUL_SCALAR:
+		for(int i = get_local_id(0); i < desc->length; i += local_size) y[i] = x[i] * desc->a;
+		break;
+	case WORK_OP_ADD_SCALAR:
+		for(int i = get_local_id(0); i < desc->length; i += local_size) y[i] = x[i] + desc->a;
+		break;
+	default:
+		break;
+	}
+	return;
+}
+
+/*
+ * persistent_batch():  one launch per batch of descriptors, one work-group per descriptor
+ *   descs[(first + group_id) % capacity]
+ */
+__kernel void persistent_batch(__global const struct work_desc * descs, __const uint first, __const uint capacity, 
+	__global float * Y, __global const float * X)
+{
+	const struct work_desc desc = descs[(first + get_group_id(0)) % capacity];
+	run_work_desc(&desc, Y, X);
+	return;
+}
+
+#if defined(__OPENCL_C_VERSION__) && (__OPENCL_C_VERSION__ >= 200)
+/*
+ * persistent_worker():  (OpenCL C 2.0, build with -cl-std=CL2.0)
+ *   a long-running kernel, the work-groups pull the descriptors from a ring in fine-grained SVM:
+ *   the host writes descs[head % capacity] and bumps head (release),
+ *   a group claims the next descriptor (claimed < head), copies it and frees the slot (op = WORK_OP_NONE),
+ *   then runs it and bumps completed (release).
+ *   the counters wrap around, (int)(a - b) compares them.
+ *   the groups exit once the ring is drained and quit is set.
+ */
+struct work_ring
+{
+	atomic_uint head;		// appended by the host
+	atomic_uint claimed;	// claimed by the work-groups
+	atomic_uint completed;	// run by the work-groups
+	atomic_uint quit;
+};
+
+__kernel void persistent_worker(__global struct work_ring * ring, __global struct work_desc * descs, __const uint capacity, 
+	__global float * Y, __global const float * X)
+{
+	__local int index;
+	for(;;) {
+		if(get_local_id(0) == 0) {
+			index = -1;
+			for(;;) {
+				uint claimed = atomic_load_explicit(&ring->claimed, memory_order_relaxed, memory_scope_all_svm_devices);
+				uint head = atomic_load_explicit(&ring->head, memory_order_acquire, memory_scope_all_svm_devices);
+				if((int)(head - claimed) > 0) {
+					if(atomic_compare_exchange_strong_explicit(&ring->claimed, &claimed, claimed + 1, 
+						memory_order_acq_rel, memory_order_relaxed, memory_scope_all_svm_devices)) {
+						index = claimed % capacity;
+						break;
+					}
+				}else if(atomic_load_explicit(&ring->quit, memory_order_acquire, memory_scope_all_svm_devices)) {
+					break;
+				}
+			}
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+		const int i = index;
+		if(i < 0) break;
+		
+		const struct work_desc desc = descs[i];
+		
+		// the slot can be reused by the host once the whole group has its copy
+		barrier(CLK_LOCAL_MEM_FENCE);
+		if(get_local_id(0) == 0) {
+			atomic_store_explicit((volatile __global atomic_int *)&descs[i].op, WORK_OP_NONE, memory_order_release, memory_scope_all_svm_devices);
+		}
+		run_work_desc(&desc, Y, X);
+		
+		// the group's writes are done before the descriptor is completed, index is reused after the barrier
+		barrier(CLK_LOCAL_MEM_FENCE | CLK_GLOBAL_MEM_FENCE);
+		if(get_local_id(0) == 0) {
+			atomic_work_item_fence(CLK_GLOBAL_MEM_FENCE, memory_order_release, memory_scope_all_svm_devices);
+			atomic_fetch_add_explicit(&ring->completed, 1, memory_order_release, memory_scope_all_svm_devices);
+		}
+	}
+	return;
+}
+#endif
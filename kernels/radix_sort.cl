@@ -0,0 +1,117 @@
+/*
+ * radix_sort.cl
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+
+#include "common.h"
+
+/*
+ * LSD radix sort of 32-bit keys (see opencl_radix_sort), 4 bits per pass.
+ * 
+ * each work-group handles a tile of (2 * local_size) items, local_size must be a power of 2 (>= 8).
+ * histograms: RADIX_NUM_DIGITS * num_groups counts, digit-major,
+ *   the exclusive scan of the histograms is the first output position of each (digit, group).
+ */
+#define RADIX_BITS (4)
+#define RADIX_NUM_DIGITS (1 << RADIX_BITS)
+#define RADIX_DIGIT(key, shift) (((key) >> (shift)) & (RADIX_NUM_DIGITS - 1))
+
+__kernel void radix_count(__const int n, __global const uint * keys, __const int shift, 
+	__local uint * counts, __global int * histograms)
+{
+	const int local_size = get_local_size(0);
+	const int local_index = get_local_id(0);
+	const int i0 = get_group_id(0) * local_size * 2 + local_index;
+	const int i1 = i0 + local_size;
+	
+	for(int d = local_index; d < RADIX_NUM_DIGITS; d += local_size) counts[d] = 0;
+	barrier(CLK_LOCAL_MEM_FENCE);
+	
+	if(i0 < n) atomic_inc(&counts[RADIX_DIGIT(keys[i0], shift)]);
+	if(i1 < n) atomic_inc(&counts[RADIX_DIGIT(keys[i1], shift)]);
+	barrier(CLK_LOCAL_MEM_FENCE);
+	
+	for(int d = local_index; d < RADIX_NUM_DIGITS; d += local_size) {
+		histograms[d * get_num_groups(0) + get_group_id(0)] = counts[d];
+	}
+}
+
+/*
+ * the tile is sorted (stable) by the digit in local memory with 1-bit splits,
+ * then each item is written to offsets[digit, group] + its rank among the tile's items of the same digit.
+ * local_keys, local_indices, partials: __local, (2 * local_size) items
+ */
+__kernel void radix_scatter(__const int n, __global const uint * keys_in, __global const uint * values_in, 
+	__global uint * keys_out, __global uint * values_out, __const int shift, __global const int * offsets, 
+	__local uint * local_keys, __local int * local_indices, __local int * partials, __const int has_values)
+{
+	const int local_size = get_local_size(0);
+	const int local_index = get_local_id(0);
+	const int first = get_group_id(0) * local_size * 2;
+	
+	// the items past the end sort last (all bits set) and are not written
+	int index0 = local_index;
+	int index1 = local_index + local_size;
+	uint key0 = (first + index0 < n)?keys_in[first + index0]:0xffffffff;
+	uint key1 = (first + index1 < n)?keys_in[first + index1]:0xffffffff;
+	
+	for(int bit = shift; bit < shift + RADIX_BITS; ++bit) {
+		int zero0 = !((key0 >> bit) & 1);
+		int zero1 = !((key1 >> bit) & 1);
+		partials[local_index] = zero0;
+		partials[local_index + local_size] = zero1;
+		int num_zeros = work_group_exclusive_scan_int(partials);
+		
+		int pos0 = zero0?partials[local_index]:(local_index - partials[local_index] + num_zeros);
+		int pos1 = zero1?partials[local_index + local_size]:(local_index + local_size - partials[local_index + local_size] + num_zeros);
+		local_keys[pos0] = key0;
+		local_indices[pos0] = index0;
+		local_keys[pos1] = key1;
+		local_indices[pos1] = index1;
+		barrier(CLK_LOCAL_MEM_FENCE);
+		
+		key0 = local_keys[local_index];
+		index0 = local_indices[local_index];
+		key1 = local_keys[local_index + local_size];
+		index1 = local_indices[local_index + local_size];
+	}
+	
+	// partials[digit]: the first position of the digit in the sorted tile
+	const int digit0 = RADIX_DIGIT(key0, shift);
+	const int digit1 = RADIX_DIGIT(key1, shift);
+	if(0 == local_index || RADIX_DIGIT(local_keys[local_index - 1], shift) != digit0) partials[digit0] = local_index;
+	if(RADIX_DIGIT(local_keys[local_index + local_size - 1], shift) != digit1) partials[digit1] = local_index + local_size;
+	barrier(CLK_LOCAL_MEM_FENCE);
+	
+	const int num_groups = get_num_groups(0);
+	const int group_id = get_group_id(0);
+	if(first + index0 < n) {
+		int dst = offsets[digit0 * num_groups + group_id] + local_index - partials[digit0];
+		keys_out[dst] = key0;
+		if(has_values) values_out[dst] = values_in[first + index0];
+	}
+	if(first + index1 < n) {
+		int dst = offsets[digit1 * num_groups + group_id] + local_index + local_size - partials[digit1];
+		keys_out[dst] = key1;
+		if(has_values) values_out[dst] = values_in[first + index1];
+	}
+}
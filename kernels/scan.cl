@@ -0,0 +1,84 @@
+/*
+ * scan.cl
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+
+#include "common.h"
+
+/*
+ * prefix sums (see opencl_scan for the multi-level driver)
+ * 
+ * each work-group scans a block of (2 * local_size) items:
+ *   out[i] = sum(in[first, i))    (exclusive)
+ *   out[i] = sum(in[first, i])    (inclusive)
+ *   block_sums[group_id] = sum(in[first, first + 2 * local_size))
+ * 
+ * partials: __local, (2 * local_size) items, local_size must be a power of 2.
+ * in and out may be the same buffer.
+ */
+#define DEFINE_SCAN_BLOCKS(type) \
+__kernel void scan_blocks_##type(__const int n, __global const type * in, __global type * out, \
+	__local type * partials, __global type * block_sums, __const int inclusive) \
+{ \
+	const int local_size = get_local_size(0); \
+	const int local_index = get_local_id(0); \
+	const int i0 = get_group_id(0) * local_size * 2 + local_index; \
+	const int i1 = i0 + local_size; \
+	\
+	type x0 = (i0 < n)?in[i0]:0; \
+	type x1 = (i1 < n)?in[i1]:0; \
+	partials[local_index] = x0; \
+	partials[local_index + local_size] = x1; \
+	\
+	type total = work_group_exclusive_scan_##type(partials); \
+	if(inclusive) { \
+		x0 += partials[local_index]; \
+		x1 += partials[local_index + local_size]; \
+	}else { \
+		x0 = partials[local_index]; \
+		x1 = partials[local_index + local_size]; \
+	} \
+	\
+	if(i0 < n) out[i0] = x0; \
+	if(i1 < n) out[i1] = x1; \
+	if(0 == local_index) block_sums[get_group_id(0)] = total; \
+}
+
+/*
+ * out[i] += offsets[group_id], launched with the same work-groups as scan_blocks
+ */
+#define DEFINE_SCAN_ADD_OFFSETS(type) \
+__kernel void scan_add_offsets_##type(__const int n, __global type * out, __global const type * offsets) \
+{ \
+	const int local_size = get_local_size(0); \
+	const int i0 = get_group_id(0) * local_size * 2 + get_local_id(0); \
+	const int i1 = i0 + local_size; \
+	const type offset = offsets[get_group_id(0)]; \
+	\
+	if(i0 < n) out[i0] += offset; \
+	if(i1 < n) out[i1] += offset; \
+}
+
+DEFINE_SCAN_BLOCKS(float)
+DEFINE_SCAN_BLOCKS(int)
+DEFINE_SCAN_ADD_OFFSETS(float)
+DEFINE_SCAN_ADD_OFFSETS(int)
@@ -0,0 +1,108 @@
+/*
+ * vec_half.cl
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+
+
+#include "common.h"
+
+/*
+ * the element-wise and reduction kernels on 16-bit storage, computed in float:
+ *   _half:  IEEE half, vload_half() / vstore_half_rte() (does not require cl_khr_fp16)
+ *   _bf16:  bfloat16 (the upper 16 bits of a float) packed in ushort, rounded to nearest even
+ * the reductions accumulate in float, all the kernels stride over [global_offset, n) like kernels/vec_scalar.cl.
+ */
+static inline float bf16_to_float(const ushort x)
+{
+	return as_float((uint)x << 16);
+}
+
+static inline ushort float_to_bf16(const float x)
+{
+	uint u = as_uint(x);
+	if(isnan(x)) return (ushort)((u >> 16) | 0x40);	// keep it a (quiet) NaN
+	u += 0x7fff + ((u >> 16) & 1);
+	return (ushort)(u >> 16);
+}
+
+/*
+ * mul_scalar():  Y[i] = X[i] * a
+ */
+__kernel void vec_mul_scalar_half(__const int n, __global half * Y, __global const half * X, __const float a)
+{
+	const int global_size = get_global_size(0);
+	for(int i = get_global_id(0); i < n; i += global_size) vstore_half_rte(vload_half(i, X) * a, i, Y);
+}
+
+__kernel void vec_mul_scalar_bf16(__const int n, __global ushort * Y, __global const ushort * X, __const float a)
+{
+	const int global_size = get_global_size(0);
+	for(int i = get_global_id(0); i < n; i += global_size) Y[i] = float_to_bf16(bf16_to_float(X[i]) * a);
+}
+
+/*
+ * add_scalar():  Y[i] = X[i] + a
+ */
+__kernel void vec_add_scalar_half(__const int n, __global half * Y, __global const half * X, __const float a)
+{
+	const int global_size = get_global_size(0);
+	for(int i = get_global_id(0); i < n; i += global_size) vstore_half_rte(vload_half(i, X) + a, i, Y);
+}
+
+__kernel void vec_add_scalar_bf16(__const int n, __global ushort * Y, __global const ushort * X, __const float a)
+{
+	const int global_size = get_global_size(0);
+	for(int i = get_global_id(0); i < n; i += global_size) Y[i] = float_to_bf16(bf16_to_float(X[i]) + a);
+}
+
+/*
+ * result[group_id] = the sum of the group's items (the work-groups stride over A), in float
+ */
+__kernel void vec_sum_half(__const int n, __global const half * A, __local float * partials, __global float * result)
+{
+	const int local_index = get_local_id(0);
+	const int global_size = get_global_size(0);
+	
+	float sum = 0;
+	for(int i = get_global_id(0); i < n; i += global_size) sum += vload_half(i, A);
+	partials[local_index] = sum;
+	work_group_reduce_sum(partials);
+	
+	if(local_index == 0) {
+		result[get_group_id(0)] = partials[0];
+	}
+}
+
+__kernel void vec_sum_bf16(__const int n, __global const ushort * A, __local float * partials, __global float * result)
+{
+	const int local_index = get_local_id(0);
+	const int global_size = get_global_size(0);
+	
+	float sum = 0;
+	for(int i = get_global_id(0); i < n; i += global_size) sum += bf16_to_float(A[i]);
+	partials[local_index] = sum;
+	work_group_reduce_sum(partials);
+	
+	if(local_index == 0) {
+		result[get_group_id(0)] = partials[0];
+	}
+}
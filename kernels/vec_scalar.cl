@@ -0,0 +1,54 @@
+/*
+ * vec_scalar.cl
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+
+#include "common.h"
+
+/*
+ * the element-wise kernels stride over [global_offset, n), any grid size covers all the items
+ * (see opencl_function_get_grid_size())
+ */
+
+/*
+ * mul_scalar():  Y[i] = X[i] * a
+ */
+__kernel void vec_mul_scalar(__const int n, __global float * Y, __global const float * X, __const float a)
+{
+	const int global_size = get_global_size(0);
+	for(int i = get_global_id(0); i < n; i += global_size) {
+		Y[i] = X[i] * a;
+	}
+	return;
+}
+
+/*
+ * add_scalar():  Y[i] = X[i] + a
+ */
+__kernel void vec_add_scalar(__const int n, __global float * Y, __global const float * X, __const float a)
+{
+	const int global_size = get_global_size(0);
+	for(int i = get_global_id(0); i < n; i += global_size) {
+		Y[i] = X[i] + a;
+	}
+	return;
+}
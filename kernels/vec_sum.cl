@@ -0,0 +1,122 @@
+/*
+ * vec_sum.cl
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+
+#include "common.h"
+
+/*
+ * reduction for the vec_sum operation
+ * 
+ * result[group_id] = the sum of the group's items, sum(result) = sum(A)
+ *   the work-groups stride over A (any grid size), each work-item adds its items first.
+ */
+__kernel void vec_sum(__const int n, __global const float * A, __local float * partials, __global float * result)
+{
+	const int local_index = get_local_id(0);
+	const int global_size = get_global_size(0);
+	
+	float sum = 0;
+	for(int i = get_global_id(0); i < n; i += global_size) sum += A[i];
+	partials[local_index] = sum;
+	work_group_reduce_sum(partials);
+	
+	if(local_index == 0) {
+		result[get_group_id(0)] = partials[0];
+	}
+}
+
+/*
+ * compensated reduction: result[group_id] = the sum of the group's items, accurate for large n
+ *   the work-groups stride over A (any grid size), each work-item sums its items with Kahan summation,
+ *   then the (sum, compensation) pairs are added pairwise (error-free two_sum) across the work-group.
+ *   the sum of a work-item is (sum - compensation).
+ */
+static inline float two_sum(const float a, const float b, float * err)
+{
+	float s = a + b;
+	float bb = s - a;
+	*err = (a - (s - bb)) + (b - bb);
+	return s;
+}
+
+__kernel void vec_sum_compensated(__const int n, __global const float * A, 
+	__local float * partials, __local float * compensations, __global float * result)
+{
+	const int local_index = get_local_id(0);
+	const int global_size = get_global_size(0);
+	
+	float sum = 0;
+	float c = 0;
+	for(int i = get_global_id(0); i < n; i += global_size) {
+		float y = A[i] - c;
+		float t = sum + y;
+		c = (t - sum) - y;
+		sum = t;
+	}
+	partials[local_index] = sum;
+	compensations[local_index] = c;
+	barrier(CLK_LOCAL_MEM_FENCE);
+	
+	for(int active = get_local_size(0); active > 1; ) {
+		int half_size = (active + 1) / 2;
+		if(local_index + half_size < active) {
+			float err = 0;
+			partials[local_index] = two_sum(partials[local_index], partials[local_index + half_size], &err);
+			compensations[local_index] += compensations[local_index + half_size] - err;
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+		active = half_size;
+	}
+	
+	if(local_index == 0) {
+		result[get_group_id(0)] = partials[0] - compensations[0];
+	}
+}
+
+#ifdef cl_khr_fp64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+/*
+ * double accumulator (only built if the device supports fp64): the work-groups stride over A
+ */
+__kernel void vec_sum_double(__const int n, __global const float * A, __local double * partials, __global double * result)
+{
+	const int local_index = get_local_id(0);
+	const int global_size = get_global_size(0);
+	
+	double sum = 0;
+	for(int i = get_global_id(0); i < n; i += global_size) sum += A[i];
+	partials[local_index] = sum;
+	barrier(CLK_LOCAL_MEM_FENCE);
+	
+	for(int active = get_local_size(0); active > 1; ) {
+		int half_size = (active + 1) / 2;
+		if(local_index + half_size < active) partials[local_index] += partials[local_index + half_size];
+		barrier(CLK_LOCAL_MEM_FENCE);
+		active = half_size;
+	}
+	
+	if(local_index == 0) {
+		result[get_group_id(0)] = partials[0];
+	}
+}
+#endif
@@ -0,0 +1,1253 @@
+/*
+ * kernels-bench.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of 
+ * this software and associated documentation files (the "Software"), to deal in 
+ * the Software without restriction, including without limitation the rights to 
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+ * of the Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ * 
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <time.h>
+
+#include <getopt.h>
+#include "opencl-context.h"
+#include "opencl-kernel.h"
+#include "opencl-library.h"
+#include "opencl-host.h"
+#include "opencl-scan.h"
+#include "opencl-radix-sort.h"
+#include "opencl-compact.h"
+#include "opencl-gemm.h"
+#include "opencl-histogram.h"
+#include "opencl-half.h"
+#include "opencl-sum.h"
+#include "opencl-work-queue.h"
+
+/*
+ * correctness checks and throughput of the kernel library (kernels/),
+ * on the first device of the platform, or on the host backend if no platform was found.
+*/
+struct bench_context
+{
+	enum opencl_backend_type backend;
+	opencl_context_t * cl;
+	cl_context ctx;			// NULL: host backend
+	cl_device_id device;
+	cl_command_queue queue;
+	cl_program program;
+	
+	size_t n;				// items
+	int repeats;
+};
+
+static double get_time_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1000000.0;
+}
+
+static cl_command_queue bench_create_queue(struct bench_context * bench, cl_int * p_ret)
+{
+#if defined(CL_TARGET_OPENCL_VERSION) && (CL_TARGET_OPENCL_VERSION >= 200)
+	return clCreateCommandQueueWithProperties(bench->ctx, bench->device, NULL, p_ret);
+#else
+	return clCreateCommandQueue(bench->ctx, bench->device, 0, p_ret);
+#endif
+}
+
+static void bench_finish(struct bench_context * bench)
+{
+	if(bench->queue) clFinish(bench->queue);
+}
+
+static struct opencl_buffer * bench_buffer_init(struct bench_context * bench, struct opencl_buffer * buf, size_t size, const void * data)
+{
+	cl_mem_flags flags = CL_MEM_READ_WRITE;
+	if(bench->ctx && data) flags |= CL_MEM_COPY_HOST_PTR;
+	buf = opencl_buffer_init(buf, bench->ctx, flags, size, data);
+	assert(buf && CL_SUCCESS == buf->err_code);
+	return buf;
+}
+
+static int bench_buffer_read(struct bench_context * bench, struct opencl_buffer * buf, void * data, size_t size)
+{
+	return (opencl_buffer_enqueue_read(buf, bench->queue, CL_TRUE, 0, size, data) == data)?0:-1;
+}
+
+static void bench_report(const char * name, size_t n, size_t bytes, double time_ms)
+{
+	if(time_ms <= 0) time_ms = 1e-6;
+	printf("%-32s n = %-10lu %10.3f ms  %10.2f Mitems/s  %8.2f GB/s\n", name, (unsigned long)n, time_ms, 
+		(double)n / (time_ms * 1000.0), (double)bytes / (time_ms * 1000000.0));
+}
+
+static void bench_report_flops(const char * name, const char * shape, double flops, double time_ms)
+{
+	if(time_ms <= 0) time_ms = 1e-6;
+	printf("%-32s %-16s %10.3f ms  %10.2f GFLOP/s\n", name, shape, time_ms, flops / (time_ms * 1000000.0));
+}
+
+/*********************************************
+ * scan
+*********************************************/
+static int verify_scan(enum opencl_scan_type type, const void * input, const void * output, size_t n, int inclusive)
+{
+	double sum = 0;
+	for(size_t i = 0; i < n; ++i) {
+		double x = (type == opencl_scan_type_float)?(double)((const float *)input)[i]:(double)((const cl_int *)input)[i];
+		double y = (type == opencl_scan_type_float)?(double)((const float *)output)[i]:(double)((const cl_int *)output)[i];
+		if(inclusive) sum += x;
+		
+		// float: the blocks are summed in a different order than the reference
+		double tolerance = (type == opencl_scan_type_float)?(1e-4 * (fabs(sum) + 1.0)):0.0;
+		if(fabs(y - sum) > tolerance) {
+			fprintf(stderr, "[ERROR]: scan(n=%lu, inclusive=%d): out[%lu] = %g, expected %g\n", 
+				(unsigned long)n, inclusive, (unsigned long)i, y, sum);
+			return -1;
+		}
+		if(!inclusive) sum += x;
+	}
+	return 0;
+}
+
+static int bench_scan_type(struct bench_context * bench, enum opencl_scan_type type)
+{
+	const char * type_name = (type == opencl_scan_type_float)?"float":"int";
+	struct opencl_scan * scan = opencl_scan_init(NULL, bench->program, bench->queue, type, 0);
+	if(NULL == scan) return -1;
+	
+	size_t n = bench->n;
+	size_t size = n * sizeof(cl_int);
+	void * input = malloc(size);
+	void * output = malloc(size);
+	assert(input && output);
+	for(size_t i = 0; i < n; ++i) {
+		if(type == opencl_scan_type_float) ((float *)input)[i] = (float)rand() / (float)RAND_MAX;
+		else ((cl_int *)input)[i] = rand() % 16;
+	}
+	
+	struct opencl_buffer in[1], out[1];
+	bench_buffer_init(bench, in, size, input);
+	bench_buffer_init(bench, out, size, NULL);
+	
+	// correctness: partial blocks and 1 to 3 levels, in place and out of place
+	int rc = 0;
+	size_t block_size = scan->local_size * 2;
+	size_t lengths[] = { 1, block_size - 1, block_size * block_size + 1, n };
+	for(size_t k = 0; k < sizeof(lengths) / sizeof(lengths[0]) && 0 == rc; ++k) {
+		size_t length = lengths[k];
+		if(length > n) continue;
+		for(int inclusive = 0; inclusive < 2 && 0 == rc; ++inclusive) {
+			rc = scan->execute(scan, in, out, length, inclusive);
+			if(0 == rc) rc = bench_buffer_read(bench, out, output, length * sizeof(cl_int));
+			if(0 == rc) rc = verify_scan(type, input, output, length, inclusive);
+		}
+	}
+	if(0 == rc) {
+		struct opencl_buffer inout[1];
+		bench_buffer_init(bench, inout, size, input);
+		rc = scan->execute(scan, inout, inout, n, 1);
+		if(0 == rc) rc = bench_buffer_read(bench, inout, output, size);
+		if(0 == rc) rc = verify_scan(type, input, output, n, 1);
+		opencl_buffer_cleanup(inout);
+	}
+	
+	// throughput: read n items, write n items
+	if(0 == rc) {
+		rc = scan->execute(scan, in, out, n, 0);	// warm up
+		bench_finish(bench);
+		
+		double begin = get_time_ms();
+		for(int i = 0; i < bench->repeats && 0 == rc; ++i) rc = scan->execute(scan, in, out, n, 0);
+		bench_finish(bench);
+		double time_ms = (get_time_ms() - begin) / bench->repeats;
+		
+		char name[64] = "";
+		snprintf(name, sizeof(name), "scan_exclusive_%s", type_name);
+		bench_report(name, n, 2 * size, time_ms);
+	}
+	if(rc) fprintf(stderr, "[ERROR]: scan (%s) failed\n", type_name);
+	
+	opencl_buffer_cleanup(in);
+	opencl_buffer_cleanup(out);
+	opencl_scan_cleanup(scan);
+	free(scan);
+	free(input);
+	free(output);
+	return rc;
+}
+
+static int bench_scan(struct bench_context * bench)
+{
+	int rc = bench_scan_type(bench, opencl_scan_type_float);
+	if(0 == rc) rc = bench_scan_type(bench, opencl_scan_type_int);
+	return rc;
+}
+
+/*********************************************
+ * radix sort
+*********************************************/
+struct key_value
+{
+	cl_uint key;
+	cl_uint value;
+};
+
+static int compare_key_value(const void * a, const void * b)
+{
+	const struct key_value * x = a;
+	const struct key_value * y = b;
+	if(x->key != y->key) return (x->key < y->key)?-1:1;
+	return (x->value < y->value)?-1:(x->value > y->value);	// stable
+}
+
+static int bench_radix_sort(struct bench_context * bench)
+{
+	struct opencl_radix_sort * sort = opencl_radix_sort_init(NULL, bench->program, bench->queue, 0);
+	if(NULL == sort) return -1;
+	
+	size_t n = bench->n;
+	size_t size = n * sizeof(cl_uint);
+	cl_uint * keys = malloc(size);
+	cl_uint * values = malloc(size);
+	struct key_value * pairs = malloc(n * sizeof(*pairs));
+	assert(keys && values && pairs);
+	for(size_t i = 0; i < n; ++i) {
+		keys[i] = ((cl_uint)rand() << 16) ^ (cl_uint)rand();
+		if(i % 4 == 0) keys[i] &= 0xff;	// duplicated keys, to check the stability
+		values[i] = i;
+		pairs[i].key = keys[i];
+		pairs[i].value = i;
+	}
+	
+	// the reference (and the baseline): qsort on the host
+	double begin = get_time_ms();
+	qsort(pairs, n, sizeof(*pairs), compare_key_value);
+	double qsort_ms = get_time_ms() - begin;
+	
+	struct opencl_buffer keys_buf[1], values_buf[1];
+	bench_buffer_init(bench, keys_buf, size, keys);
+	bench_buffer_init(bench, values_buf, size, values);
+	
+	int rc = sort->execute(sort, keys_buf, values_buf, n);
+	if(0 == rc) rc = bench_buffer_read(bench, keys_buf, keys, size);
+	if(0 == rc) rc = bench_buffer_read(bench, values_buf, values, size);
+	for(size_t i = 0; i < n && 0 == rc; ++i) {
+		if(keys[i] != pairs[i].key || values[i] != pairs[i].value) {
+			fprintf(stderr, "[ERROR]: radix_sort: [%lu] = {%u, %u}, expected {%u, %u}\n", 
+				(unsigned long)i, keys[i], values[i], pairs[i].key, pairs[i].value);
+			rc = -1;
+		}
+	}
+	
+	// throughput: sort the (already sorted) keys again, the number of passes does not depend on the data
+	if(0 == rc) {
+		bench_finish(bench);
+		begin = get_time_ms();
+		for(int i = 0; i < bench->repeats && 0 == rc; ++i) rc = sort->execute(sort, keys_buf, values_buf, n);
+		bench_finish(bench);
+		double time_ms = (get_time_ms() - begin) / bench->repeats;
+		
+		bench_report("radix_sort_key_value", n, 2 * size, time_ms);
+		bench_report("qsort_key_value (host)", n, 2 * size, qsort_ms);
+	}
+	
+	opencl_buffer_cleanup(keys_buf);
+	opencl_buffer_cleanup(values_buf);
+	opencl_radix_sort_cleanup(sort);
+	free(sort);
+	free(keys);
+	free(values);
+	free(pairs);
+	return rc;
+}
+
+/*********************************************
+ * stream compaction
+*********************************************/
+static int bench_compact(struct bench_context * bench)
+{
+	struct opencl_compact * compact = opencl_compact_init(NULL, bench->program, bench->queue, opencl_scan_type_float, 0);
+	if(NULL == compact) return -1;
+	
+	size_t n = bench->n;
+	size_t size = n * sizeof(float);
+	float * input = malloc(size);
+	float * output = malloc(size);
+	assert(input && output);
+	for(size_t i = 0; i < n; ++i) input[i] = (float)rand() / (float)RAND_MAX;
+	
+	struct opencl_buffer in[1], out[1], count[1];
+	bench_buffer_init(bench, in, size, input);
+	bench_buffer_init(bench, out, size, NULL);
+	bench_buffer_init(bench, count, sizeof(cl_int), NULL);
+	
+	float threshold = 0.5f;
+	cl_int num_kept = 0;
+	int rc = compact->execute(compact, in, out, count, n, opencl_compact_op_greater, &threshold);
+	if(0 == rc) rc = bench_buffer_read(bench, count, &num_kept, sizeof(num_kept));
+	if(0 == rc && num_kept > 0) rc = bench_buffer_read(bench, out, output, num_kept * sizeof(float));
+	
+	size_t k = 0;
+	for(size_t i = 0; i < n && 0 == rc; ++i) {
+		if(!(input[i] > threshold)) continue;
+		if(k >= num_kept || output[k] != input[i]) {
+			fprintf(stderr, "[ERROR]: compact: out[%lu] mismatch\n", (unsigned long)k);
+			rc = -1;
+		}
+		++k;
+	}
+	if(0 == rc && k != num_kept) {
+		fprintf(stderr, "[ERROR]: compact: count = %d, expected %lu\n", num_kept, (unsigned long)k);
+		rc = -1;
+	}
+	
+	if(0 == rc) {
+		bench_finish(bench);
+		double begin = get_time_ms();
+		for(int i = 0; i < bench->repeats && 0 == rc; ++i) {
+			rc = compact->execute(compact, in, out, count, n, opencl_compact_op_greater, &threshold);
+		}
+		bench_finish(bench);
+		double time_ms = (get_time_ms() - begin) / bench->repeats;
+		
+		// read the input, write the kept items
+		bench_report("compact_float (x > 0.5)", n, size + num_kept * sizeof(float), time_ms);
+	}
+	
+	opencl_buffer_cleanup(in);
+	opencl_buffer_cleanup(out);
+	opencl_buffer_cleanup(count);
+	opencl_compact_cleanup(compact);
+	free(compact);
+	free(input);
+	free(output);
+	return rc;
+}
+
+/*********************************************
+ * gemm
+*********************************************/
+static void random_fill(float * data, size_t n)
+{
+	for(size_t i = 0; i < n; ++i) data[i] = (float)rand() / (float)RAND_MAX * 2.0f - 1.0f;
+}
+
+static int verify_matrix(const char * name, const float * output, const float * expected, size_t n, int K)
+{
+	// the blocked kernels add the products in a different order
+	float tolerance = 1e-5f * (float)(K + 16);
+	for(size_t i = 0; i < n; ++i) {
+		if(fabsf(output[i] - expected[i]) > tolerance * (1.0f + fabsf(expected[i]))) {
+			fprintf(stderr, "[ERROR]: %s: [%lu] = %g, expected %g\n", name, (unsigned long)i, output[i], expected[i]);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+// the reference (and the baseline): a naive ijk loop on the host
+static void naive_sgemm(int M, int N, int K, float alpha, const float * A, const float * B, float beta, float * C)
+{
+	for(int i = 0; i < M; ++i) {
+		for(int j = 0; j < N; ++j) {
+			float sum = 0;
+			for(int k = 0; k < K; ++k) sum += A[(size_t)i * K + k] * B[(size_t)k * N + j];
+			C[(size_t)i * N + j] = alpha * sum + beta * C[(size_t)i * N + j];
+		}
+	}
+}
+
+static int bench_sgemm(struct bench_context * bench, struct opencl_gemm * gemm)
+{
+	// a square-ish problem derived from the length, not a multiple of the tile size to check the edges
+	size_t dim = (size_t)sqrt((double)bench->n) / 4;
+	if(dim < 1) dim = 1;
+	if(dim > 1024) dim = 1024;
+	int M = dim, N = dim + 7, K = dim + 3;
+	float alpha = 1.5f, beta = 0.5f;
+	
+	size_t size_a = (size_t)M * K * sizeof(float);
+	size_t size_b = (size_t)K * N * sizeof(float);
+	size_t size_c = (size_t)M * N * sizeof(float);
+	float * a = malloc(size_a);
+	float * b = malloc(size_b);
+	float * c = malloc(size_c);
+	float * expected = malloc(size_c);
+	assert(a && b && c && expected);
+	random_fill(a, (size_t)M * K);
+	random_fill(b, (size_t)K * N);
+	random_fill(c, (size_t)M * N);
+	memcpy(expected, c, size_c);
+	
+	double begin = get_time_ms();
+	naive_sgemm(M, N, K, alpha, a, b, beta, expected);
+	double naive_ms = get_time_ms() - begin;
+	
+	struct opencl_buffer A[1], B[1], C[1];
+	bench_buffer_init(bench, A, size_a, a);
+	bench_buffer_init(bench, B, size_b, b);
+	bench_buffer_init(bench, C, size_c, c);
+	
+	int rc = gemm->sgemm(gemm, M, N, K, alpha, A, B, beta, C);
+	if(0 == rc) rc = bench_buffer_read(bench, C, c, size_c);
+	if(0 == rc) rc = verify_matrix("sgemm", c, expected, (size_t)M * N, K);
+	
+	if(0 == rc) {
+		// beta = 0: C is not read
+		bench_finish(bench);
+		begin = get_time_ms();
+		for(int i = 0; i < bench->repeats && 0 == rc; ++i) rc = gemm->sgemm(gemm, M, N, K, 1.0f, A, B, 0.0f, C);
+		bench_finish(bench);
+		double time_ms = (get_time_ms() - begin) / bench->repeats;
+		
+		char shape[64] = "";
+		snprintf(shape, sizeof(shape), "%dx%dx%d", M, N, K);
+		double flops = 2.0 * M * N * K;
+		bench_report_flops("sgemm", shape, flops, time_ms);
+		bench_report_flops("sgemm_naive (host)", shape, flops, naive_ms);
+	}
+	
+	opencl_buffer_cleanup(A);
+	opencl_buffer_cleanup(B);
+	opencl_buffer_cleanup(C);
+	free(a);
+	free(b);
+	free(c);
+	free(expected);
+	return rc;
+}
+
+static int bench_gemv_batched(struct bench_context * bench, struct opencl_gemm * gemm)
+{
+	// many small matrices
+	int m = 48, n = 32;
+	size_t batch_count = bench->n / ((size_t)m * n);
+	if(batch_count < 1) batch_count = 1;
+	if(batch_count > 65535) batch_count = 65535;
+	float alpha = 1.0f, beta = 0.25f;
+	
+	size_t size_a = (size_t)m * n * batch_count * sizeof(float);
+	size_t size_x = (size_t)n * batch_count * sizeof(float);
+	size_t size_y = (size_t)m * batch_count * sizeof(float);
+	float * a = malloc(size_a);
+	float * x = malloc(size_x);
+	float * y = malloc(size_y);
+	float * expected = malloc(size_y);
+	assert(a && x && y && expected);
+	random_fill(a, (size_t)m * n * batch_count);
+	random_fill(x, (size_t)n * batch_count);
+	random_fill(y, (size_t)m * batch_count);
+	memcpy(expected, y, size_y);
+	
+	// a gemv is a (m x n) * (n x 1) sgemm
+	double begin = get_time_ms();
+	for(size_t i = 0; i < batch_count; ++i) {
+		naive_sgemm(m, 1, n, alpha, a + i * m * n, x + i * n, beta, expected + i * m);
+	}
+	double naive_ms = get_time_ms() - begin;
+	
+	struct opencl_buffer A[1], X[1], Y[1];
+	bench_buffer_init(bench, A, size_a, a);
+	bench_buffer_init(bench, X, size_x, x);
+	bench_buffer_init(bench, Y, size_y, y);
+	
+	int rc = gemm->gemv_batched(gemm, m, n, batch_count, alpha, A, X, beta, Y);
+	if(0 == rc) rc = bench_buffer_read(bench, Y, y, size_y);
+	if(0 == rc) rc = verify_matrix("gemv_batched", y, expected, (size_t)m * batch_count, n);
+	
+	if(0 == rc) {
+		bench_finish(bench);
+		begin = get_time_ms();
+		for(int i = 0; i < bench->repeats && 0 == rc; ++i) rc = gemm->gemv_batched(gemm, m, n, batch_count, alpha, A, X, 0.0f, Y);
+		bench_finish(bench);
+		double time_ms = (get_time_ms() - begin) / bench->repeats;
+		
+		char shape[64] = "";
+		snprintf(shape, sizeof(shape), "%dx%d x %lu", m, n, (unsigned long)batch_count);
+		double flops = 2.0 * m * n * batch_count;
+		bench_report_flops("gemv_batched", shape, flops, time_ms);
+		bench_report_flops("gemv_naive (host)", shape, flops, naive_ms);
+	}
+	
+	opencl_buffer_cleanup(A);
+	opencl_buffer_cleanup(X);
+	opencl_buffer_cleanup(Y);
+	free(a);
+	free(x);
+	free(y);
+	free(expected);
+	return rc;
+}
+
+static int bench_gemm(struct bench_context * bench)
+{
+	struct opencl_gemm * gemm = opencl_gemm_init(NULL, bench->program, bench->queue);
+	if(NULL == gemm) return -1;
+	if(bench->backend == opencl_backend_type_opencl) {
+		printf("sgemm: tile %lu, %lu rows per work-item\n", 
+			(unsigned long)gemm->sgemm_block.x, (unsigned long)(gemm->sgemm_block.x / gemm->sgemm_block.y));
+	}
+	
+	int rc = bench_sgemm(bench, gemm);
+	if(0 == rc) rc = bench_gemv_batched(bench, gemm);
+	
+	opencl_gemm_cleanup(gemm);
+	free(gemm);
+	return rc;
+}
+
+/*********************************************
+ * histogram
+*********************************************/
+static void host_histogram(const float * data, size_t n, unsigned int * histogram, size_t num_bins, float min, float max)
+{
+	// the same binning as kernels/histogram.cl
+	const float scale = (float)num_bins / (max - min);
+	const float last_bin = (float)(num_bins - 1);
+	memset(histogram, 0, num_bins * sizeof(*histogram));
+	for(size_t i = 0; i < n; ++i) {
+		float t = (data[i] - min) * scale;
+		size_t bin = 0;
+		if(t >= 0.0f) bin = (size_t)((t < last_bin)?t:last_bin);
+		++histogram[bin];
+	}
+}
+
+static int bench_histogram(struct bench_context * bench)
+{
+	// the bins and the range the kernels were built with (see main())
+	struct opencl_histogram * hist = opencl_histogram_init(NULL, bench->program, bench->queue, 0);
+	if(NULL == hist) return -1;
+	size_t num_bins = hist->num_bins;
+	float min = hist->min;
+	float max = hist->max;
+	if(!(max > min)) {
+		opencl_histogram_cleanup(hist);
+		free(hist);
+		return -1;
+	}
+	
+	size_t n = bench->n;
+	size_t size = n * sizeof(float);
+	size_t bins_size = num_bins * sizeof(cl_uint);
+	float * input = malloc(size);
+	float * readback = malloc(size);
+	unsigned int * histogram = malloc(bins_size);
+	unsigned int * expected = malloc(bins_size);
+	assert(input && readback && histogram && expected);
+	
+	// 10% of the items out of the range
+	float range = max - min;
+	for(size_t i = 0; i < n; ++i) input[i] = min - 0.05f * range + (float)rand() / (float)RAND_MAX * 1.1f * range;
+	host_histogram(input, n, expected, num_bins, min, max);
+	
+	struct opencl_buffer in[1], bins[1];
+	bench_buffer_init(bench, in, size, input);
+	bench_buffer_init(bench, bins, bins_size, NULL);
+	
+	int rc = hist->execute(hist, in, n, bins);
+	if(0 == rc) rc = bench_buffer_read(bench, bins, histogram, bins_size);
+	for(size_t i = 0; i < num_bins && 0 == rc; ++i) {
+		if(histogram[i] != expected[i]) {
+			fprintf(stderr, "[ERROR]: histogram: bin[%lu] = %u, expected %u\n", (unsigned long)i, histogram[i], expected[i]);
+			rc = -1;
+		}
+	}
+	
+	if(0 == rc) {
+		bench_finish(bench);
+		double begin = get_time_ms();
+		for(int i = 0; i < bench->repeats && 0 == rc; ++i) {
+			rc = hist->execute(hist, in, n, bins);
+			if(0 == rc) rc = bench_buffer_read(bench, bins, histogram, bins_size);
+		}
+		double time_ms = (get_time_ms() - begin) / bench->repeats;
+		
+		// the baseline: read the data back and count on the host
+		begin = get_time_ms();
+		for(int i = 0; i < bench->repeats && 0 == rc; ++i) {
+			rc = bench_buffer_read(bench, in, readback, size);
+			host_histogram(readback, n, expected, num_bins, min, max);
+		}
+		double readback_ms = (get_time_ms() - begin) / bench->repeats;
+		
+		char name[64] = "";
+		snprintf(name, sizeof(name), "histogram (%lu bins)", (unsigned long)num_bins);
+		bench_report(name, n, size + bins_size, time_ms);
+		bench_report("readback + host histogram", n, size, readback_ms);
+	}
+	
+	opencl_buffer_cleanup(in);
+	opencl_buffer_cleanup(bins);
+	opencl_histogram_cleanup(hist);
+	free(hist);
+	free(input);
+	free(readback);
+	free(histogram);
+	free(expected);
+	return rc;
+}
+
+/*********************************************
+ * half / bf16 storage
+*********************************************/
+static struct opencl_function * bench_function_init(struct bench_context * bench, struct opencl_function * function, const char * kernel_name)
+{
+	if(bench->backend == opencl_backend_type_host) return opencl_host_function_init(function, kernel_name);
+	function = opencl_function_init(function, bench->program, kernel_name);
+	assert(function);
+	function->queue = bench->queue;
+	return function;
+}
+
+#define BENCH_SUM_LOCAL_SIZE (256)
+static int bench_storage_type(struct bench_context * bench, enum opencl_storage_type type, const float * input, double expected_sum)
+{
+	static const char * suffixes[] = {
+		[opencl_storage_type_float] = "",
+		[opencl_storage_type_half] = "_half",
+		[opencl_storage_type_bf16] = "_bf16",
+	};
+	const char * type_name = opencl_storage_type_to_string(type);
+	char mul_name[64] = "", sum_name[64] = "";
+	snprintf(mul_name, sizeof(mul_name), "vec_mul_scalar%s", suffixes[type]);
+	snprintf(sum_name, sizeof(sum_name), "vec_sum%s", suffixes[type]);
+	
+	size_t n = bench->n;
+	size_t size = n * opencl_storage_type_size(type);
+	size_t local_size = BENCH_SUM_LOCAL_SIZE;
+	
+	struct opencl_function mul[1], sum[1];
+	if(NULL == bench_function_init(bench, mul, mul_name) || NULL == bench_function_init(bench, sum, sum_name)) return -1;
+	
+	float a = 3.0f;
+	cl_int length = (cl_int)n;
+	opencl_function_set_args(mul, 4, sizeof(length), &length, sizeof(cl_mem), NULL, sizeof(cl_mem), NULL, sizeof(a), &a);
+	opencl_function_set_args(sum, 4, sizeof(length), &length, sizeof(cl_mem), NULL, local_size * sizeof(float), NULL, sizeof(cl_mem), NULL);
+	
+	// grid-stride kernels: a grid bounded by the device's occupancy, one partial sum per work-group
+	size_t mul_global_size = opencl_function_get_grid_size(mul, n, local_size);
+	size_t global_size = opencl_function_get_grid_size(sum, n, local_size);
+	size_t num_groups = global_size / local_size;
+	void * data = malloc(size);
+	float * output = malloc(n * sizeof(float));
+	float * partials = malloc(num_groups * sizeof(float));
+	assert(data && output && partials);
+	opencl_storage_from_float(type, data, input, n);
+	
+	struct opencl_buffer X[1], Y[1], result[1];
+	bench_buffer_init(bench, X, size, data);
+	bench_buffer_init(bench, Y, size, NULL);
+	bench_buffer_init(bench, result, num_groups * sizeof(float), NULL);
+	
+	opencl_function_bind_buffer(mul, 1, Y, opencl_buffer_access_write);
+	opencl_function_bind_buffer(mul, 2, X, opencl_buffer_access_read);
+	mul->set_dims(mul, 1, NULL, &mul_global_size, &local_size);
+	
+	opencl_function_bind_buffer(sum, 1, X, opencl_buffer_access_read);
+	opencl_function_bind_buffer(sum, 3, result, opencl_buffer_access_write);
+	sum->set_dims(sum, 1, NULL, &global_size, &local_size);
+	
+	// accuracy: the storage rounding against the float input
+	int rc = mul->execute(mul, 0, NULL, NULL);
+	if(0 == rc) rc = sum->execute(sum, 0, NULL, NULL);
+	if(0 == rc) rc = bench_buffer_read(bench, Y, data, size);
+	if(0 == rc) rc = bench_buffer_read(bench, result, partials, num_groups * sizeof(float));
+	
+	double max_error = 0;
+	double total = 0;
+	if(0 == rc) {
+		opencl_storage_to_float(type, output, data, n);
+		for(size_t i = 0; i < n; ++i) {
+			double expected = (double)input[i] * a;
+			double error = fabs(output[i] - expected) / (fabs(expected) + 1e-30);
+			if(error > max_error) max_error = error;
+		}
+		for(size_t i = 0; i < num_groups; ++i) total += partials[i];
+	}
+	
+	if(0 == rc) {
+		bench_finish(bench);
+		double begin = get_time_ms();
+		for(int i = 0; i < bench->repeats && 0 == rc; ++i) rc = mul->execute(mul, 0, NULL, NULL);
+		bench_finish(bench);
+		double mul_ms = (get_time_ms() - begin) / bench->repeats;
+		
+		begin = get_time_ms();
+		for(int i = 0; i < bench->repeats && 0 == rc; ++i) rc = sum->execute(sum, 0, NULL, NULL);
+		bench_finish(bench);
+		double sum_ms = (get_time_ms() - begin) / bench->repeats;
+		
+		bench_report(mul_name, n, 2 * size, mul_ms);
+		printf("    %-6s max relative error = %.3e\n", type_name, max_error);
+		bench_report(sum_name, n, size, sum_ms);
+		printf("    %-6s relative error = %.3e\n", type_name, fabs(total - expected_sum) / fabs(expected_sum));
+	}
+	
+	opencl_function_cleanup(mul);
+	opencl_function_cleanup(sum);
+	opencl_buffer_cleanup(X);
+	opencl_buffer_cleanup(Y);
+	opencl_buffer_cleanup(result);
+	free(data);
+	free(output);
+	free(partials);
+	return rc;
+}
+
+static int bench_half(struct bench_context * bench)
+{
+	size_t n = bench->n;
+	float * input = malloc(n * sizeof(float));
+	assert(input);
+	
+	double expected_sum = 0;
+	for(size_t i = 0; i < n; ++i) {
+		input[i] = 1.0f + (float)rand() / (float)RAND_MAX;
+		expected_sum += input[i];
+	}
+	
+	// the host converts the 16-bit items in software, it's compute bound and doesn't gain from the halved bytes
+	if(bench->backend == opencl_backend_type_host) {
+		printf("half: host backend, the 16-bit throughput is not representative of a device\n");
+	}
+	
+	int rc = 0;
+	static const enum opencl_storage_type types[] = { opencl_storage_type_float, opencl_storage_type_half, opencl_storage_type_bf16 };
+	for(size_t i = 0; i < sizeof(types) / sizeof(types[0]) && 0 == rc; ++i) {
+		rc = bench_storage_type(bench, types[i], input, expected_sum);
+	}
+	free(input);
+	return rc;
+}
+
+/*********************************************
+ * sum: plain / compensated / double
+*********************************************/
+static int bench_sum(struct bench_context * bench)
+{
+	size_t n = bench->n;
+	size_t size = n * sizeof(float);
+	float * input = malloc(size);
+	assert(input);
+	
+	double expected = 0;
+	for(size_t i = 0; i < n; ++i) {
+		input[i] = (float)rand() / (float)RAND_MAX;
+		expected += input[i];
+	}
+	
+	struct opencl_buffer in[1];
+	bench_buffer_init(bench, in, size, input);
+	
+	int rc = 0;
+	for(int mode = opencl_sum_mode_plain; mode <= opencl_sum_mode_double && 0 == rc; ++mode) {
+		const char * mode_name = opencl_sum_mode_to_string(mode);
+		struct opencl_sum * sum = opencl_sum_init(NULL, bench->program, bench->queue, mode);
+		if(NULL == sum) {
+			printf("vec_sum (%s): not supported\n", mode_name);
+			continue;
+		}
+		
+		double result = 0;
+		rc = sum->execute(sum, in, n, &result);
+		if(0 == rc) {
+			double begin = get_time_ms();
+			for(int i = 0; i < bench->repeats && 0 == rc; ++i) rc = sum->execute(sum, in, n, &result);
+			double time_ms = (get_time_ms() - begin) / bench->repeats;
+			
+			char name[64] = "";
+			snprintf(name, sizeof(name), "vec_sum (%s)", mode_name);
+			bench_report(name, n, size, time_ms);
+			printf("    relative error = %.3e\n", fabs(result - expected) / fabs(expected));
+		}
+		opencl_sum_cleanup(sum);
+		free(sum);
+	}
+	
+	opencl_buffer_cleanup(in);
+	free(input);
+	return rc;
+}
+
+/*********************************************
+ * work queue: tiny jobs, one launch per job vs. the work queue
+*********************************************/
+#define BENCH_JOB_LENGTH (256)
+#define BENCH_MAX_JOBS (8192)
+
+static int bench_check_jobs(const char * name, const float * Y, const float * X, size_t num_items, float a)
+{
+	for(size_t i = 0; i < num_items; ++i) {
+		if(Y[i] != X[i] * a) {
+			fprintf(stderr, "[ERROR]: %s: Y[%lu] = %g, expected %g\n", name, (unsigned long)i, Y[i], X[i] * a);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int bench_work_queue_mode(struct bench_context * bench, enum opencl_work_queue_mode mode, 
+	struct opencl_buffer * Y, struct opencl_buffer * X, size_t num_jobs, float a, double * time_ms)
+{
+	// the persistent worker occupies its queue until stop()
+	cl_command_queue queue = NULL;
+	if(bench->ctx) {
+		cl_int ret = 0;
+		queue = bench_create_queue(bench, &ret);
+		if(ret != CL_SUCCESS) return -1;
+	}
+	
+	const char * mode_name = opencl_work_queue_mode_to_string(mode);
+	struct opencl_work_queue * wq = opencl_work_queue_init(NULL, bench->program, queue, 0, mode);
+	if(NULL == wq) {
+		if(queue) clReleaseCommandQueue(queue);
+		return -1;
+	}
+	if(wq->mode != mode) printf("work queue (%s): not supported, fallback to %s\n", mode_name, opencl_work_queue_mode_to_string(wq->mode));
+	
+	int rc = wq->start(wq, Y, X);
+	if(0 == rc) {
+		double begin = get_time_ms();
+		for(int r = 0; r < bench->repeats && 0 == rc; ++r) {
+			for(size_t i = 0; i < num_jobs && 0 == rc; ++i) {
+				struct opencl_work_desc desc = {
+					.op = opencl_work_op_mul_scalar,
+					.offset = (cl_int)(i * BENCH_JOB_LENGTH),
+					.length = BENCH_JOB_LENGTH,
+					.a = a,
+				};
+				rc = wq->push(wq, &desc);
+			}
+			if(0 == rc) rc = wq->wait(wq);
+		}
+		*time_ms = (get_time_ms() - begin) / bench->repeats;
+	}
+	if(wq->stop(wq)) rc = -1;
+	
+	opencl_work_queue_cleanup(wq);
+	free(wq);
+	if(queue) clReleaseCommandQueue(queue);
+	return rc;
+}
+
+static int bench_work_queue(struct bench_context * bench)
+{
+	size_t num_jobs = bench->n / BENCH_JOB_LENGTH;
+	if(num_jobs > BENCH_MAX_JOBS) num_jobs = BENCH_MAX_JOBS;
+	if(0 == num_jobs) num_jobs = 1;
+	size_t num_items = num_jobs * BENCH_JOB_LENGTH;
+	size_t size = num_items * sizeof(float);
+	float * input = malloc(size);
+	float * output = malloc(size);
+	assert(input && output);
+	for(size_t i = 0; i < num_items; ++i) input[i] = (float)rand() / (float)RAND_MAX;
+	
+	struct opencl_buffer X[1], Y[1];
+	bench_buffer_init(bench, X, size, input);
+	bench_buffer_init(bench, Y, size, NULL);
+	
+	// one launch per job: vec_mul_scalar over [offset, offset + length)
+	struct opencl_function mul[1];
+	if(NULL == bench_function_init(bench, mul, "vec_mul_scalar")) {
+		free(input);
+		free(output);
+		return -1;
+	}
+	float a = 3.0f;
+	cl_int end = 0;
+	opencl_function_set_args(mul, 4, sizeof(end), &end, sizeof(cl_mem), NULL, sizeof(cl_mem), NULL, sizeof(a), &a);
+	opencl_function_bind_buffer(mul, 1, Y, opencl_buffer_access_write);
+	opencl_function_bind_buffer(mul, 2, X, opencl_buffer_access_read);
+	
+	int rc = 0;
+	size_t local_size = 64;
+	size_t global_size = BENCH_JOB_LENGTH;
+	double begin = get_time_ms();
+	for(int r = 0; r < bench->repeats && 0 == rc; ++r) {
+		for(size_t i = 0; i < num_jobs && 0 == rc; ++i) {
+			size_t offset = i * BENCH_JOB_LENGTH;
+			end = (cl_int)(offset + BENCH_JOB_LENGTH);
+			mul->set_dims(mul, 1, &offset, &global_size, &local_size);
+			rc = mul->execute(mul, 0, NULL, NULL);
+		}
+		bench_finish(bench);
+	}
+	double launch_ms = (get_time_ms() - begin) / bench->repeats;
+	if(0 == rc) rc = bench_buffer_read(bench, Y, output, size);
+	if(0 == rc) rc = bench_check_jobs("vec_mul_scalar", output, input, num_items, a);
+	if(0 == rc) {
+		bench_report("vec_mul_scalar (launch per job)", num_items, 2 * size, launch_ms);
+		printf("    %lu jobs, %.3f us per job\n", (unsigned long)num_jobs, launch_ms * 1000.0 / num_jobs);
+	}
+	opencl_function_cleanup(mul);
+	
+	static const enum opencl_work_queue_mode modes[] = { opencl_work_queue_mode_batched, opencl_work_queue_mode_persistent };
+	for(size_t m = 0; m < sizeof(modes) / sizeof(modes[0]) && 0 == rc; ++m) {
+		if(bench->backend == opencl_backend_type_host && modes[m] == opencl_work_queue_mode_persistent) break;
+		
+		// the results of the previous run are cleared
+		if(bench->ctx) {
+			float zero = 0.0f;
+			cl_int ret = clEnqueueFillBuffer(bench->queue, Y->gpu_data, &zero, sizeof(zero), 0, size, 0, NULL, NULL);
+			if(ret != CL_SUCCESS) rc = -1;
+			bench_finish(bench);
+		}else {
+			memset(Y->cpu_data, 0, size);
+		}
+		
+		double time_ms = 0;
+		if(0 == rc) rc = bench_work_queue_mode(bench, modes[m], Y, X, num_jobs, a, &time_ms);
+		if(0 == rc) rc = bench_buffer_read(bench, Y, output, size);
+		
+		char name[64] = "";
+		snprintf(name, sizeof(name), "work queue (%s)", opencl_work_queue_mode_to_string(modes[m]));
+		if(0 == rc) rc = bench_check_jobs(name, output, input, num_items, a);
+		if(0 == rc) {
+			bench_report(name, num_items, 2 * size, time_ms);
+			printf("    %lu jobs, %.3f us per job\n", (unsigned long)num_jobs, time_ms * 1000.0 / num_jobs);
+		}
+	}
+	
+	opencl_buffer_cleanup(X);
+	opencl_buffer_cleanup(Y);
+	free(input);
+	free(output);
+	return rc;
+}
+
+/*********************************************
+ * svm: host writes the input, vec_mul_scalar, host reads the output
+ *   cl_mem (copy): enqueue_write / enqueue_read of host arrays
+ *   cl_mem, svm_coarse, svm_fine: in place through opencl_buffer_map()
+*********************************************/
+static int bench_svm_round_trip(struct bench_context * bench, enum opencl_buffer_type type, int use_copies, 
+	float * input, float * output, double * time_ms, enum opencl_buffer_type * created_type)
+{
+	size_t n = bench->n;
+	size_t size = n * sizeof(float);
+	size_t local_size = 256;
+	float a = 3.0f;
+	cl_int length = (cl_int)n;
+	
+	struct opencl_buffer X[1], Y[1];
+	opencl_buffer_init_svm(X, bench->ctx, bench->device, CL_MEM_READ_ONLY, size, NULL, type);
+	opencl_buffer_init_svm(Y, bench->ctx, bench->device, CL_MEM_WRITE_ONLY, size, NULL, type);
+	*created_type = X->type;
+	if(use_copies) {
+		X->cpu_data = input;
+		Y->cpu_data = output;
+	}
+	
+	struct opencl_function mul[1];
+	bench_function_init(bench, mul, "vec_mul_scalar");
+	opencl_function_set_args(mul, 4, sizeof(length), &length, sizeof(cl_mem), NULL, sizeof(cl_mem), NULL, sizeof(a), &a);
+	opencl_function_bind_buffer(mul, 1, Y, opencl_buffer_access_write);
+	opencl_function_bind_buffer(mul, 2, X, opencl_buffer_access_read);
+	size_t global_size = opencl_function_get_grid_size(mul, n, local_size);
+	mul->set_dims(mul, 1, NULL, &global_size, &local_size);
+	
+	int rc = 0;
+	double begin = get_time_ms();
+	for(int r = 0; r < bench->repeats && 0 == rc; ++r) {
+		float * x = use_copies?input:opencl_buffer_map(X, bench->queue, opencl_buffer_access_write);
+		if(NULL == x) {
+			rc = -1;
+			break;
+		}
+		for(size_t i = 0; i < n; ++i) x[i] = (float)(i & 1023) + r;
+		rc = use_copies?opencl_buffer_enqueue_write(X, bench->queue, CL_FALSE, 0, size):opencl_buffer_unmap(X, bench->queue);
+		
+		if(0 == rc) rc = mul->execute(mul, 0, NULL, NULL);
+		
+		const float * y = NULL;
+		if(0 == rc) y = use_copies?opencl_buffer_enqueue_read(Y, bench->queue, CL_TRUE, 0, size, output):opencl_buffer_map(Y, bench->queue, opencl_buffer_access_read);
+		if(NULL == y) {
+			rc = -1;
+			break;
+		}
+		for(size_t i = 0; i < n && 0 == rc; ++i) {
+			if(y[i] != ((float)(i & 1023) + r) * a) {
+				fprintf(stderr, "[ERROR]: %s: Y[%lu] = %g, expected %g\n", 
+					opencl_buffer_type_to_string(X->type), (unsigned long)i, y[i], ((float)(i & 1023) + r) * a);
+				rc = -1;
+			}
+		}
+		if(!use_copies && opencl_buffer_unmap(Y, bench->queue)) rc = -1;
+	}
+	bench_finish(bench);
+	*time_ms = (get_time_ms() - begin) / bench->repeats;
+	
+	if(use_copies) {
+		X->cpu_data = NULL;
+		Y->cpu_data = NULL;
+	}
+	opencl_function_cleanup(mul);
+	opencl_buffer_cleanup(X);
+	opencl_buffer_cleanup(Y);
+	return rc;
+}
+
+static int bench_svm(struct bench_context * bench)
+{
+	if(bench->backend == opencl_backend_type_host) {
+		printf("svm: the host backend's buffers are host memory\n");
+		return 0;
+	}
+	
+	size_t n = bench->n;
+	size_t size = n * sizeof(float);
+	float * input = malloc(size);
+	float * output = malloc(size);
+	assert(input && output);
+	
+	static const struct {
+		enum opencl_buffer_type type;
+		int use_copies;
+	}variants[] = {
+		{ opencl_buffer_type_mem, 1 },
+		{ opencl_buffer_type_mem, 0 },
+		{ opencl_buffer_type_svm_coarse, 0 },
+		{ opencl_buffer_type_svm_fine, 0 },
+	};
+	
+	int rc = 0;
+	for(size_t i = 0; i < sizeof(variants) / sizeof(variants[0]) && 0 == rc; ++i) {
+		double time_ms = 0;
+		enum opencl_buffer_type type = opencl_buffer_type_mem;
+		rc = bench_svm_round_trip(bench, variants[i].type, variants[i].use_copies, input, output, &time_ms, &type);
+		
+		char name[64] = "";
+		snprintf(name, sizeof(name), "round trip (%s, %s)", opencl_buffer_type_to_string(variants[i].type), variants[i].use_copies?"copy":"map");
+		if(type != variants[i].type) {
+			printf("%s: not supported\n", name);
+			continue;
+		}
+		if(0 == rc) bench_report(name, n, 2 * size, time_ms);
+	}
+	free(input);
+	free(output);
+	return rc;
+}
+
+/*********************************************
+ * main
+*********************************************/
+static const struct bench
+{
+	const char * name;
+	int (* run)(struct bench_context * bench);
+}s_benches[] = {
+	{ "scan", bench_scan },
+	{ "radix_sort", bench_radix_sort },
+	{ "compact", bench_compact },
+	{ "gemm", bench_gemm },
+	{ "histogram", bench_histogram },
+	{ "half", bench_half },
+	{ "sum", bench_sum },
+	{ "work_queue", bench_work_queue },
+	{ "svm", bench_svm },
+};
+#define NUM_BENCHES (sizeof(s_benches) / sizeof(s_benches[0]))
+
+static void show_usuages(const char * exe_name)
+{
+	fprintf(stderr, "Usuage: %s \\\n"
+		"--platform=<platform_name_prefix(default: the first one)> \\\n"
+		"--backend=<opencl|host(default: opencl, host if no platform was found)> \\\n"
+		"--kernels=<directory(default: kernels)> \\\n"
+		"--options=<build_options(e.g. \"-D SGEMM_TILE_SIZE=64 -D HISTOGRAM_NUM_BINS=64\", "
+			"OPENCL_TARGE_VERSION=200 builds add -cl-std=CL2.0 on OpenCL 2.x devices for the persistent work queue)> \\\n"
+		"--length=<items(default: %d)> \\\n"
+		"--repeats=<n(default: %d)> \\\n"
+		"[bench_name ...(default: all)]\n", exe_name, (1 << 24), 10);
+	fprintf(stderr, "benches:");
+	for(size_t i = 0; i < NUM_BENCHES; ++i) fprintf(stderr, " %s", s_benches[i].name);
+	fprintf(stderr, "\n");
+}
+
+static int init_opencl(struct bench_context * bench, const char * platform_name, const char * kernels_dir, const char * build_options)
+{
+	opencl_context_t * cl = bench->cl;
+	struct opencl_platform * platform = cl->get_platform_by_name_prefix(cl, platform_name);
+	if(NULL == platform) return -1;
+	
+	int rc = cl->load_devices(cl, 0, platform);
+	if(rc || cl->num_devices <= 0) return -1;
+	bench->device = cl->devices[0].id;
+	
+	cl_int ret = 0;
+	cl_context_properties propertities[] = {
+		CL_CONTEXT_PLATFORM,
+		(cl_context_properties)platform->id,
+		0,
+	};
+	bench->ctx = clCreateContext(propertities, 1, &bench->device, NULL, NULL, &ret);
+	if(ret != CL_SUCCESS) return -1;
+	bench->queue = bench_create_queue(bench, &ret);
+	if(ret != CL_SUCCESS) return -1;
+	
+	// persistent_worker() is only built by OpenCL C 2.0 (see opencl-work-queue.h)
+	char options[1024] = "";
+	snprintf(options, sizeof(options), "%s", build_options?build_options:"");
+#if defined(CL_TARGET_OPENCL_VERSION) && (CL_TARGET_OPENCL_VERSION >= 200)
+	char version[256] = "";
+	if(NULL == strstr(options, "-cl-std=")
+		&& CL_SUCCESS == clGetDeviceInfo(bench->device, CL_DEVICE_VERSION, sizeof(version), version, NULL)
+		&& 0 == strncmp(version, "OpenCL 2.", sizeof("OpenCL 2.") - 1)) 
+	{
+		size_t length = strlen(options);
+		snprintf(options + length, sizeof(options) - length, "%s-cl-std=CL2.0", length?" ":"");
+	}
+#endif
+	
+	struct opencl_library * library = opencl_library_init(NULL, bench->ctx, 1, &bench->device);
+	assert(library);
+	rc = opencl_library_add_path(library, kernels_dir);
+	if(0 == rc) rc = opencl_library_set_options(library, options);
+	if(0 == rc) rc = library->build_async(library, NULL, NULL);
+	
+	struct opencl_program * program = (0 == rc)?library->wait(library):NULL;
+	if(program && program->wait(program, -1) == CL_BUILD_SUCCESS) {
+		clRetainProgram(program->prog);
+		bench->program = program->prog;
+	}else {
+		fprintf(stderr, "[ERROR]: failed to build %s\n%s", kernels_dir, (program && program->build_log)?program->build_log:"");
+		rc = -1;
+	}
+	if(program) {
+		opencl_program_cleanup(program);
+		free(program);
+	}
+	opencl_library_cleanup(library);
+	free(library);
+	
+	bench->backend = opencl_backend_type_opencl;
+	printf("device: %s\n", platform->name);
+	return rc;
+}
+
+static void bench_context_cleanup(struct bench_context * bench)
+{
+	if(bench->program) clReleaseProgram(bench->program);
+	if(bench->queue) clReleaseCommandQueue(bench->queue);
+	if(bench->ctx) clReleaseContext(bench->ctx);
+	bench->program = NULL;
+	bench->queue = NULL;
+	bench->ctx = NULL;
+	
+	if(bench->cl) {
+		opencl_context_cleanup(bench->cl);
+		free(bench->cl);
+		bench->cl = NULL;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	static struct option options[] = {
+		{"platform", required_argument, 0, 'p'},
+		{"backend", required_argument, 0, 'b'},
+		{"kernels", required_argument, 0, 'k'},
+		{"options", required_argument, 0, 'o'},
+		{"length", required_argument, 0, 'n'},
+		{"repeats", required_argument, 0, 'r'},
+		{"help", no_argument, 0, 'h'},
+		{NULL, }
+	};
+	
+	const char * platform_name = NULL;
+	const char * backend_name = NULL;
+	const char * kernels_dir = "kernels";
+	const char * build_options = NULL;
+	struct bench_context bench[1] = {{
+		.backend = opencl_backend_type_host,
+		.n = (1 << 24),
+		.repeats = 10,
+	}};
+	while(1) {
+		int option_index = 0;
+		int c = getopt_long(argc, argv, "p:b:k:o:n:r:h", options, &option_index);
+		if(c == -1) break;
+		switch(c) {
+		case 'p': platform_name = optarg; break;
+		case 'b': backend_name = optarg; break;
+		case 'k': kernels_dir = optarg; break;
+		case 'o': build_options = optarg; break;
+		case 'n': bench->n = strtoul(optarg, NULL, 0); break;
+		case 'r': bench->repeats = atoi(optarg); break;
+		case 'h': 
+		default:
+			show_usuages(argv[0]); 
+			exit(c != 'h');
+		}
+	}
+	if(bench->n == 0 || bench->n > (1u << 30) || bench->repeats <= 0) {
+		show_usuages(argv[0]);
+		exit(1);
+	}
+	
+	// the host kernels are specialized by the same defines as the device kernels
+	opencl_host_set_build_options(build_options);
+	
+	int rc = 0;
+	int use_host = (backend_name && strcasecmp(backend_name, "host") == 0);
+	if(!use_host) {
+		bench->cl = opencl_context_init(NULL, bench);
+		assert(bench->cl);
+		if(bench->cl->num_platforms > 0) {
+			rc = init_opencl(bench, platform_name, kernels_dir, build_options);
+			if(rc) {
+				bench_context_cleanup(bench);
+				exit(1);
+			}
+		}
+	}
+	if(bench->backend == opencl_backend_type_host) {
+		printf("device: host (%d threads)\n", opencl_host_get_num_threads());
+	}
+	
+	srand(1);
+	int num_failed = 0;
+	for(size_t i = 0; i < NUM_BENCHES; ++i) {
+		const struct bench * b = &s_benches[i];
+		if(optind < argc) {
+			int selected = 0;
+			for(int k = optind; k < argc; ++k) if(strcmp(argv[k], b->name) == 0) selected = 1;
+			if(!selected) continue;
+		}
+		rc = b->run(bench);
+		printf("%s: %s\n", b->name, rc?"FAILED":"OK");
+		if(rc) ++num_failed;
+	}
+	
+	bench_context_cleanup(bench);
+	return num_failed?1:0;
+}
@@ -34,11 +34,23 @@
 #include <getopt.h>
 #include "opencl-context.h"
 #include "opencl-kernel.h"
+#include "opencl-library.h"
+#include "opencl-host.h"
+#include "opencl-notifier.h"
+#include "opencl-memory.h"
+#include "shm-region.h"
+#include "task-graph.h"
+#include "file-watcher.h"
+#include "numa-topology.h"
 #include "utils.h"
 
 #include <json-c/json.h>
 #include <pthread.h>
 #include <semaphore.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <sched.h>
 
 #ifndef FALSE
 #define FALSE 	(0)
@@ -55,6 +67,9 @@
 
 
 struct task_context;
+struct shared_states;
+struct hot_reload;
+struct buffer_view;
 typedef struct global_params
 {
 	void * user_data;
@@ -65,23 +80,55 @@ typedef struct global_params
 	char ** non_option_args;
 	
 	const char * conf_file;
-	json_object * jconfig;
+	struct task_graph graph[1];	// the compiled config
+	const char * kernel_file;	// a kernel module, or a directory of headers and modules (default: kernels)
+	const char * build_options;	// the compile options of the kernels (e.g. the tile sizes), NULL: none
 	
 	struct opencl_context * cl;
 	struct opencl_platform * platform;
 	const char * platform_name;
 	
+	enum opencl_backend_type backend;
+	const char * backend_name;	// "opencl" or "host", (default: auto)
+	
+	struct opencl_notifier * notifier;	// tasks' completions are dispatched from the main thread
+	
 	struct opencl_device * device;
 	cl_context ctx;
 	cl_program program;
+	struct opencl_library * library;	// the kernels, compiled per module and linked into program
+	cl_uint num_ctx_devices;	// the devices the program is built for
+	cl_device_id ctx_devices[TASK_GRAPH_MAX_TASKS];
+	
+	int watch;	// hot-reload the kernels and the config file
+	struct hot_reload * reload;	// the versions of (program, config) run by the tasks
+	
+	int pipeline_depth;	// max number of the DAG iterations in flight
+	int num_buffers;
+	struct opencl_buffer * buffers;	// shared by the tasks, the launches are ordered by the buffers' hazard tracking
+	struct opencl_memory_manager * memory;	// the buffers' device memory, the cold ones are evicted to host memory
+	cl_ulong memory_budget;		// bytes, (0: the device's global memory)
+	size_t buffer_alignment;	// bytes, the origin of the ranges bound as sub-buffer views
+	pthread_mutex_t views_mutex;
+	int num_views;
+	struct buffer_view ** views;	// the ranges of the buffers bound by the tasks' args
+	
+	struct numa_topology numa[1];
+	int use_numa;	// pin the tasks' threads to NUMA nodes, their host buffers are placed on the same nodes
+	int worker_numa_node;	// (multi-processes mode) the node of the worker's sub-device, (-1: unknown)
 	
 	int is_multi_processes;
+	int worker_index;	// multi-processes mode: the task run by this worker process, (-1: the coordinator)
+	struct opencl_device sub_device[1];	// multi-processes mode: the workers sharing a device run on its sub-devices
+	struct shm_region * shm;
+	struct shared_states * shared;	// semaphores and task states, in the shm_region in the multi-processes mode
+	struct task_edge * edges;	// (multi-processes mode) the data sent along the edges: [producer * num_tasks + consumer]
+	
 	int num_tasks;
 	struct task_context ** tasks;
-	sem_t * tasks_sems;
 	
-	pthread_rwlock_t rw_mutex;
-	int * tasks_status;
+	long shutdown_timeout_ms;	// deadline to drain the in-flight iterations on shutdown, (< 0: no limit)
+	double start_time;
 }global_params_t;
 
 global_params_t * global_params_init(global_params_t * params, int argc, char ** argv, void ** user_data);
@@ -89,26 +136,38 @@ void global_params_cleanup(global_params_t * params);
 
 static struct opencl_context g_cl_context[1];
 int run_tasks(global_params_t * params);
+static int run_process(global_params_t * params);
+static int run_multi_processes(global_params_t * params);
+static int drain_tasks(global_params_t * params);
+static int start_watching(global_params_t * params);
+static void dump_metrics(global_params_t * params, FILE * fp);
 
 #include <signal.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+static double get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+}
 
-volatile int g_quit;
+static struct opencl_notifier * volatile g_notifier;
+volatile sig_atomic_t g_quit;
 void on_signal(int sig)
 {
-	if(sig == SIGINT) {
-		g_quit = 1;
-		
-		abort();
-	}
+	if(g_quit) _exit(128 + sig);	// second signal: don't wait for the drain
+	
+	g_quit = 1;
+	if(g_notifier) g_notifier->stop(g_notifier);	// wake up the main loop
 	return;
 }
 
 int main(int argc, char **argv)
 {
 	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
 	// signal(SIGUSR1, on_signal);
 	
 	setvbuf(stdout, NULL, _IONBF, 0);
@@ -117,24 +176,66 @@ int main(int argc, char **argv)
 	global_params_t * params = global_params_init(NULL, argc, argv, NULL);
 	assert(params);
 	
+	if(params->is_multi_processes) return run_multi_processes(params);
+	return run_process(params);
+}
+
+/*
+ * the single-process mode, or a worker process of the multi-processes mode
+*/
+static int run_process(global_params_t * params)
+{
 	opencl_context_t * cl = opencl_context_init(g_cl_context, params);
 	assert(cl);
-	assert(cl->num_platforms > 0);
 	
-	struct opencl_platform * platform = &cl->platforms[0];
-	if(params->platform_name) platform = cl->get_platform_by_name_prefix(cl, params->platform_name);
+	struct opencl_platform * platform = NULL;
+	if(params->backend == opencl_backend_type_opencl) {
+		platform = cl->get_platform_by_name_prefix(cl, params->platform_name);
+		if(NULL == platform) {
+			if(params->backend_name) {
+				fprintf(stderr, "[ERROR]: platform '%s' not found\n", params->platform_name?params->platform_name:"(default)");
+				exit(1);
+			}
+			fprintf(stderr, "[WARNING]: no opencl platform, fall back to the host backend\n");
+			params->backend = opencl_backend_type_host;
+		}
+	}
 	
 	params->cl = cl;
 	params->platform = platform;
 	
+	struct opencl_notifier * notifier = opencl_notifier_init(NULL, params);
+	assert(notifier);
+	params->notifier = notifier;
+	g_notifier = notifier;
+	
+	params->start_time = get_time();
 	run_tasks(params);
+	if(params->watch && start_watching(params)) {
+		fprintf(stderr, "[WARNING]: can't watch the kernel file and the config file, hot reload disabled\n");
+	}
 	
 	while(!g_quit) {
-		sleep(1);
+		int rc = notifier->run_once(notifier, -1);	// returns on completions or signals
+		if(rc < 0) break;
 	}
-
-	opencl_context_cleanup(cl);
+	
+	// no more iterations will be admitted (see on_task_completed), wait for the in-flight ones
+	fprintf(stderr, "[LOG]: shutting down, draining in-flight tasks ...\n");
+	int rc = drain_tasks(params);
+	dump_metrics(params, stderr);
+	if(rc) {
+		// the runtime may still call back into the tasks, tearing them down is not safe
+		fprintf(stderr, "[WARNING]: shutdown deadline exceeded, tasks still in flight, skip cleanup\n");
+		_exit(1);
+	}
+	
+	g_notifier = NULL;
 	global_params_cleanup(params);
+	opencl_context_cleanup(cl);
+	opencl_notifier_cleanup(notifier);
+	free(notifier);
+	free(params);
 	return 0;
 }
 
@@ -142,12 +243,21 @@ int main(int argc, char **argv)
  * run tasks
 *********************************************/
 
-typedef struct dim_3d
+/*
+ * pipelined iterations: iteration N uses the buffer set (N % pipeline_depth),
+ * the roots start iteration N once the sinks have completed iteration (N - pipeline_depth).
+*/
+#define MAX_PIPELINE_DEPTH (4)
+
+/*
+ * the user_data of the completion notified for a slot: the iteration launched in it
+*/
+struct task_completion
 {
-	size_t x;
-	size_t y;
-	size_t z;
-}opencl_dim_3d;
+	struct task_context * task;
+	int slot;
+	long iteration;
+};
 
 
 struct task_context
@@ -157,7 +267,7 @@ struct task_context
 	int index;
 	
 	global_params_t * params;
-	json_object * jtask; // task config
+	const struct task_graph_task * config;
 	int quit;
 	struct {
 		pthread_mutex_t mutex;
@@ -167,22 +277,47 @@ struct task_context
 	cl_context ctx;
 	struct opencl_device * device;
 	struct opencl_function function[1];
+	int numa_node;	// index of params->numa->nodes, (-1: not pinned)
 	
 	
 	cl_command_queue queue;			// create a queue for the task to execute independent commands without requiring synchronization.
 	size_t num_waiting_events;
 	const cl_event * waiting_events;
-	cl_event event;
 	cl_int err_code;
 	
+	// the ranges of the outputs read back after each iteration
+	int num_readbacks;
+	struct task_graph_range * readbacks;
+	
+	// multi-processes mode: inputs popped from the producers' outboxes, outputs pushed to the consumers' ones
+	void * record;
+	size_t cb_record;
+	void * output_record;
+	size_t cb_output_record;
+	
 	struct dim_3d offsets;
 	struct dim_3d grid;		// global sizes
 	struct dim_3d block;	// local sizes
 	
+	// in-flight iterations
+	long num_launched;
+	struct {
+		double launch_time;
+		struct opencl_event_list events[1];	// the kernels' events, profiled on completion
+		struct task_completion completion[1];
+	}slots[MAX_PIPELINE_DEPTH];
+	unsigned int completed_ahead;	// bit i: iteration (num_iterations + i) has completed before the previous ones
+	
+	// metrics
+	long num_iterations;	// completed iterations (all the iterations before it)
+	double total_latency;	// launch to completion notified
+	double busy_time;		// kernels' execution time (profiling info, or measured by the host backend)
+	cl_ulong memory_footprint;	// the buffers used by an iteration
+	struct opencl_memory_stats memory[1];	// the evictions and restores caused by the task's launches
+	long num_local_iterations;	// launched from a cpu of numa_node
 	
 	// callbacks 
 	int (* on_init)(struct task_context * task, int task_index, void * user_data);
-	int (* on_read_data)(struct task_context * task, int function_index, const char * kernel_name, void * user_data);
 
 	// methods
 	int (* run)(struct task_context * task);
@@ -195,16 +330,23 @@ static int task_run(struct task_context * task)
 
 struct task_context * task_context_new(global_params_t * params, cl_context ctx, struct opencl_device * device)
 {
-	assert(params && ctx && device);
+	assert(params);
+	assert(params->backend == opencl_backend_type_host || (ctx && device));
 	
 	struct task_context * task = calloc(1, sizeof(*task));
 	assert(task);
 	task->params = params;
 	task->ctx = ctx;
 	task->device = device;
+	task->numa_node = -1;
 	
 	
 	task->run = task_run;
+	for(int i = 0; i < MAX_PIPELINE_DEPTH; ++i) {
+		opencl_event_list_init(task->slots[i].events, 0);
+		task->slots[i].completion->task = task;
+		task->slots[i].completion->slot = i;
+	}
 	
 	int rc = 0;
 	rc = pthread_cond_init(&task->mc.cond, NULL);
@@ -218,27 +360,13 @@ void task_context_free(struct task_context * task)
 {
 	if(NULL == task) return;
 	int rc = 0;
-	if(task->event) {
-		clSetUserEventStatus(task->event, CL_COMPLETE);
-	}
-	
 	rc = pthread_mutex_lock(&task->mc.mutex);
 	assert(0 == rc);
 	task->quit = 1;
 	pthread_cond_broadcast(&task->mc.cond);
 	pthread_mutex_unlock(&task->mc.mutex);
 	
-	
-	if(task->event) {
-		clReleaseEvent(task->event);
-		task->event = NULL;
-	}
-	
-	if(task->queue) {
-		clReleaseCommandQueue(task->queue);
-		task->queue = NULL;
-	}
-	
+	// the thread may still be using the queue and the events
 	if(task->thread_id) {
 		void * exit_code = NULL;
 		int rc = pthread_join(task->thread_id, &exit_code);
@@ -247,382 +375,1934 @@ void task_context_free(struct task_context * task)
 			(long)(intptr_t)exit_code, rc);
 		task->thread_id = (pthread_t)0;
 	}
+	
+	// kernel events, not user events: they have been drained (see drain_tasks()), only release them
+	for(int i = 0; i < MAX_PIPELINE_DEPTH; ++i) opencl_event_list_cleanup(task->slots[i].events);
+	free(task->readbacks);
+	free(task->record);
+	free(task->output_record);
+	
+	if(task->queue) {
+		clReleaseCommandQueue(task->queue);
+		task->queue = NULL;
+	}
 
 	pthread_cond_destroy(&task->mc.cond);
 	pthread_mutex_destroy(&task->mc.mutex);
 	free(task);
 }
 
-// test data
-#define NUM_TASKS (4)
-#define ARRAY_SIZE (1024)
-#define LOCAL_SIZE (256)
-static const size_t s_array_lengths[NUM_TASKS] = {
-	ARRAY_SIZE, 
-	ARRAY_SIZE,
-	ARRAY_SIZE * 2,
-	ARRAY_SIZE * 2
+/*
+ * the built-in config (no --conf):
+ *   task_0: vec_add_scalar(y[0, 1024), x0, 1.0)
+ *   task_1: vec_add_scalar(y[1024, 2048), x1, 2.0)
+ *   task_2: vec_mul_scalar(z, y, 3.0)
+ *   task_3: vec_sum(z) ==> partials
+*/
+#define LOCAL_SIZE (256)	// default work-group size
+static const char * s_default_config = 
+	"{ \"buffers\": ["
+	"    { \"name\": \"x0\", \"length\": 1024, \"access\": \"read_only\", \"init\": [1, 1] },"
+	"    { \"name\": \"x1\", \"length\": 1024, \"access\": \"read_only\", \"init\": [1023, -1] },"
+	"    { \"name\": \"y\", \"length\": 2048 },"
+	"    { \"name\": \"z\", \"length\": 2048 },"
+	"    { \"name\": \"partials\", \"length\": 8, \"access\": \"write_only\", \"residency\": \"host\" } ],"
+	"  \"tasks\": ["
+	"    { \"dims\": 3, \"n\": 1024, \"functions\": [ { \"kernel\": \"vec_add_scalar\", \"args\": ["
+	"        { \"int\": 1024 }, { \"buffer\": \"y\", \"access\": \"write\", \"offset\": 0, \"length\": 1024 }, { \"buffer\": \"x0\" },"
+	"        { \"float\": 1.0 } ] } ] },"
+	"    { \"dims\": 3, \"n\": 1024, \"functions\": [ { \"kernel\": \"vec_add_scalar\", \"args\": ["
+	"        { \"int\": 1024 }, { \"buffer\": \"y\", \"access\": \"write\", \"offset\": 1024, \"length\": 1024 }, { \"buffer\": \"x1\" },"
+	"        { \"float\": 2.0 } ] } ] },"
+	"    { \"dims\": 3, \"n\": 2048, \"dependencies\": [0, 1], \"functions\": [ { \"kernel\": \"vec_mul_scalar\", \"args\": ["
+	"        { \"int\": 2048 }, { \"buffer\": \"z\", \"access\": \"write\" }, { \"buffer\": \"y\", \"access\": \"read\" }, { \"float\": 3.0 } ] } ] },"
+	"    { \"dims\": 3, \"n\": 2048, \"dependencies\": [2], \"functions\": [ { \"kernel\": \"vec_sum\", \"args\": ["
+	"        { \"int\": 2048 }, { \"buffer\": \"z\", \"access\": \"read\" }, { \"local_per_item\": 4 },"
+	"        { \"buffer\": \"partials\", \"access\": \"write\" } ] } ] } ]"
+	"}";
+
+/*
+ * multi-processes mode: the workers don't share the buffers,
+ * the ranges written by a producer and read by a consumer are copied to the edge's outbox (a shm_ring)
+ * when the producer's iteration completes: one record per edge and iteration.
+ *   record: header | (range, data) * num_ranges
+*/
+#define MAX_EDGE_RANGES (8)
+struct task_edge
+{
+	int num_ranges;
+	size_t cb_record;
+	struct task_graph_range ranges[MAX_EDGE_RANGES];
+};
+struct task_record_header
+{
+	int producer;
+	int slot;
+	int num_ranges;
+};
+struct task_record_range
+{
+	int buffer_index;
+	size_t offset;	// (bytes)
+	size_t length;
 };
 
-static json_object * generate_dummy_config(void)
-{
-	/* 
-	 * {
-	 *   "tasks": [
-	 *     { "dims": 3,
-	 *       "offsets": [0, 0, 0],
-	 *       "n": <array_length>,
-	 *       "dependencies": [ tasks_index_list ],
-	 *       "functions": [
-	 *           "vec_add_scalar", // kernel_name_0
-	 *           // ...
-	 *           // kernel_name_n
-	 * 
-	 *       ]
-	 *     },
-	 *     { ... },
-	 *   ]
-	 * }
-	*/
-	json_object * jconfig = json_object_new_object();
-	json_object * jtasks = json_object_new_array();
-	json_object_object_add(jconfig, "tasks", jtasks);
-
-	for(int i = 0; i < NUM_TASKS; ++i) {
-		json_object * jtask = json_object_new_object();
-		json_object_object_add(jtask, "dims", json_object_new_int(3));	// always use dim_3d
-		json_object_object_add(jtask, "offsets", NULL);
-		
-		ssize_t array_length = s_array_lengths[i];
-		assert(array_length > 0);
-		json_object_object_add(jtask, "n", json_object_new_int64(array_length));
-		
-		json_object * jdependencies = json_object_new_array();
-		json_object * jfunctions = json_object_new_array();
-		
-		switch(i) {
-		case 0: case 1: 
-			// no dependencies
-			
-			// functions
-			json_object_array_add(jfunctions, json_object_new_string("vec_add_scalar"));
-			break; 
-		case 2: 
-			// dependencies
-			json_object_array_add(jdependencies, json_object_new_int(0));	// task 0
-			json_object_array_add(jdependencies, json_object_new_int(1));	// task 1
-			
-			// functions
-			json_object_array_add(jfunctions, json_object_new_string("vec_mul_scalar"));
-			break;
-		case 3:
-			// dependencies
-			json_object_array_add(jdependencies, json_object_new_int(2));	// task 2
-			
-			// functions
-			json_object_array_add(jfunctions, json_object_new_string("vec_sum"));
-			break;
-		}
-		json_object_object_add(jtask, "dependencies", jdependencies);
-		json_object_object_add(jtask, "functions", jfunctions);
-		json_object_array_add(jtasks, jtask);
-	}
-	return jconfig;
-}
+/*
+ * task states shared by the workers: threads, or processes (placed in a shm_region).
+ * the states updated on every iteration are atomics, each task on its own cache line.
+*/
+#define CACHE_LINE_SIZE (64)
+struct task_state
+{
+	sem_t sem;				// admits one iteration of the task
+	int num_dependencies;
+	int num_waiting[MAX_PIPELINE_DEPTH];	// per slot: dependencies not yet completed (atomic)
+	long num_iterations;
+	long num_admitted;		// admitted iterations (atomic)
+	pid_t pid;				// (multi-processes mode) the worker process
+}__attribute__((aligned(CACHE_LINE_SIZE)));
 
-static void * process(void * user_data) 
+struct shared_states
 {
-	int rc = 0;
-	cl_int ret = 0;
-	struct task_context * task = user_data;
-	assert(task && task->params);
-	
-	// run_task
-	//~ pthread_mutex_lock(&task->mc.mutex); // lock mutex before cond_wait
-	
-	global_params_t * params = task->params;
-	json_object * jtask = task->jtask;
-	assert(jtask);
+	struct {
+		int num_pending;	// admitted but not yet completed task iterations (atomic)
+		int quit;			// (multi-processes mode) set by the coordinator
+	}__attribute__((aligned(CACHE_LINE_SIZE)));
+	struct task_state states[TASK_GRAPH_MAX_TASKS];
 	
-	assert(task->index >= 0 && task->index < params->num_tasks);
-	sem_t * sems = params->tasks_sems;
-	int * tasks_status = params->tasks_status;
-	assert(sems && tasks_status);
+	// the task graph (read only): the roots depend on the sinks of the previous iteration
+	int num_tasks;
+	int num_consumers[TASK_GRAPH_MAX_TASKS];
+	int consumers[TASK_GRAPH_MAX_TASKS][TASK_GRAPH_MAX_TASKS];
+	int is_root[TASK_GRAPH_MAX_TASKS];
 	
-	cl_context ctx = task->ctx;
-	struct opencl_device * device = task->device;
-	cl_program program = params->program;
-	assert(ctx && device && program);
+	// (multi-processes mode) the edges' outboxes: (char *)shared + ring_offsets[producer][consumer], (0: no data)
+	size_t ring_offsets[TASK_GRAPH_MAX_TASKS][TASK_GRAPH_MAX_TASKS];
+};
+#define SHARED_STATES_SIZE ((sizeof(struct shared_states) + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1))
+
+// an outbox holds the records of all the in-flight iterations
+static size_t get_outbox_capacity(const struct task_edge * edge, int pipeline_depth)
+{
+	if(0 == edge->num_ranges) return 0;
+	return (sizeof(size_t) + edge->cb_record) * pipeline_depth;
+}
+
+static size_t shared_states_calc_size(const struct task_edge * edges, int num_tasks, int pipeline_depth)
+{
+	size_t size = SHARED_STATES_SIZE;
+	for(int i = 0; i < num_tasks * num_tasks; ++i) {
+		size_t capacity = get_outbox_capacity(&edges[i], pipeline_depth);
+		if(capacity) size += shm_ring_calc_size(capacity);
+	}
+	return size;
+}
+
+static void add_consumer(struct shared_states * shared, int producer, int consumer)
+{
+	for(int i = 0; i < shared->num_consumers[producer]; ++i) {
+		if(shared->consumers[producer][i] == consumer) return;
+	}
+	shared->consumers[producer][shared->num_consumers[producer]++] = consumer;
+	++shared->states[consumer].num_dependencies;
+}
+
+static struct shared_states * shared_states_init(struct shared_states * shared, const struct task_graph * graph, int pipeline_depth, int pshared, const struct task_edge * edges)
+{
+	int num_tasks = graph->num_tasks;
+	assert(shared && num_tasks > 0 && num_tasks <= TASK_GRAPH_MAX_TASKS);
+	memset(shared, 0, sizeof(*shared));
+	shared->num_tasks = num_tasks;
 	
-	json_object * jfunctions = NULL;
-	json_bool ok = FALSE;
-	ok = json_object_object_get_ex(jtask, "functions", &jfunctions);
-	assert(ok && jfunctions);
+	// the dependencies have been validated by the task_graph (in range, no duplicates, no cycles)
+	for(int i = 0; i < num_tasks; ++i) {
+		const struct task_graph_task * config = &graph->tasks[i];
+		for(int j = 0; j < config->num_dependencies; ++j) add_consumer(shared, config->dependencies[j], i);
+	}
 	
-#define MAX_FUNCTIONS (16)
-	int num_functions = json_object_array_length(jfunctions);
-	assert(num_functions > 0 && num_functions <= MAX_FUNCTIONS);
+	int num_roots = 0;
+	for(int i = 0; i < num_tasks; ++i) {
+		shared->is_root[i] = (0 == shared->states[i].num_dependencies);
+		num_roots += shared->is_root[i];
+	}
+	assert(num_roots > 0);
+	for(int i = 0; i < num_tasks; ++i) {
+		if(shared->num_consumers[i] > 0) continue;	// not a sink
+		for(int root = 0; root < num_tasks; ++root) {
+			if(shared->is_root[root]) add_consumer(shared, i, root);
+		}
+	}
 	
-	// load kernels
-	struct opencl_function *functions[MAX_FUNCTIONS];
-	memset(functions, 0, sizeof(*functions));
-	for(int i = 0; i < num_functions; ++i) {
-		json_object * jkernel = json_object_array_get_idx(jfunctions, i);
-		assert(jkernel);
-		const char * kernel_name = json_object_get_string(jkernel);
-		assert(kernel_name);
-		
-		functions[i] = opencl_function_init(NULL, program, kernel_name);
-		assert(functions[i]);
+	int rc = 0;
+	for(int i = 0; i < num_tasks; ++i) {
+		struct task_state * state = &shared->states[i];
+		for(int slot = 0; slot < MAX_PIPELINE_DEPTH; ++slot) state->num_waiting[slot] = state->num_dependencies;
 		
-		functions[i]->set_dims(functions[i], 3, (size_t *)&task->offsets, (size_t *)&task->grid, (size_t *)&task->block);
+		// admit the first (pipeline_depth) iterations of the roots
+		int value = shared->is_root[i]?pipeline_depth:0;
+		rc = sem_init(&state->sem, pshared, value);
+		if(rc) perror("sem_init");
+		assert(0 == rc);
+		state->num_admitted = value;
+		shared->num_pending += value;
 	}
 	
-	// init command queue
-	cl_command_queue queue = task->queue;
-	if(NULL == queue) {
-		
-		cl_command_queue_properties queue_props = CL_QUEUE_PROFILING_ENABLE 
-				| CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE	// kernels will be execute without order, use events to do sync
-				| 0;	
+	if(pshared && edges) {
+		size_t offset = SHARED_STATES_SIZE;
+		for(int producer = 0; producer < num_tasks; ++producer) {
+			for(int consumer = 0; consumer < num_tasks; ++consumer) {
+				size_t capacity = get_outbox_capacity(&edges[producer * num_tasks + consumer], pipeline_depth);
+				if(0 == capacity) continue;
 				
-		queue = clCreateCommandQueue(ctx, device->id, queue_props, &ret);
-		assert(queue);
-		task->queue = queue;
+				struct shm_ring * ring = shm_ring_init((char *)shared + offset, capacity);
+				assert(ring);
+				shared->ring_offsets[producer][consumer] = offset;
+				offset += shm_ring_calc_size(capacity);
+			}
+		}
 	}
+	return shared;
+}
+
+static void shared_states_cleanup(struct shared_states * shared)
+{
+	if(NULL == shared) return;
+	for(int i = 0; i < shared->num_tasks; ++i) {
+		sem_destroy(&shared->states[i].sem);
+		for(int j = 0; j < shared->num_tasks; ++j) {
+			if(shared->ring_offsets[i][j]) shm_ring_cleanup((struct shm_ring *)((char *)shared + shared->ring_offsets[i][j]));
+		}
+	}
+	shared->num_tasks = 0;
+}
+
+static struct shm_ring * get_edge_outbox(struct shared_states * shared, int producer, int consumer)
+{
+	assert(producer >= 0 && producer < shared->num_tasks && consumer >= 0 && consumer < shared->num_tasks);
+	assert(shared->ring_offsets[producer][consumer] > 0);
+	return (struct shm_ring *)((char *)shared + shared->ring_offsets[producer][consumer]);
+}
+
+static inline struct opencl_buffer * get_buffer(global_params_t * params, int slot, int buffer_index)
+{
+	assert(slot >= 0 && slot < params->pipeline_depth);
+	assert(buffer_index >= 0 && buffer_index < params->graph->num_buffers);
+	return &params->buffers[slot * params->graph->num_buffers + buffer_index];
+}
+
+/*
+ * a buffer arg: the whole buffer, or a sub-buffer view of the range (created once, shared by the tasks)
+*/
+struct buffer_view
+{
+	const struct opencl_buffer * parent;
+	uint64_t offset;	// items
+	uint64_t length;
+	struct opencl_buffer buf[1];
+};
+static struct opencl_buffer * get_arg_buffer(global_params_t * params, int slot, const struct task_graph_arg * arg)
+{
+	struct opencl_buffer * parent = get_buffer(params, slot, arg->buffer_index);
+	if(0 == arg->offset && arg->length * TASK_GRAPH_ITEM_SIZE == parent->size) return parent;
 	
-	// init task
-	if(task->on_init) task->on_init(task, task->index, task->user_data);
-	
-	sem_t * sem = &params->tasks_sems[task->index];
-	assert(sem);
-	while(!task->quit) {
-		//~ rc = pthread_cond_wait(&task->mc.cond, &task->mc.mutex);
-		//~ if(rc || task->quit) break;
-		int cur_value = 0;
-		rc = sem_getvalue(sem, &cur_value);
-		printf("sems[%d] status: value=%d\n", task->index, cur_value);
-		rc = sem_wait(sem);
-		assert(0 == rc);
-		if(task->quit) break;
-		
-		pthread_rwlock_wrlock(&params->rw_mutex);
-		tasks_status[task->index] = 0;	// reset status
-		pthread_rwlock_unlock(&params->rw_mutex);
-		
-		for(int i = 0; i < num_functions; ++i) {
-			struct opencl_function * function = functions[i];
-			assert(function);
-			
-			// load data
-			if(task->on_read_data) {
-				task->on_read_data(task, i, function->kernel->name, task->user_data);
-			}else {
-				// todo: load default data for testing
-				// opencl_function_set_args(function, num_args, size0, arg0, size1, arg1, ...);
-			}
-			// todo: execute
-			//~ rc = function->execute(function, task->num_waiting_events, task->waiting_events, &task->event);
-			//~ check_error(ret);
-		}
-		sleep(1);	// dummy process 
-		
-		// todo: add required synchronization for current task
-		// ...
-		pthread_rwlock_wrlock(&params->rw_mutex);
-		tasks_status[task->index] = 1;
-		pthread_rwlock_unlock(&params->rw_mutex);
-		
-		// tasks sync 
-		switch(task->index) {
-		case 0: case 1:
-			pthread_rwlock_wrlock(&params->rw_mutex);
-			if(tasks_status[0] > 0 && tasks_status[1] > 0) {
-				tasks_status[0] = -1;
-				tasks_status[1] = -1;
-				sem_post(&sems[2]);	// notify task2 to execute
-			}
-			pthread_rwlock_unlock(&params->rw_mutex);
-			break;
-		case 2:
-			pthread_rwlock_wrlock(&params->rw_mutex);
-			sem_post(&sems[3]);	// notify task2 to execute
-			pthread_rwlock_unlock(&params->rw_mutex);
-			break;
-		case 3:
-			pthread_rwlock_wrlock(&params->rw_mutex);
-			sem_post(&sems[0]);	// notify task0 to execute
-			sem_post(&sems[1]);	// notify task1 to execute
-			pthread_rwlock_unlock(&params->rw_mutex);
+	pthread_mutex_lock(&params->views_mutex);
+	struct buffer_view * view = NULL;
+	for(int i = 0; i < params->num_views; ++i) {
+		struct buffer_view * v = params->views[i];
+		if(v->parent == parent && v->offset == arg->offset && v->length == arg->length) {
+			view = v;
 			break;
-		
 		}
+	}
+	if(NULL == view) {
+		view = calloc(1, sizeof(*view));
+		assert(view);
+		view->parent = parent;
+		view->offset = arg->offset;
+		view->length = arg->length;
+		struct opencl_buffer * buf = opencl_buffer_init_view(view->buf, parent, 0, arg->offset * TASK_GRAPH_ITEM_SIZE, arg->length * TASK_GRAPH_ITEM_SIZE);
+		assert(buf);	// the origins have been checked by check_buffer_ranges()
 		
-		if(task->quit) break;	// if quit signal has been set while processing
+		struct buffer_view ** views = realloc(params->views, sizeof(*views) * (params->num_views + 1));
+		assert(views);
+		views[params->num_views++] = view;
+		params->views = views;
 	}
-	//~ pthread_mutex_unlock(&task->mc.mutex);
-	pthread_exit((void *)(intptr_t)rc);
-	
-#if defined(_WIN32) || defined(WIN32)
-	return (void *)(intptr_t)rc;
-#endif
+	pthread_mutex_unlock(&params->views_mutex);
+	return view->buf;
 }
 
-static int on_init_task(struct task_context * task, int task_index, void * user_data)
+static int is_edge_buffer(global_params_t * params, int buffer_index)
 {
-	fprintf(stderr, "[LOG]::%s(%p, %d, %p)\n", __FUNCTION__, task, task_index, user_data);
-	
+	if(NULL == params->edges) return 0;
+	int num_tasks = params->num_tasks;
+	for(int i = 0; i < num_tasks * num_tasks; ++i) {
+		const struct task_edge * edge = &params->edges[i];
+		for(int j = 0; j < edge->num_ranges; ++j) {
+			if(edge->ranges[j].buffer_index == buffer_index) return 1;
+		}
+	}
 	return 0;
 }
 
-static int on_load_task_data(struct task_context * task, int function_index, const char * kernel_name, void * user_data)
+static void * new_init_data(const struct task_graph_buffer * config)
 {
-	fprintf(stderr, "[LOG]::%s(%p, %d, %s, %p)\n", __FUNCTION__, task, function_index, kernel_name,  user_data);
-	
-	return 0;
+	void * data = malloc(config->length * TASK_GRAPH_ITEM_SIZE);
+	assert(data);
+	for(size_t i = 0; i < config->length; ++i) {
+		double value = config->init[0] + (double)i * config->init[1];
+		switch(config->type) {
+		case task_graph_data_type_float: ((cl_float *)data)[i] = (cl_float)value; break;
+		case task_graph_data_type_int: ((cl_int *)data)[i] = (cl_int)value; break;
+		case task_graph_data_type_uint: ((cl_uint *)data)[i] = (cl_uint)value; break;
+		default: assert(0);
+		}
+	}
+	return data;
 }
 
-int run_tasks(global_params_t * params)
+static int init_buffers(global_params_t * params)
 {
-	assert(params && params->cl && params->platform);
-	int rc = 0;
-	cl_int ret = 0;
-	
-	// todo: parse json config
-	int device_index = 0;
-	int device_type = CL_DEVICE_TYPE_GPU;
+	const struct task_graph * graph = params->graph;
+	int num_buffers = graph->num_buffers * params->pipeline_depth;	// a buffer set per pipeline slot
+	if(0 == num_buffers) return 0;
 	
-	opencl_context_t * cl = params->cl;
-	struct opencl_platform * platform = params->platform;
-	assert(cl && platform);
-
-	rc = cl->load_devices(cl, device_type, platform);
-	assert(0 == rc);
+	struct opencl_buffer * buffers = calloc(num_buffers, sizeof(*buffers));
+	assert(buffers);
+	params->num_buffers = num_buffers;
+	params->buffers = buffers;
 	
-	struct opencl_device * device = &cl->devices[device_index];
-	assert(device);
-	cl_context_properties propertities[] = {
-		CL_CONTEXT_PLATFORM,
-		(cl_context_properties)platform->id,
-		0,
+	static const cl_mem_flags access_flags[] = {
+		[task_graph_access_read] = CL_MEM_READ_ONLY,
+		[task_graph_access_write] = CL_MEM_WRITE_ONLY,
+		[task_graph_access_read_write] = CL_MEM_READ_WRITE,
 	};
-
-	cl_context ctx = clCreateContext(propertities, 1, &device->id, NULL, NULL, &ret);
-	check_error(ret);
-	params->ctx = ctx;
 	
-	char * source = NULL;
-	size_t cb_source = 0;
-	const char * kernel_file = "kernels/kernels.cl";
-	cb_source = load_file(kernel_file, &source);
-	assert(cb_source != -1 && cb_source > 0);
+	cl_context ctx = params->ctx; // NULL: host buffers
+	struct opencl_memory_manager * memory = opencl_memory_manager_init(NULL, ctx, params->num_ctx_devices, params->ctx_devices, params->memory_budget);
+	if(NULL == memory) return -1;
+	params->memory = memory;
+	params->buffer_alignment = opencl_buffer_get_alignment(ctx);
+	if(0 == params->buffer_alignment) return -1;
 	
-	// build kernels
-	cl_program program = clCreateProgramWithSource(ctx, 1, (const char **)&source, &cb_source, &ret);
-	assert(program);
-	free(source); source = NULL;
-	
-	ret = clBuildProgram(program, 1, &device->id, NULL, NULL, NULL);
-	check_error(ret);
-	params->program = program;
-
-	json_object * jconfig = params->jconfig;
-	if(NULL == jconfig) {
-		jconfig = generate_dummy_config();
-		assert(jconfig);
-		params->jconfig = jconfig;
+	for(int index = 0; index < graph->num_buffers; ++index) {
+		const struct task_graph_buffer * config = &graph->buffers[index];
+		void * init_data = config->has_init?new_init_data(config):NULL;
+		
+		cl_mem_flags flags = access_flags[config->access];
+		if(init_data) flags |= CL_MEM_COPY_HOST_PTR;
+		if(config->residency == task_graph_residency_host) flags |= CL_MEM_ALLOC_HOST_PTR;
+		
+		// the host copy: results read back, or (multi-processes mode) the data sent to the other worker processes
+		int has_cpu_data = (config->residency == task_graph_residency_host) || is_edge_buffer(params, index);
+		for(int slot = 0; slot < params->pipeline_depth; ++slot) {
+			struct opencl_buffer * buf = memory->alloc(memory, get_buffer(params, slot, index), flags, config->length * TASK_GRAPH_ITEM_SIZE, init_data);
+			if(NULL == buf) {
+				fprintf(stderr, "[ERROR]: buffers[%d] (%s): failed to allocate %lu bytes\n", 
+					index, config->name, (unsigned long)(config->length * TASK_GRAPH_ITEM_SIZE));
+				free(init_data);
+				return -1;
+			}
+			
+			if(!has_cpu_data || buf->cpu_data) continue;
+			buf->cpu_data = calloc(1, buf->size);
+			assert(buf->cpu_data);
+			buf->on_free_cpu_data = free;
+		}
+		free(init_data);
 	}
+	return 0;
+}
+
+/*
+ * bind the args declared in the config, the args are set once and reused by every iteration.
+ * scalars point to the values held by params->graph
+*/
+static int bind_args(struct task_context * task, struct opencl_function * function, const struct task_graph_function * config, int slot)
+{
+	global_params_t * params = task->params;
+	size_t group_size = task->block.x * task->block.y * task->block.z;
 	
-	// load task settings
-	json_object * jtasks = NULL;
-	json_bool ok = FALSE;
-	ok = json_object_object_get_ex(jconfig, "tasks", &jtasks);
-	assert(ok && jtasks);
-	
-	int num_tasks = json_object_array_length(jtasks);
-	assert(num_tasks > 0 && num_tasks <= NUM_TASKS);
-	
-	struct task_context ** tasks = calloc(num_tasks, sizeof(*tasks));
-	sem_t * sems = calloc(num_tasks, sizeof(*sems));
-	int * tasks_status = calloc(num_tasks, sizeof(*tasks_status));
-	assert(tasks && sems && tasks_status);
-	
-	params->num_tasks = num_tasks;
-	params->tasks = tasks;
-	params->tasks_sems = sems;
-	params->tasks_status = tasks_status;
-	
-	for(int i = 0; i < num_tasks; ++i) {
-		// init semaphores
-		switch(i) {
-		case 0: case 1:
-			rc = sem_init(&sems[i], 0, 1);
-			break;
-		case 2: case 3:
-			rc = sem_init(&sems[i], 0, 0);
+	for(int i = 0; i < config->num_args; ++i) {
+		const struct task_graph_arg * arg = &config->args[i];
+		switch(arg->type) {
+		case task_graph_arg_type_buffer: opencl_function_set_arg(function, i, sizeof(cl_mem), NULL); break;	// bound below
+		case task_graph_arg_type_float: opencl_function_set_arg(function, i, sizeof(cl_float), &arg->value.f32); break;
+		case task_graph_arg_type_int: opencl_function_set_arg(function, i, sizeof(cl_int), &arg->value.i32); break;
+		case task_graph_arg_type_uint: opencl_function_set_arg(function, i, sizeof(cl_uint), &arg->value.u32); break;
+		case task_graph_arg_type_local:
+			opencl_function_set_arg(function, i, arg->value.cb_local * (arg->local_per_item?group_size:1), NULL);
 			break;
 		default:
-			break;
+			return -1;
 		}
-		if(rc) perror("sem_init");
-		assert(0 == rc);
-		
-		json_object * jtask = json_object_array_get_idx(jtasks, i);
-		struct task_context * task = task_context_new(params, ctx, device);
-		assert(task);
-		tasks[i] = task;
-
-		task->index = i;
-		task->jtask = jtask;
-		task->jtask = jtask;
-		task->on_init = on_init_task;
-		task->on_read_data = on_load_task_data;
-		
-		rc = pthread_create(&tasks[i]->thread_id, NULL, process, tasks[i]);
-		assert(0 == rc);
 	}
-
+	
+	for(int i = 0; i < config->num_args; ++i) {
+		const struct task_graph_arg * arg = &config->args[i];
+		if(arg->type != task_graph_arg_type_buffer) continue;
+		int rc = opencl_function_bind_buffer(function, i, get_arg_buffer(params, slot, arg), (enum opencl_buffer_access)arg->access);
+		if(rc) return rc;
+	}
 	return 0;
 }
 
-/*********************************************
- * global_params
-*********************************************/
-static void show_usuages(const char * exe_name)
+/*
+ * the buffers bound by the functions of a task (each one once)
+*/
+static int get_task_buffers(global_params_t * params, const struct task_graph_task * config, int slot, struct opencl_buffer ** buffers)
 {
-	fprintf(stderr, "Usuage: %s \\\n"
-		"--conf=<conf_file(default: conf/config.json)> \\\n"
-		"--platform=<platform_name(default: nvidia)>\n", exe_name);
-		
-	return;
+	int num_buffers = 0;
+	for(int i = 0; i < config->num_functions; ++i) {
+		const struct task_graph_function * function = &config->functions[i];
+		for(int j = 0; j < function->num_args; ++j) {
+			const struct task_graph_arg * arg = &function->args[j];
+			if(arg->type != task_graph_arg_type_buffer) continue;
+			
+			struct opencl_buffer * buf = get_buffer(params, slot, arg->buffer_index);
+			int k = 0;
+			for(; k < num_buffers; ++k) if(buffers[k] == buf) break;
+			if(k == num_buffers) buffers[num_buffers++] = buf;
+		}
+	}
+	assert(num_buffers <= TASK_GRAPH_MAX_BUFFERS);
+	return num_buffers;
 }
-global_params_t * global_params_init(global_params_t * params, int argc, char ** argv, void ** user_data)
+
+static cl_ulong get_memory_footprint(global_params_t * params, const struct task_graph_task * config)
 {
-	if(NULL == params) params = calloc(1, sizeof(*params));
-	else memset(params, 0, sizeof(*params));
-	
-	static struct option options[] = {
-		{"conf", required_argument, 0, 'c'},
-		{"platform", required_argument, 0, 'p'},
-		{"verbose", no_argument, 0, 'v'},
+	struct opencl_buffer * buffers[TASK_GRAPH_MAX_BUFFERS];
+	int num_buffers = get_task_buffers(params, config, 0, buffers);
+	cl_ulong footprint = 0;
+	for(int i = 0; i < num_buffers; ++i) footprint += buffers[i]->size;
+	return footprint;
+}
+
+/*
+ * the node of a buffer's host copies: the node of the first task writing it, or reading it, (-1: none)
+*/
+static int get_buffer_numa_node(const struct task_graph * graph, int buffer_index, const int * task_nodes)
+{
+	int node = -1;
+	for(int i = 0; i < graph->num_tasks; ++i) {
+		if(task_nodes[i] < 0) continue;
+		const struct task_graph_task * config = &graph->tasks[i];
+		for(int j = 0; j < config->num_functions; ++j) {
+			const struct task_graph_function * function = &config->functions[j];
+			for(int k = 0; k < function->num_args; ++k) {
+				const struct task_graph_arg * arg = &function->args[k];
+				if(arg->type != task_graph_arg_type_buffer || arg->buffer_index != buffer_index) continue;
+				if(arg->access & task_graph_access_write) return task_nodes[i];
+				if(node < 0) node = task_nodes[i];
+			}
+		}
+	}
+	return node;
+}
+
+/*
+ * place the host copies of the buffers (the host backend's data, the results read back) next to their tasks,
+ * the pages already touched by the init data are migrated. the device memory is left to the runtime.
+*/
+static void place_buffers(global_params_t * params, const int * task_nodes)
+{
+	const struct task_graph * graph = params->graph;
+	for(int index = 0; index < graph->num_buffers; ++index) {
+		int node = get_buffer_numa_node(graph, index, task_nodes);
+		if(node < 0) continue;
+		for(int slot = 0; slot < params->pipeline_depth; ++slot) {
+			struct opencl_buffer * buf = get_buffer(params, slot, index);
+			if(NULL == buf->cpu_data) continue;
+			numa_topology_bind_memory(params->numa, buf->cpu_data, buf->size, node);
+		}
+	}
+}
+
+/*
+ * each iteration of a task keeps its buffers resident until it is launched
+*/
+static int check_memory_footprints(global_params_t * params, const struct task_graph * graph)
+{
+	struct opencl_memory_manager * memory = params->memory;
+	if(NULL == memory || 0 == memory->budget) return 0;
+	for(int i = 0; i < graph->num_tasks; ++i) {
+		cl_ulong footprint = get_memory_footprint(params, &graph->tasks[i]);
+		if(footprint > memory->budget) {
+			fprintf(stderr, "[ERROR]: tasks[%d]: the buffers (%lu bytes) exceed the memory budget (%lu bytes)\n", 
+				i, (unsigned long)footprint, (unsigned long)memory->budget);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * the ranges bound as sub-buffer views start at multiples of the devices' base address alignment
+*/
+static int check_buffer_ranges(global_params_t * params, const struct task_graph * graph)
+{
+	for(int i = 0; i < graph->num_tasks; ++i) {
+		const struct task_graph_task * config = &graph->tasks[i];
+		for(int j = 0; j < config->num_functions; ++j) {
+			const struct task_graph_function * function = &config->functions[j];
+			for(int k = 0; k < function->num_args; ++k) {
+				const struct task_graph_arg * arg = &function->args[k];
+				if(arg->type != task_graph_arg_type_buffer || 0 == (arg->offset * TASK_GRAPH_ITEM_SIZE) % params->buffer_alignment) continue;
+				fprintf(stderr, "[ERROR]: tasks[%d]: functions[%d]: args[%d]: offset %lu (%lu bytes) is not a multiple of the base address alignment (%lu bytes)\n", 
+					i, j, k, (unsigned long)arg->offset, (unsigned long)(arg->offset * TASK_GRAPH_ITEM_SIZE), (unsigned long)params->buffer_alignment);
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+static void add_readback(struct task_context * task, const struct task_graph_range * range)
+{
+	for(int i = 0; i < task->num_readbacks; ++i) {
+		const struct task_graph_range * readback = &task->readbacks[i];
+		if(readback->buffer_index == range->buffer_index 
+			&& readback->offset == range->offset 
+			&& readback->length == range->length) return;
+	}
+	task->readbacks = realloc(task->readbacks, sizeof(*task->readbacks) * (task->num_readbacks + 1));
+	assert(task->readbacks);
+	task->readbacks[task->num_readbacks++] = *range;
+}
+
+/*
+ * the ranges written by the task to the host-resident buffers (duplicates removed),
+ * return the number of ranges, only the first max_ranges ones are filled.
+*/
+#define MAX_HOST_OUTPUTS (TASK_GRAPH_MAX_FUNCTIONS * TASK_GRAPH_MAX_ARGS)
+static int get_host_outputs(const struct task_graph * graph, const struct task_graph_task * config, struct task_graph_range * ranges, int max_ranges)
+{
+	int num_ranges = 0;
+	for(int i = 0; i < config->num_functions; ++i) {
+		const struct task_graph_function * function = &config->functions[i];
+		for(int j = 0; j < function->num_args; ++j) {
+			const struct task_graph_arg * arg = &function->args[j];
+			if(arg->type != task_graph_arg_type_buffer || !(arg->access & task_graph_access_write)) continue;
+			if(graph->buffers[arg->buffer_index].residency != task_graph_residency_host) continue;
+			
+			int k = 0;
+			for(; k < num_ranges && k < max_ranges; ++k) {
+				if(ranges[k].buffer_index == arg->buffer_index && ranges[k].offset == arg->offset && ranges[k].length == arg->length) break;
+			}
+			if(k < num_ranges) continue;
+			if(num_ranges < max_ranges) ranges[num_ranges] = (struct task_graph_range){ arg->buffer_index, arg->offset, arg->length };
+			++num_ranges;
+		}
+	}
+	return num_ranges;
+}
+
+/*
+ * the ranges read back after each iteration: 
+ * the outputs written to host-resident buffers, and (multi-processes mode) the data sent to the consumers
+*/
+static void init_readbacks(struct task_context * task)
+{
+	global_params_t * params = task->params;
+	
+	struct task_graph_range outputs[MAX_HOST_OUTPUTS];
+	int num_outputs = get_host_outputs(params->graph, task->config, outputs, MAX_HOST_OUTPUTS);
+	assert(num_outputs <= MAX_HOST_OUTPUTS);
+	for(int i = 0; i < num_outputs; ++i) add_readback(task, &outputs[i]);
+	
+	if(NULL == params->edges) return;
+	for(int consumer = 0; consumer < params->num_tasks; ++consumer) {
+		const struct task_edge * edge = &params->edges[task->index * params->num_tasks + consumer];
+		for(int i = 0; i < edge->num_ranges; ++i) add_readback(task, &edge->ranges[i]);
+	}
+}
+
+static void enqueue_read_outputs(struct task_context * task, int slot)
+{
+	for(int i = 0; i < task->num_readbacks; ++i) {
+		const struct task_graph_range * range = &task->readbacks[i];
+		struct opencl_buffer * buf = get_buffer(task->params, slot, range->buffer_index);
+		void * data = opencl_buffer_enqueue_read(buf, task->queue, CL_FALSE, 
+			range->offset * TASK_GRAPH_ITEM_SIZE, range->length * TASK_GRAPH_ITEM_SIZE, NULL);
+		assert(data);
+	}
+}
+
+/*
+ * (multi-processes mode) called from the main thread before the consumers are admitted
+*/
+static void publish_outputs(struct task_context * task, int slot)
+{
+	global_params_t * params = task->params;
+	if(!params->is_multi_processes) return;
+	
+	for(int consumer = 0; consumer < params->num_tasks; ++consumer) {
+		const struct task_edge * edge = &params->edges[task->index * params->num_tasks + consumer];
+		if(0 == edge->num_ranges) continue;
+		
+		if(NULL == task->output_record) {
+			task->output_record = malloc(edge->cb_record);
+			task->cb_output_record = edge->cb_record;
+		}else if(task->cb_output_record < edge->cb_record) {
+			task->output_record = realloc(task->output_record, edge->cb_record);
+			task->cb_output_record = edge->cb_record;
+		}
+		assert(task->output_record);
+		
+		struct task_record_header * header = task->output_record;
+		*header = (struct task_record_header){ .producer = task->index, .slot = slot, .num_ranges = edge->num_ranges };
+		unsigned char * p = (unsigned char *)(header + 1);
+		for(int i = 0; i < edge->num_ranges; ++i) {
+			struct opencl_buffer * buf = get_buffer(params, slot, edge->ranges[i].buffer_index);
+			struct task_record_range range = {
+				.buffer_index = edge->ranges[i].buffer_index,
+				.offset = edge->ranges[i].offset * TASK_GRAPH_ITEM_SIZE,
+				.length = edge->ranges[i].length * TASK_GRAPH_ITEM_SIZE,
+			};
+			memcpy(p, &range, sizeof(range));
+			p += sizeof(range);
+			memcpy(p, (char *)buf->cpu_data + range.offset, range.length);
+			p += range.length;
+		}
+		assert((size_t)(p - (unsigned char *)header) == edge->cb_record);
+		
+		// one outbox per edge: the consumer pops the producer's outputs in the iterations' order
+		struct shm_ring * outbox = get_edge_outbox(params->shared, task->index, consumer);
+		int rc = shm_ring_push(outbox, header, edge->cb_record, NULL, 0, -1);
+		assert(0 == rc);
+	}
+}
+
+/*
+ * (multi-processes mode) called from the task's thread once admitted, the producers have already published their outputs
+*/
+static void load_inputs(struct task_context * task, int slot)
+{
+	global_params_t * params = task->params;
+	if(!params->is_multi_processes) return;
+	
+	for(int producer = 0; producer < params->num_tasks; ++producer) {
+		const struct task_edge * edge = &params->edges[producer * params->num_tasks + task->index];
+		if(0 == edge->num_ranges) continue;
+		
+		if(NULL == task->record) {
+			task->record = malloc(edge->cb_record);
+			task->cb_record = edge->cb_record;
+		}else if(task->cb_record < edge->cb_record) {
+			task->record = realloc(task->record, edge->cb_record);
+			task->cb_record = edge->cb_record;
+		}
+		assert(task->record);
+		
+		struct shm_ring * outbox = get_edge_outbox(params->shared, producer, task->index);
+		ssize_t cb = shm_ring_pop(outbox, task->record, task->cb_record, -1);
+		assert(cb == (ssize_t)edge->cb_record);
+		
+		const struct task_record_header * header = task->record;
+		assert(header->producer == producer && header->slot == slot && header->num_ranges == edge->num_ranges);
+		const unsigned char * p = (const unsigned char *)(header + 1);
+		for(int i = 0; i < header->num_ranges; ++i) {
+			struct task_record_range range;
+			memcpy(&range, p, sizeof(range));
+			p += sizeof(range);
+			
+			struct opencl_buffer * buf = get_buffer(params, slot, range.buffer_index);
+			assert(buf->cpu_data && (range.offset + range.length) <= buf->size);
+			memcpy((char *)buf->cpu_data + range.offset, p, range.length);
+			p += range.length;
+			
+			int rc = opencl_buffer_enqueue_write(buf, task->queue, CL_FALSE, range.offset, range.length);
+			assert(0 == rc);
+		}
+	}
+}
+
+/*
+ * print the sums of the host-resident outputs
+*/
+static void print_results(struct task_context * task, int slot)
+{
+	global_params_t * params = task->params;
+	const struct task_graph * graph = params->graph;
+	if(!params->verbose && (task->num_iterations % 1000) != 1) return;
+	
+	for(int i = 0; i < task->num_readbacks; ++i) {
+		const struct task_graph_range * range = &task->readbacks[i];
+		const struct task_graph_buffer * config = &graph->buffers[range->buffer_index];
+		if(config->residency != task_graph_residency_host) continue;
+		
+		const void * data = get_buffer(params, slot, range->buffer_index)->cpu_data;
+		double sum = 0;
+		for(size_t j = range->offset; j < (range->offset + range->length); ++j) {
+			switch(config->type) {
+			case task_graph_data_type_float: sum += ((const cl_float *)data)[j]; break;
+			case task_graph_data_type_int: sum += ((const cl_int *)data)[j]; break;
+			case task_graph_data_type_uint: sum += ((const cl_uint *)data)[j]; break;
+			}
+		}
+		printf("task[%d]: iterations=%ld, %s: sum() = %.1f\n", task->index, task->num_iterations, config->name, sum);
+	}
+}
+
+static double get_profiling_time(const struct opencl_event_list * events)
+{
+	double elapsed = 0;
+	for(size_t i = 0; i < events->length; ++i) {
+		cl_ulong start = 0, end = 0;
+		cl_int ret = clGetEventProfilingInfo(events->events[i], CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
+		if(CL_SUCCESS == ret) ret = clGetEventProfilingInfo(events->events[i], CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
+		if(CL_SUCCESS == ret && end > start) elapsed += (double)(end - start) / 1000000000.0;
+	}
+	return elapsed;
+}
+
+/*
+ * the last completed dependency admits the task's iteration using the slot.
+ * the tasks complete their iterations in order, the slots are admitted in order too.
+*/
+static void complete_dependency(struct shared_states * shared, int index, int slot)
+{
+	struct task_state * state = &shared->states[index];
+	if(__atomic_sub_fetch(&state->num_waiting[slot], 1, __ATOMIC_ACQ_REL) > 0) return;
+	
+	// the slot can't be completed again before this iteration has been admitted, reset the counter first
+	__atomic_store_n(&state->num_waiting[slot], state->num_dependencies, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&shared->num_pending, 1, __ATOMIC_ACQ_REL);
+	__atomic_add_fetch(&state->num_admitted, 1, __ATOMIC_ACQ_REL);
+	sem_post(&state->sem);
+}
+
+/*********************************************
+ * hot reload: versions of (program, config)
+ * 
+ * a new version is installed from the main thread, starting at the first DAG iteration
+ * not yet admitted by any task: all the tasks of an iteration run the same version.
+ * each task thread switches the functions of a slot when it launches an iteration of a newer version,
+ * the older versions are released once their last iteration has completed.
+*********************************************/
+#define MAX_VERSIONS (4)
+struct task_version
+{
+	long id;
+	long first_iteration;	// the first DAG iteration run by this version
+	cl_program program;		// retained, (NULL: host backend)
+	struct task_graph * graph;	// params->graph, or a reloaded config (shared by the following versions of the program)
+};
+
+struct hot_reload
+{
+	pthread_mutex_t mutex;	// guards the versions, read by the task threads on each launch
+	long next_id;
+	int num_versions;
+	struct task_version versions[MAX_VERSIONS];	// the oldest one still in use first
+	
+	struct file_watcher * watcher;
+	int is_building;				// the kernels are being rebuilt
+	struct opencl_program * built;	// the result of the build
+	int rebuild_pending;			// the kernel file has changed during the build
+};
+
+static struct hot_reload * hot_reload_init(global_params_t * params)
+{
+	struct hot_reload * reload = calloc(1, sizeof(*reload));
+	assert(reload);
+	int rc = pthread_mutex_init(&reload->mutex, NULL);
+	assert(0 == rc);
+	
+	if(params->program) clRetainProgram(params->program);
+	reload->versions[0] = (struct task_version){ reload->next_id++, 0, params->program, params->graph };
+	reload->num_versions = 1;
+	return reload;
+}
+
+static void release_version(global_params_t * params, struct hot_reload * reload, int index)
+{
+	struct task_version * version = &reload->versions[index];
+	if(version->program) clReleaseProgram(version->program);
+	
+	int is_shared = (version->graph == params->graph);
+	for(int i = 0; i < reload->num_versions && !is_shared; ++i) {
+		if(i != index && reload->versions[i].graph == version->graph) is_shared = 1;
+	}
+	if(!is_shared) {
+		task_graph_cleanup(version->graph);
+		free(version->graph);
+	}
+	memset(version, 0, sizeof(*version));
+}
+
+/*
+ * the version run by the task's iteration: the latest one started at or before it
+*/
+static struct task_version get_task_version(global_params_t * params, long iteration)
+{
+	struct hot_reload * reload = params->reload;
+	pthread_mutex_lock(&reload->mutex);
+	int i = reload->num_versions - 1;
+	while(i > 0 && reload->versions[i].first_iteration > iteration) --i;
+	struct task_version version = reload->versions[i];
+	pthread_mutex_unlock(&reload->mutex);
+	return version;
+}
+
+/*
+ * (main thread) release the versions whose iterations have all completed
+*/
+static void release_versions(global_params_t * params)
+{
+	struct hot_reload * reload = params->reload;
+	if(NULL == reload || reload->num_versions < 2) return;
+	
+	pthread_mutex_lock(&reload->mutex);
+	while(reload->num_versions > 1) {
+		long first_iteration = reload->versions[1].first_iteration;
+		int i = 0;
+		for(; i < params->num_tasks; ++i) {
+			struct task_context * task = params->tasks[i];
+			if(task && task->num_iterations < first_iteration) break;
+		}
+		if(i < params->num_tasks) break;
+		
+		if(params->verbose) fprintf(stderr, "[LOG]: reload: version %ld released\n", reload->versions[0].id);
+		release_version(params, reload, 0);
+		--reload->num_versions;
+		memmove(&reload->versions[0], &reload->versions[1], sizeof(reload->versions[0]) * reload->num_versions);
+	}
+	pthread_mutex_unlock(&reload->mutex);
+}
+
+/*
+ * (main thread) takes the ownership of program and graph on success
+*/
+static int install_version(global_params_t * params, cl_program program, struct task_graph * graph)
+{
+	struct hot_reload * reload = params->reload;
+	struct shared_states * shared = params->shared;
+	release_versions(params);
+	
+	pthread_mutex_lock(&reload->mutex);
+	if(reload->num_versions == MAX_VERSIONS) {
+		pthread_mutex_unlock(&reload->mutex);
+		fprintf(stderr, "[WARNING]: reload: too many versions still in use, skipped\n");
+		return -1;
+	}
+	
+	// the iterations are only admitted from this thread, none of the tasks has admitted first_iteration yet
+	long first_iteration = 0;
+	for(int i = 0; i < params->num_tasks; ++i) {
+		long num_admitted = __atomic_load_n(&shared->states[i].num_admitted, __ATOMIC_ACQUIRE);
+		if(num_admitted > first_iteration) first_iteration = num_admitted;
+	}
+	struct task_version * version = &reload->versions[reload->num_versions++];
+	*version = (struct task_version){ reload->next_id++, first_iteration, program, graph };
+	pthread_mutex_unlock(&reload->mutex);
+	
+	fprintf(stderr, "[LOG]: reload: version %ld runs from iteration %ld\n", version->id, first_iteration);
+	return 0;
+}
+
+/*
+ * called from the main thread (notifier) when all commands of the task's iteration have completed.
+ * the event callbacks may run in any order, the slot is carried by the completion (user_data).
+*/
+static void on_task_completed(void * user_data, cl_event event, cl_int status)
+{
+	struct task_completion * completion = user_data;
+	assert(completion && completion->task);
+	struct task_context * task = completion->task;
+	int slot = completion->slot;
+	global_params_t * params = task->params;
+	struct shared_states * shared = params->shared;
+	
+	if(status < 0) {
+		fprintf(stderr, "[ERROR]: task[%d] failed: %s\n", task->index, opencl_error_to_string(status));
+	}
+	long ahead = completion->iteration - task->num_iterations;
+	assert(ahead >= 0 && ahead < params->pipeline_depth && (completion->iteration % params->pipeline_depth) == slot);
+	if(ahead && params->verbose) {
+		fprintf(stderr, "[LOG]: task[%d]: iteration %ld completed before iteration %ld\n", 
+			task->index, completion->iteration, task->num_iterations);
+	}
+	task->completed_ahead |= 1u << ahead;
+	while(task->completed_ahead & 1) {
+		++task->num_iterations;
+		task->completed_ahead >>= 1;
+	}
+	
+	struct opencl_event_list * events = task->slots[slot].events;
+	task->total_latency += get_time() - task->slots[slot].launch_time;
+	if(params->backend == opencl_backend_type_opencl) task->busy_time += get_profiling_time(events);
+	opencl_event_list_clear(events);
+	print_results(task, slot);
+	__atomic_store_n(&shared->states[task->index].num_iterations, task->num_iterations, __ATOMIC_RELAXED);
+	publish_outputs(task, slot);
+	release_versions(params);
+	
+	// tasks sync
+	int quit = g_quit || __atomic_load_n(&shared->quit, __ATOMIC_ACQUIRE);
+	for(int i = 0; i < shared->num_consumers[task->index]; ++i) {
+		int consumer = shared->consumers[task->index][i];
+		
+		// shutting down: the DAG iteration is complete, don't start a new one
+		if(quit && shared->is_root[consumer]) continue;
+		complete_dependency(shared, consumer, slot);	// the roots: iteration (N + pipeline_depth) reuses the slot
+	}
+	__atomic_sub_fetch(&shared->num_pending, 1, __ATOMIC_ACQ_REL);
+}
+
+#define MAX_FUNCTIONS (TASK_GRAPH_MAX_FUNCTIONS)
+
+/*
+ * create the functions of a slot from a version of the program and the config
+ * return the number of functions
+*/
+static int load_functions(struct task_context * task, const struct task_version * version, int slot, struct opencl_function ** functions)
+{
+	global_params_t * params = task->params;
+	const struct task_graph_task * config = &version->graph->tasks[task->index];
+	int is_host = (params->backend == opencl_backend_type_host);
+	int num_functions = config->num_functions;
+	assert(num_functions > 0 && num_functions <= MAX_FUNCTIONS);
+	
+	task->offsets = (struct dim_3d){ config->offsets[0], config->offsets[1], config->offsets[2] };
+	task->grid = (struct dim_3d){ config->global_sizes[0], config->global_sizes[1], config->global_sizes[2] };
+	task->block = (struct dim_3d){ 
+		config->local_sizes[0]?config->local_sizes[0]:LOCAL_SIZE, 
+		config->local_sizes[1]?config->local_sizes[1]:1, 
+		config->local_sizes[2]?config->local_sizes[2]:1 };
+	for(int i = 0; i < num_functions; ++i) {
+		const char * kernel_name = config->functions[i].kernel_name;
+		
+		struct opencl_function * function = NULL;
+		if(is_host) function = opencl_host_function_init(NULL, kernel_name);
+		else function = opencl_function_init(NULL, version->program, kernel_name);
+		assert(function);
+		
+		function->queue = task->queue;
+		int rc = bind_args(task, function, &config->functions[i], slot);
+		assert(0 == rc);
+		functions[i] = function;
+	}
+	
+	// "n": the grid-stride kernels share a grid bounded by the occupancy of the least occupied one
+	if(config->grid_stride) {
+		size_t grid_size = 0;
+		for(int i = 0; i < num_functions; ++i) {
+			size_t size = opencl_function_get_grid_size(functions[i], config->global_sizes[0], task->block.x);
+			if(0 == grid_size || size < grid_size) grid_size = size;
+		}
+		task->grid.x = grid_size;
+	}
+	for(int i = 0; i < num_functions; ++i) {
+		functions[i]->set_dims(functions[i], 3, (size_t *)&task->offsets, (size_t *)&task->grid, (size_t *)&task->block);
+	}
+	return num_functions;
+}
+
+static void unload_functions(struct opencl_function ** functions, int num_functions)
+{
+	for(int i = 0; i < num_functions; ++i) {
+		opencl_function_cleanup(functions[i]);
+		free(functions[i]);
+		functions[i] = NULL;
+	}
+}
+
+static void * process(void * user_data) 
+{
+	int rc = 0;
+	cl_int ret = 0;
+	struct task_context * task = user_data;
+	assert(task && task->params);
+	
+	// run_task
+	//~ pthread_mutex_lock(&task->mc.mutex); // lock mutex before cond_wait
+	
+	global_params_t * params = task->params;
+	assert(task->config);
+	
+	assert(task->index >= 0 && task->index < params->num_tasks);
+	assert(params->shared && params->reload);
+	
+	cl_context ctx = task->ctx;
+	struct opencl_device * device = task->device;
+	int is_host = (params->backend == opencl_backend_type_host);
+	assert(is_host || (ctx && device && params->program));
+	
+	if(task->numa_node >= 0 && numa_topology_bind_thread(params->numa, task->numa_node)) {
+		fprintf(stderr, "[WARNING]: tasks[%d]: can't pin the thread to NUMA node %d\n", 
+			task->index, params->numa->nodes[task->numa_node].id);
+		task->numa_node = -1;
+	}
+	
+	// init command queue
+	cl_command_queue queue = task->queue;
+	if(!is_host && NULL == queue) {
+		
+		cl_command_queue_properties queue_props = CL_QUEUE_PROFILING_ENABLE 
+				| CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE	// kernels will be execute without order, use events to do sync
+				| 0;	
+				
+		queue = clCreateCommandQueue(ctx, device->id, queue_props, &ret);
+		assert(queue);
+		task->queue = queue;
+	}
+	
+	// load kernels, a set of functions per pipeline slot
+	int pipeline_depth = params->pipeline_depth;
+	struct opencl_function *functions[MAX_PIPELINE_DEPTH][MAX_FUNCTIONS];
+	int num_functions[MAX_PIPELINE_DEPTH] = { 0 };
+	long versions[MAX_PIPELINE_DEPTH] = { 0 };	// the version loaded in each slot
+	memset(functions, 0, sizeof(functions));
+	for(int slot = 0; slot < pipeline_depth; ++slot) {
+		struct task_version version = get_task_version(params, slot);
+		num_functions[slot] = load_functions(task, &version, slot, functions[slot]);
+		versions[slot] = version.id;
+	}
+	
+	// init task
+	if(task->on_init) task->on_init(task, task->index, task->user_data);
+	
+	sem_t * sem = &params->shared->states[task->index].sem;
+	assert(sem);
+	while(!task->quit) {
+		//~ rc = pthread_cond_wait(&task->mc.cond, &task->mc.mutex);
+		//~ if(rc || task->quit) break;
+		if(params->verbose) {
+			int cur_value = 0;
+			rc = sem_getvalue(sem, &cur_value);
+			printf("sems[%d] status: value=%d\n", task->index, cur_value);
+		}
+		while((rc = sem_wait(sem)) == -1 && errno == EINTR);	// interrupted by the signal handler
+		assert(0 == rc);
+		if(task->quit) break;
+		
+		// the previous iteration using the slot has completed before this one was admitted
+		long iteration = task->num_launched++;
+		int slot = iteration % pipeline_depth;
+		struct opencl_event_list * events = task->slots[slot].events;
+		task->slots[slot].launch_time = get_time();
+		task->slots[slot].completion->iteration = iteration;
+		if(task->numa_node >= 0 && numa_topology_get_cpu_node(params->numa, sched_getcpu()) == task->numa_node) {
+			++task->num_local_iterations;
+		}
+		
+		struct task_version version = get_task_version(params, iteration);
+		if(version.id != versions[slot]) {
+			unload_functions(functions[slot], num_functions[slot]);
+			num_functions[slot] = load_functions(task, &version, slot, functions[slot]);
+			versions[slot] = version.id;
+		}
+		
+		// restore the evicted buffers, they are kept resident until the commands have been flushed
+		struct opencl_buffer * buffers[TASK_GRAPH_MAX_BUFFERS];
+		int num_buffers = get_task_buffers(params, &version.graph->tasks[task->index], slot, buffers);
+		rc = params->memory->acquire(params->memory, num_buffers, buffers, task->memory);
+		assert(0 == rc);
+		load_inputs(task, slot);
+		
+		for(int i = 0; i < num_functions[slot]; ++i) {
+			struct opencl_function * function = functions[slot][i];
+			assert(function);
+			
+			// the waiting list is built from the bound buffers, no explicit sync between the tasks' queues
+			cl_event event = NULL;
+			rc = function->execute(function, task->num_waiting_events, task->waiting_events, &event);
+			assert(0 == rc);
+			
+			if(event) {
+				events->add(events, event);
+				clReleaseEvent(event);
+			}
+		}
+		if(is_host) task->busy_time += get_time() - task->slots[slot].launch_time;	// the host functions are synchronous
+		enqueue_read_outputs(task, slot);
+		
+		// notify the main thread when the iteration completes
+		struct opencl_notifier * notifier = params->notifier;
+		if(is_host) {
+			rc = notifier->post(notifier, on_task_completed, task->slots[slot].completion);
+		}else {
+			cl_event marker = NULL;
+			ret = clEnqueueMarkerWithWaitList(queue, 0, NULL, &marker); // waits for all previous commands in the queue
+			check_error(ret);
+			clFlush(queue);
+			
+			rc = notifier->watch(notifier, marker, on_task_completed, task->slots[slot].completion);
+			clReleaseEvent(marker);
+		}
+		assert(0 == rc);
+		params->memory->release(params->memory, num_buffers, buffers);
+		
+		if(task->quit) break;	// if quit signal has been set while processing
+	}
+	//~ pthread_mutex_unlock(&task->mc.mutex);
+	for(int slot = 0; slot < pipeline_depth; ++slot) unload_functions(functions[slot], num_functions[slot]);
+	pthread_exit((void *)(intptr_t)rc);
+	
+#if defined(_WIN32) || defined(WIN32)
+	return (void *)(intptr_t)rc;
+#endif
+}
+
+static int on_init_task(struct task_context * task, int task_index, void * user_data)
+{
+	fprintf(stderr, "[LOG]::%s(%p, %d, %p)\n", __FUNCTION__, task, task_index, user_data);
+	
+	return 0;
+}
+
+/*
+ * partition the device, the worker keeps the sub-device (slot % num_sub_devices) and releases the others
+*/
+static struct opencl_device * create_sub_device(global_params_t * params, struct opencl_device * device, 
+	const cl_device_partition_property * props, int slot, cl_uint * p_num_sub_devices, cl_int * p_ret)
+{
+	cl_uint num_sub_devices = 0;
+	cl_int ret = clCreateSubDevices(device->id, props, 0, NULL, &num_sub_devices);
+	*p_ret = ret;
+	if(ret != CL_SUCCESS || 0 == num_sub_devices) return NULL;
+	
+	cl_device_id * sub_ids = calloc(num_sub_devices, sizeof(*sub_ids));
+	assert(sub_ids);
+	ret = clCreateSubDevices(device->id, props, num_sub_devices, sub_ids, NULL);
+	check_error(ret);
+	
+	cl_device_id id = sub_ids[slot % num_sub_devices];
+	for(cl_uint i = 0; i < num_sub_devices; ++i) {
+		if(sub_ids[i] != id) clReleaseDevice(sub_ids[i]);
+	}
+	free(sub_ids);
+	
+	struct opencl_device * sub_device = opencl_device_init(params->sub_device, id);
+	assert(sub_device);
+	sub_device->platform = device->platform;
+	*p_num_sub_devices = num_sub_devices;
+	return sub_device;
+}
+
+/*
+ * (multi-processes mode) the workers sharing a device run on its sub-devices if it can be partitioned,
+ * a CPU device is split by NUMA node first: the worker's compute units and host buffers stay on the same node.
+*/
+static struct opencl_device * get_worker_device(global_params_t * params, struct opencl_device * device, int num_sharing, int slot)
+{
+	if(num_sharing <= 1 || device->max_sub_devices < 2) return device;
+	
+	struct opencl_device * sub_device = NULL;
+	cl_uint num_sub_devices = 0;
+	cl_int ret = CL_SUCCESS;
+	if(params->use_numa && (device->device_type & CL_DEVICE_TYPE_CPU)) {
+		const cl_device_partition_property props[] = { 
+			CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN, CL_DEVICE_AFFINITY_DOMAIN_NUMA, 0 
+		};
+		sub_device = create_sub_device(params, device, props, slot, &num_sub_devices, &ret);
+		if(sub_device) {
+			// the runtimes list the affinity domains in the order of the nodes
+			if(num_sub_devices == (cl_uint)params->numa->num_nodes) params->worker_numa_node = slot % num_sub_devices;
+			fprintf(stderr, "[INFO]: worker[%d]: NUMA sub-device %d/%u\n", 
+				params->worker_index, slot % (int)num_sub_devices, num_sub_devices);
+			return sub_device;
+		}
+		fprintf(stderr, "[WARNING]: worker[%d]: can't partition the device by NUMA node (%s)\n", 
+			params->worker_index, opencl_error_to_string(ret));
+	}
+	
+	cl_uint compute_units = device->max_compute_units / num_sharing;
+	if(0 == compute_units) return device;
+	
+	const cl_device_partition_property props[] = { CL_DEVICE_PARTITION_EQUALLY, compute_units, 0 };
+	sub_device = create_sub_device(params, device, props, slot, &num_sub_devices, &ret);
+	if(NULL == sub_device) {
+		fprintf(stderr, "[WARNING]: worker[%d]: can't partition the device (%s), share the whole device\n", 
+			params->worker_index, opencl_error_to_string(ret));
+		return device;
+	}
+	fprintf(stderr, "[INFO]: worker[%d]: sub-device %d/%u, compute units: %u\n", 
+		params->worker_index, slot % (int)num_sub_devices, num_sub_devices, compute_units);
+	return sub_device;
+}
+
+/*
+ * the NUMA node of a task's thread and host buffers, (-1: not pinned).
+ * the tasks are spread over the nodes on the host backend and on the CPU devices
+ * (a worker process uses the node of its NUMA sub-device), the GPU devices are left to the driver.
+*/
+static int get_task_numa_node(global_params_t * params, int task_index, const struct opencl_device * device)
+{
+	if(!params->use_numa) return -1;
+	if(params->is_multi_processes) {
+		if(task_index != params->worker_index) return -1;
+		if(params->worker_numa_node >= 0) return params->worker_numa_node;
+	}
+	if(device && !(device->device_type & CL_DEVICE_TYPE_CPU)) return -1;
+	return task_index % params->numa->num_nodes;
+}
+
+/*
+ * device placement: "device" of the task config (modulo the number of devices),
+ * or the first device (single-process mode) / round-robin over the devices (multi-processes mode).
+*/
+static int get_task_device_index(global_params_t * params, int task_index, int num_devices)
+{
+	const struct task_graph_task * config = &params->graph->tasks[task_index];
+	if(config->device_index >= 0) return config->device_index % num_devices;
+	return params->is_multi_processes?(task_index % num_devices):0;
+}
+
+static int init_opencl_backend(global_params_t * params, struct opencl_device ** task_devices)
+{
+	int rc = 0;
+	cl_int ret = 0;
+	
+	int device_type = CL_DEVICE_TYPE_GPU;
+	
+	opencl_context_t * cl = params->cl;
+	struct opencl_platform * platform = params->platform;
+	assert(cl && platform);
+	
+	// a CPU runtime (e.g. pocl): run on its CPU devices
+	cl_uint num_gpus = 0;
+	ret = clGetDeviceIDs(platform->id, CL_DEVICE_TYPE_GPU, 0, NULL, &num_gpus);
+	if(ret == CL_DEVICE_NOT_FOUND || 0 == num_gpus) device_type = CL_DEVICE_TYPE_CPU;
+
+	rc = cl->load_devices(cl, device_type, platform);
+	assert(0 == rc);
+	
+	int num_devices = cl->num_devices;
+	assert(num_devices > 0);
+	
+	// the devices used by the tasks run by this process, the context and the program are created for all of them
+	cl_uint num_ctx_devices = 0;
+	cl_device_id * ctx_devices = params->ctx_devices;
+	for(int i = 0; i < params->num_tasks; ++i) {
+		if(params->is_multi_processes && i != params->worker_index) continue;
+		
+		int device_index = get_task_device_index(params, i, num_devices);
+		struct opencl_device * device = &cl->devices[device_index];
+		if(params->is_multi_processes) {
+			// each worker process owns a device (or a sub-device)
+			int num_sharing = 0;
+			int rank = 0;
+			for(int j = 0; j < params->num_tasks; ++j) {
+				if(get_task_device_index(params, j, num_devices) != device_index) continue;
+				if(j < i) ++rank;
+				++num_sharing;
+			}
+			device = get_worker_device(params, device, num_sharing, rank);
+		}
+		assert(device);
+		task_devices[i] = device;
+		
+		cl_uint j = 0;
+		for(; j < num_ctx_devices; ++j) if(ctx_devices[j] == device->id) break;
+		if(j == num_ctx_devices) ctx_devices[num_ctx_devices++] = device->id;
+	}
+	assert(num_ctx_devices > 0);
+	params->num_ctx_devices = num_ctx_devices;
+	
+	cl_context_properties propertities[] = {
+		CL_CONTEXT_PLATFORM,
+		(cl_context_properties)platform->id,
+		0,
+	};
+
+	cl_context ctx = clCreateContext(propertities, num_ctx_devices, ctx_devices, NULL, NULL, &ret);
+	check_error(ret);
+	params->ctx = ctx;
+	
+	// build kernels in the background, see wait_program()
+	struct opencl_library * library = opencl_library_init(NULL, ctx, num_ctx_devices, ctx_devices);
+	assert(library);
+	params->library = library;
+	rc = opencl_library_add_path(library, params->kernel_file);
+	if(0 == rc) rc = opencl_library_set_options(library, params->build_options);
+	if(0 == rc) rc = library->build_async(library, NULL, NULL);
+	if(rc) {
+		fprintf(stderr, "[ERROR]: failed to load the kernels from %s\n", params->kernel_file);
+		exit(1);
+	}
+	return 0;
+}
+
+/*
+ * wait for the kernels built while the buffers were being initialized
+*/
+static int wait_program(global_params_t * params)
+{
+	if(NULL == params->library) return 0;
+	struct opencl_program * program = params->library->wait(params->library);
+	assert(program);
+	
+	int rc = 0;
+	if(program->wait(program, -1) == CL_BUILD_SUCCESS) {
+		clRetainProgram(program->prog);
+		params->program = program->prog;
+	}else {
+		fprintf(stderr, "[ERROR]: failed to build %s\n%s", params->kernel_file, program->build_log?program->build_log:"");
+		rc = -1;
+	}
+	opencl_program_cleanup(program);
+	free(program);
+	return rc;
+}
+
+/*********************************************
+ * hot reload: watch the kernel file and the config file
+ * 
+ * the kernels are rebuilt asynchronously (only the changed modules are recompiled, see opencl_library),
+ * the config is recompiled on the main thread.
+ * a new version is only installed if all the kernels used by the config can be created,
+ * otherwise the current one keeps running (rollback).
+*********************************************/
+/*
+ * validate the kernels used by the config against the program (NULL: host backend)
+*/
+static int check_kernels(global_params_t * params, cl_program program, const struct task_graph * graph)
+{
+	for(int i = 0; i < graph->num_tasks; ++i) {
+		const struct task_graph_task * config = &graph->tasks[i];
+		for(int j = 0; j < config->num_functions; ++j) {
+			const struct task_graph_function * function = &config->functions[j];
+			if(NULL == program) {
+				if(opencl_host_has_kernel(function->kernel_name)) continue;
+				fprintf(stderr, "[ERROR]: reload: tasks[%d].functions[%d]: host kernel '%s' not found\n", i, j, function->kernel_name);
+				return -1;
+			}
+			
+			cl_int ret = 0;
+			cl_kernel kernel = clCreateKernel(program, function->kernel_name, &ret);
+			if(NULL == kernel) {
+				fprintf(stderr, "[ERROR]: reload: tasks[%d].functions[%d]: kernel '%s': %s\n", 
+					i, j, function->kernel_name, opencl_error_to_string(ret));
+				return -1;
+			}
+			cl_uint num_args = 0;
+			ret = clGetKernelInfo(kernel, CL_KERNEL_NUM_ARGS, sizeof(num_args), &num_args, NULL);
+			clReleaseKernel(kernel);
+			if(CL_SUCCESS == ret && num_args != function->num_args) {
+				fprintf(stderr, "[ERROR]: reload: tasks[%d].functions[%d]: kernel '%s' takes %u args, %d configured\n", 
+					i, j, function->kernel_name, num_args, function->num_args);
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+static struct task_version get_latest_version(global_params_t * params)
+{
+	return get_task_version(params, LONG_MAX);
+}
+
+static void start_program_build(global_params_t * params);
+
+/*
+ * (main thread) the background build has completed
+*/
+static void on_program_built(void * user_data, cl_event event, cl_int status)
+{
+	global_params_t * params = user_data;
+	struct hot_reload * reload = params->reload;
+	struct opencl_program * build = __atomic_exchange_n(&reload->built, NULL, __ATOMIC_ACQ_REL);
+	assert(reload->is_building && build);
+	reload->is_building = 0;
+	
+	if(build->build_status != CL_BUILD_SUCCESS) {
+		fprintf(stderr, "[ERROR]: reload: failed to build %s, keep running the current kernels\n%s", 
+			params->kernel_file, build->build_log?build->build_log:"");
+	}else {
+		// the new program runs the current config
+		struct task_version latest = get_latest_version(params);
+		if(0 == check_kernels(params, build->prog, latest.graph)) {
+			if(0 == install_version(params, build->prog, latest.graph)) build->prog = NULL;
+		}else {
+			fprintf(stderr, "[ERROR]: reload: %s doesn't match the config, keep running the current kernels\n", params->kernel_file);
+		}
+	}
+	opencl_program_cleanup(build);
+	free(build);
+	
+	if(reload->rebuild_pending && !g_quit) {
+		reload->rebuild_pending = 0;
+		start_program_build(params);
+	}
+}
+
+// called from a runtime's thread
+static void on_library_built(struct opencl_library * library, struct opencl_program * build, void * user_data)
+{
+	global_params_t * params = user_data;
+	__atomic_store_n(&params->reload->built, build, __ATOMIC_RELEASE);
+	int rc = params->notifier->post(params->notifier, on_program_built, params);
+	assert(0 == rc);
+}
+
+static void start_program_build(global_params_t * params)
+{
+	struct hot_reload * reload = params->reload;
+	if(reload->is_building) {		// coalesce the changes made during a build
+		reload->rebuild_pending = 1;
+		return;
+	}
+	
+	reload->is_building = 1;
+	int rc = params->library->build_async(params->library, on_library_built, params);
+	if(rc) {
+		fprintf(stderr, "[ERROR]: reload: failed to load %s\n", params->kernel_file);
+		reload->is_building = 0;
+	}
+}
+
+static void on_kernel_file_changed(void * user_data, const char * path)
+{
+	global_params_t * params = user_data;
+	fprintf(stderr, "[LOG]: reload: %s changed, rebuilding ...\n", path);
+	start_program_build(params);
+}
+
+/*
+ * the reloaded config may change the kernels, their args and the work sizes,
+ * but not the buffers nor the data flow (dependencies and host-resident outputs).
+*/
+static int check_graph_compatible(const struct task_graph * current, const struct task_graph * graph)
+{
+	if(graph->num_buffers != current->num_buffers 
+		|| memcmp(graph->buffers, current->buffers, sizeof(*graph->buffers) * graph->num_buffers)) {
+		fprintf(stderr, "[ERROR]: reload: the buffers can't be changed without a restart\n");
+		return -1;
+	}
+	if(graph->num_tasks != current->num_tasks) {
+		fprintf(stderr, "[ERROR]: reload: the number of tasks can't be changed without a restart\n");
+		return -1;
+	}
+	
+	struct task_graph_range outputs[2][MAX_HOST_OUTPUTS];
+	for(int i = 0; i < graph->num_tasks; ++i) {
+		const struct task_graph_task * config = &graph->tasks[i];
+		const struct task_graph_task * current_config = &current->tasks[i];
+		if(config->num_dependencies != current_config->num_dependencies 
+			|| memcmp(config->dependencies, current_config->dependencies, sizeof(config->dependencies[0]) * config->num_dependencies)) {
+			fprintf(stderr, "[ERROR]: reload: tasks[%d]: the dependencies can't be changed without a restart\n", i);
+			return -1;
+		}
+		if(!config->grid_stride && 0 == config->local_sizes[0] && (config->global_sizes[0] % LOCAL_SIZE)) {
+			fprintf(stderr, "[ERROR]: reload: tasks[%d]: global size %lu is not a multiple of the default local size %d\n", 
+				i, (unsigned long)config->global_sizes[0], LOCAL_SIZE);
+			return -1;
+		}
+		
+		// the same ranges are read back
+		int num_outputs = get_host_outputs(graph, config, outputs[0], MAX_HOST_OUTPUTS);
+		int num_current = get_host_outputs(current, current_config, outputs[1], MAX_HOST_OUTPUTS);
+		int j = 0;
+		for(; j < num_outputs && num_outputs == num_current; ++j) {
+			const struct task_graph_range * range = &outputs[0][j];
+			int k = 0;
+			for(; k < num_current; ++k) {
+				const struct task_graph_range * current_range = &outputs[1][k];
+				if(range->buffer_index == current_range->buffer_index 
+					&& range->offset == current_range->offset 
+					&& range->length == current_range->length) break;
+			}
+			if(k == num_current) break;
+		}
+		if(num_outputs != num_current || j < num_outputs) {
+			fprintf(stderr, "[ERROR]: reload: tasks[%d]: the host-resident outputs can't be changed without a restart\n", i);
+			return -1;
+		}
+	}
+	if(memcmp(&graph->settings, &current->settings, sizeof(graph->settings))) {
+		fprintf(stderr, "[WARNING]: reload: the settings are only applied on restart\n");
+	}
+	return 0;
+}
+
+static void on_conf_file_changed(void * user_data, const char * path)
+{
+	global_params_t * params = user_data;
+	fprintf(stderr, "[LOG]: reload: %s changed\n", path);
+	
+	struct task_graph * graph = calloc(1, sizeof(*graph));
+	assert(graph);
+	char cache_file[4096] = "";
+	snprintf(cache_file, sizeof(cache_file), "%s.cache", params->conf_file);
+	int rc = task_graph_load_file(graph, params->conf_file, cache_file);
+	if(rc) fprintf(stderr, "[ERROR]: reload: %s: %s\n", params->conf_file, graph->err_msg);
+	
+	struct task_version latest = get_latest_version(params);
+	if(0 == rc) rc = check_graph_compatible(latest.graph, graph);
+	if(0 == rc) rc = check_memory_footprints(params, graph);
+	if(0 == rc) rc = check_buffer_ranges(params, graph);
+	if(0 == rc) rc = check_kernels(params, latest.program, graph);
+	
+	if(0 == rc) {
+		if(latest.program) clRetainProgram(latest.program);
+		rc = install_version(params, latest.program, graph);
+		if(0 == rc) return;
+		if(latest.program) clReleaseProgram(latest.program);
+	}else {
+		fprintf(stderr, "[ERROR]: reload: keep running the current config\n");
+	}
+	task_graph_cleanup(graph);
+	free(graph);
+}
+
+static void on_watcher_readable(void * user_data, int fd)
+{
+	struct file_watcher * watcher = user_data;
+	watcher->dispatch(watcher);
+}
+
+static int start_watching(global_params_t * params)
+{
+	struct hot_reload * reload = params->reload;
+	struct file_watcher * watcher = file_watcher_init(NULL);
+	if(NULL == watcher) return -1;
+	reload->watcher = watcher;
+	
+	// the host backend doesn't use the kernel files
+	int rc = 0;
+	int num_files = 0;
+	if(params->library) {
+		const char * paths[256];
+		num_files = opencl_library_get_files(params->library, paths, 256);
+		if(num_files > 256) num_files = 256;
+		for(int i = 0; 0 == rc && i < num_files; ++i) rc = watcher->add(watcher, paths[i], on_kernel_file_changed, params);
+	}
+	if(0 == rc && params->conf_file) rc = watcher->add(watcher, params->conf_file, on_conf_file_changed, params);
+	if(0 == rc) rc = params->notifier->add_fd(params->notifier, watcher->fd, on_watcher_readable, watcher);
+	if(rc) return -1;
+	
+	fprintf(stderr, "[LOG]: watching %d kernel file(s) in %s%s%s\n", num_files, params->kernel_file, 
+		params->conf_file?" and ":"", params->conf_file?params->conf_file:"");
+	return 0;
+}
+
+static void hot_reload_cleanup(global_params_t * params)
+{
+	struct hot_reload * reload = params->reload;
+	if(NULL == reload) return;
+	
+	if(reload->watcher) {
+		if(params->notifier) params->notifier->remove_fd(params->notifier, reload->watcher->fd);
+		file_watcher_cleanup(reload->watcher);
+		free(reload->watcher);
+		reload->watcher = NULL;
+	}
+	
+	// the completion posted to the notifier won't be dispatched anymore
+	if(reload->is_building) {
+		params->library->wait(params->library);
+		struct opencl_program * build = __atomic_exchange_n(&reload->built, NULL, __ATOMIC_ACQ_REL);
+		if(build) {
+			opencl_program_cleanup(build);
+			free(build);
+		}
+		reload->is_building = 0;
+	}
+	
+	while(reload->num_versions > 0) {
+		release_version(params, reload, reload->num_versions - 1);
+		--reload->num_versions;
+	}
+	pthread_mutex_destroy(&reload->mutex);
+	free(reload);
+	params->reload = NULL;
+}
+
+int run_tasks(global_params_t * params)
+{
+	assert(params && params->cl);
+	int rc = 0;
+	
+	int num_tasks = params->num_tasks;
+	assert(num_tasks == params->graph->num_tasks);
+	
+	cl_context ctx = NULL;
+	struct opencl_device * task_devices[TASK_GRAPH_MAX_TASKS] = { NULL };
+	if(params->backend == opencl_backend_type_opencl) {
+		assert(params->platform);
+		rc = init_opencl_backend(params, task_devices);
+		assert(0 == rc);
+		ctx = params->ctx;
+	}else {
+		opencl_host_set_build_options(params->build_options);
+		fprintf(stderr, "[INFO]: host backend: num_threads = %d\n", opencl_host_get_num_threads());
+	}
+
+	if(init_buffers(params) 
+		|| check_memory_footprints(params, params->graph) 
+		|| check_buffer_ranges(params, params->graph)) exit(1);
+	if(wait_program(params)) exit(1);
+	
+	params->reload = hot_reload_init(params);
+	assert(params->reload);
+	
+	struct shared_states * shared = params->shared;
+	if(NULL == shared) { // single-process mode
+		rc = posix_memalign((void **)&shared, CACHE_LINE_SIZE, sizeof(*shared));
+		assert(0 == rc && shared);
+		shared = shared_states_init(shared, params->graph, params->pipeline_depth, 0, 0);
+		assert(shared);
+		params->shared = shared;
+	}
+	assert(shared->num_tasks == num_tasks);
+	
+	int task_nodes[TASK_GRAPH_MAX_TASKS];
+	for(int i = 0; i < num_tasks; ++i) task_nodes[i] = get_task_numa_node(params, i, task_devices[i]);
+	place_buffers(params, task_nodes);
+	
+	struct task_context ** tasks = calloc(num_tasks, sizeof(*tasks));
+	assert(tasks);
+	params->tasks = tasks;
+	
+	for(int i = 0; i < num_tasks; ++i) {
+		if(params->is_multi_processes && i != params->worker_index) continue; // run by another worker process
+		
+		struct task_context * task = task_context_new(params, ctx, task_devices[i]);
+		assert(task);
+		tasks[i] = task;
+
+		task->index = i;
+		task->config = &params->graph->tasks[i];
+		task->on_init = on_init_task;
+		task->memory_footprint = get_memory_footprint(params, task->config);
+		task->numa_node = task_nodes[i];
+		init_readbacks(task);
+		
+		rc = pthread_create(&tasks[i]->thread_id, NULL, process, tasks[i]);
+		assert(0 == rc);
+	}
+
+	return 0;
+}
+
+/*
+ * shutdown: wait for the in-flight iterations to be notified and finish the queues,
+ * returns -1 if the deadline (shutdown_timeout_ms) has been exceeded.
+*/
+static int drain_tasks(global_params_t * params)
+{
+	struct opencl_notifier * notifier = params->notifier;
+	struct shared_states * shared = params->shared;
+	double deadline = get_time() + (double)params->shutdown_timeout_ms / 1000.0;
+	
+	while(__atomic_load_n(&shared->num_pending, __ATOMIC_SEQ_CST) > 0) {
+		int timeout_ms = -1;
+		if(params->shutdown_timeout_ms >= 0) {
+			double remaining = deadline - get_time();
+			if(remaining <= 0) return -1;
+			timeout_ms = (int)(remaining * 1000.0) + 1;
+		}
+		// the other workers' completions won't wake up this process, poll the counter
+		if(params->is_multi_processes && (timeout_ms < 0 || timeout_ms > 10)) timeout_ms = 10;
+		int rc = notifier->run_once(notifier, timeout_ms);
+		if(rc < 0) return -1;
+	}
+	
+	// every iteration ends with a marker which has completed, clFinish() won't block on a stalled device
+	for(int i = 0; i < params->num_tasks; ++i) {
+		struct task_context * task = params->tasks[i];
+		if(task && task->queue) {
+			cl_int ret = clFinish(task->queue);
+			check_error(ret);
+		}
+	}
+	return 0;
+}
+
+/*
+ * the iterations launched from the task's node, and the pages of its buffers' host copies on the node
+*/
+static void dump_numa_locality(global_params_t * params, struct task_context * task, FILE * fp)
+{
+	struct numa_topology * numa = params->numa;
+	size_t counts[numa->num_nodes];
+	memset(counts, 0, sizeof(counts));
+	ssize_t num_pages = 0;
+	for(int slot = 0; slot < params->pipeline_depth; ++slot) {
+		struct opencl_buffer * buffers[TASK_GRAPH_MAX_BUFFERS];
+		int num_buffers = get_task_buffers(params, task->config, slot, buffers);
+		for(int i = 0; i < num_buffers && num_pages >= 0; ++i) {
+			if(NULL == buffers[i]->cpu_data) continue;
+			ssize_t n = numa_topology_count_pages(numa, buffers[i]->cpu_data, buffers[i]->size, counts);
+			num_pages = (n < 0)?-1:(num_pages + n);
+		}
+	}
+	
+	char pages[64] = "n/a";
+	if(num_pages > 0) {
+		snprintf(pages, sizeof(pages), "%zu/%zd (%.1f%%)", counts[task->numa_node], num_pages, 
+			(double)counts[task->numa_node] * 100.0 / num_pages);
+	}
+	long n = task->num_launched;
+	fprintf(fp, "task[%d]: numa node=%d, local iterations=%ld/%ld (%.1f%%), local pages=%s\n",
+		task->index, numa->nodes[task->numa_node].id, 
+		task->num_local_iterations, n, (n > 0)?(double)task->num_local_iterations * 100.0 / n:0.0,
+		pages);
+}
+
+static void dump_metrics(global_params_t * params, FILE * fp)
+{
+	double elapsed = get_time() - params->start_time;
+	int is_host = (params->backend == opencl_backend_type_host);
+	fprintf(fp, "==== metrics: backend=%s, elapsed=%.3f s ====\n", is_host?"host":"opencl", elapsed);
+	for(int i = 0; i < params->num_tasks; ++i) {
+		struct task_context * task = params->tasks[i];
+		if(NULL == task) continue;
+		long n = task->num_iterations;
+		fprintf(fp, "task[%d]: iterations=%ld (%.1f/s), avg latency=%.3f ms, avg %s time=%.3f ms\n",
+			task->index, n, 
+			(elapsed > 0)?(double)n / elapsed:0.0,
+			(n > 0)?task->total_latency * 1000.0 / n:0.0,
+			is_host?"host":"kernel",
+			(n > 0)?task->busy_time * 1000.0 / n:0.0);
+		fprintf(fp, "task[%d]: memory=%.3f MiB, restores=%ld (%.3f MiB), evictions=%ld (%.3f MiB)\n",
+			task->index, (double)task->memory_footprint / (1 << 20),
+			task->memory->num_restores, (double)task->memory->bytes_restored / (1 << 20),
+			task->memory->num_evictions, (double)task->memory->bytes_evicted / (1 << 20));
+		if(task->numa_node >= 0) dump_numa_locality(params, task, fp);
+	}
+	
+	struct opencl_memory_manager * memory = params->memory;
+	if(memory) {
+		pthread_mutex_lock(&memory->mutex);
+		struct opencl_memory_stats stats = memory->stats;
+		pthread_mutex_unlock(&memory->mutex);
+		char budget[64] = "unlimited";
+		if(memory->budget) snprintf(budget, sizeof(budget), "%.3f MiB", (double)memory->budget / (1 << 20));
+		fprintf(fp, "memory: used=%.3f MiB, peak=%.3f MiB, budget=%s, restores=%ld, evictions=%ld\n",
+			(double)stats.used / (1 << 20), (double)stats.peak / (1 << 20), budget,
+			stats.num_restores, stats.num_evictions);
+	}
+	fflush(fp);
+}
+
+/*********************************************
+ * multi-processes mode
+*********************************************/
+#include <sys/wait.h>
+
+static void stop_workers(global_params_t * params, int sig)
+{
+	struct shared_states * shared = params->shared;
+	__atomic_store_n(&shared->quit, 1, __ATOMIC_RELEASE);
+	for(int i = 0; i < shared->num_tasks; ++i) {
+		if(shared->states[i].pid > 0) kill(shared->states[i].pid, sig);
+	}
+}
+
+static int wait_workers(global_params_t * params)
+{
+	struct shared_states * shared = params->shared;
+	int num_alive = 0;
+	for(int i = 0; i < shared->num_tasks; ++i) num_alive += (shared->states[i].pid > 0);
+	
+	int rc = 0;
+	int stopping = 0;
+	double deadline = 0;
+	while(num_alive > 0) {
+		if(g_quit && !stopping) {
+			stop_workers(params, SIGTERM);
+			stopping = 1;
+			deadline = get_time() + (double)params->shutdown_timeout_ms / 1000.0 + 1.0;
+		}
+		if(stopping && params->shutdown_timeout_ms >= 0 && get_time() > deadline) {
+			fprintf(stderr, "[WARNING]: %d worker(s) still alive after the shutdown deadline, kill them\n", num_alive);
+			stop_workers(params, SIGKILL);
+			params->shutdown_timeout_ms = -1;
+		}
+		
+		int status = 0;
+		pid_t pid = waitpid(-1, &status, WNOHANG);
+		if(pid < 0) {
+			if(errno == EINTR) continue;
+			perror("waitpid");
+			return -1;
+		}
+		if(0 == pid) {
+			struct timespec interval = { .tv_nsec = 10 * 1000000 };
+			nanosleep(&interval, NULL);
+			continue;
+		}
+		
+		int index = -1;
+		for(int i = 0; i < shared->num_tasks; ++i) {
+			if(shared->states[i].pid == pid) { index = i; break; }
+		}
+		if(index < 0) continue;
+		shared->states[index].pid = 0;
+		--num_alive;
+		
+		if(WIFEXITED(status) && 0 == WEXITSTATUS(status)) continue;
+		if(WIFSIGNALED(status)) fprintf(stderr, "[ERROR]: worker[%d] (pid=%ld) killed by signal %d\n", index, (long)pid, WTERMSIG(status));
+		else fprintf(stderr, "[ERROR]: worker[%d] (pid=%ld) exited with code %d\n", index, (long)pid, WEXITSTATUS(status));
+		rc = 1;
+		
+		// the DAG can't make progress without the task, shut the other workers down
+		if(!g_quit) g_quit = 1;
+	}
+	return rc;
+}
+
+/*
+ * the coordinator: forks a worker process per task and waits for them,
+ * the semaphores, the task states and the workers' inboxes are placed in a shm_region.
+*/
+static int run_multi_processes(global_params_t * params)
+{
+	int num_tasks = params->num_tasks;
+	
+	size_t size = shared_states_calc_size(params->edges, num_tasks, params->pipeline_depth);
+	struct shm_region * shm = shm_region_init(NULL, size);
+	if(NULL == shm) {
+		fprintf(stderr, "[ERROR]: failed to create the shared memory region\n");
+		exit(1);
+	}
+	struct shared_states * shared = shared_states_init(shm->data, params->graph, params->pipeline_depth, 1, params->edges);
+	assert(shared);
+	params->shm = shm;
+	params->shared = shared;
+	
+	// no opencl calls before fork(): each worker initializes its own runtime, context and device
+	for(int i = 0; i < num_tasks; ++i) {
+		pid_t pid = fork();
+		if(pid < 0) {
+			perror("fork");
+			g_quit = 1;
+			break;
+		}
+		if(0 == pid) {
+			signal(SIGINT, SIG_IGN);	// the coordinator forwards SIGTERM to the workers
+			params->worker_index = i;
+			exit(run_process(params));
+		}
+		shared->states[i].pid = pid;
+		fprintf(stderr, "[LOG]: worker[%d] started, pid=%ld\n", i, (long)pid);
+	}
+	
+	int rc = wait_workers(params);
+	for(int i = 0; i < num_tasks; ++i) {
+		fprintf(stderr, "worker[%d]: iterations=%ld\n", i, shared->states[i].num_iterations);
+	}
+	
+	shared_states_cleanup(shared);
+	params->shared = NULL;
+	shm_region_cleanup(shm);
+	free(shm);
+	params->shm = NULL;
+	
+	global_params_cleanup(params);
+	free(params);
+	return rc;
+}
+
+/*********************************************
+ * global_params
+*********************************************/
+static void show_usuages(const char * exe_name)
+{
+	fprintf(stderr, "Usuage: %s \\\n"
+		"--conf=<conf_file(default: conf/config.json)> \\\n"
+		"--platform=<platform_name(default: nvidia)> \\\n"
+		"--backend=<opencl|host(default: opencl, host if no platform was found)> \\\n"
+		"--shutdown-timeout=<ms(default: 5000, -1: no limit)> \\\n"
+		"--multi-processes (run each task in a worker process) \\\n"
+		"--kernels=<kernel_file or directory(default: kernels)> \\\n"
+		"--watch (hot-reload the kernel file and the config file) \\\n"
+		"--build-options=<compile options of the kernels, e.g. \"-D SGEMM_TILE_SIZE=32\"> \\\n"
+		"--memory-budget=<MiB of device memory for the buffers(default: the device's global memory)> \\\n"
+		"--no-numa (don't pin the tasks and their host buffers to NUMA nodes) \\\n"
+		"--depth=<pipeline_depth(default: 2, max: %d)>\n", exe_name, MAX_PIPELINE_DEPTH);
+		
+	return;
+}
+/*
+ * (multi-processes mode) the ranges sent along each edge of the graph
+*/
+static int init_task_edges(global_params_t * params, const char * conf_name)
+{
+	const struct task_graph * graph = params->graph;
+	int num_tasks = graph->num_tasks;
+	struct task_edge * edges = calloc(num_tasks * num_tasks, sizeof(*edges));
+	assert(edges);
+	params->edges = edges;
+	
+	for(int producer = 0; producer < num_tasks; ++producer) {
+		for(int consumer = 0; consumer < num_tasks; ++consumer) {
+			if(producer == consumer) continue;
+			struct task_edge * edge = &edges[producer * num_tasks + consumer];
+			int num_ranges = task_graph_get_edge_ranges(graph, producer, consumer, edge->ranges, MAX_EDGE_RANGES);
+			if(num_ranges > MAX_EDGE_RANGES) {
+				fprintf(stderr, "[ERROR]: %s: tasks[%d]: too many ranges sent to tasks[%d] (%d > %d)\n", 
+					conf_name, producer, consumer, num_ranges, MAX_EDGE_RANGES);
+				return -1;
+			}
+			if(0 == num_ranges) continue;
+			
+			edge->num_ranges = num_ranges;
+			edge->cb_record = sizeof(struct task_record_header);
+			for(int i = 0; i < num_ranges; ++i) edge->cb_record += sizeof(struct task_record_range) + edge->ranges[i].length * TASK_GRAPH_ITEM_SIZE;
+		}
+	}
+	return 0;
+}
+
+global_params_t * global_params_init(global_params_t * params, int argc, char ** argv, void ** user_data)
+{
+	if(NULL == params) params = calloc(1, sizeof(*params));
+	else memset(params, 0, sizeof(*params));
+	
+	static struct option options[] = {
+		{"conf", required_argument, 0, 'c'},
+		{"platform", required_argument, 0, 'p'},
+		{"backend", required_argument, 0, 'b'},
+		{"shutdown-timeout", required_argument, 0, 't'},
+		{"multi-processes", no_argument, 0, 'm'},
+		{"depth", required_argument, 0, 'd'},
+		{"kernels", required_argument, 0, 'k'},
+		{"watch", no_argument, 0, 'w'},
+		{"build-options", required_argument, 0, 'o'},
+		{"memory-budget", required_argument, 0, 'M'},
+		{"no-numa", no_argument, 0, 'N'},
+		{"verbose", no_argument, 0, 'v'},
 		{"help", no_argument, 0, 'h'},
 		{NULL, }
 	};
 	
 	int rc = 0;
-	rc = pthread_rwlock_init(&params->rw_mutex, NULL);
+	rc = pthread_mutex_init(&params->views_mutex, NULL);
 	assert(0 == rc);
 	
 	const char * conf_file = NULL;
 	const char * platform_name = NULL;
+	const char * backend_name = NULL;
+	const char * shutdown_timeout = NULL;
 	int verbose = -1;
+	int multi_processes = -1;
+	const char * depth = NULL;
+	const char * kernel_file = NULL;
+	int watch = -1;
+	const char * build_options = NULL;
+	const char * memory_budget = NULL;
+	int numa = -1;
 	while(1) {
 		int option_index = 0;
-		int c = getopt_long(argc, argv, "c:p:vh", options, &option_index);
+		int c = getopt_long(argc, argv, "c:p:b:t:md:k:wo:M:Nvh", options, &option_index);
 		if(c == -1) break;
 		switch(c) {
 		case 'c': conf_file = optarg; break;
 		case 'p': platform_name = optarg; break;
+		case 'b': backend_name = optarg; break;
+		case 't': shutdown_timeout = optarg; break;
+		case 'm': multi_processes = 1; break;
+		case 'd': depth = optarg; break;
+		case 'k': kernel_file = optarg; break;
+		case 'w': watch = 1; break;
+		case 'o': build_options = optarg; break;
+		case 'M': memory_budget = optarg; break;
+		case 'N': numa = 0; break;
 		case 'v': verbose = 1; break;
 		case 'h': 
 		default:
@@ -647,11 +2327,90 @@ global_params_t * global_params_init(global_params_t * params, int argc, char **
 	if(platform_name) params->platform_name = platform_name;
 	if(verbose >= 0) params->verbose = verbose;
 	
+	// compile the config once, the tasks only read the validated records
+	struct task_graph * graph = params->graph;
+	const char * conf_name = params->conf_file?params->conf_file:"(default config)";
 	if(params->conf_file) {
-		params->jconfig = json_object_from_file(params->conf_file);
-		assert(params->jconfig);
+		char cache_file[4096] = "";
+		snprintf(cache_file, sizeof(cache_file), "%s.cache", params->conf_file);
+		rc = task_graph_load_file(graph, params->conf_file, cache_file);
+	}else {
+		json_object * jconfig = json_tokener_parse(s_default_config);
+		assert(jconfig);
+		rc = task_graph_load_json(graph, jconfig);
+		json_object_put(jconfig);
+	}
+	if(rc) {
+		fprintf(stderr, "[ERROR]: %s: %s\n", conf_name, graph->err_msg);
+		exit(1);
+	}
+	
+	for(int i = 0; i < graph->num_tasks; ++i) {
+		const struct task_graph_task * config = &graph->tasks[i];
+		if(!config->grid_stride && 0 == config->local_sizes[0] && (config->global_sizes[0] % LOCAL_SIZE)) {
+			fprintf(stderr, "[ERROR]: %s: tasks[%d]: global size %lu is not a multiple of the default local size %d\n", 
+				conf_name, i, (unsigned long)config->global_sizes[0], LOCAL_SIZE);
+			exit(1);
+		}
+	}
+	params->num_tasks = graph->num_tasks;
+	
+	// command line options take precedence over the config file
+	const struct task_graph_settings * settings = &graph->settings;
+	if(NULL == params->platform_name && settings->platform[0]) params->platform_name = settings->platform;
+	if(NULL == backend_name && settings->backend[0]) backend_name = settings->backend;
+	
+	params->backend = opencl_backend_type_opencl;
+	if(backend_name) {
+		if(strcasecmp(backend_name, "host") == 0) params->backend = opencl_backend_type_host;
+		else if(strcasecmp(backend_name, "opencl") != 0) {
+			fprintf(stderr, "[ERROR]: unknown backend '%s'\n", backend_name);
+			show_usuages(argv[0]);
+			exit(1);
+		}
+		params->backend_name = backend_name;
+	}
+	
+	params->shutdown_timeout_ms = 5000;
+	if(shutdown_timeout) params->shutdown_timeout_ms = atol(shutdown_timeout);
+	else if(settings->has_shutdown_timeout) params->shutdown_timeout_ms = settings->shutdown_timeout_ms;
+	
+	if(multi_processes < 0) multi_processes = settings->multi_processes;
+	params->is_multi_processes = (multi_processes > 0);
+	params->worker_index = -1;
+	
+	params->pipeline_depth = 2;
+	if(depth) params->pipeline_depth = atoi(depth);
+	else if(settings->pipeline_depth > 0) params->pipeline_depth = settings->pipeline_depth;
+	if(params->pipeline_depth < 1 || params->pipeline_depth > MAX_PIPELINE_DEPTH) {
+		fprintf(stderr, "[ERROR]: invalid pipeline depth %d (1 ~ %d)\n", params->pipeline_depth, MAX_PIPELINE_DEPTH);
+		exit(1);
+	}
+	
+	params->kernel_file = "kernels";
+	if(kernel_file) params->kernel_file = kernel_file;
+	else if(settings->kernel_file[0]) params->kernel_file = settings->kernel_file;
+	
+	if(build_options) params->build_options = build_options;
+	else if(settings->build_options[0]) params->build_options = settings->build_options;
+	
+	if(memory_budget) params->memory_budget = (cl_ulong)atoll(memory_budget) << 20;
+	else params->memory_budget = (cl_ulong)settings->memory_budget_mb << 20;
+	
+	if(watch < 0) watch = settings->watch;
+	params->watch = (watch > 0);
+	if(params->watch && params->is_multi_processes) {
+		fprintf(stderr, "[WARNING]: hot reload is not supported in the multi-processes mode\n");
+		params->watch = 0;
 	}
 	
+	// (default: on the hosts with more than one node)
+	numa_topology_init(params->numa);
+	if(numa < 0) numa = settings->numa;
+	params->use_numa = (numa < 0)?(params->numa->num_nodes > 1):(numa > 0);
+	params->worker_numa_node = -1;
+	
+	if(params->is_multi_processes && init_task_edges(params, conf_name)) exit(1);
 	return params;
 }
 
@@ -659,37 +2418,60 @@ void global_params_cleanup(global_params_t * params)
 {
 	if(NULL == params) return;
 
-	pthread_rwlock_wrlock(&params->rw_mutex);
 	if(params->non_option_args) free(params->non_option_args);
 	params->non_option_args = NULL;
 	params->num_args = 0;
 
-	sem_t * sems = params->tasks_sems;
 	struct task_context ** tasks = params->tasks;
-	if(sems || tasks) {
-		assert(sems && tasks);
+	if(tasks) {
+		assert(params->shared);
 		for(int i = 0; i < params->num_tasks; ++i) {
-			if(tasks[i]) tasks[i]->quit = 1;
-			sem_post(&sems[i]); // cancel sem_wait(ing) jobs
+			if(NULL == tasks[i]) continue;	// (multi-processes mode) run by another worker process
+			tasks[i]->quit = 1;
+			sem_post(&params->shared->states[i].sem); // cancel sem_wait(ing) jobs
 			
-			if(tasks[i]) {
-				task_context_free(tasks[i]);
-				tasks[i] = NULL;
-			}
-			if(!params->is_multi_processes) sem_destroy(&sems[i]);
+			task_context_free(tasks[i]);
+			tasks[i] = NULL;
 		}
-		free(sems);
 		free(tasks);
 	}
-	free(params->tasks_status);
+	
+	// (multi-processes mode) the shared states belong to the coordinator
+	if(params->shared && !params->is_multi_processes) {
+		shared_states_cleanup(params->shared);
+		free(params->shared);
+	}
+	params->shared = NULL;
 	params->num_tasks = 0;
 	params->tasks = NULL;
-	params->tasks_sems = NULL;
-	params->tasks_status = NULL;
-
-	if(params->jconfig) {
-		json_object_put(params->jconfig);
-		params->jconfig = NULL;
+	
+	hot_reload_cleanup(params);	// the tasks have been stopped
+	task_graph_cleanup(params->graph);
+	free(params->edges);
+	params->edges = NULL;
+	
+	// the views before their parents
+	for(int i = 0; i < params->num_views; ++i) {
+		opencl_buffer_cleanup(params->views[i]->buf);
+		free(params->views[i]);
+	}
+	free(params->views);
+	params->views = NULL;
+	params->num_views = 0;
+	
+	if(params->buffers) {
+		for(int i = 0; i < params->num_buffers; ++i) {
+			if(params->memory) params->memory->free(params->memory, &params->buffers[i]);
+			else opencl_buffer_cleanup(&params->buffers[i]);
+		}
+		free(params->buffers);
+		params->buffers = NULL;
+		params->num_buffers = 0;
+	}
+	if(params->memory) {
+		opencl_memory_manager_cleanup(params->memory);
+		free(params->memory);
+		params->memory = NULL;
 	}
 	
 	if(params->program) {
@@ -697,7 +2479,24 @@ void global_params_cleanup(global_params_t * params)
 		params->program = NULL;
 	}
 	
-	pthread_rwlock_unlock(&params->rw_mutex);
-	pthread_rwlock_destroy(&params->rw_mutex);
+	if(params->library) {
+		opencl_library_cleanup(params->library);
+		free(params->library);
+		params->library = NULL;
+	}
+	
+	if(params->ctx) {
+		clReleaseContext(params->ctx);
+		params->ctx = NULL;
+	}
+	
+	if(params->sub_device->id) {
+		opencl_device_cleanup(params->sub_device);
+		clReleaseDevice(params->sub_device->id);
+		params->sub_device->id = NULL;
+	}
+	
+	numa_topology_cleanup(params->numa);
+	pthread_mutex_destroy(&params->views_mutex);
 	return;
 }
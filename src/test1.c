@@ -32,6 +32,8 @@
 #include <inttypes.h>
 
 #include "opencl-context.h"
+#include "opencl-host.h"
+#include "utils.h"
 
 #define check_error(ret) do { 			\
 		if(CL_SUCCESS == ret) break; 	\
@@ -42,6 +44,7 @@
 	}while(0)
 	
 int run_test(int num_sub_devices, cl_device_id * sub_device_ids, opencl_context_t * cl);
+int run_test_host(void);
 
 int main(int argc, char **argv)
 {
@@ -57,8 +60,19 @@ int main(int argc, char **argv)
 	opencl_context_t * cl = opencl_context_init(NULL, NULL);
 	assert(cl);
 	
-	struct opencl_platform * platform = cl->get_platform_by_name_prefix(cl, "NVIDIA");
-	assert(platform);
+	struct opencl_platform * platform = NULL;
+	int use_host = (argc > 1 && strcmp(argv[1], "--host") == 0);
+	if(!use_host) {
+		platform = cl->get_platform_by_name_prefix(cl, "NVIDIA");
+		if(NULL == platform) platform = cl->get_platform_by_name_prefix(cl, NULL);
+	}
+	if(NULL == platform) {
+		// no opencl platform: fall back to the host backend
+		rc = run_test_host();
+		opencl_context_cleanup(cl);
+		free(cl);
+		return rc;
+	}
 	
 	rc = cl->load_devices(cl, 0, platform);
 	assert(0 == rc);
@@ -121,41 +135,6 @@ int main(int argc, char **argv)
 	return 0;
 }
 
-/*******************************
- * utils
-*******************************/
-#include <sys/stat.h>
-#include <unistd.h>
-
-ssize_t load_file(const char * filename, char ** p_data)
-{
-	int rc = 0;
-	struct stat st[1];
-	memset(st, 0, sizeof(st));
-	rc = stat(filename, st);
-	if(rc) return -1;
-	if((st->st_mode & S_IFMT) != S_IFREG) return -1;
-	if(st->st_size == 0) return 0;
-	
-	if(NULL == p_data) return (st->st_size + 1); // return buffer size
-	
-	FILE * fp = fopen(filename, "rb");
-	assert(fp);
-	
-	char * data = *p_data;
-	if(NULL == data) {
-		data = malloc(st->st_size + 1);
-		assert(data);
-		*p_data = data;
-	}
-	ssize_t length = fread(data, 1, st->st_size, fp);
-	assert(length == st->st_size);
-	data[length] = '\0';
-	fclose(fp);
-	
-	return length;
-}
-
 /*******************************
  * run tests
 *******************************/
@@ -234,26 +213,43 @@ int run_test(int num_devices, cl_device_id * device_ids, opencl_context_t * cl)
 		assert(buffers[i]);
 	}
 	
-	// step 3. create program from source file
-	const char * kernels_file = "kernels/kernels.cl";
-	char * sources = NULL;
-	size_t length = load_file(kernels_file, &sources);
-	printf("length: %d\n", (int)length);
+	// queue[0] and queue[1] write the halves of buffers[2] through sub-buffers
+	size_t alignment = opencl_buffer_get_alignment(ctx);
+	if(0 == alignment || (ARRAY_SIZE * sizeof(float)) % alignment) {
+		fprintf(stderr, "[ERROR]: the sub-buffer origin (%lu bytes) is not aligned to CL_DEVICE_MEM_BASE_ADDR_ALIGN (%lu bytes)\n", 
+			(unsigned long)(ARRAY_SIZE * sizeof(float)), (unsigned long)alignment);
+		exit(1);
+	}
+	cl_mem y_halves[2] = { NULL };
+	for(int i = 0; i < 2; ++i) {
+		cl_buffer_region region = { .origin = i * ARRAY_SIZE * sizeof(float), .size = ARRAY_SIZE * sizeof(float) };
+		y_halves[i] = clCreateSubBuffer(buffers[2], CL_MEM_WRITE_ONLY, CL_BUFFER_CREATE_TYPE_REGION, &region, &ret);
+		check_error(ret);
+	}
 	
-	assert(length != -1 && length > 0 && sources);
+	// step 3. create program from the kernel modules, they include kernels/common.h
+	const char * kernels_files[] = { "kernels/vec_scalar.cl", "kernels/vec_sum.cl" };
+	char * sources[2] = { NULL };
+	size_t lengths[2] = { 0 };
+	for(int i = 0; i < 2; ++i) {
+		lengths[i] = load_file(kernels_files[i], &sources[i]);
+		printf("%s: length: %d\n", kernels_files[i], (int)lengths[i]);
+		assert(lengths[i] != -1 && lengths[i] > 0 && sources[i]);
+	}
 	
-	cl_program program = clCreateProgramWithSource(ctx, 1, (const char **)&sources, &length, &ret);
+	cl_program program = clCreateProgramWithSource(ctx, 2, (const char **)sources, lengths, &ret);
 	check_error(ret);
 	assert(program);
 	
-	ret = clBuildProgram(program, num_devices, device_ids, NULL, NULL, NULL);
+	ret = clBuildProgram(program, num_devices, device_ids, "-I kernels", NULL, NULL);
 	check_error(ret);
 	
 	/* 
 	 * step 4. load kernels and set args
-	 * __kernel void vec_mul_scalar(__global float * Y, __global float * X, __const float a);
-	 * __kernel void vec_add_scalar(__global float * Y, __global const float * X, __const float a, __const int y_offset);
-	 * __kernel void vec_sum(__const int n, __global float * A, __local float * partials, __global float * result);
+	 * __kernel void vec_mul_scalar(__const int n, __global float * Y, __global const float * X, __const float a);
+	 * __kernel void vec_add_scalar(__const int n, __global float * Y, __global const float * X, __const float a);
+	 * __kernel void vec_sum(__const int n, __global const float * A, __local float * partials, __global float * result);
+	 * the kernels stride over n items, the grids are bounded by the device's occupancy
 	*/
 	cl_kernel vec_add_scalar_0 = clCreateKernel(program, "vec_add_scalar", &ret);	// for queue[0]
 	check_error(ret);
@@ -270,30 +266,39 @@ int run_test(int num_devices, cl_device_id * device_ids, opencl_context_t * cl)
 	cl_float a_1 = 2.0f;	// for queue_1
 	cl_float a_2 = 3.0f;	// for queue_2
 
-	cl_int offset_0 = 0;
-	cl_int offset_1 = ARRAY_SIZE;	
+	cl_int n_0 = (cl_int)array_lengths[0];
+	cl_int n_1 = (cl_int)array_lengths[1];
+	cl_int n_2 = (cl_int)array_lengths[2];
 	// queue_0
-	clSetKernelArg(vec_add_scalar_0, 0, sizeof(cl_mem), &buffers[2]);	// Y
-	clSetKernelArg(vec_add_scalar_0, 1, sizeof(cl_mem), &buffers[0]);	// X
-	clSetKernelArg(vec_add_scalar_0, 2, sizeof(cl_float), &a_0);		// a
-	clSetKernelArg(vec_add_scalar_0, 3, sizeof(cl_int), &offset_0);		// offset
+	clSetKernelArg(vec_add_scalar_0, 0, sizeof(cl_int), &n_0);			// n
+	clSetKernelArg(vec_add_scalar_0, 1, sizeof(cl_mem), &y_halves[0]);	// Y: buffers[2][0, ARRAY_SIZE)
+	clSetKernelArg(vec_add_scalar_0, 2, sizeof(cl_mem), &buffers[0]);	// X
+	clSetKernelArg(vec_add_scalar_0, 3, sizeof(cl_float), &a_0);		// a
 	
 	// queue_1
-	clSetKernelArg(vec_add_scalar_1, 0, sizeof(cl_mem), &buffers[2]);	// Y
-	clSetKernelArg(vec_add_scalar_1, 1, sizeof(cl_mem), &buffers[1]);	// X
-	clSetKernelArg(vec_add_scalar_1, 2, sizeof(cl_float), &a_1);		// a
-	clSetKernelArg(vec_add_scalar_1, 3, sizeof(cl_int), &offset_1);		// offset
+	clSetKernelArg(vec_add_scalar_1, 0, sizeof(cl_int), &n_1);			// n
+	clSetKernelArg(vec_add_scalar_1, 1, sizeof(cl_mem), &y_halves[1]);	// Y: buffers[2][ARRAY_SIZE, ARRAY_SIZE * 2)
+	clSetKernelArg(vec_add_scalar_1, 2, sizeof(cl_mem), &buffers[1]);	// X
+	clSetKernelArg(vec_add_scalar_1, 3, sizeof(cl_float), &a_1);		// a
 	
 	// queue_2
-	clSetKernelArg(vec_mul_scalar, 0, sizeof(cl_mem), &buffers[3]);		// Y
-	clSetKernelArg(vec_mul_scalar, 1, sizeof(cl_mem), &buffers[2]);		// X
-	clSetKernelArg(vec_mul_scalar, 2, sizeof(cl_float), &a_2);			// a
+	clSetKernelArg(vec_mul_scalar, 0, sizeof(cl_int), &n_2);			// n
+	clSetKernelArg(vec_mul_scalar, 1, sizeof(cl_mem), &buffers[3]);		// Y
+	clSetKernelArg(vec_mul_scalar, 2, sizeof(cl_mem), &buffers[2]);		// X
+	clSetKernelArg(vec_mul_scalar, 3, sizeof(cl_float), &a_2);			// a
+	
+	// the grids: any n, bounded by the device's occupancy
+	size_t local_size = 256;
+	size_t global_sizes[NUM_COMMAND_QUEUE] = {
+		[0] = opencl_get_grid_size(vec_add_scalar_0, device, array_lengths[0], local_size),
+		[1] = opencl_get_grid_size(vec_add_scalar_1, device, array_lengths[1], local_size),
+		[2] = opencl_get_grid_size(vec_mul_scalar, device, array_lengths[2], local_size),
+		[3] = opencl_get_grid_size(vec_sum, device, array_lengths[3], local_size),
+	};
 	
 	// queue_3
 	cl_int n = (cl_int)array_lengths[3];
-	size_t local_size = 256;
-	assert(local_size < n && (n % local_size == 0));
-	size_t num_groups = n / local_size;
+	size_t num_groups = global_sizes[3] / local_size;	// one partial sum per work-group
 
 	cl_float * results = calloc(num_groups, sizeof(float));	// for queue_3
 	cl_mem mem_results = clCreateBuffer(ctx, CL_MEM_WRITE_ONLY, num_groups * sizeof(float), NULL, &ret);
@@ -330,28 +335,28 @@ int run_test(int num_devices, cl_device_id * device_ids, opencl_context_t * cl)
 	// step 7. execute kernels
 	ret = clEnqueueNDRangeKernel(queues[0], vec_add_scalar_0, 1,
 		NULL, 
-		(size_t[]){array_lengths[0], 1, 1},
+		(size_t[]){global_sizes[0], 1, 1},
 		(size_t[]){local_size, 1, 1},
 		0, NULL, NULL);
 	check_error(ret);
 	
 	ret = clEnqueueNDRangeKernel(queues[1], vec_add_scalar_1, 1,
 		NULL, 
-		(size_t[]){array_lengths[1], 1, 1},
+		(size_t[]){global_sizes[1], 1, 1},
 		(size_t[]){local_size, 1, 1},
 		0, NULL, NULL);
 	check_error(ret);
 	
 	ret = clEnqueueNDRangeKernel(queues[2], vec_mul_scalar, 1, 
 		NULL, 
-		(size_t[]){array_lengths[2], 1, 1},
+		(size_t[]){global_sizes[2], 1, 1},
 		(size_t[]){local_size, 1, 1},
 		0, NULL, NULL);
 	check_error(ret);
 	
 	ret = clEnqueueNDRangeKernel(queues[3], vec_sum,  1, 
 		NULL, 
-		(size_t[]){array_lengths[3], 1, 1},
+		(size_t[]){global_sizes[3], 1, 1},
 		(size_t[]){local_size, 1, 1},
 		0, NULL, NULL);
 	check_error(ret);
@@ -406,7 +411,10 @@ int run_test(int num_devices, cl_device_id * device_ids, opencl_context_t * cl)
 	if(vec_mul_scalar) clReleaseKernel(vec_mul_scalar);
 	if(vec_sum) clReleaseKernel(vec_sum);
 	
-	// release cl_mems
+	// release cl_mems, the sub-buffers first
+	for(int i = 0; i < 2; ++i) {
+		if(y_halves[i]) clReleaseMemObject(y_halves[i]);
+	}
 	for(int i = 0; i < NUM_COMMAND_QUEUE; ++i) {
 		if(buffers[i]) {
 			clReleaseMemObject(buffers[i]);
@@ -423,9 +431,110 @@ int run_test(int num_devices, cl_device_id * device_ids, opencl_context_t * cl)
 	
 	
 	if(program) clReleaseProgram(program);
-	if(sources) free(sources);
+	for(int i = 0; i < 2; ++i) free(sources[i]);
 	clReleaseContext(ctx);
 	return 0;
 }
 
 
+
+int run_test_host(void)
+{
+	int rc = 0;
+	size_t local_size = 256;
+	static size_t array_lengths[] = {
+		[0] = ARRAY_SIZE,
+		[1] = ARRAY_SIZE,
+		[2] = ARRAY_SIZE * 2,
+		[3] = ARRAY_SIZE * 2,
+	};
+	
+	float * buf_0 = calloc(array_lengths[0], sizeof(float));
+	float * buf_1 = calloc(array_lengths[1], sizeof(float));
+	float * buf_2 = calloc(array_lengths[2], sizeof(float));
+	float * buf_3 = calloc(array_lengths[3], sizeof(float));
+	assert(buf_0 && buf_1 && buf_2 && buf_3);
+	
+	for(int i = 0; i < ARRAY_SIZE; ++i) {
+		buf_0[i] = i + 1;
+		buf_1[i] = ARRAY_SIZE - i - 1;
+	}
+	
+	struct opencl_function * vec_add_scalar_0 = opencl_host_function_init(NULL, "vec_add_scalar");
+	struct opencl_function * vec_add_scalar_1 = opencl_host_function_init(NULL, "vec_add_scalar");
+	struct opencl_function * vec_mul_scalar = opencl_host_function_init(NULL, "vec_mul_scalar");
+	struct opencl_function * vec_sum = opencl_host_function_init(NULL, "vec_sum");
+	assert(vec_add_scalar_0 && vec_add_scalar_1 && vec_mul_scalar && vec_sum);
+	
+	cl_float a_0 = 1.0f;
+	cl_float a_1 = 2.0f;
+	cl_float a_2 = 3.0f;
+	float * y_halves[2] = { buf_2, buf_2 + ARRAY_SIZE };	// the halves of buf_2
+	
+	cl_int n = (cl_int)array_lengths[3];
+	size_t num_groups = n / local_size;
+	cl_float * results = calloc(num_groups, sizeof(float));
+	assert(results);
+	
+	cl_int n_0 = (cl_int)array_lengths[0];
+	cl_int n_1 = (cl_int)array_lengths[1];
+	cl_int n_2 = (cl_int)array_lengths[2];
+	opencl_function_set_args(vec_add_scalar_0, 4, 
+		sizeof(cl_int), &n_0, sizeof(float *), &y_halves[0], sizeof(float *), &buf_0, sizeof(cl_float), &a_0);
+	opencl_function_set_args(vec_add_scalar_1, 4, 
+		sizeof(cl_int), &n_1, sizeof(float *), &y_halves[1], sizeof(float *), &buf_1, sizeof(cl_float), &a_1);
+	opencl_function_set_args(vec_mul_scalar, 4, 
+		sizeof(cl_int), &n_2, sizeof(float *), &buf_3, sizeof(float *), &buf_2, sizeof(cl_float), &a_2);
+	opencl_function_set_args(vec_sum, 4, 
+		sizeof(cl_int), &n, sizeof(float *), &buf_3, local_size * sizeof(float), NULL, sizeof(float *), &results);
+	
+	vec_add_scalar_0->set_dims(vec_add_scalar_0, 1, NULL, &array_lengths[0], &local_size);
+	vec_add_scalar_1->set_dims(vec_add_scalar_1, 1, NULL, &array_lengths[1], &local_size);
+	vec_mul_scalar->set_dims(vec_mul_scalar, 1, NULL, &array_lengths[2], &local_size);
+	vec_sum->set_dims(vec_sum, 1, NULL, &array_lengths[3], &local_size);
+	
+	rc = vec_add_scalar_0->execute(vec_add_scalar_0, 0, NULL, NULL);
+	assert(0 == rc);
+	rc = vec_add_scalar_1->execute(vec_add_scalar_1, 0, NULL, NULL);
+	assert(0 == rc);
+	rc = vec_mul_scalar->execute(vec_mul_scalar, 0, NULL, NULL);
+	assert(0 == rc);
+	rc = vec_sum->execute(vec_sum, 0, NULL, NULL);
+	assert(0 == rc);
+	
+	// verify results
+	for(size_t i = 0; i < array_lengths[3]; ++i) {
+		printf("[%.4d]: %g * %g = %g\n", (int)i, buf_2[i], a_2, buf_3[i]);
+		assert(buf_2[i] * a_2 == buf_3[i]);
+	}
+	fflush(stdout);
+	
+	float sum = 0.0;
+	for(size_t i = 0; i < num_groups; ++i) sum += results[i];
+	printf("sum() = %.1f\n", sum);
+	
+	float sum_verify = 0.0;
+	for(size_t i = 0; i < array_lengths[3]; ++i)
+	{
+		sum_verify += buf_3[i];
+	}
+	printf("sum_verify = %.1f\n", sum_verify);
+	assert(sum == sum_verify);
+	
+// cleanup
+	opencl_function_cleanup(vec_add_scalar_0);
+	opencl_function_cleanup(vec_add_scalar_1);
+	opencl_function_cleanup(vec_mul_scalar);
+	opencl_function_cleanup(vec_sum);
+	free(vec_add_scalar_0);
+	free(vec_add_scalar_1);
+	free(vec_mul_scalar);
+	free(vec_sum);
+	
+	free(buf_0);
+	free(buf_1);
+	free(buf_2);
+	free(buf_3);
+	free(results);
+	return rc;
+}
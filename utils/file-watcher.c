@@ -0,0 +1,147 @@
+/*
+ * file-watcher.c
+ *
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "file-watcher.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <sys/inotify.h>
+
+struct file_watch
+{
+	int wd;		// the directory's watch descriptor
+	char path[PATH_MAX];
+	char name[NAME_MAX + 1];	// the file name in the directory
+	file_changed_func on_changed;
+	void * user_data;
+};
+
+#define FILE_WATCHER_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO)
+
+static int watcher_add(struct file_watcher * watcher, const char * path, file_changed_func on_changed, void * user_data)
+{
+	assert(watcher && watcher->fd >= 0);
+	assert(path && on_changed);
+	if(strlen(path) >= PATH_MAX) return -1;
+	
+	char dir[PATH_MAX] = "";
+	char name[PATH_MAX] = "";
+	strcpy(dir, path);
+	strcpy(name, path);
+	const char * base_name = basename(name);
+	if(strlen(base_name) > NAME_MAX) return -1;
+	
+	int wd = inotify_add_watch(watcher->fd, dirname(dir), FILE_WATCHER_EVENTS);
+	if(wd < 0) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): inotify_add_watch(%s) failed: %s\n", 
+			__FILE__, __LINE__, __FUNCTION__, 
+			dir, strerror(errno));
+		return -1;
+	}
+	
+	struct file_watch * files = realloc(watcher->files, sizeof(*files) * (watcher->num_files + 1));
+	assert(files);
+	watcher->files = files;
+	
+	struct file_watch * file = &files[watcher->num_files++];
+	memset(file, 0, sizeof(*file));
+	file->wd = wd;	// the same wd if the directory is already watched
+	strcpy(file->path, path);
+	strcpy(file->name, base_name);
+	file->on_changed = on_changed;
+	file->user_data = user_data;
+	return 0;
+}
+
+static int watcher_dispatch(struct file_watcher * watcher)
+{
+	assert(watcher && watcher->fd >= 0);
+	
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	int num_changed = 0;
+	while(1) {
+		ssize_t cb = read(watcher->fd, buf, sizeof(buf));
+		if(cb < 0) {
+			if(errno == EINTR) continue;
+			if(errno == EAGAIN) break;
+			perror("read(inotify)");
+			return -1;
+		}
+		if(cb == 0) break;
+		
+		for(char * p = buf; p < buf + cb; ) {
+			const struct inotify_event * event = (const struct inotify_event *)p;
+			p += sizeof(*event) + event->len;
+			if(0 == event->len) continue;
+			
+			for(int i = 0; i < watcher->num_files; ++i) {
+				struct file_watch * file = &watcher->files[i];
+				if(file->wd != event->wd || strcmp(file->name, event->name) != 0) continue;
+				file->on_changed(file->user_data, file->path);
+				++num_changed;
+			}
+		}
+	}
+	return num_changed;
+}
+
+struct file_watcher * file_watcher_init(struct file_watcher * watcher)
+{
+	if(NULL == watcher) watcher = calloc(1, sizeof(*watcher));
+	else memset(watcher, 0, sizeof(*watcher));
+	assert(watcher);
+	
+	watcher->add = watcher_add;
+	watcher->dispatch = watcher_dispatch;
+	
+	watcher->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(watcher->fd < 0) {
+		perror("inotify_init1");
+		return NULL;
+	}
+	return watcher;
+}
+
+void file_watcher_cleanup(struct file_watcher * watcher)
+{
+	if(NULL == watcher) return;
+	if(watcher->fd >= 0) close(watcher->fd);	// removes all the watches
+	watcher->fd = -1;
+	
+	free(watcher->files);
+	watcher->files = NULL;
+	watcher->num_files = 0;
+	return;
+}
@@ -0,0 +1,247 @@
+/*
+ * numa-topology.c
+ *
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "numa-topology.h"
+
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#define NUMA_SYSFS_NODES	"/sys/devices/system/node"
+#define NUMA_MAX_NODES		(1024)
+
+// <linux/mempolicy.h>
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED	(1)
+#endif
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE	(1 << 1)
+#endif
+
+/*
+ * cpulist: "0-3,8-11"
+*/
+static int parse_cpulist(const char * cpulist, int ** p_cpus)
+{
+	int num_cpus = 0;
+	int * cpus = NULL;
+	const char * p = cpulist;
+	while(*p) {
+		char * end = NULL;
+		long first = strtol(p, &end, 10);
+		if(end == p) break;
+		long last = first;
+		p = end;
+		if(*p == '-') {
+			last = strtol(p + 1, &end, 10);
+			p = end;
+		}
+		for(long cpu = first; cpu <= last; ++cpu) {
+			cpus = realloc(cpus, sizeof(*cpus) * (num_cpus + 1));
+			assert(cpus);
+			cpus[num_cpus++] = (int)cpu;
+		}
+		if(*p == ',') ++p;
+		else break;
+	}
+	*p_cpus = cpus;
+	return num_cpus;
+}
+
+static int load_node(struct numa_node * node, int id)
+{
+	char path[PATH_MAX] = "";
+	snprintf(path, sizeof(path), NUMA_SYSFS_NODES "/node%d/cpulist", id);
+	FILE * fp = fopen(path, "r");
+	if(NULL == fp) return -1;
+	
+	char cpulist[4096] = "";
+	char * line = fgets(cpulist, sizeof(cpulist), fp);
+	fclose(fp);
+	if(NULL == line) return -1;
+	
+	node->id = id;
+	node->num_cpus = parse_cpulist(cpulist, &node->cpus);
+	return 0;
+}
+
+static int compare_node_id(const void * a, const void * b)
+{
+	return ((const struct numa_node *)a)->id - ((const struct numa_node *)b)->id;
+}
+
+struct numa_topology * numa_topology_init(struct numa_topology * topo)
+{
+	if(NULL == topo) topo = calloc(1, sizeof(*topo));
+	else memset(topo, 0, sizeof(*topo));
+	assert(topo);
+	
+	DIR * dir = opendir(NUMA_SYSFS_NODES);
+	struct dirent * entry = NULL;
+	while(dir && (entry = readdir(dir))) {
+		int id = -1;
+		if(sscanf(entry->d_name, "node%d", &id) != 1 || id < 0 || id >= NUMA_MAX_NODES) continue;
+		
+		struct numa_node node = { 0 };
+		if(load_node(&node, id)) continue;
+		if(0 == node.num_cpus) {	// memory only
+			free(node.cpus);
+			continue;
+		}
+		topo->nodes = realloc(topo->nodes, sizeof(*topo->nodes) * (topo->num_nodes + 1));
+		assert(topo->nodes);
+		topo->nodes[topo->num_nodes++] = node;
+	}
+	if(dir) closedir(dir);
+	
+	if(topo->num_nodes > 1) {
+		qsort(topo->nodes, topo->num_nodes, sizeof(*topo->nodes), compare_node_id);
+		return topo;
+	}
+	if(topo->num_nodes == 1) return topo;
+	
+	// no sysfs nodes: a single node
+	long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if(num_cpus <= 0) num_cpus = 1;
+	topo->nodes = calloc(1, sizeof(*topo->nodes));
+	assert(topo->nodes);
+	topo->num_nodes = 1;
+	topo->nodes[0].cpus = calloc(num_cpus, sizeof(int));
+	assert(topo->nodes[0].cpus);
+	topo->nodes[0].num_cpus = (int)num_cpus;
+	for(int i = 0; i < num_cpus; ++i) topo->nodes[0].cpus[i] = i;
+	return topo;
+}
+
+void numa_topology_cleanup(struct numa_topology * topo)
+{
+	if(NULL == topo) return;
+	for(int i = 0; i < topo->num_nodes; ++i) free(topo->nodes[i].cpus);
+	free(topo->nodes);
+	topo->nodes = NULL;
+	topo->num_nodes = 0;
+	return;
+}
+
+int numa_topology_get_cpu_node(const struct numa_topology * topo, int cpu)
+{
+	assert(topo);
+	for(int i = 0; i < topo->num_nodes; ++i) {
+		const struct numa_node * node = &topo->nodes[i];
+		for(int j = 0; j < node->num_cpus; ++j) if(node->cpus[j] == cpu) return i;
+	}
+	return -1;
+}
+
+int numa_topology_bind_thread(const struct numa_topology * topo, int node)
+{
+	assert(topo && node >= 0 && node < topo->num_nodes);
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	for(int i = 0; i < topo->nodes[node].num_cpus; ++i) CPU_SET(topo->nodes[node].cpus[i], &cpus);
+	
+	int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+	if(rc) {
+		fprintf(stderr, "[ERROR]::%s(%d)::%s(): node %d: %s\n", 
+			__FILE__, __LINE__, __FUNCTION__, 
+			topo->nodes[node].id, strerror(rc));
+		return -1;
+	}
+	return 0;
+}
+
+int numa_topology_bind_memory(const struct numa_topology * topo, void * addr, size_t size, int node)
+{
+	assert(topo && node >= 0 && node < topo->num_nodes);
+#if defined(__linux__) && defined(SYS_mbind)
+	uintptr_t page_size = (uintptr_t)sysconf(_SC_PAGESIZE);
+	uintptr_t begin = ((uintptr_t)addr + page_size - 1) & ~(page_size - 1);
+	uintptr_t end = ((uintptr_t)addr + size) & ~(page_size - 1);
+	if(end <= begin) return 0;	// no whole page
+	
+	unsigned long nodemask[NUMA_MAX_NODES / (8 * sizeof(unsigned long))] = { 0 };
+	int id = topo->nodes[node].id;
+	nodemask[id / (8 * sizeof(unsigned long))] |= 1UL << (id % (8 * sizeof(unsigned long)));
+	
+	long rc = syscall(SYS_mbind, (void *)begin, (unsigned long)(end - begin), MPOL_PREFERRED, 
+		nodemask, (unsigned long)NUMA_MAX_NODES, MPOL_MF_MOVE);
+	if(rc) {
+		fprintf(stderr, "[WARNING]: mbind(node %d) failed: %s\n", id, strerror(errno));
+		return -1;
+	}
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+ssize_t numa_topology_count_pages(const struct numa_topology * topo, const void * addr, size_t size, size_t * counts)
+{
+	assert(topo && counts);
+#if defined(__linux__) && defined(SYS_move_pages)
+	uintptr_t page_size = (uintptr_t)sysconf(_SC_PAGESIZE);
+	uintptr_t begin = (uintptr_t)addr & ~(page_size - 1);
+	uintptr_t end = (uintptr_t)addr + size;
+	
+	enum { batch_size = 1024 };
+	void * pages[batch_size];
+	int status[batch_size];
+	ssize_t num_pages = 0;
+	for(uintptr_t page = begin; page < end; ) {
+		unsigned long count = 0;
+		for(; count < batch_size && page < end; ++count, page += page_size) pages[count] = (void *)page;
+		
+		// nodes == NULL: query the node of each page
+		long rc = syscall(SYS_move_pages, 0, count, pages, NULL, status, 0);
+		if(rc < 0) return -1;
+		for(unsigned long i = 0; i < count; ++i) {
+			if(status[i] < 0) continue;	// not resident
+			for(int j = 0; j < topo->num_nodes; ++j) {
+				if(topo->nodes[j].id != status[i]) continue;
+				++counts[j];
+				++num_pages;
+				break;
+			}
+		}
+	}
+	return num_pages;
+#else
+	return -1;
+#endif
+}
@@ -0,0 +1,255 @@
+/*
+ * shm-region.c
+ *
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "shm-region.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+struct shm_region * shm_region_init(struct shm_region * shm, size_t size)
+{
+	assert(size > 0);
+	int is_allocated = (NULL == shm);
+	if(is_allocated) shm = calloc(1, sizeof(*shm));
+	else memset(shm, 0, sizeof(*shm));
+	assert(shm);
+	shm->fd = -1;
+
+	char name[100] = "";
+	snprintf(name, sizeof(name), "/opencl-test.%ld.%p", (long)getpid(), (void *)shm);
+
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if(fd < 0) {
+		perror("shm_open");
+		if(is_allocated) free(shm);
+		return NULL;
+	}
+	shm_unlink(name);	// only reachable through the mapping (and the inherited fd) from now on
+
+	int rc = ftruncate(fd, size);
+	if(rc) {
+		perror("ftruncate");
+		close(fd);
+		if(is_allocated) free(shm);
+		return NULL;
+	}
+
+	void * data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(data == MAP_FAILED) {
+		perror("mmap");
+		close(fd);
+		if(is_allocated) free(shm);
+		return NULL;
+	}
+
+	shm->fd = fd;
+	shm->size = size;
+	shm->data = data;
+	return shm;
+}
+
+void shm_region_cleanup(struct shm_region * shm)
+{
+	if(NULL == shm) return;
+	if(shm->data) munmap(shm->data, shm->size);
+	if(shm->fd >= 0) close(shm->fd);
+	shm->data = NULL;
+	shm->size = 0;
+	shm->fd = -1;
+	return;
+}
+
+/*********************************************
+ * shm_ring
+*********************************************/
+#define SHM_RING_ALIGNMENT (64)
+size_t shm_ring_calc_size(size_t capacity)
+{
+	size_t size = sizeof(struct shm_ring) + capacity;
+	return (size + SHM_RING_ALIGNMENT - 1) & ~(size_t)(SHM_RING_ALIGNMENT - 1);
+}
+
+struct shm_ring * shm_ring_init(void * mem, size_t capacity)
+{
+	assert(mem && capacity > sizeof(size_t));
+	struct shm_ring * ring = mem;
+	memset(ring, 0, sizeof(*ring));
+	ring->size = capacity;
+
+	int rc = 0;
+	pthread_mutexattr_t mattr;
+	pthread_mutexattr_init(&mattr);
+	pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&mattr, PTHREAD_MUTEX_ROBUST);
+	rc = pthread_mutex_init(&ring->mutex, &mattr);
+	assert(0 == rc);
+	pthread_mutexattr_destroy(&mattr);
+
+	pthread_condattr_t cattr;
+	pthread_condattr_init(&cattr);
+	pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+	pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+	rc = pthread_cond_init(&ring->not_empty, &cattr);
+	assert(0 == rc);
+	rc = pthread_cond_init(&ring->not_full, &cattr);
+	assert(0 == rc);
+	pthread_condattr_destroy(&cattr);
+	return ring;
+}
+
+void shm_ring_cleanup(struct shm_ring * ring)
+{
+	if(NULL == ring) return;
+	pthread_cond_destroy(&ring->not_empty);
+	pthread_cond_destroy(&ring->not_full);
+	pthread_mutex_destroy(&ring->mutex);
+	return;
+}
+
+/*
+ * the positions are only updated after a record has been completely copied,
+ * if the previous owner died in the middle of a copy, the ring is still consistent.
+*/
+static int ring_check_owner(struct shm_ring * ring, int rc)
+{
+	if(rc == EOWNERDEAD) {
+		fprintf(stderr, "[WARNING]::%s(%d)::%s(): the previous owner of the ring died\n",
+			__FILE__, __LINE__, __FUNCTION__);
+		pthread_mutex_consistent(&ring->mutex);
+		rc = 0;
+	}
+	return rc;
+}
+
+static int ring_wait(struct shm_ring * ring, pthread_cond_t * cond, const struct timespec * deadline)
+{
+	int rc = 0;
+	if(NULL == deadline) rc = pthread_cond_wait(cond, &ring->mutex);
+	else rc = pthread_cond_timedwait(cond, &ring->mutex, deadline);
+	return ring_check_owner(ring, rc);
+}
+
+static struct timespec * make_deadline(struct timespec * deadline, int timeout_ms)
+{
+	if(timeout_ms < 0) return NULL;
+	clock_gettime(CLOCK_MONOTONIC, deadline);
+	deadline->tv_sec += timeout_ms / 1000;
+	deadline->tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+	if(deadline->tv_nsec >= 1000000000) {
+		++deadline->tv_sec;
+		deadline->tv_nsec -= 1000000000;
+	}
+	return deadline;
+}
+
+static void ring_write(struct shm_ring * ring, size_t pos, const void * data, size_t length)
+{
+	size_t offset = pos % ring->size;
+	size_t cb = ring->size - offset;
+	if(cb > length) cb = length;
+	memcpy(ring->data + offset, data, cb);
+	if(length > cb) memcpy(ring->data, (const unsigned char *)data + cb, length - cb);
+}
+
+static void ring_read(struct shm_ring * ring, size_t pos, void * data, size_t length)
+{
+	size_t offset = pos % ring->size;
+	size_t cb = ring->size - offset;
+	if(cb > length) cb = length;
+	memcpy(data, ring->data + offset, cb);
+	if(length > cb) memcpy((unsigned char *)data + cb, ring->data, length - cb);
+}
+
+int shm_ring_push(struct shm_ring * ring, const void * header, size_t cb_header, const void * payload, size_t cb_payload, int timeout_ms)
+{
+	assert(ring);
+	size_t length = cb_header + cb_payload;
+	size_t cb_record = sizeof(size_t) + length;
+	if(cb_record > ring->size) return -1;
+
+	struct timespec ts;
+	struct timespec * deadline = make_deadline(&ts, timeout_ms);
+
+	int rc = ring_check_owner(ring, pthread_mutex_lock(&ring->mutex));
+	if(rc) return -1;
+	while(0 == rc && (ring->size - (ring->tail - ring->head)) < cb_record) {
+		rc = ring_wait(ring, &ring->not_full, deadline);
+	}
+	if(0 == rc) {
+		size_t pos = ring->tail;
+		ring_write(ring, pos, &length, sizeof(length));
+		pos += sizeof(length);
+		if(cb_header) ring_write(ring, pos, header, cb_header);
+		pos += cb_header;
+		if(cb_payload) ring_write(ring, pos, payload, cb_payload);
+		ring->tail += cb_record;
+		pthread_cond_broadcast(&ring->not_empty);
+	}
+	pthread_mutex_unlock(&ring->mutex);
+	return rc?-1:0;
+}
+
+ssize_t shm_ring_pop(struct shm_ring * ring, void * record, size_t max_size, int timeout_ms)
+{
+	assert(ring && record);
+	struct timespec ts;
+	struct timespec * deadline = make_deadline(&ts, timeout_ms);
+
+	int rc = ring_check_owner(ring, pthread_mutex_lock(&ring->mutex));
+	if(rc) return -1;
+	while(0 == rc && ring->tail == ring->head) {
+		rc = ring_wait(ring, &ring->not_empty, deadline);
+	}
+
+	ssize_t length = -1;
+	if(0 == rc) {
+		size_t cb = 0;
+		ring_read(ring, ring->head, &cb, sizeof(cb));
+		if(cb <= max_size) {
+			ring_read(ring, ring->head + sizeof(cb), record, cb);
+			ring->head += sizeof(cb) + cb;
+			length = cb;
+			pthread_cond_broadcast(&ring->not_full);
+		}else {
+			fprintf(stderr, "[ERROR]::%s(%d)::%s(): record too large (%lu > %lu)\n",
+				__FILE__, __LINE__, __FUNCTION__,
+				(unsigned long)cb, (unsigned long)max_size);
+		}
+	}
+	pthread_mutex_unlock(&ring->mutex);
+	return length;
+}